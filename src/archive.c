@@ -0,0 +1,501 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef SATGPS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef SATGPS_ZSTD
+#include <zstd.h>
+#endif
+
+#include "satgps.h"
+#include "ubx.h"
+#include "batch.h"
+#include "archive.h"
+
+static int64_t clock_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* refills the input buffer once it is used up; returns the bytes available, 0 at the end, -1 on error */
+static ssize_t input_fill(archive_t *archive) {
+    ssize_t n;
+
+    if (archive->input_start < archive->input_end) {
+        return (ssize_t) (archive->input_end - archive->input_start);
+    }
+    if (archive->input_eof) {
+        return 0;
+    }
+    do {
+        n = read(archive->fd, archive->input, ARCHIVE_INPUT_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        archive->error = errno;
+        return -1;
+    }
+    archive->input_start = 0;
+    archive->input_end = (size_t) n;
+    archive->input_eof = n == 0;
+    archive->bytes_read += (uint64_t) n;
+    return n;
+}
+
+/*
+ * The fill functions decompress into a block until it is full; they return 1
+ * if more may follow, 0 at the end of the input, -1 on an error (in error)
+ * */
+static int fill_plain(archive_t *archive, archive_block_t *block) {
+    ssize_t avail;
+    size_t n;
+
+    while (block->length < ARCHIVE_BLOCK_SIZE) {
+        avail = input_fill(archive);
+        if (avail <= 0) {
+            return (int) avail;
+        }
+        n = ARCHIVE_BLOCK_SIZE - block->length;
+        if (n > (size_t) avail) {
+            n = (size_t) avail;
+        }
+        memcpy(block->data + block->length, archive->input + archive->input_start, n);
+        archive->input_start += n;
+        block->length += n;
+    }
+    return 1;
+}
+
+#ifdef SATGPS_ZLIB
+static int fill_gzip(archive_t *archive, archive_block_t *block) {
+    z_stream *z = (z_stream *) archive->decoder;
+    ssize_t avail;
+    int result;
+
+    z->next_out = (Bytef *) block->data;
+    z->avail_out = ARCHIVE_BLOCK_SIZE;
+
+    while (z->avail_out > 0) {
+        avail = input_fill(archive);
+        if (avail < 0) {
+            break;
+        }
+        if (archive->stream_end) {
+            if (avail == 0) {
+                break;
+            }
+            /* another member follows */
+            inflateReset(z);
+            archive->stream_end = 0;
+        }
+
+        z->next_in = archive->input + archive->input_start;
+        z->avail_in = (uInt) avail;
+        result = inflate(z, Z_NO_FLUSH);
+        archive->input_start = archive->input_end - z->avail_in;
+
+        if (result == Z_STREAM_END) {
+            archive->stream_end = 1;
+        } else if (result == Z_BUF_ERROR && avail == 0) {
+            archive->error = ENODATA;           /* truncated */
+            break;
+        } else if (result != Z_OK && result != Z_BUF_ERROR) {
+            archive->error = EBADMSG;
+            break;
+        }
+    }
+
+    block->length = ARCHIVE_BLOCK_SIZE - z->avail_out;
+    if (archive->error) {
+        return -1;
+    }
+    return z->avail_out > 0 ? 0 : 1;
+}
+#endif
+
+#ifdef SATGPS_ZSTD
+static int fill_zstd(archive_t *archive, archive_block_t *block) {
+    ZSTD_outBuffer out = {block->data, ARCHIVE_BLOCK_SIZE, 0};
+    ZSTD_inBuffer in;
+    ssize_t avail;
+    size_t result, before;
+
+    while (out.pos < out.size) {
+        avail = input_fill(archive);
+        if (avail < 0) {
+            break;
+        }
+        in.src = archive->input + archive->input_start;
+        in.size = (size_t) avail;
+        in.pos = 0;
+        before = out.pos;
+
+        /* called with no input too, to flush what the decoder still holds */
+        result = ZSTD_decompressStream((ZSTD_DStream *) archive->decoder, &out, &in);
+        archive->input_start += in.pos;
+        if (ZSTD_isError(result)) {
+            archive->error = EBADMSG;
+            break;
+        }
+        archive->stream_end = result == 0;
+
+        if (avail == 0 && out.pos == before) {
+            if (!archive->stream_end) {
+                archive->error = ENODATA;       /* truncated */
+            }
+            break;
+        }
+    }
+
+    block->length = out.pos;
+    if (archive->error) {
+        return -1;
+    }
+    return out.pos < out.size ? 0 : 1;
+}
+#endif
+
+static int fill(archive_t *archive, archive_block_t *block) {
+    switch (archive->format) {
+#ifdef SATGPS_ZLIB
+        case ARCHIVE_GZIP:
+            return fill_gzip(archive, block);
+#endif
+#ifdef SATGPS_ZSTD
+        case ARCHIVE_ZSTD:
+            return fill_zstd(archive, block);
+#endif
+        default:
+            return fill_plain(archive, block);
+    }
+}
+
+static void *decompress_thread(void *arg) {
+    archive_t *archive = (archive_t *) arg;
+    archive_block_t *block;
+    int64_t start, filling, filled;
+    int more = 1;
+
+    while (more > 0) {
+        start = clock_ns();
+        pthread_mutex_lock(&archive->lock);
+        while (archive->running && archive->produced - archive->consumed == ARCHIVE_BLOCKS) {
+            pthread_cond_wait(&archive->not_full, &archive->lock);
+        }
+        if (!archive->running) {
+            pthread_mutex_unlock(&archive->lock);
+            break;
+        }
+        pthread_mutex_unlock(&archive->lock);
+
+        /* the parser doesn't touch this block until produced moves past it */
+        block = &archive->blocks[archive->produced % ARCHIVE_BLOCKS];
+        filling = clock_ns();
+        block->length = 0;
+        more = fill(archive, block);
+        block->last = more <= 0;
+        filled = clock_ns();
+
+        pthread_mutex_lock(&archive->lock);
+        archive->produced++;
+        archive->stats.blocks++;
+        archive->stats.decompress.bytes_in = archive->bytes_read;
+        archive->stats.decompress.bytes_out += block->length;
+        archive->stats.decompress.wait_ns += filling - start;
+        archive->stats.decompress.busy_ns += filled - filling;
+        pthread_cond_signal(&archive->not_empty);
+        pthread_mutex_unlock(&archive->lock);
+    }
+    return NULL;
+}
+
+/* sets up the decoder for the format named by the first bytes of input */
+static int decoder_init(archive_t *archive) {
+    const uint8_t *magic = archive->input;
+    size_t length = archive->input_end;
+
+    if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        archive->format = ARCHIVE_GZIP;
+#ifdef SATGPS_ZLIB
+        archive->decoder = calloc(1, sizeof(z_stream));
+        if (archive->decoder == NULL) {
+            return -1;
+        }
+        /* gzip header only */
+        if (inflateInit2((z_stream *) archive->decoder, 15 + 16) != Z_OK) {
+            free(archive->decoder);
+            archive->decoder = NULL;
+            errno = ENOMEM;
+            return -1;
+        }
+        return 0;
+#endif
+    } else if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        archive->format = ARCHIVE_ZSTD;
+#ifdef SATGPS_ZSTD
+        archive->decoder = ZSTD_createDStream();
+        if (archive->decoder == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        ZSTD_initDStream((ZSTD_DStream *) archive->decoder);
+        return 0;
+#endif
+    } else {
+        archive->format = ARCHIVE_PLAIN;
+        return 0;
+    }
+
+    /* compressed, but built without the library */
+    errno = ENOTSUP;
+    return -1;
+}
+
+static void decoder_free(archive_t *archive) {
+    if (archive->decoder == NULL) {
+        return;
+    }
+#ifdef SATGPS_ZLIB
+    if (archive->format == ARCHIVE_GZIP) {
+        inflateEnd((z_stream *) archive->decoder);
+        free(archive->decoder);
+    }
+#endif
+#ifdef SATGPS_ZSTD
+    if (archive->format == ARCHIVE_ZSTD) {
+        ZSTD_freeDStream((ZSTD_DStream *) archive->decoder);
+    }
+#endif
+    archive->decoder = NULL;
+}
+
+/*
+ * Opens a log, "-" for stdin, and starts decompressing it
+ *
+ * Returns -1 with errno set if it can't be read, memory runs out, or it is
+ * compressed with a format this build doesn't support (ENOTSUP).
+ * */
+int archive_open(archive_t *archive, const char *path) {
+    ssize_t n;
+    int i, error;
+
+    memset(archive, 0, sizeof(archive_t));
+    archive->start_ns = clock_ns();
+    archive->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (archive->fd < 0) {
+        return -1;
+    }
+    posix_fadvise(archive->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    archive->input = (uint8_t *) malloc(ARCHIVE_INPUT_SIZE);
+    for (i = 0; i < ARCHIVE_BLOCKS; i++) {
+        archive->blocks[i].data = (char *) malloc(ARCHIVE_BLOCK_SIZE);
+    }
+    if (archive->input == NULL || archive->blocks[0].data == NULL || archive->blocks[1].data == NULL) {
+        error = ENOMEM;
+        goto fail;
+    }
+
+    /* enough for the magic number; a pipe may deliver it in pieces */
+    while (archive->input_end < 4) {
+        n = read(archive->fd, archive->input + archive->input_end, ARCHIVE_INPUT_SIZE - archive->input_end);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            error = errno;
+            goto fail;
+        }
+        if (n == 0) {
+            archive->input_eof = 1;
+            break;
+        }
+        archive->input_end += (size_t) n;
+        archive->bytes_read += (uint64_t) n;
+    }
+    if (decoder_init(archive) < 0) {
+        error = errno;
+        goto fail;
+    }
+
+    ubx_stream_init(&archive->framer);
+    pthread_mutex_init(&archive->lock, NULL);
+    pthread_cond_init(&archive->not_empty, NULL);
+    pthread_cond_init(&archive->not_full, NULL);
+    archive->running = 1;
+    error = pthread_create(&archive->thread, NULL, decompress_thread, archive);
+    if (error != 0) {
+        pthread_cond_destroy(&archive->not_full);
+        pthread_cond_destroy(&archive->not_empty);
+        pthread_mutex_destroy(&archive->lock);
+        archive->running = 0;
+        decoder_free(archive);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    for (i = 0; i < ARCHIVE_BLOCKS; i++) {
+        free(archive->blocks[i].data);
+    }
+    free(archive->input);
+    if (archive->fd != STDIN_FILENO) {
+        close(archive->fd);
+    }
+    memset(archive, 0, sizeof(archive_t));
+    archive->fd = -1;
+    errno = error;
+    return -1;
+}
+
+/* one framed message to the parsers */
+static void parse_message(archive_t *archive, int kind) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+    ubx_stream_t *framer = &archive->framer;
+    char sentence[GPS_MAX_SENTENCE];
+
+    if (kind == UBX_STREAM_UBX) {
+        if (ubx_decode(framer->frame, framer->length) < 0) {
+            archive->parse_errors++;
+        }
+        return;
+    }
+
+    memcpy(sentence, framer->frame, framer->length + 1);
+    /* keep GpsData.sentence current, like gps_read() does */
+    strncpy(gps_data->sentence, sentence, sizeof(gps_data->sentence) - 1);
+    if (!checksum_valid(sentence) || !prefix_valid(sentence) || parse_sentence(sentence) < 0) {
+        archive->parse_errors++;
+    }
+}
+
+/* hands a parsed block back to the decompression thread */
+static void release_block(archive_t *archive) {
+    pthread_mutex_lock(&archive->lock);
+    archive->consumed++;
+    archive->stats.parse.bytes_in += archive->current->length;
+    archive->stats.parse.bytes_out += archive->current->length;
+    pthread_cond_signal(&archive->not_full);
+    pthread_mutex_unlock(&archive->lock);
+    archive->current = NULL;
+}
+
+/*
+ * Parses the log through the framer into GpsData and the fix handlers
+ *
+ * With a batch, appends a row per fix like gps_parse_batch() and stops when
+ * it is full; drain it and call again. Returns 1 in that case, 0 at the end
+ * of the log (call gps_batch_finish() then), and -1 if reading or decoding
+ * failed: everything before the failure has been parsed, archive->error says
+ * why (EINVAL for a batch below GPS_BATCH_MIN_CAPACITY). Without a batch it runs to the end. Only the time spent in here counts
+ * as the parse stage.
+ * */
+int archive_parse(archive_t *archive, gps_batch_t *batch) {
+    archive_block_t *block;
+    int64_t start = clock_ns(), now;
+    int kind, used, result = 1;
+
+    if (archive->end_ns != 0) {
+        return archive->error ? -1 : 0;
+    }
+    if (batch != NULL && batch->capacity < GPS_BATCH_MIN_CAPACITY) {
+        /* it would never have room for a sentence */
+        archive->error = EINVAL;
+        return -1;
+    }
+    if (batch != NULL && gps_add_fix_handler(gps_batch_fix_handler, batch) < 0) {
+        return -1;
+    }
+
+    for (;;) {
+        if (archive->current == NULL) {
+            now = clock_ns();
+            pthread_mutex_lock(&archive->lock);
+            archive->stats.parse.busy_ns += now - start;
+            while (archive->produced == archive->consumed) {
+                pthread_cond_wait(&archive->not_empty, &archive->lock);
+            }
+            pthread_mutex_unlock(&archive->lock);
+            start = clock_ns();
+            archive->stats.parse.wait_ns += start - now;
+
+            archive->current = &archive->blocks[archive->consumed % ARCHIVE_BLOCKS];
+            archive->offset = 0;
+        }
+
+        block = archive->current;
+        while (archive->offset < block->length) {
+            if (batch != NULL && batch->count + GPS_BATCH_MIN_CAPACITY > batch->capacity) {
+                goto done;
+            }
+            kind = ubx_stream_feed(&archive->framer, (uint8_t *) block->data + archive->offset,
+                                   (int) (block->length - archive->offset), &used);
+            archive->offset += (size_t) used;
+            if (kind != UBX_STREAM_NONE) {
+                parse_message(archive, kind);
+            }
+        }
+
+        if (block->last) {
+            release_block(archive);
+            archive->end_ns = clock_ns();
+            result = archive->error ? -1 : 0;
+            break;
+        }
+        release_block(archive);
+    }
+
+done:
+    if (batch != NULL) {
+        gps_remove_fix_handler(gps_batch_fix_handler, batch);
+    }
+    pthread_mutex_lock(&archive->lock);
+    archive->stats.parse.busy_ns += clock_ns() - start;
+    archive->stats.sentences = archive->framer.sentences;
+    archive->stats.frames = archive->framer.frames;
+    archive->stats.errors = archive->parse_errors;
+    pthread_mutex_unlock(&archive->lock);
+    return result;
+}
+
+/* consistent copy of both stages' counters, from any thread */
+void archive_stats(archive_t *archive, archive_stats_t *stats) {
+    pthread_mutex_lock(&archive->lock);
+    *stats = archive->stats;
+    stats->elapsed_ns = (archive->end_ns ? archive->end_ns : clock_ns()) - archive->start_ns;
+    pthread_mutex_unlock(&archive->lock);
+}
+
+/* stops the decompression thread, even mid-file, and frees everything */
+void archive_close(archive_t *archive) {
+    int i;
+
+    if (archive->fd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&archive->lock);
+    archive->running = 0;
+    pthread_cond_broadcast(&archive->not_full);
+    pthread_mutex_unlock(&archive->lock);
+    pthread_join(archive->thread, NULL);
+
+    pthread_cond_destroy(&archive->not_full);
+    pthread_cond_destroy(&archive->not_empty);
+    pthread_mutex_destroy(&archive->lock);
+    decoder_free(archive);
+    for (i = 0; i < ARCHIVE_BLOCKS; i++) {
+        free(archive->blocks[i].data);
+    }
+    free(archive->input);
+    if (archive->fd != STDIN_FILENO) {
+        close(archive->fd);
+    }
+    archive->fd = -1;
+}
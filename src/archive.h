@@ -0,0 +1,93 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "satgps.h"
+#include "ubx.h"
+#include "batch.h"
+
+#define ARCHIVE_BLOCK_SIZE          (1024 * 1024)   /* decompressed bytes handed over at a time */
+#define ARCHIVE_BLOCKS              2               /* one being filled while the other is parsed */
+#define ARCHIVE_INPUT_SIZE          (256 * 1024)    /* compressed bytes per read() */
+
+/* what archive_open() found */
+#define ARCHIVE_PLAIN               0
+#define ARCHIVE_GZIP                1
+#define ARCHIVE_ZSTD                2
+
+typedef struct {
+    char                *data;
+    size_t              length;
+    int                 last;                       /* end of input (or an error) after this block */
+} archive_block_t;
+
+/* one side of the queue */
+typedef struct {
+    uint64_t            bytes_in;                   /* decompression: file bytes, parsing: block bytes */
+    uint64_t            bytes_out;                  /* decompressed bytes handed on */
+    int64_t             busy_ns;                    /* working */
+    int64_t             wait_ns;                    /* blocked on the other stage */
+} archive_stage_t;
+
+typedef struct {
+    archive_stage_t     decompress;
+    archive_stage_t     parse;
+    unsigned long       blocks;
+    unsigned long       sentences;                  /* NMEA sentences framed */
+    unsigned long       frames;                     /* UBX frames framed */
+    unsigned long       errors;                     /* sentences rejected, UBX frames that didn't decode */
+    int64_t             elapsed_ns;                 /* since archive_open() */
+} archive_stats_t;
+
+/*
+ * Compressed log ingestion
+ *
+ * Reads a plain, gzip or zstd log (told apart by its first bytes, so pipes
+ * work) on a decompression thread into ARCHIVE_BLOCKS blocks; the caller's
+ * thread runs each block through the NMEA/UBX framer (ubx.h) and the parsers
+ * while the next one is being filled, so the two overlap. Concatenated gzip
+ * members and zstd frames are read through. gzip needs zlib and zstd needs
+ * libzstd when the library is built; without them archive_open() fails with
+ * ENOTSUP for that format.
+ *
+ * Each stage's busy and waiting time is kept: the stage that waits least is
+ * the bottleneck.
+ * */
+typedef struct {
+    int                 fd;
+    int                 format;                     /* ARCHIVE_PLAIN, ARCHIVE_GZIP or ARCHIVE_ZSTD */
+    void                *decoder;                   /* z_stream or ZSTD_DStream */
+    uint8_t             *input;
+    size_t              input_start, input_end;
+    int                 input_eof;
+    int                 stream_end;                 /* the decoder finished a member/frame */
+    uint64_t            bytes_read;                 /* file bytes, decompression thread only */
+
+    archive_block_t     blocks[ARCHIVE_BLOCKS];
+    uint64_t            produced;                   /* blocks filled */
+    uint64_t            consumed;                   /* blocks parsed */
+    archive_block_t     *current;                   /* block being parsed, NULL between blocks */
+    size_t              offset;                     /* parsed bytes of current */
+
+    pthread_mutex_t     lock;
+    pthread_cond_t      not_empty;
+    pthread_cond_t      not_full;
+    pthread_t           thread;
+    int                 running;
+    int                 error;                      /* read() errno, EBADMSG if corrupt, ENODATA if cut short, EINVAL for a too small batch; 0 if none */
+
+    ubx_stream_t        framer;
+    unsigned long       parse_errors;               /* parsing thread only */
+    archive_stats_t     stats;
+    int64_t             start_ns;
+    int64_t             end_ns;                     /* when the last block was parsed */
+} archive_t;
+
+int archive_open(archive_t *, const char *);
+int archive_parse(archive_t *, gps_batch_t *);
+void archive_stats(archive_t *, archive_stats_t *);
+void archive_close(archive_t *);
+
+#endif /* ARCHIVE_H */
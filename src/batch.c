@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "batch.h"
+
+/* appends a completed fix as a new row, arg is the gps_batch_t; full batches ignore it */
+void gps_batch_fix_handler(const gps_fix_t *fix, void *arg) {
+    gps_batch_t *batch = (gps_batch_t *) arg;
+    int row = batch->count;
+    /* a UBX NAV-PVT fix carries what GGA and RMC do */
+    int has_rmc = fix->sources & (GNRMC_MESSAGE | UBX_MESSAGE);
+    int has_gga = fix->sources & (GNGGA_MESSAGE | UBX_MESSAGE);
+
+    if (row >= batch->capacity) {
+        return;
+    }
+
+    batch->utc_epoch_ns[row] = fix->utc_epoch_ns;
+    batch->latitude[row] = fix->latitude;
+    batch->longitude[row] = fix->longitude;
+    batch->altitude[row] = has_gga ? fix->altitude : NAN;
+    batch->speed[row] = has_rmc ? fix->speed : NAN;
+    batch->track_angle[row] = has_rmc ? fix->track_angle : NAN;
+    batch->HDOP[row] = has_gga ? fix->HDOP : NAN;
+    batch->gps_quality[row] = has_gga ? fix->gps_quality : -1;
+    batch->number_svs[row] = has_gga ? fix->number_svs : -1;
+    batch->min_snr[row] = gps_min_snr();
+    batch->valid[row] = fix->valid;
+
+    batch->count++;
+}
+
+/*
+ * Allocates every column for capacity rows, returns -1 if out of memory or
+ * capacity is below GPS_BATCH_MIN_CAPACITY (such a batch could never take a line)
+ * */
+int gps_batch_alloc(gps_batch_t *batch, int capacity) {
+
+    memset(batch, 0, sizeof(gps_batch_t));
+    if (capacity < GPS_BATCH_MIN_CAPACITY) {
+        return -1;
+    }
+
+    batch->utc_epoch_ns = (int64_t *) malloc(capacity * sizeof(int64_t));
+    batch->latitude = (double *) malloc(capacity * sizeof(double));
+    batch->longitude = (double *) malloc(capacity * sizeof(double));
+    batch->altitude = (double *) malloc(capacity * sizeof(double));
+    batch->speed = (double *) malloc(capacity * sizeof(double));
+    batch->track_angle = (double *) malloc(capacity * sizeof(double));
+    batch->HDOP = (double *) malloc(capacity * sizeof(double));
+    batch->gps_quality = (int *) malloc(capacity * sizeof(int));
+    batch->number_svs = (int *) malloc(capacity * sizeof(int));
+    batch->min_snr = (int *) malloc(capacity * sizeof(int));
+    batch->valid = (int *) malloc(capacity * sizeof(int));
+
+    if (!batch->utc_epoch_ns || !batch->latitude || !batch->longitude || !batch->altitude || !batch->speed ||
+        !batch->track_angle || !batch->HDOP || !batch->gps_quality || !batch->number_svs || !batch->min_snr || !batch->valid) {
+        gps_batch_free(batch);
+        return -1;
+    }
+
+    batch->capacity = capacity;
+    return 0;
+}
+
+void gps_batch_free(gps_batch_t *batch) {
+    free(batch->utc_epoch_ns);
+    free(batch->latitude);
+    free(batch->longitude);
+    free(batch->altitude);
+    free(batch->speed);
+    free(batch->track_angle);
+    free(batch->HDOP);
+    free(batch->gps_quality);
+    free(batch->number_svs);
+    free(batch->min_snr);
+    free(batch->valid);
+    memset(batch, 0, sizeof(gps_batch_t));
+}
+
+/* empties the batch without freeing the columns */
+void gps_batch_reset(gps_batch_t *batch) {
+    batch->count = 0;
+    batch->errors = 0;
+}
+
+/*
+ * Parses many sentences in one call, appending one row per completed fix
+ *
+ * Sentences are decoded with the current filters, so GNRMC_MESSAGE and/or
+ * GNGGA_MESSAGE must be set for rows to appear. The lines are not modified.
+ * Stops early when the batch is full and returns the number of lines consumed,
+ * so the caller can drain the batch and call again with the rest, or -1 if
+ * the batch is smaller than GPS_BATCH_MIN_CAPACITY.
+ * */
+int gps_parse_batch(char **lines, int n, gps_batch_t *batch) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+    char buffer[256];
+    int i;
+
+    if (batch->capacity < GPS_BATCH_MIN_CAPACITY || gps_add_fix_handler(gps_batch_fix_handler, batch) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+
+        if (batch->count + GPS_BATCH_MIN_CAPACITY > batch->capacity) {
+            break;
+        }
+
+        strncpy(buffer, lines[i], sizeof(buffer) - 1);
+        buffer[sizeof(buffer) - 1] = '\0';
+        /* keep GpsData.sentence current, like gps_read() does */
+        strncpy(gps_data->sentence, buffer, sizeof(gps_data->sentence) - 1);
+
+        if (!checksum_valid(buffer) || !prefix_valid(buffer) || parse_sentence(buffer) < 0) {
+            batch->errors++;
+        }
+    }
+
+    gps_remove_fix_handler(gps_batch_fix_handler, batch);
+    return i;
+}
+
+/* stores the last, possibly partial, fix once there are no more lines */
+void gps_batch_finish(gps_batch_t *batch) {
+    if (gps_add_fix_handler(gps_batch_fix_handler, batch) < 0) {
+        return;
+    }
+    gps_flush_fix();
+    gps_remove_fix_handler(gps_batch_fix_handler, batch);
+}
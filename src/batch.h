@@ -0,0 +1,39 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "satgps.h"
+
+/* one line can complete two fixes (the previous epoch and its own), so a batch needs room for both */
+#define GPS_BATCH_MIN_CAPACITY  2
+
+/*
+ * Columnar (struct-of-arrays) fix storage filled by gps_parse_batch()
+ *
+ * Row i of every column belongs to the same fix. Values a fix did not carry
+ * (e.g. speed when RMC is filtered out) are NAN for doubles and -1 for ints.
+ * */
+typedef struct {
+    int                 capacity;                   /* rows allocated per column */
+    int                 count;                      /* rows filled */
+    int                 errors;                     /* lines rejected (checksum, prefix or parse errors) */
+    int64_t             *utc_epoch_ns;              /* UTC nanoseconds since 1970-01-01 */
+    double              *latitude;                  /* in degrees, N is positive, S negative */
+    double              *longitude;                 /* in degrees, E is positive, W negative */
+    double              *altitude;                  /* orthometric height in meters */
+    double              *speed;                     /* ground speed in m/s */
+    double              *track_angle;               /* course in degrees */
+    double              *HDOP;                      /* HDOP */
+    int                 *gps_quality;               /* GPS quality indicator */
+    int                 *number_svs;                /* Number of SVs in use */
+    int                 *min_snr;                   /* lowest SNR in view in dB-Hz of the last complete GSV cycle, -1 if unknown */
+    int                 *valid;                     /* 1 = valid, 0 = invalid */
+} gps_batch_t;
+
+int gps_batch_alloc(gps_batch_t *, int);
+void gps_batch_free(gps_batch_t *);
+void gps_batch_reset(gps_batch_t *);
+int gps_parse_batch(char **, int, gps_batch_t *);
+void gps_batch_finish(gps_batch_t *);
+void gps_batch_fix_handler(const gps_fix_t *, void *);
+
+#endif /* BATCH_H */
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "satgps.h"
+#include "ccsds.h"
+
+/* big-endian writers, return the position after the value */
+static uint8_t *put_u8(uint8_t *p, uint8_t value) {
+    *p++ = value;
+    return p;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value) {
+    *p++ = (uint8_t) (value >> 8);
+    *p++ = (uint8_t) value;
+    return p;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value) {
+    *p++ = (uint8_t) (value >> 24);
+    *p++ = (uint8_t) (value >> 16);
+    *p++ = (uint8_t) (value >> 8);
+    *p++ = (uint8_t) value;
+    return p;
+}
+
+void ccsds_init(ccsds_t *ccsds, uint16_t first_apid, ccsds_sink_t sink, void *sink_arg) {
+    int i;
+
+    memset(ccsds, 0, sizeof(ccsds_t));
+    for (i = 0; i < CCSDS_POOL_SIZE; i++) {
+        ccsds->free_list[i] = i;
+    }
+    ccsds->num_free = CCSDS_POOL_SIZE;
+    for (i = 0; i < CCSDS_NUM_TYPES; i++) {
+        ccsds->stream[i].apid = (first_apid + i) & 0x7FF;
+        ccsds->stream[i].last_ns = INT64_MIN;
+    }
+    ccsds->sink = sink;
+    ccsds->sink_arg = sink_arg;
+}
+
+/* limits a packet type to one packet per interval seconds, 0 for no limit */
+void ccsds_set_rate(ccsds_t *ccsds, int type, double interval) {
+    if (type >= 0 && type < CCSDS_NUM_TYPES) {
+        ccsds->stream[type].interval_ns = (int64_t) (interval * NSEC_PER_SEC);
+    }
+}
+
+/* takes a buffer from the pool, NULL if all are in use */
+uint8_t *ccsds_acquire(ccsds_t *ccsds) {
+    if (ccsds->num_free == 0) {
+        return NULL;
+    }
+    return ccsds->buffer[ccsds->free_list[--ccsds->num_free]];
+}
+
+void ccsds_release(ccsds_t *ccsds, uint8_t *packet) {
+    ccsds->free_list[ccsds->num_free++] = (int) ((packet - &ccsds->buffer[0][0]) / CCSDS_MAX_PACKET);
+}
+
+/* writes primary and secondary headers, returns the start of the user data */
+static uint8_t *put_headers(ccsds_stream_t *stream, uint8_t *packet, int64_t utc_epoch_ns) {
+    uint8_t *p = packet;
+    int64_t seconds = utc_epoch_ns / NSEC_PER_SEC;
+    int64_t subseconds = ((utc_epoch_ns % NSEC_PER_SEC) << 16) / NSEC_PER_SEC;
+
+    /* version 0, telemetry, secondary header present */
+    p = put_u16(p, 0x0800 | stream->apid);
+    /* unsegmented */
+    p = put_u16(p, 0xC000 | (stream->sequence & 0x3FFF));
+    /* length, filled in by packet_send() */
+    p = put_u16(p, 0);
+
+    p = put_u32(p, (uint32_t) seconds);
+    p = put_u16(p, (uint16_t) subseconds);
+    return p;
+}
+
+/* completes the length field and hands the packet to the sink */
+static int packet_send(ccsds_t *ccsds, ccsds_stream_t *stream, uint8_t *packet, uint8_t *end, int64_t now) {
+    size_t length = end - packet;
+    int retval;
+
+    /* packet data length is the number of octets after the primary header minus one */
+    put_u16(packet + 4, (uint16_t) (length - CCSDS_PRIMARY_HEADER - 1));
+
+    retval = ccsds->sink(packet, length, ccsds->sink_arg);
+    ccsds_release(ccsds, packet);
+
+    if (retval < 0) {
+        stream->dropped++;
+        return -1;
+    }
+    stream->sequence = (stream->sequence + 1) & 0x3FFF;
+    stream->last_ns = now;
+    stream->sent++;
+    return 0;
+}
+
+/* returns 1 if the stream may send at now */
+static int stream_due(const ccsds_stream_t *stream, int64_t now) {
+    return stream->last_ns == INT64_MIN || now - stream->last_ns >= stream->interval_ns;
+}
+
+/*
+ * Fix packet, 24 bytes of user data:
+ *   i32 latitude, i32 longitude (1e-7 degrees), i32 altitude (cm),
+ *   u16 speed (cm/s), u16 track (0.01 degrees), u16 HDOP (0.01),
+ *   u8 quality, u8 SVs, u8 valid, u8 spare, u16 sources (the gps_fix_t bits,
+ *   UBX_MESSAGE is 0x100)
+ * */
+int ccsds_send_fix(ccsds_t *ccsds, const gps_fix_t *fix) {
+    ccsds_stream_t *stream = &ccsds->stream[CCSDS_FIX];
+    uint8_t *packet, *p;
+
+    if (!stream_due(stream, fix->utc_epoch_ns)) {
+        return 0;
+    }
+    if ((packet = ccsds_acquire(ccsds)) == NULL) {
+        stream->dropped++;
+        return -1;
+    }
+
+    p = put_headers(stream, packet, fix->utc_epoch_ns);
+    p = put_u32(p, (uint32_t) (int32_t) lround(fix->latitude * 1e7));
+    p = put_u32(p, (uint32_t) (int32_t) lround(fix->longitude * 1e7));
+    p = put_u32(p, (uint32_t) (int32_t) lround(fix->altitude * 100.0));
+    p = put_u16(p, (uint16_t) lround(fmin(fix->speed * 100.0, 65535.0)));
+    p = put_u16(p, (uint16_t) lround(fix->track_angle * 100.0));
+    p = put_u16(p, (uint16_t) lround(fmin(fix->HDOP * 100.0, 65535.0)));
+    p = put_u8(p, (uint8_t) fix->gps_quality);
+    p = put_u8(p, (uint8_t) fix->number_svs);
+    p = put_u8(p, (uint8_t) fix->valid);
+    p = put_u8(p, 0);
+    p = put_u16(p, (uint16_t) fix->sources);
+
+    return packet_send(ccsds, stream, packet, p, fix->utc_epoch_ns);
+}
+
+/* appends the satellites of one GSV set */
+static uint8_t *put_satellites(uint8_t *p, uint8_t *count, const gsv_data_t *gsv, int constellation, uint8_t *end) {
+    int i, n;
+
+    if (gsv == NULL) {
+        return p;
+    }
+    n = gsv->satellites_in_view < GPS_MAX_SATS ? gsv->satellites_in_view : GPS_MAX_SATS;
+    for (i = 0; i < n && p + 6 <= end; i++) {
+        p = put_u8(p, (uint8_t) constellation);
+        p = put_u8(p, (uint8_t) gsv->gsv_sat[i].prn_number);
+        p = put_u8(p, (uint8_t) (int8_t) gsv->gsv_sat[i].elevation);
+        p = put_u16(p, (uint16_t) gsv->gsv_sat[i].azimuth);
+        p = put_u8(p, (uint8_t) gsv->gsv_sat[i].signal_to_noise);
+        (*count)++;
+    }
+    return p;
+}
+
+/*
+ * Sky view packet: u8 count, then per satellite
+ *   u8 constellation (0 GPS, 1 GLONASS), u8 PRN, i8 elevation, u16 azimuth, u8 SNR
+ * */
+int ccsds_send_skyview(ccsds_t *ccsds, int64_t now) {
+    ccsds_stream_t *stream = &ccsds->stream[CCSDS_SKYVIEW];
+    gps_data_t *gps_data = gps_get_data_ptr();
+    uint8_t *packet, *p, *count;
+
+    if (!stream_due(stream, now)) {
+        return 0;
+    }
+    if ((packet = ccsds_acquire(ccsds)) == NULL) {
+        stream->dropped++;
+        return -1;
+    }
+
+    p = put_headers(stream, packet, now);
+    count = p;
+    p = put_u8(p, 0);
+    p = put_satellites(p, count, gps_data->GsvDataGps, 0, packet + CCSDS_MAX_PACKET);
+    p = put_satellites(p, count, gps_data->GsvDataGlonass, 1, packet + CCSDS_MAX_PACKET);
+
+    return packet_send(ccsds, stream, packet, p, now);
+}
+
+/*
+ * Health packet, 16 bytes of user data:
+ *   u32 fixes completed, u8 GSA fix type, u8 GPS in view, u8 GLONASS in view,
+ *   u8 spare, u16 PDOP, u16 HDOP, u16 VDOP (0.01), u16 packets dropped
+ * */
+int ccsds_send_health(ccsds_t *ccsds, int64_t now) {
+    ccsds_stream_t *stream = &ccsds->stream[CCSDS_HEALTH];
+    gps_data_t *gps_data = gps_get_data_ptr();
+    const gsa_data_t *gsa = gps_data->GsaDataGn;
+    unsigned long dropped = 0;
+    uint8_t *packet, *p;
+    int i;
+
+    if (!stream_due(stream, now)) {
+        return 0;
+    }
+    if ((packet = ccsds_acquire(ccsds)) == NULL) {
+        stream->dropped++;
+        return -1;
+    }
+    for (i = 0; i < CCSDS_NUM_TYPES; i++) {
+        dropped += ccsds->stream[i].dropped;
+    }
+
+    p = put_headers(stream, packet, now);
+    p = put_u32(p, (uint32_t) gps_data->fix_count);
+    p = put_u8(p, (uint8_t) (gsa ? gsa->mode_2 : 0));
+    p = put_u8(p, (uint8_t) (gps_data->GsvDataGps ? gps_data->GsvDataGps->satellites_in_view : 0));
+    p = put_u8(p, (uint8_t) (gps_data->GsvDataGlonass ? gps_data->GsvDataGlonass->satellites_in_view : 0));
+    p = put_u8(p, 0);
+    p = put_u16(p, (uint16_t) lround(gsa ? fmin(gsa->PDOP * 100.0, 65535.0) : 0.0));
+    p = put_u16(p, (uint16_t) lround(gsa ? fmin(gsa->HDOP * 100.0, 65535.0) : 0.0));
+    p = put_u16(p, (uint16_t) lround(gsa ? fmin(gsa->VDOP * 100.0, 65535.0) : 0.0));
+    p = put_u16(p, (uint16_t) (dropped > 0xFFFF ? 0xFFFF : dropped));
+
+    return packet_send(ccsds, stream, packet, p, now);
+}
+
+/* for gps_add_fix_handler(ccsds_fix_handler, &ccsds): every packet type, clocked by the fix time */
+void ccsds_fix_handler(const gps_fix_t *fix, void *arg) {
+    ccsds_t *ccsds = (ccsds_t *) arg;
+
+    ccsds_send_fix(ccsds, fix);
+    ccsds_send_skyview(ccsds, fix->utc_epoch_ns);
+    ccsds_send_health(ccsds, fix->utc_epoch_ns);
+}
+
+/* sink writing packets back to back to a file descriptor (pointed to by arg) */
+int ccsds_file_sink(const uint8_t *packet, size_t length, void *arg) {
+    int fd = *(int *) arg;
+
+    return write(fd, packet, length) == (ssize_t) length ? 0 : -1;
+}
+
+/* opens a UDP socket for ccsds_udp_sink, returns -1 on error */
+int ccsds_udp_open(ccsds_udp_t *udp, const char *host, int port) {
+    memset(&udp->addr, 0, sizeof(udp->addr));
+    udp->addr.sin_family = AF_INET;
+    udp->addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &udp->addr.sin_addr) != 1) {
+        return -1;
+    }
+    udp->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    return udp->fd < 0 ? -1 : 0;
+}
+
+/* sink sending one datagram per packet */
+int ccsds_udp_sink(const uint8_t *packet, size_t length, void *arg) {
+    ccsds_udp_t *udp = (ccsds_udp_t *) arg;
+
+    return sendto(udp->fd, packet, length, 0, (struct sockaddr *) &udp->addr, sizeof(udp->addr)) == (ssize_t) length ? 0 : -1;
+}
+
+void ccsds_udp_close(ccsds_udp_t *udp) {
+    if (udp->fd >= 0) {
+        close(udp->fd);
+        udp->fd = -1;
+    }
+}
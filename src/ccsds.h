@@ -0,0 +1,73 @@
+#ifndef CCSDS_H
+#define CCSDS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#include "satgps.h"
+
+#define CCSDS_POOL_SIZE         8           /* packet buffers */
+#define CCSDS_MAX_PACKET        512         /* bytes per packet buffer */
+#define CCSDS_PRIMARY_HEADER    6
+#define CCSDS_SECONDARY_HEADER  6           /* 4 bytes seconds, 2 bytes 1/65536 subseconds */
+#define CCSDS_HEADER_SIZE       (CCSDS_PRIMARY_HEADER + CCSDS_SECONDARY_HEADER)
+#define CCSDS_DEFAULT_APID      0x0A0       /* first APID, the packet types follow it */
+
+/* packet types */
+#define CCSDS_FIX               0           /* unified fix */
+#define CCSDS_SKYVIEW           1           /* GSV satellites in view */
+#define CCSDS_HEALTH            2           /* receiver health */
+#define CCSDS_NUM_TYPES         3
+
+/* sends one complete packet, returns -1 on failure */
+typedef int (*ccsds_sink_t)(const uint8_t *, size_t, void *);
+
+/*
+ * Rate limit and counters per packet type
+ * */
+typedef struct {
+    uint16_t            apid;                       /* 11-bit application process id */
+    uint16_t            sequence;                   /* 14-bit source sequence count */
+    int64_t             interval_ns;                /* minimum time between packets, 0 = every fix */
+    int64_t             last_ns;                    /* time of the last packet sent */
+    unsigned long       sent;
+    unsigned long       dropped;                    /* no buffer or sink error */
+} ccsds_stream_t;
+
+/*
+ * Telemetry packetizer
+ *
+ * Packets are serialized straight into a fixed pool of buffers and handed to
+ * the sink from there; nothing is allocated after ccsds_init().
+ * */
+typedef struct {
+    uint8_t             buffer[CCSDS_POOL_SIZE][CCSDS_MAX_PACKET];
+    int                 free_list[CCSDS_POOL_SIZE];
+    int                 num_free;
+    ccsds_stream_t      stream[CCSDS_NUM_TYPES];
+    ccsds_sink_t        sink;
+    void                *sink_arg;
+} ccsds_t;
+
+/* sink state for ccsds_udp_sink */
+typedef struct {
+    int                 fd;
+    struct sockaddr_in  addr;
+} ccsds_udp_t;
+
+void ccsds_init(ccsds_t *, uint16_t, ccsds_sink_t, void *);
+void ccsds_set_rate(ccsds_t *, int, double);
+uint8_t *ccsds_acquire(ccsds_t *);
+void ccsds_release(ccsds_t *, uint8_t *);
+int ccsds_send_fix(ccsds_t *, const gps_fix_t *);
+int ccsds_send_skyview(ccsds_t *, int64_t);
+int ccsds_send_health(ccsds_t *, int64_t);
+void ccsds_fix_handler(const gps_fix_t *, void *);
+
+int ccsds_file_sink(const uint8_t *, size_t, void *);
+int ccsds_udp_open(ccsds_udp_t *, const char *, int);
+int ccsds_udp_sink(const uint8_t *, size_t, void *);
+void ccsds_udp_close(ccsds_udp_t *);
+
+#endif /* CCSDS_H */
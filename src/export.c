@@ -0,0 +1,655 @@
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "gpstime.h"
+#include "export.h"
+
+#define NSEC_PER_DAY    (SEC_PER_DAY * NSEC_PER_SEC)
+
+/* copies a string literal and advances p */
+#define PUT(p, lit)     (memcpy(p, lit, sizeof(lit) - 1), (p) + sizeof(lit) - 1)
+
+/* separator and, in NDJSON, the key of the next field */
+#define KEY(exp, p, name)   ((exp)->format == EXPORT_CSV ? PUT(p, ",") : PUT(p, ",\"" name "\":"))
+
+static const char CsvHeaders[3][512] = {
+    "type,time,utc_epoch_ns,valid,latitude,longitude,altitude,speed,track_angle,gps_quality,number_svs,hdop,sources\n",
+    "type,utc_epoch_ns,system,satellites_in_view,prn,elevation,azimuth,snr\n",
+    "type,utc_epoch_ns,fixes,valid_fixes,span,mean_latitude,mean_longitude,sigma_east,sigma_north,cep,drms2,"
+    "hdop,hdop_trend,pdop,pdop_trend,number_svs,since_valid,"
+    "quality_0,quality_1,quality_2,quality_3,quality_4,quality_5,quality_6,quality_7,quality_8,quality_9\n"
+};
+
+static const char DigitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const uint64_t Pow10[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/*
+ * Grisu2 (F. Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+ * with Integers", 2010)
+ *
+ * Works on 64-bit "do-it-yourself" floats f * 2^e. The output always reads
+ * back to the same double and is the shortest such string for all but a
+ * fraction of a percent of inputs, which come out one digit longer.
+ * */
+typedef struct {
+    uint64_t            f;
+    int                 e;
+} diyfp_t;
+
+/* normalized 10^-348, 10^-340 ... 10^340, rounded to nearest */
+static const diyfp_t CachedPowers[87] = {
+    {0xfa8fd5a0081c0288, -1220}, {0xbaaee17fa23ebf76, -1193}, {0x8b16fb203055ac76, -1166},
+    {0xcf42894a5dce35ea, -1140}, {0x9a6bb0aa55653b2d, -1113}, {0xe61acf033d1a45df, -1087},
+    {0xab70fe17c79ac6ca, -1060}, {0xff77b1fcbebcdc4f, -1034}, {0xbe5691ef416bd60c, -1007},
+    {0x8dd01fad907ffc3c, -980}, {0xd3515c2831559a83, -954}, {0x9d71ac8fada6c9b5, -927},
+    {0xea9c227723ee8bcb, -901}, {0xaecc49914078536d, -874}, {0x823c12795db6ce57, -847},
+    {0xc21094364dfb5637, -821}, {0x9096ea6f3848984f, -794}, {0xd77485cb25823ac7, -768},
+    {0xa086cfcd97bf97f4, -741}, {0xef340a98172aace5, -715}, {0xb23867fb2a35b28e, -688},
+    {0x84c8d4dfd2c63f3b, -661}, {0xc5dd44271ad3cdba, -635}, {0x936b9fcebb25c996, -608},
+    {0xdbac6c247d62a584, -582}, {0xa3ab66580d5fdaf6, -555}, {0xf3e2f893dec3f126, -529},
+    {0xb5b5ada8aaff80b8, -502}, {0x87625f056c7c4a8b, -475}, {0xc9bcff6034c13053, -449},
+    {0x964e858c91ba2655, -422}, {0xdff9772470297ebd, -396}, {0xa6dfbd9fb8e5b88f, -369},
+    {0xf8a95fcf88747d94, -343}, {0xb94470938fa89bcf, -316}, {0x8a08f0f8bf0f156b, -289},
+    {0xcdb02555653131b6, -263}, {0x993fe2c6d07b7fac, -236}, {0xe45c10c42a2b3b06, -210},
+    {0xaa242499697392d3, -183}, {0xfd87b5f28300ca0e, -157}, {0xbce5086492111aeb, -130},
+    {0x8cbccc096f5088cc, -103}, {0xd1b71758e219652c, -77}, {0x9c40000000000000, -50},
+    {0xe8d4a51000000000, -24}, {0xad78ebc5ac620000, 3}, {0x813f3978f8940984, 30},
+    {0xc097ce7bc90715b3, 56}, {0x8f7e32ce7bea5c70, 83}, {0xd5d238a4abe98068, 109},
+    {0x9f4f2726179a2245, 136}, {0xed63a231d4c4fb27, 162}, {0xb0de65388cc8ada8, 189},
+    {0x83c7088e1aab65db, 216}, {0xc45d1df942711d9a, 242}, {0x924d692ca61be758, 269},
+    {0xda01ee641a708dea, 295}, {0xa26da3999aef774a, 322}, {0xf209787bb47d6b85, 348},
+    {0xb454e4a179dd1877, 375}, {0x865b86925b9bc5c2, 402}, {0xc83553c5c8965d3d, 428},
+    {0x952ab45cfa97a0b3, 455}, {0xde469fbd99a05fe3, 481}, {0xa59bc234db398c25, 508},
+    {0xf6c69a72a3989f5c, 534}, {0xb7dcbf5354e9bece, 561}, {0x88fcf317f22241e2, 588},
+    {0xcc20ce9bd35c78a5, 614}, {0x98165af37b2153df, 641}, {0xe2a0b5dc971f303a, 667},
+    {0xa8d9d1535ce3b396, 694}, {0xfb9b7cd9a4a7443c, 720}, {0xbb764c4ca7a44410, 747},
+    {0x8bab8eefb6409c1a, 774}, {0xd01fef10a657842c, 800}, {0x9b10a4e5e9913129, 827},
+    {0xe7109bfba19c0c9d, 853}, {0xac2820d9623bf429, 880}, {0x80444b5e7aa7cf85, 907},
+    {0xbf21e44003acdd2d, 933}, {0x8e679c2f5e44ff8f, 960}, {0xd433179d9c8cb841, 986},
+    {0x9e19db92b4e31ba9, 1013}, {0xeb96bf6ebadf77d9, 1039}, {0xaf87023b9bf0ee6b, 1066}
+};
+
+#define DP_SIGNIFICAND_MASK     0x000fffffffffffffULL
+#define DP_HIDDEN_BIT           0x0010000000000000ULL
+#define DP_EXPONENT_BIAS        1075            /* 1023 + 52 */
+
+static diyfp_t diyfp_from_double(double value) {
+    diyfp_t v;
+    uint64_t bits;
+    int biased_exponent;
+
+    memcpy(&bits, &value, sizeof(bits));
+    biased_exponent = (int) ((bits >> 52) & 0x7ff);
+    v.f = bits & DP_SIGNIFICAND_MASK;
+    if (biased_exponent != 0) {
+        v.f += DP_HIDDEN_BIT;
+        v.e = biased_exponent - DP_EXPONENT_BIAS;
+    } else {
+        v.e = 1 - DP_EXPONENT_BIAS;             /* subnormal */
+    }
+    return v;
+}
+
+static diyfp_t diyfp_normalize(diyfp_t v) {
+    int shift = __builtin_clzll(v.f);
+
+    v.f <<= shift;
+    v.e -= shift;
+    return v;
+}
+
+/* upper 64 bits of the 128-bit product, rounded */
+static diyfp_t diyfp_multiply(diyfp_t a, diyfp_t b) {
+    uint64_t a_hi = a.f >> 32, a_lo = a.f & 0xffffffff;
+    uint64_t b_hi = b.f >> 32, b_lo = b.f & 0xffffffff;
+    uint64_t hh = a_hi * b_hi, hl = a_hi * b_lo, lh = a_lo * b_hi, ll = a_lo * b_lo;
+    uint64_t mid = (ll >> 32) + (hl & 0xffffffff) + (lh & 0xffffffff) + (1ULL << 31);
+    diyfp_t r;
+
+    r.f = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+    r.e = a.e + b.e + 64;
+    return r;
+}
+
+/* power of ten that brings binary exponent e into [-60, -32]; *K is minus its decimal exponent */
+static diyfp_t cached_power(int e, int *K) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int) dk;
+    int index;
+
+    if (dk - k > 0.0) {
+        k++;
+    }
+    index = (k >> 3) + 1;
+    *K = -(-348 + index * 8);
+    return CachedPowers[index];
+}
+
+static int count_digits(uint32_t n) {
+    int digits = 1;
+
+    while (digits < 10 && n >= Pow10[digits]) {
+        digits++;
+    }
+    return digits;
+}
+
+/* moves the last digit towards w while it stays inside the rounding interval */
+static void grisu_round(char *digits, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static void digit_gen(diyfp_t w, diyfp_t mp, uint64_t delta, char *digits, int *length, int *K) {
+    int shift = -mp.e;
+    uint64_t one = 1ULL << shift;
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t) (mp.f >> shift);
+    uint64_t p2 = mp.f & (one - 1);
+    uint64_t rest;
+    int kappa = count_digits(p1);
+    int d;
+
+    *length = 0;
+
+    /* integer part */
+    while (kappa > 0) {
+        d = (int) (p1 / Pow10[kappa - 1]);
+        p1 = (uint32_t) (p1 % Pow10[kappa - 1]);
+        if (d != 0 || *length != 0) {
+            digits[(*length)++] = (char) ('0' + d);
+        }
+        kappa--;
+        rest = ((uint64_t) p1 << shift) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            grisu_round(digits, *length, delta, rest, Pow10[kappa] << shift, wp_w);
+            return;
+        }
+    }
+
+    /* fraction */
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        d = (int) (p2 >> shift);
+        if (d != 0 || *length != 0) {
+            digits[(*length)++] = (char) ('0' + d);
+        }
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            grisu_round(digits, *length, delta, p2, one, -kappa < 20 ? wp_w * Pow10[-kappa] : 0);
+            return;
+        }
+    }
+}
+
+/* value > 0 and finite; value = digits * 10^K */
+static void grisu2(double value, char *digits, int *length, int *K) {
+    diyfp_t v = diyfp_from_double(value);
+    diyfp_t w, mp, mm, c;
+
+    /* boundaries halfway to the neighbouring doubles */
+    mp.f = (v.f << 1) + 1;
+    mp.e = v.e - 1;
+    mp = diyfp_normalize(mp);
+    if (v.f == DP_HIDDEN_BIT) {
+        mm.f = (v.f << 2) - 1;                  /* the lower neighbour is closer */
+        mm.e = v.e - 2;
+    } else {
+        mm.f = (v.f << 1) - 1;
+        mm.e = v.e - 1;
+    }
+    mm.f <<= mm.e - mp.e;
+    mm.e = mp.e;
+
+    c = cached_power(mp.e, K);
+    w = diyfp_multiply(diyfp_normalize(v), c);
+    mp = diyfp_multiply(mp, c);
+    mm = diyfp_multiply(mm, c);
+    mm.f++;
+    mp.f--;
+    digit_gen(w, mp, mp.f - mm.f, digits, length, K);
+}
+
+static char *put_2digits(char *p, unsigned n) {
+    memcpy(p, DigitPairs + n * 2, 2);
+    return p + 2;
+}
+
+/* writes n as decimal, returns the number of characters (at most EXPORT_MAX_INT, no NUL) */
+int export_int(char *p, int64_t n) {
+    char tmp[EXPORT_MAX_INT];
+    char *t = tmp + sizeof(tmp);
+    uint64_t u = n < 0 ? 0 - (uint64_t) n : (uint64_t) n;
+    int length = 0;
+
+    if (n < 0) {
+        p[length++] = '-';
+    }
+    while (u >= 100) {
+        t -= 2;
+        memcpy(t, DigitPairs + (u % 100) * 2, 2);
+        u /= 100;
+    }
+    if (u >= 10) {
+        t -= 2;
+        memcpy(t, DigitPairs + u * 2, 2);
+    } else {
+        *--t = (char) ('0' + u);
+    }
+    memcpy(p + length, t, tmp + sizeof(tmp) - t);
+    return length + (int) (tmp + sizeof(tmp) - t);
+}
+
+/*
+ * Writes a finite x in the shortest decimal that reads back as x, returns the
+ * number of characters (at most EXPORT_MAX_DOUBLE, no NUL)
+ *
+ * Plain notation from 1e-6 to 1e21, e.g. 47.285623 or 0.004, exponent notation
+ * outside, e.g. 1.5e-7. Integral values have no decimal point.
+ * */
+int export_double(char *p, double x) {
+    char *start = p;
+    char *digits;
+    int length, K, point, i;
+
+    if (signbit(x)) {
+        *p++ = '-';
+        x = -x;
+    }
+    if (x == 0.0) {
+        *p++ = '0';
+        return (int) (p - start);
+    }
+
+    digits = p;
+    grisu2(x, digits, &length, &K);
+    point = length + K;                         /* 10^(point-1) <= x < 10^point */
+
+    if (length <= point && point <= 21) {
+        /* 1234e7 -> 12340000000 */
+        for (i = length; i < point; i++) {
+            digits[i] = '0';
+        }
+        p = digits + point;
+    } else if (0 < point && point <= 21) {
+        /* 1234e-2 -> 12.34 */
+        memmove(digits + point + 1, digits + point, length - point);
+        digits[point] = '.';
+        p = digits + length + 1;
+    } else if (-6 < point && point <= 0) {
+        /* 1234e-6 -> 0.001234 */
+        memmove(digits + 2 - point, digits, length);
+        digits[0] = '0';
+        digits[1] = '.';
+        for (i = 2; i < 2 - point; i++) {
+            digits[i] = '0';
+        }
+        p = digits + 2 - point + length;
+    } else {
+        /* 1234e30 -> 1.234e33 */
+        if (length > 1) {
+            memmove(digits + 2, digits + 1, length - 1);
+            digits[1] = '.';
+            p = digits + length + 1;
+        } else {
+            p = digits + 1;
+        }
+        *p++ = 'e';
+        p += export_int(p, point - 1);
+    }
+    return (int) (p - start);
+}
+
+static char *put_int(char *p, int64_t n) {
+    return p + export_int(p, n);
+}
+
+static char *put_double(const export_t *exp, char *p, double x) {
+    if (!isfinite(x)) {
+        return exp->format == EXPORT_CSV ? p : PUT(p, "null");
+    }
+    return p + export_double(p, x);
+}
+
+/* ISO 8601 UTC with milliseconds, e.g. 2021-06-01T12:34:56.789Z */
+static char *put_time(char *p, int64_t ns) {
+    int64_t days = ns / NSEC_PER_DAY;
+    int64_t ns_of_day = ns % NSEC_PER_DAY;
+    int64_t year;
+    unsigned month, day, ms, sec;
+
+    if (ns_of_day < 0) {
+        ns_of_day += NSEC_PER_DAY;
+        days--;
+    }
+    civil_from_days(days, &year, &month, &day);
+    ms = (unsigned) (ns_of_day / 1000000);
+    sec = ms / 1000;
+
+    p = put_2digits(p, (unsigned) (year / 100 % 100));
+    p = put_2digits(p, (unsigned) (year % 100));
+    *p++ = '-';
+    p = put_2digits(p, month);
+    *p++ = '-';
+    p = put_2digits(p, day);
+    *p++ = 'T';
+    p = put_2digits(p, sec / 3600);
+    *p++ = ':';
+    p = put_2digits(p, sec / 60 % 60);
+    *p++ = ':';
+    p = put_2digits(p, sec % 60);
+    *p++ = '.';
+    *p++ = (char) ('0' + ms % 1000 / 100);
+    p = put_2digits(p, ms % 100);
+    *p++ = 'Z';
+    return p;
+}
+
+/* bit of export_t.headers to CsvHeaders index */
+static int header_index(unsigned int type) {
+    return __builtin_ctz(type);
+}
+
+/* makes room for one record and writes the CSV header if due, NULL if there is no room */
+static char *record_begin(export_t *exp, unsigned int type) {
+    const char *header;
+    size_t length;
+
+    if (exp->size - exp->used < EXPORT_MAX_RECORD) {
+        if (exp->fd < 0) {
+            if (exp->error == 0) {
+                exp->error = ENOBUFS;
+            }
+            return NULL;
+        }
+        if (export_flush(exp) < 0) {
+            return NULL;
+        }
+    }
+
+    if (exp->format == EXPORT_CSV && !(exp->headers & type)) {
+        header = CsvHeaders[header_index(type)];
+        length = strlen(header);
+        memcpy(exp->buffer + exp->used, header, length);
+        exp->used += length;
+        exp->headers |= type;
+    }
+    return exp->buffer + exp->used;
+}
+
+static void record_end(export_t *exp, char *p) {
+    exp->used = p - exp->buffer;
+    exp->records++;
+}
+
+/* opens a record: {"type":"name" or name */
+static char *record_open(const export_t *exp, char *p, const char *name, size_t length) {
+    if (exp->format == EXPORT_CSV) {
+        memcpy(p, name, length);
+        return p + length;
+    }
+    p = PUT(p, "{\"type\":\"");
+    memcpy(p, name, length);
+    p += length;
+    *p++ = '"';
+    return p;
+}
+
+static char *record_close(const export_t *exp, char *p) {
+    if (exp->format != EXPORT_CSV) {
+        *p++ = '}';
+    }
+    *p++ = '\n';
+    return p;
+}
+
+/*
+ * Sets up an exporter writing format into buffer, and to fd (-1 for none) when full
+ *
+ * Returns -1 if the buffer is smaller than EXPORT_MAX_RECORD.
+ * */
+int export_init(export_t *exp, int format, int fd, char *buffer, size_t size) {
+    memset(exp, 0, sizeof(export_t));
+    exp->format = format;
+    exp->fd = fd;
+    exp->buffer = buffer;
+    exp->size = size;
+    return size < EXPORT_MAX_RECORD ? -1 : 0;
+}
+
+/* returns 0, or -1 if there was no room (see export_t.error) */
+int export_fix(export_t *exp, const gps_fix_t *fix) {
+    char *p = record_begin(exp, EXPORT_FIX);
+
+    if (p == NULL) {
+        return -1;
+    }
+    p = record_open(exp, p, "fix", 3);
+    if (exp->format == EXPORT_CSV) {
+        *p++ = ',';
+        p = put_time(p, fix->utc_epoch_ns);
+    } else {
+        p = PUT(p, ",\"time\":\"");
+        p = put_time(p, fix->utc_epoch_ns);
+        *p++ = '"';
+    }
+    p = KEY(exp, p, "utc_epoch_ns");
+    p = put_int(p, fix->utc_epoch_ns);
+    p = KEY(exp, p, "valid");
+    p = put_int(p, fix->valid);
+    p = KEY(exp, p, "latitude");
+    p = put_double(exp, p, fix->latitude);
+    p = KEY(exp, p, "longitude");
+    p = put_double(exp, p, fix->longitude);
+    p = KEY(exp, p, "altitude");
+    p = put_double(exp, p, fix->altitude);
+    p = KEY(exp, p, "speed");
+    p = put_double(exp, p, fix->speed);
+    p = KEY(exp, p, "track_angle");
+    p = put_double(exp, p, fix->track_angle);
+    p = KEY(exp, p, "gps_quality");
+    p = put_int(p, fix->gps_quality);
+    p = KEY(exp, p, "number_svs");
+    p = put_int(p, fix->number_svs);
+    p = KEY(exp, p, "hdop");
+    p = put_double(exp, p, fix->HDOP);
+    p = KEY(exp, p, "sources");
+    p = put_int(p, fix->sources);
+    record_end(exp, record_close(exp, p));
+    return 0;
+}
+
+/*
+ * One sky view: the satellites of a GSV table (msg_type GPGSV_MESSAGE or
+ * GLGSV_MESSAGE) at time t_ns. NDJSON has them in a "satellites" array, CSV
+ * writes a row per satellite. Returns 0, or -1 if there was no room.
+ * */
+int export_sky(export_t *exp, const gsv_data_t *gsv, int msg_type, int64_t t_ns) {
+    const char *system = msg_type == GLGSV_MESSAGE ? "GL" : "GP";
+    int count = gsv->satellites_in_view < GPS_MAX_SATS ? gsv->satellites_in_view : GPS_MAX_SATS;
+    const gsv_sat_t *sat;
+    char *p = record_begin(exp, EXPORT_SKY);
+    char prefix[64], *prefix_end;
+    int i, first = 1;
+
+    if (p == NULL) {
+        return -1;
+    }
+
+    if (exp->format == EXPORT_CSV) {
+        /* every row repeats the sky view columns */
+        prefix_end = PUT(prefix, "sky,");
+        prefix_end = put_int(prefix_end, t_ns);
+        *prefix_end++ = ',';
+        memcpy(prefix_end, system, 2);
+        prefix_end += 2;
+        *prefix_end++ = ',';
+        prefix_end = put_int(prefix_end, gsv->satellites_in_view);
+        *prefix_end++ = ',';
+
+        for (i = 0; i < count; i++) {
+            sat = &gsv->gsv_sat[i];
+            if (sat->prn_number <= 0) {
+                continue;
+            }
+            memcpy(p, prefix, prefix_end - prefix);
+            p += prefix_end - prefix;
+            p = put_int(p, sat->prn_number);
+            *p++ = ',';
+            p = put_int(p, sat->elevation);
+            *p++ = ',';
+            p = put_int(p, sat->azimuth);
+            *p++ = ',';
+            p = put_int(p, sat->signal_to_noise);
+            *p++ = '\n';
+        }
+        record_end(exp, p);
+        return 0;
+    }
+
+    p = PUT(p, "{\"type\":\"sky\",\"utc_epoch_ns\":");
+    p = put_int(p, t_ns);
+    p = PUT(p, ",\"system\":\"");
+    memcpy(p, system, 2);
+    p += 2;
+    p = PUT(p, "\",\"satellites_in_view\":");
+    p = put_int(p, gsv->satellites_in_view);
+    p = PUT(p, ",\"satellites\":[");
+    for (i = 0; i < count; i++) {
+        sat = &gsv->gsv_sat[i];
+        if (sat->prn_number <= 0) {
+            continue;
+        }
+        p = first ? PUT(p, "{\"prn\":") : PUT(p, ",{\"prn\":");
+        first = 0;
+        p = put_int(p, sat->prn_number);
+        p = PUT(p, ",\"elevation\":");
+        p = put_int(p, sat->elevation);
+        p = PUT(p, ",\"azimuth\":");
+        p = put_int(p, sat->azimuth);
+        p = PUT(p, ",\"snr\":");
+        p = put_int(p, sat->signal_to_noise);
+        *p++ = '}';
+    }
+    p = PUT(p, "]}\n");
+    record_end(exp, p);
+    return 0;
+}
+
+/* fixstats_query() results at time t_ns; returns 0, or -1 if there was no room */
+int export_stats(export_t *exp, const fixstats_result_t *stats, int64_t t_ns) {
+    char *p = record_begin(exp, EXPORT_STATS);
+    int i;
+
+    if (p == NULL) {
+        return -1;
+    }
+    p = record_open(exp, p, "stats", 5);
+    p = KEY(exp, p, "utc_epoch_ns");
+    p = put_int(p, t_ns);
+    p = KEY(exp, p, "fixes");
+    p = put_int(p, stats->fixes);
+    p = KEY(exp, p, "valid_fixes");
+    p = put_int(p, stats->valid_fixes);
+    p = KEY(exp, p, "span");
+    p = put_double(exp, p, stats->span);
+    p = KEY(exp, p, "mean_latitude");
+    p = put_double(exp, p, stats->mean_latitude);
+    p = KEY(exp, p, "mean_longitude");
+    p = put_double(exp, p, stats->mean_longitude);
+    p = KEY(exp, p, "sigma_east");
+    p = put_double(exp, p, stats->sigma_east);
+    p = KEY(exp, p, "sigma_north");
+    p = put_double(exp, p, stats->sigma_north);
+    p = KEY(exp, p, "cep");
+    p = put_double(exp, p, stats->cep);
+    p = KEY(exp, p, "drms2");
+    p = put_double(exp, p, stats->drms2);
+    p = KEY(exp, p, "hdop");
+    p = put_double(exp, p, stats->hdop);
+    p = KEY(exp, p, "hdop_trend");
+    p = put_double(exp, p, stats->hdop_trend);
+    p = KEY(exp, p, "pdop");
+    p = put_double(exp, p, stats->pdop);
+    p = KEY(exp, p, "pdop_trend");
+    p = put_double(exp, p, stats->pdop_trend);
+    p = KEY(exp, p, "number_svs");
+    p = put_double(exp, p, stats->number_svs);
+    p = KEY(exp, p, "since_valid");
+    p = put_double(exp, p, stats->since_valid);
+
+    if (exp->format == EXPORT_CSV) {
+        for (i = 0; i < FIXSTATS_QUALITIES; i++) {
+            *p++ = ',';
+            p = put_int(p, stats->quality[i]);
+        }
+    } else {
+        p = PUT(p, ",\"quality\":[");
+        for (i = 0; i < FIXSTATS_QUALITIES; i++) {
+            if (i > 0) {
+                *p++ = ',';
+            }
+            p = put_int(p, stats->quality[i]);
+        }
+        *p++ = ']';
+    }
+    record_end(exp, record_close(exp, p));
+    return 0;
+}
+
+/* gps_fix_handler_t writing every fix, arg is the export_t */
+void export_fix_handler(const gps_fix_t *fix, void *arg) {
+    export_fix((export_t *) arg, fix);
+}
+
+/* writes the buffered records to fd, returns -1 on a write error (the unwritten rest stays buffered) */
+int export_flush(export_t *exp) {
+    size_t done = 0;
+    ssize_t n;
+
+    if (exp->fd < 0) {
+        return 0;
+    }
+    while (done < exp->used) {
+        n = write(exp->fd, exp->buffer + done, exp->used - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (exp->error == 0) {
+                exp->error = errno;
+            }
+            break;
+        }
+        done += n;
+    }
+
+    exp->bytes_written += done;
+    memmove(exp->buffer, exp->buffer + done, exp->used - done);
+    exp->used -= done;
+    return exp->used == 0 ? 0 : -1;
+}
+
+/* empties the buffer without writing it, for buffer-only exporters */
+void export_reset(export_t *exp) {
+    exp->used = 0;
+    exp->error = 0;
+}
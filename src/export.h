@@ -0,0 +1,59 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "satgps.h"
+#include "fixstats.h"
+
+/* formats */
+#define EXPORT_NDJSON               0           /* one JSON object per line */
+#define EXPORT_CSV                  1           /* one row per record, first column is the record type */
+
+#define EXPORT_MAX_RECORD           4096        /* worst case bytes per record, header included */
+#define EXPORT_DEFAULT_BUFFER       65536       /* a good buffer size when writing to an fd */
+#define EXPORT_MAX_DOUBLE           25          /* longest export_double() output */
+#define EXPORT_MAX_INT              20          /* longest export_int() output */
+
+/* record types, also the bits of export_t.headers */
+#define EXPORT_FIX                  1<<0
+#define EXPORT_SKY                  1<<1
+#define EXPORT_STATS                1<<2
+
+/*
+ * Streaming fix/sky/stats exporter
+ *
+ * Records are formatted straight into the caller's buffer, numbers by hand
+ * (doubles in the shortest form that reads back to the same value, Grisu2),
+ * and the buffer goes to fd in one write() when the next record might not fit.
+ * With fd -1 the buffer is all there is: take exp->buffer[0, exp->used), then
+ * export_reset(); a record that doesn't fit fails instead.
+ *
+ * CSV streams may mix record types; each type gets its header line before its
+ * first row. NaN and infinity are written as null (JSON) or an empty field.
+ * */
+typedef struct {
+    int                 format;                     /* EXPORT_NDJSON or EXPORT_CSV */
+    int                 fd;                         /* -1 for buffer only */
+    char                *buffer;
+    size_t              size;
+    size_t              used;
+    unsigned int        headers;                    /* CSV record types whose header was written */
+    unsigned long       records;
+    uint64_t            bytes_written;              /* handed to fd so far */
+    int                 error;                      /* errno of the first failed write, ENOBUFS when a buffer-only exporter filled */
+} export_t;
+
+int export_init(export_t *, int, int, char *, size_t);
+int export_fix(export_t *, const gps_fix_t *);
+int export_sky(export_t *, const gsv_data_t *, int, int64_t);
+int export_stats(export_t *, const fixstats_result_t *, int64_t);
+void export_fix_handler(const gps_fix_t *, void *);
+int export_flush(export_t *);
+void export_reset(export_t *);
+
+int export_int(char *, int64_t);
+int export_double(char *, double);
+
+#endif /* EXPORT_H */
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "fixcodec.h"
+
+#define FIELD_TIME      0
+#define FIELD_LAT       1
+#define FIELD_LON       2
+#define FIELD_ALT       3
+
+/* bit reader over a completed frame */
+typedef struct {
+    const uint8_t       *data;
+    size_t              size;
+    size_t              pos;                        /* in bits */
+} bit_reader_t;
+
+static uint64_t zigzag_encode(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/* deltas wrap like unsigned, so out-of-range values still round-trip instead of overflowing */
+static int64_t wrap_sub(int64_t a, int64_t b) {
+    return (int64_t) ((uint64_t) a - (uint64_t) b);
+}
+
+static int64_t wrap_add(int64_t a, int64_t b) {
+    return (int64_t) ((uint64_t) a + (uint64_t) b);
+}
+
+static void put_bits(fixcodec_t *codec, uint64_t value, int num_bits) {
+    int i;
+
+    for (i = num_bits - 1; i >= 0; i--) {
+        codec->bits = (codec->bits << 1) | ((value >> i) & 1);
+        if (++codec->num_bits == 8) {
+            codec->frame[codec->bytes++] = (uint8_t) codec->bits;
+            codec->bits = 0;
+            codec->num_bits = 0;
+        }
+    }
+}
+
+/* varint in chunk_bits pieces, each followed by a continuation bit */
+static void put_varint(fixcodec_t *codec, uint64_t value) {
+    int chunk = codec->config.chunk_bits;
+    uint64_t mask = ((uint64_t) 1 << chunk) - 1;
+
+    do {
+        put_bits(codec, value & mask, chunk);
+        value >>= chunk;
+        put_bits(codec, value != 0, 1);
+    } while (value != 0);
+}
+
+static int get_bits(bit_reader_t *reader, int num_bits, uint64_t *value) {
+    int i;
+
+    if (reader->pos + num_bits > reader->size * 8) {
+        return -1;
+    }
+    *value = 0;
+    for (i = 0; i < num_bits; i++, reader->pos++) {
+        *value = (*value << 1) | ((reader->data[reader->pos >> 3] >> (7 - (reader->pos & 7))) & 1);
+    }
+    return 0;
+}
+
+static int get_varint(bit_reader_t *reader, int chunk, uint64_t *value) {
+    uint64_t piece, more;
+    int shift = 0;
+
+    *value = 0;
+    do {
+        if (shift >= 64 || get_bits(reader, chunk, &piece) < 0 || get_bits(reader, 1, &more) < 0) {
+            return -1;
+        }
+        *value |= piece << shift;
+        shift += chunk;
+    } while (more);
+    return 0;
+}
+
+/* fix to fixed-point time, lat, lon, alt, returns a bit per NaN field (lat 4, lon 2, alt 1) */
+static int quantize(const fixcodec_config_t *config, const gps_fix_t *fix, int64_t *q) {
+    double value[4] = {0.0, fix->latitude, fix->longitude, fix->altitude};
+    double scale[4] = {0.0, config->position_scale, config->position_scale, config->altitude_scale};
+    int i, missing = 0;
+
+    q[FIELD_TIME] = fix->utc_epoch_ns / config->time_unit_ns;
+    for (i = FIELD_LAT; i <= FIELD_ALT; i++) {
+        /* llround() of NaN is undefined, in practice INT64_MIN */
+        if (isfinite(value[i])) {
+            q[i] = llround(value[i] * scale[i]);
+        } else {
+            q[i] = 0;
+            missing |= 1 << (FIELD_ALT - i);
+        }
+    }
+    return missing;
+}
+
+void fixcodec_default_config(fixcodec_config_t *config) {
+    config->position_scale = FIXCODEC_DEFAULT_POSITION_SCALE;
+    config->altitude_scale = FIXCODEC_DEFAULT_ALTITUDE_SCALE;
+    config->time_unit_ns = FIXCODEC_DEFAULT_TIME_UNIT_NS;
+    config->chunk_bits = FIXCODEC_DEFAULT_CHUNK_BITS;
+    config->keyframe_interval = FIXCODEC_DEFAULT_KEYFRAME_INTERVAL;
+}
+
+/* starts an empty frame */
+static void frame_begin(fixcodec_t *codec) {
+    codec->count = 0;
+    codec->bits = 0;
+    codec->num_bits = 0;
+    codec->bytes = 1;   /* fix count, written when the frame closes */
+}
+
+void fixcodec_init(fixcodec_t *codec, const fixcodec_config_t *config) {
+    memset(codec, 0, sizeof(fixcodec_t));
+    codec->config = *config;
+    if (codec->config.chunk_bits < 1 || codec->config.chunk_bits > 16) {
+        codec->config.chunk_bits = FIXCODEC_DEFAULT_CHUNK_BITS;
+    }
+    if (codec->config.keyframe_interval < 1 || codec->config.keyframe_interval > 255) {
+        codec->config.keyframe_interval = FIXCODEC_DEFAULT_KEYFRAME_INTERVAL;
+    }
+    codec->max_record = FIXCODEC_MAX_RECORD(codec->config.chunk_bits);
+    frame_begin(codec);
+}
+
+/*
+ * Closes the frame being built
+ *
+ * The frame is then in codec->frame, codec->frame_bytes long. Returns its
+ * length, 0 if it was empty.
+ * */
+int fixcodec_flush(fixcodec_t *codec) {
+    if (codec->count == 0) {
+        return 0;
+    }
+    if (codec->num_bits > 0) {
+        put_bits(codec, 0, 8 - codec->num_bits);
+    }
+    codec->frame[0] = (uint8_t) codec->count;
+    codec->frame_bytes = codec->bytes;
+    frame_begin(codec);
+    return (int) codec->frame_bytes;
+}
+
+/*
+ * Adds a fix to the current frame
+ *
+ * Returns the length of a completed frame (see fixcodec_flush()) once the frame
+ * holds keyframe_interval fixes or has no room for another, 0 otherwise.
+ * */
+int fixcodec_encode(fixcodec_t *codec, const gps_fix_t *fix) {
+    int64_t q[4], time_delta;
+    int i, missing;
+
+    missing = quantize(&codec->config, fix, q);
+
+    put_bits(codec, fix->valid != 0, 1);
+    put_bits(codec, missing != 0, 1);
+    if (missing) {
+        put_bits(codec, (uint64_t) missing, 3);
+    }
+    if (codec->count == 0) {
+        /* the keyframe is a delta from zero */
+        memset(codec->prev, 0, sizeof(codec->prev));
+        put_varint(codec, zigzag_encode(q[FIELD_TIME]));
+        codec->prev_time_delta = 0;
+    } else {
+        time_delta = wrap_sub(q[FIELD_TIME], codec->prev[FIELD_TIME]);
+        put_varint(codec, zigzag_encode(wrap_sub(time_delta, codec->prev_time_delta)));
+        codec->prev_time_delta = time_delta;
+    }
+    codec->prev[FIELD_TIME] = q[FIELD_TIME];
+    for (i = FIELD_LAT; i <= FIELD_ALT; i++) {
+        if (!(missing & (1 << (FIELD_ALT - i)))) {
+            put_varint(codec, zigzag_encode(wrap_sub(q[i], codec->prev[i])));
+            codec->prev[i] = q[i];
+        }
+    }
+    codec->count++;
+
+    if (codec->count >= codec->config.keyframe_interval || codec->bytes + codec->max_record > FIXCODEC_MAX_FRAME) {
+        return fixcodec_flush(codec);
+    }
+    return 0;
+}
+
+/* decodes up to max fixes from a frame, returns the number decoded or -1 if the frame is corrupt */
+int fixcodec_decode(const fixcodec_config_t *config, const uint8_t *frame, size_t size, gps_fix_t *fix, int max) {
+    bit_reader_t reader;
+    uint64_t value, valid, missing;
+    int64_t q[4], time_delta = 0;
+    double scale[4] = {0.0, config->position_scale, config->position_scale, config->altitude_scale};
+    double decoded[4];
+    int count, n, i;
+
+    if (size < 1) {
+        return -1;
+    }
+    count = frame[0];
+    reader.data = frame;
+    reader.size = size;
+    reader.pos = 8;
+
+    for (n = 0; n < count && n < max; n++) {
+        if (get_bits(&reader, 1, &valid) < 0 || get_bits(&reader, 1, &missing) < 0) {
+            return -1;
+        }
+        if (missing && get_bits(&reader, 3, &missing) < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            memset(q, 0, sizeof(q));
+        }
+        for (i = 0; i < 4; i++) {
+            decoded[i] = NAN;
+            if (missing & (1 << (FIELD_ALT - i))) {
+                continue;
+            }
+            if (get_varint(&reader, config->chunk_bits, &value) < 0) {
+                return -1;
+            }
+            if (i == FIELD_TIME && n > 0) {
+                time_delta = wrap_add(time_delta, zigzag_decode(value));
+                q[i] = wrap_add(q[i], time_delta);
+            } else {
+                q[i] = wrap_add(q[i], zigzag_decode(value));
+            }
+            if (i != FIELD_TIME) {
+                decoded[i] = q[i] / scale[i];
+            }
+        }
+
+        memset(&fix[n], 0, sizeof(gps_fix_t));
+        fix[n].valid = (int) valid;
+        fix[n].utc_epoch_ns = q[FIELD_TIME] * config->time_unit_ns;
+        fix[n].utc_time.tv_sec = (fix[n].utc_epoch_ns / NSEC_PER_SEC) % SEC_PER_DAY;
+        fix[n].utc_time.tv_usec = (fix[n].utc_epoch_ns % NSEC_PER_SEC) / 1000;
+        fix[n].latitude = decoded[FIELD_LAT];
+        fix[n].longitude = decoded[FIELD_LON];
+        fix[n].altitude = decoded[FIELD_ALT];
+    }
+    return n;
+}
@@ -0,0 +1,72 @@
+#ifndef FIXCODEC_H
+#define FIXCODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "satgps.h"
+
+#define FIXCODEC_MAX_FRAME          256     /* bytes per frame */
+
+/*
+ * Worst case bytes per fix for a chunk size: valid and missing bits, the NaN
+ * mask, four 64-bit varints and the padding of a partly filled byte. A frame
+ * closes before a fix could overflow it; 65 bytes at chunk_bits 1.
+ * */
+#define FIXCODEC_MAX_RECORD(chunk_bits) \
+    ((1 + 1 + 3 + 4 * ((64 + (chunk_bits) - 1) / (chunk_bits)) * ((chunk_bits) + 1) + 7 + 7) / 8)
+
+/* defaults: ~1 cm horizontal, 1 cm vertical, 1 ms, a keyframe every 32 fixes */
+#define FIXCODEC_DEFAULT_POSITION_SCALE     1e7
+#define FIXCODEC_DEFAULT_ALTITUDE_SCALE     100.0
+#define FIXCODEC_DEFAULT_TIME_UNIT_NS       1000000
+#define FIXCODEC_DEFAULT_CHUNK_BITS         4
+#define FIXCODEC_DEFAULT_KEYFRAME_INTERVAL  32
+
+/*
+ * Codec precision, must match on both ends of the link
+ * */
+typedef struct {
+    double              position_scale;             /* fixed-point units per degree of lat/lon */
+    double              altitude_scale;             /* fixed-point units per meter */
+    int64_t             time_unit_ns;               /* nanoseconds per time unit */
+    int                 chunk_bits;                 /* payload bits per varint chunk, 1-16 */
+    int                 keyframe_interval;          /* fixes per frame, the first is a keyframe */
+} fixcodec_config_t;
+
+/*
+ * Frame encoder
+ *
+ * A frame opens with a keyframe holding absolute fixed-point values; the
+ * following fixes store zig-zag deltas (delta-of-delta for time) as bit-level
+ * varints. Frames are independent, so a lost frame only loses its own fixes.
+ *
+ * Frame layout, MSB first:
+ *   8 bits     number of fixes
+ *   per fix    1 bit valid, 1 bit missing, if missing 3 bits for which of
+ *              latitude, longitude and altitude are NaN, then varints for the
+ *              time and every field that isn't
+ *
+ * A NaN field is left out and decodes as NaN; the next value of that field is
+ * a delta from the last one that was known (0 at the keyframe).
+ * */
+typedef struct {
+    fixcodec_config_t   config;
+    uint8_t             frame[FIXCODEC_MAX_FRAME];
+    size_t              frame_bytes;                /* length of the last completed frame */
+    int                 count;                      /* fixes in the frame being built */
+    uint64_t            bits;                       /* bit accumulator */
+    int                 num_bits;                   /* bits in the accumulator */
+    size_t              bytes;                      /* bytes written to frame */
+    size_t              max_record;                 /* FIXCODEC_MAX_RECORD(config.chunk_bits) */
+    int64_t             prev[4];                    /* previous time, lat, lon, alt in fixed point */
+    int64_t             prev_time_delta;
+} fixcodec_t;
+
+void fixcodec_default_config(fixcodec_config_t *);
+void fixcodec_init(fixcodec_t *, const fixcodec_config_t *);
+int fixcodec_encode(fixcodec_t *, const gps_fix_t *);
+int fixcodec_flush(fixcodec_t *);
+int fixcodec_decode(const fixcodec_config_t *, const uint8_t *, size_t, gps_fix_t *, int);
+
+#endif /* FIXCODEC_H */
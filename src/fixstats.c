@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "geodesy.h"
+#include "gpstime.h"
+#include "fixstats.h"
+
+#define DEG2RAD     (M_PI / 180.0)
+#define RAD2DEG     (180.0 / M_PI)
+
+/*
+ * Sets up a window: kind FIXSTATS_BY_COUNT keeps the last window fixes,
+ * FIXSTATS_BY_TIME the fixes of the last window seconds. Either way it holds
+ * at most FIXSTATS_MAX_SAMPLES.
+ * */
+void fixstats_init(fixstats_t *stats, int kind, double window) {
+    memset(stats, 0, sizeof(fixstats_t));
+    stats->kind = kind;
+    if (kind == FIXSTATS_BY_COUNT) {
+        stats->window_fixes = (int) window;
+        if (stats->window_fixes < 1 || stats->window_fixes > FIXSTATS_MAX_SAMPLES) {
+            stats->window_fixes = FIXSTATS_MAX_SAMPLES;
+        }
+    } else {
+        stats->window_ns = (int64_t) (window * NSEC_PER_SEC);
+    }
+}
+
+/* moves the tangent plane to latitude/longitude */
+static void fixstats_set_reference(fixstats_t *stats, double latitude, double longitude) {
+    double sin_lat = sin(latitude * DEG2RAD);
+    double w = sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+
+    stats->has_reference = 1;
+    stats->ref_latitude = latitude;
+    stats->ref_longitude = longitude;
+    stats->meridian_radius = WGS84_A * (1.0 - WGS84_E2) / (w * w * w);
+    stats->parallel_radius = (WGS84_A / w) * cos(latitude * DEG2RAD);
+}
+
+static void trend_add(fixstats_trend_t *trend, double t, double y, double sign) {
+    trend->n += sign;
+    trend->t += sign * t;
+    trend->tt += sign * t * t;
+    trend->y += sign * y;
+    trend->ty += sign * t * y;
+}
+
+/* adds (sign 1) or removes (sign -1) a sample from the running sums */
+static void sums_apply(fixstats_t *stats, const fixstats_sample_t *s, double sign) {
+    fixstats_sums_t *sums = &stats->sums;
+    double t = (double) (s->utc_epoch_ns - stats->ref_epoch_ns) / NSEC_PER_SEC;
+    double east, north;
+    int quality;
+
+    if (s->valid) {
+        east = (s->longitude - stats->ref_longitude) * DEG2RAD * stats->parallel_radius;
+        north = (s->latitude - stats->ref_latitude) * DEG2RAD * stats->meridian_radius;
+        sums->positions += sign;
+        sums->east += sign * east;
+        sums->north += sign * north;
+        sums->east2 += sign * east * east;
+        sums->north2 += sign * north * north;
+        sums->valid += (int) sign;
+    }
+    if (s->hdop > 0.0) {
+        trend_add(&sums->hdop, t, s->hdop, sign);
+    }
+    if (s->pdop > 0.0) {
+        trend_add(&sums->pdop, t, s->pdop, sign);
+    }
+    sums->number_svs += sign * s->number_svs;
+
+    quality = s->gps_quality;
+    if (quality < 0 || quality >= FIXSTATS_QUALITIES) {
+        quality = FIXSTATS_QUALITIES - 1;
+    }
+    sums->quality[quality] += (int) sign;
+}
+
+/* recomputes the sums from the samples, around the current position and time */
+static void sums_rebuild(fixstats_t *stats, double latitude, double longitude) {
+    int i;
+
+    memset(&stats->sums, 0, sizeof(fixstats_sums_t));
+    fixstats_set_reference(stats, latitude, longitude);
+    if (stats->count > 0) {
+        stats->ref_epoch_ns = stats->samples[stats->head].utc_epoch_ns;
+    }
+    for (i = 0; i < stats->count; i++) {
+        sums_apply(stats, &stats->samples[(stats->head + i) % FIXSTATS_MAX_SAMPLES], 1.0);
+    }
+    stats->evictions = 0;
+}
+
+static void evict_oldest(fixstats_t *stats) {
+    sums_apply(stats, &stats->samples[stats->head], -1.0);
+    stats->head = (stats->head + 1) % FIXSTATS_MAX_SAMPLES;
+    stats->count--;
+    stats->evictions++;
+}
+
+/* drops samples that are older than the window at time now */
+static void evict_before(fixstats_t *stats, int64_t now) {
+    if (stats->kind != FIXSTATS_BY_TIME) {
+        return;
+    }
+    while (stats->count > 0 && stats->samples[stats->head].utc_epoch_ns <= now - stats->window_ns) {
+        evict_oldest(stats);
+    }
+}
+
+/* adds a fix to the window, evicting what falls out of it */
+void fixstats_add(fixstats_t *stats, const gps_fix_t *fix) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+    fixstats_sample_t *s;
+    double east, north;
+
+    if (stats->count == 0) {
+        stats->ref_epoch_ns = fix->utc_epoch_ns;
+    }
+
+    if (fix->valid) {
+        if (!stats->has_reference) {
+            fixstats_set_reference(stats, fix->latitude, fix->longitude);
+        } else {
+            east = (fix->longitude - stats->ref_longitude) * DEG2RAD * stats->parallel_radius;
+            north = (fix->latitude - stats->ref_latitude) * DEG2RAD * stats->meridian_radius;
+            if (fabs(east) > FIXSTATS_MAX_OFFSET || fabs(north) > FIXSTATS_MAX_OFFSET) {
+                sums_rebuild(stats, fix->latitude, fix->longitude);
+            }
+        }
+    }
+
+    /* the fix time can step back (receiver restart, new log): start over */
+    if (stats->count > 0 && fix->utc_epoch_ns < stats->last_epoch_ns) {
+        stats->count = 0;
+        sums_rebuild(stats, stats->ref_latitude, stats->ref_longitude);
+        stats->ref_epoch_ns = fix->utc_epoch_ns;
+    }
+
+    if (stats->count == FIXSTATS_MAX_SAMPLES ||
+        (stats->kind == FIXSTATS_BY_COUNT && stats->count == stats->window_fixes)) {
+        evict_oldest(stats);
+    }
+    evict_before(stats, fix->utc_epoch_ns);
+
+    s = &stats->samples[(stats->head + stats->count) % FIXSTATS_MAX_SAMPLES];
+    s->utc_epoch_ns = fix->utc_epoch_ns;
+    s->latitude = fix->latitude;
+    s->longitude = fix->longitude;
+    s->hdop = fix->HDOP;
+    s->pdop = 0.0;
+    if (gps_data->GsaDataGn != NULL) {
+        if (gps_data->GsaDataGn->HDOP > 0.0) {
+            s->hdop = gps_data->GsaDataGn->HDOP;
+        }
+        s->pdop = gps_data->GsaDataGn->PDOP;
+    }
+    s->gps_quality = fix->gps_quality;
+    s->number_svs = fix->number_svs;
+    s->valid = fix->valid;
+    stats->count++;
+    sums_apply(stats, s, 1.0);
+
+    stats->last_epoch_ns = fix->utc_epoch_ns;
+    if (fix->valid) {
+        stats->last_valid_ns = fix->utc_epoch_ns;
+    }
+
+    /* subtracting what was added leaves rounding behind, start from scratch now and then */
+    if (stats->evictions >= FIXSTATS_MAX_SAMPLES) {
+        sums_rebuild(stats, stats->ref_latitude, stats->ref_longitude);
+    }
+}
+
+/* for gps_add_fix_handler(fixstats_fix_handler, &stats) */
+void fixstats_fix_handler(const gps_fix_t *fix, void *arg) {
+    fixstats_add((fixstats_t *) arg, fix);
+}
+
+/* mean and slope per minute of a trend, 0 without samples */
+static void trend_result(const fixstats_trend_t *trend, double *mean, double *slope) {
+    double d;
+
+    *mean = 0.0;
+    *slope = 0.0;
+    if (trend->n < 0.5) {
+        return;
+    }
+    *mean = trend->y / trend->n;
+    d = trend->n * trend->tt - trend->t * trend->t;
+    if (trend->n >= 1.5 && d > 1e-9) {
+        *slope = (trend->n * trend->ty - trend->t * trend->y) / d * 60.0;
+    }
+}
+
+/*
+ * Statistics of the window as of now (UTC ns, 0 for the time of the newest fix)
+ *
+ * For time windows, fixes that have aged out by now are dropped first.
+ * */
+void fixstats_query(fixstats_t *stats, int64_t now, fixstats_result_t *result) {
+    const fixstats_sums_t *sums = &stats->sums;
+    double n, mean_east, mean_north, var_east, var_north;
+
+    if (now == 0) {
+        now = stats->last_epoch_ns;
+    }
+    evict_before(stats, now);
+
+    memset(result, 0, sizeof(fixstats_result_t));
+    result->fixes = stats->count;
+    result->valid_fixes = sums->valid;
+    result->since_valid = stats->last_valid_ns ? (double) (now - stats->last_valid_ns) / NSEC_PER_SEC : -1.0;
+    memcpy(result->quality, sums->quality, sizeof(result->quality));
+    if (stats->count == 0) {
+        return;
+    }
+
+    result->span = (double) (stats->samples[(stats->head + stats->count - 1) % FIXSTATS_MAX_SAMPLES].utc_epoch_ns -
+                             stats->samples[stats->head].utc_epoch_ns) / NSEC_PER_SEC;
+    result->number_svs = sums->number_svs / stats->count;
+    trend_result(&sums->hdop, &result->hdop, &result->hdop_trend);
+    trend_result(&sums->pdop, &result->pdop, &result->pdop_trend);
+
+    n = sums->positions;
+    if (n < 0.5) {
+        return;
+    }
+    mean_east = sums->east / n;
+    mean_north = sums->north / n;
+    var_east = fmax(sums->east2 / n - mean_east * mean_east, 0.0);
+    var_north = fmax(sums->north2 / n - mean_north * mean_north, 0.0);
+
+    result->mean_latitude = stats->ref_latitude + mean_north / stats->meridian_radius * RAD2DEG;
+    result->mean_longitude = stats->ref_longitude + mean_east / stats->parallel_radius * RAD2DEG;
+    result->sigma_east = sqrt(var_east);
+    result->sigma_north = sqrt(var_north);
+    result->cep = 0.589 * (result->sigma_east + result->sigma_north);
+    result->drms2 = 2.0 * sqrt(var_east + var_north);
+}
@@ -0,0 +1,103 @@
+#ifndef FIXSTATS_H
+#define FIXSTATS_H
+
+#include <stdint.h>
+
+#include "satgps.h"
+
+#define FIXSTATS_MAX_SAMPLES        1024        /* fixes a window can hold */
+#define FIXSTATS_QUALITIES          10          /* GGA quality indicators 0-9 */
+#define FIXSTATS_MAX_OFFSET         10000.0     /* meters from the reference before it is moved */
+
+/* window kinds */
+#define FIXSTATS_BY_COUNT           0           /* the last N fixes */
+#define FIXSTATS_BY_TIME            1           /* fixes of the last N seconds */
+
+/* one fix as the window remembers it */
+typedef struct {
+    int64_t             utc_epoch_ns;
+    double              latitude;                   /* in degrees */
+    double              longitude;                  /* in degrees */
+    double              hdop;                       /* 0 if unknown */
+    double              pdop;                       /* from GSA, 0 if unknown */
+    int                 gps_quality;
+    int                 number_svs;
+    int                 valid;
+} fixstats_sample_t;
+
+/* least squares line y(t) through the samples that have a value */
+typedef struct {
+    double              n, t, tt, y, ty;
+} fixstats_trend_t;
+
+/* running sums, updated as fixes enter and leave the window */
+typedef struct {
+    double              positions;                  /* valid fixes */
+    double              east, north;                /* sums of meters from the reference */
+    double              east2, north2;              /* sums of squares */
+    fixstats_trend_t    hdop;
+    fixstats_trend_t    pdop;
+    double              number_svs;
+    int                 valid;
+    int                 quality[FIXSTATS_QUALITIES];
+} fixstats_sums_t;
+
+/*
+ * Rolling window over the fix stream
+ *
+ * Every fix is added to running sums and subtracted again when it leaves the
+ * window, so both adding and querying are O(1). Positions are summed in meters
+ * on a tangent plane near the data; the sums are rebuilt from the samples
+ * once per FIXSTATS_MAX_SAMPLES evictions so that rounding can't accumulate.
+ * Several windows (e.g. 10 s and 10 min) can follow the same stream.
+ * */
+typedef struct {
+    /* configuration */
+    int                 kind;                       /* FIXSTATS_BY_COUNT or FIXSTATS_BY_TIME */
+    int                 window_fixes;               /* FIXSTATS_BY_COUNT */
+    int64_t             window_ns;                  /* FIXSTATS_BY_TIME */
+
+    fixstats_sample_t   samples[FIXSTATS_MAX_SAMPLES];
+    int                 head;                       /* oldest sample */
+    int                 count;
+    fixstats_sums_t     sums;
+    int                 evictions;                  /* since the sums were last rebuilt */
+
+    /* tangent plane and time origin of the sums */
+    int                 has_reference;
+    double              ref_latitude;
+    double              ref_longitude;
+    double              meridian_radius;            /* meters per radian of latitude */
+    double              parallel_radius;            /* meters per radian of longitude */
+    int64_t             ref_epoch_ns;
+
+    int64_t             last_epoch_ns;              /* newest fix, 0 if none */
+    int64_t             last_valid_ns;              /* newest valid fix, 0 if none */
+} fixstats_t;
+
+/* what fixstats_query() reports */
+typedef struct {
+    int                 fixes;                      /* in the window */
+    int                 valid_fixes;
+    double              span;                       /* seconds from the oldest to the newest fix */
+    double              mean_latitude;              /* of the valid fixes, in degrees */
+    double              mean_longitude;
+    double              sigma_east;                 /* standard deviations in meters */
+    double              sigma_north;
+    double              cep;                        /* circular error probable (50%) in meters */
+    double              drms2;                      /* 2DRMS (95-98%) in meters */
+    double              hdop;                       /* mean */
+    double              hdop_trend;                 /* change per minute */
+    double              pdop;
+    double              pdop_trend;
+    double              number_svs;                 /* mean satellites used */
+    int                 quality[FIXSTATS_QUALITIES];    /* fixes per GGA quality indicator */
+    double              since_valid;                /* seconds since the last valid fix, -1 if none yet */
+} fixstats_result_t;
+
+void fixstats_init(fixstats_t *, int, double);
+void fixstats_add(fixstats_t *, const gps_fix_t *);
+void fixstats_fix_handler(const gps_fix_t *, void *);
+void fixstats_query(fixstats_t *, int64_t, fixstats_result_t *);
+
+#endif /* FIXSTATS_H */
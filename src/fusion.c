@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "fusion.h"
+
+#define EARTH_RADIUS                6371008.8   /* meters, mean */
+#define DEG2RAD                     (M_PI / 180.0)
+
+/* error scale per GGA quality indicator 0-9 */
+static const double QualityScale[10] = {
+    0.0,                                        /* invalid */
+    1.0,                                        /* GNSS */
+    0.5,                                        /* differential */
+    1.0,                                        /* PPS */
+    0.05,                                       /* RTK fixed */
+    0.2,                                        /* RTK float */
+    5.0,                                        /* dead reckoning */
+    10.0,                                       /* manual */
+    10.0,                                       /* simulator */
+    0.5                                         /* SBAS */
+};
+
+/* returns -1 if there are more receivers than FUSION_MAX_RECEIVERS */
+int fusion_init(fusion_t *fusion, int num_receivers) {
+    memset(fusion, 0, sizeof(fusion_t));
+    if (num_receivers < 1 || num_receivers > FUSION_MAX_RECEIVERS) {
+        return -1;
+    }
+    fusion->num_receivers = num_receivers;
+    fusion->uere = FUSION_DEFAULT_UERE;
+    fusion->reject_sigma = FUSION_REJECT_SIGMA;
+    fusion->align_ns = FUSION_ALIGN_NS;
+    fusion->wait_ns = FUSION_WAIT_NS;
+    fusion->stale_ns = FUSION_STALE_NS;
+    return 0;
+}
+
+void fusion_set_handler(fusion_t *fusion, fusion_handler_t handler, void *arg) {
+    fusion->handler = handler;
+    fusion->handler_arg = arg;
+}
+
+/* 1 sigma horizontal error of a fix in meters, 0 if it can't be used */
+static double fix_sigma(const fusion_t *fusion, const gps_fix_t *fix) {
+    int has_gga = fix->sources & (GNGGA_MESSAGE | UBX_MESSAGE);
+    double sigma = fusion->uere * (has_gga && fix->HDOP > 0.0 ? fix->HDOP : FUSION_DEFAULT_HDOP);
+
+    if (!fix->valid || isnan(fix->latitude) || isnan(fix->longitude)) {
+        return 0.0;
+    }
+    if (has_gga) {
+        if (fix->gps_quality <= 0 || fix->gps_quality > 9) {
+            return 0.0;
+        }
+        sigma *= QualityScale[fix->gps_quality];
+        if (fix->number_svs > 0 && fix->number_svs < FUSION_MIN_SVS) {
+            sigma *= sqrt((double) FUSION_MIN_SVS / fix->number_svs);
+        }
+    }
+    return sigma;
+}
+
+/*
+ * Fuses the valid fixes of one epoch into out
+ *
+ * Positions are compared on a plane tangent at the first valid fix, which is
+ * exact enough for receivers metres to kilometres apart. Returns -1, with
+ * result filled in, if no fix in the epoch was valid.
+ * */
+int fusion_fuse(fusion_t *fusion, const fusion_epoch_t *epoch, gps_fix_t *out, fusion_result_t *result) {
+    const gps_fix_t *fix, *best = NULL;
+    double w[FUSION_MAX_RECEIVERS], east[FUSION_MAX_RECEIVERS], north[FUSION_MAX_RECEIVERS];
+    int active[FUSION_MAX_RECEIVERS];
+    double ref_lat = 0.0, ref_lon = 0.0, cos_lat = 1.0, sigma, best_sigma = 0.0;
+    double sum_w = 0.0, sum_e = 0.0, sum_n = 0.0, rest_w, mean_e, mean_n, d2, r, worst_r;
+    double alt_w = 0.0, alt_sum = 0.0, vel_w = 0.0, vel_e = 0.0, vel_n = 0.0;
+    int i, worst, valid = 0;
+
+    memset(result, 0, sizeof(fusion_result_t));
+    result->utc_epoch_ns = epoch->utc_epoch_ns;
+
+    /* weights and tangent plane coordinates */
+    for (i = 0; i < fusion->num_receivers; i++) {
+        active[i] = 0;
+        if (!(epoch->mask & (1u << i))) {
+            continue;
+        }
+        fix = &epoch->fixes[i];
+        sigma = fix_sigma(fusion, fix);
+        if (sigma <= 0.0) {
+            continue;
+        }
+        if (valid == 0) {
+            ref_lat = fix->latitude;
+            ref_lon = fix->longitude;
+            cos_lat = cos(ref_lat * DEG2RAD);
+        }
+        if (best == NULL || sigma < best_sigma) {
+            best = fix;
+            best_sigma = sigma;
+        }
+        w[i] = 1.0 / (sigma * sigma);
+        east[i] = remainder(fix->longitude - ref_lon, 360.0) * DEG2RAD * cos_lat * EARTH_RADIUS;
+        north[i] = (fix->latitude - ref_lat) * DEG2RAD * EARTH_RADIUS;
+        sum_w += w[i];
+        sum_e += w[i] * east[i];
+        sum_n += w[i] * north[i];
+        active[i] = 1;
+        result->used_mask |= 1u << i;
+        valid++;
+    }
+    if (valid == 0) {
+        return -1;
+    }
+    result->used = valid;
+
+    /* vote out the worst fix against the mean of the others while a majority remains */
+    while ((result->used - 1) * 2 > valid) {
+        worst = -1;
+        worst_r = fusion->reject_sigma;
+        for (i = 0; i < fusion->num_receivers; i++) {
+            if (!active[i]) {
+                continue;
+            }
+            rest_w = sum_w - w[i];
+            mean_e = (sum_e - w[i] * east[i]) / rest_w;
+            mean_n = (sum_n - w[i] * north[i]) / rest_w;
+            d2 = (east[i] - mean_e) * (east[i] - mean_e) + (north[i] - mean_n) * (north[i] - mean_n);
+            /* the fix's own variance plus that of the mean it is compared with */
+            r = sqrt(d2 / (1.0 / w[i] + 1.0 / rest_w));
+            if (r > worst_r) {
+                worst = i;
+                worst_r = r;
+            }
+        }
+        if (worst < 0) {
+            break;
+        }
+        active[worst] = 0;
+        sum_w -= w[worst];
+        sum_e -= w[worst] * east[worst];
+        sum_n -= w[worst] * north[worst];
+        result->used--;
+        result->rejected++;
+        result->used_mask &= ~(1u << worst);
+        result->rejected_mask |= 1u << worst;
+        if (&epoch->fixes[worst] == best) {
+            best = NULL;
+        }
+    }
+
+    mean_e = sum_e / sum_w;
+    mean_n = sum_n / sum_w;
+    memset(out, 0, sizeof(gps_fix_t));
+    for (i = 0; i < fusion->num_receivers; i++) {
+        if (!active[i]) {
+            continue;
+        }
+        fix = &epoch->fixes[i];
+        d2 = (east[i] - mean_e) * (east[i] - mean_e) + (north[i] - mean_n) * (north[i] - mean_n);
+        result->chi2 += w[i] * d2;
+        if (sqrt(d2) > result->spread) {
+            result->spread = sqrt(d2);
+        }
+        if (best == NULL || 1.0 / w[i] < best_sigma * best_sigma) {
+            best = fix;
+            best_sigma = sqrt(1.0 / w[i]);
+        }
+        if (fix->sources & (GNGGA_MESSAGE | UBX_MESSAGE)) {
+            alt_w += w[i];
+            alt_sum += w[i] * fix->altitude;
+        }
+        if (fix->sources & (GNRMC_MESSAGE | UBX_MESSAGE)) {
+            vel_w += w[i];
+            vel_e += w[i] * fix->speed * sin(fix->track_angle * DEG2RAD);
+            vel_n += w[i] * fix->speed * cos(fix->track_angle * DEG2RAD);
+        }
+        if (fix->number_svs > out->number_svs) {
+            out->number_svs = fix->number_svs;
+        }
+        out->sources |= fix->sources;
+    }
+    /* two components per fix, less the fitted mean */
+    result->chi2 = result->used > 1 ? result->chi2 / (2.0 * (result->used - 1)) : 0.0;
+    result->sigma = sqrt(1.0 / sum_w);
+    result->missing_mask = ((1u << fusion->num_receivers) - 1) & ~epoch->mask;
+
+    /* date and time of day from the most trusted fix, the epoch's own time */
+    out->utc_time = best->utc_time;
+    out->utc_date = best->utc_date;
+    out->utc_epoch_ns = best->utc_epoch_ns;
+    out->gps_quality = best->gps_quality;
+    out->valid = 1;
+    out->latitude = ref_lat + mean_n / EARTH_RADIUS / DEG2RAD;
+    out->longitude = remainder(ref_lon + mean_e / (EARTH_RADIUS * cos_lat) / DEG2RAD, 360.0);
+    out->altitude = alt_w > 0.0 ? alt_sum / alt_w : NAN;
+    if (vel_w > 0.0) {
+        out->speed = hypot(vel_e, vel_n) / vel_w;
+        out->track_angle = fmod(atan2(vel_e, vel_n) / DEG2RAD + 360.0, 360.0);
+    }
+    /* the fused error as an equivalent DOP */
+    out->HDOP = result->sigma / fusion->uere;
+    return 0;
+}
+
+/* receivers heard from within stale_ns of the newest fix, or not yet heard from since the first */
+static unsigned int live_receivers(const fusion_t *fusion) {
+    unsigned int mask = 0;
+    int64_t seen;
+    int i;
+
+    for (i = 0; i < fusion->num_receivers; i++) {
+        seen = fusion->seen_mask & (1u << i) ? fusion->last_seen[i] : fusion->first_ns;
+        if (fusion->newest_ns - seen <= fusion->stale_ns) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+/* fuses the oldest pending epoch and hands it to the handler */
+static void emit_oldest(fusion_t *fusion) {
+    fusion_epoch_t *epoch = &fusion->epochs[fusion->order[0]];
+    fusion_result_t result;
+    gps_fix_t fused;
+
+    if (fusion_fuse(fusion, epoch, &fused, &result) < 0) {
+        fusion->empty++;
+    } else {
+        fusion->epochs_fused++;
+        if (result.missing_mask & live_receivers(fusion)) {
+            fusion->incomplete++;
+        }
+        if (fusion->handler != NULL) {
+            fusion->handler(&fused, &result, fusion->handler_arg);
+        }
+    }
+
+    fusion->fused_ns = epoch->utc_epoch_ns;
+    fusion->fused_any = 1;
+    memmove(fusion->order, fusion->order + 1, (FUSION_PENDING - 1) * sizeof(int));
+    fusion->pending--;
+}
+
+
+static void emit_ready(fusion_t *fusion) {
+    const fusion_epoch_t *epoch;
+    unsigned int live;
+
+    while (fusion->pending > 0) {
+        epoch = &fusion->epochs[fusion->order[0]];
+        live = live_receivers(fusion);
+        if ((epoch->mask & live) != live && fusion->newest_ns - epoch->utc_epoch_ns <= fusion->wait_ns) {
+            break;
+        }
+        emit_oldest(fusion);
+    }
+}
+
+/*
+ * Hands in a fix from receiver 0 to num_receivers - 1
+ *
+ * The handler may run from here with this or earlier epochs. Returns -1 for
+ * a receiver number out of range.
+ * */
+int fusion_add(fusion_t *fusion, int receiver, const gps_fix_t *fix) {
+    int64_t t = fix->utc_epoch_ns, d;
+    fusion_epoch_t *epoch = NULL;
+    int i, slot, used;
+
+    if (receiver < 0 || receiver >= fusion->num_receivers) {
+        return -1;
+    }
+    if (fusion->seen_mask == 0) {
+        fusion->first_ns = t;
+        fusion->newest_ns = t;
+    }
+    if (!(fusion->seen_mask & (1u << receiver)) || t > fusion->last_seen[receiver]) {
+        fusion->last_seen[receiver] = t;
+    }
+    fusion->seen_mask |= 1u << receiver;
+    if (t > fusion->newest_ns) {
+        fusion->newest_ns = t;
+    }
+    if (fusion->fused_any && t <= fusion->fused_ns + fusion->align_ns) {
+        fusion->late++;
+        emit_ready(fusion);
+        return 0;
+    }
+
+    for (i = 0; i < fusion->pending; i++) {
+        d = t - fusion->epochs[fusion->order[i]].utc_epoch_ns;
+        if (d >= -fusion->align_ns && d <= fusion->align_ns) {
+            epoch = &fusion->epochs[fusion->order[i]];
+            break;
+        }
+    }
+
+    if (epoch == NULL) {
+        if (fusion->pending == FUSION_PENDING) {
+            emit_oldest(fusion);
+        }
+        /* a free slot, then keep order[] sorted by time */
+        for (slot = 0; slot < FUSION_PENDING; slot++) {
+            used = 0;
+            for (i = 0; i < fusion->pending; i++) {
+                used |= fusion->order[i] == slot;
+            }
+            if (!used) {
+                break;
+            }
+        }
+        for (i = fusion->pending; i > 0 && fusion->epochs[fusion->order[i - 1]].utc_epoch_ns > t; i--) {
+            fusion->order[i] = fusion->order[i - 1];
+        }
+        fusion->order[i] = slot;
+        fusion->pending++;
+        epoch = &fusion->epochs[slot];
+        epoch->utc_epoch_ns = t;
+        epoch->mask = 0;
+    }
+
+    /* a second fix from the same receiver in one epoch replaces the first */
+    epoch->fixes[receiver] = *fix;
+    epoch->mask |= 1u << receiver;
+    emit_ready(fusion);
+    return 0;
+}
+
+/* fuses every pending epoch, at the end of the logs */
+void fusion_flush(fusion_t *fusion) {
+    while (fusion->pending > 0) {
+        emit_oldest(fusion);
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <stdint.h>
+
+#include "satgps.h"
+
+#define FUSION_MAX_RECEIVERS        8
+#define FUSION_PENDING              4           /* epochs waiting for every receiver */
+#define FUSION_DEFAULT_UERE         5.0         /* meters (1 sigma), scaled by HDOP */
+#define FUSION_DEFAULT_HDOP         2.0         /* for fixes that carry none */
+#define FUSION_MIN_SVS              6           /* fewer satellites inflate the error */
+#define FUSION_ALIGN_NS             50000000LL  /* fixes this close in time are one epoch */
+#define FUSION_WAIT_NS              1000000000LL    /* an epoch is fused without a late receiver after this */
+#define FUSION_STALE_NS             5000000000LL    /* a receiver silent this long isn't waited for */
+#define FUSION_REJECT_SIGMA         3.5         /* leave-one-out distance, in sigmas, that rejects a receiver */
+
+/* how one epoch was fused */
+typedef struct {
+    int64_t             utc_epoch_ns;
+    int                 used;                       /* receivers in the fused fix */
+    int                 rejected;                   /* valid fixes voted out */
+    unsigned int        used_mask;                  /* bit per receiver */
+    unsigned int        rejected_mask;
+    unsigned int        missing_mask;               /* expected but didn't report (in time) */
+    double              sigma;                      /* meters, 1 sigma horizontal error of the fused position */
+    double              chi2;                       /* reduced chi-square of the used fixes, about 1 if they agree within their DOP */
+    double              spread;                     /* meters, farthest used fix from the fused position */
+} fusion_result_t;
+
+typedef void (*fusion_handler_t)(const gps_fix_t *, const fusion_result_t *, void *);
+
+/* fixes of one epoch, a slot per receiver */
+typedef struct {
+    int64_t             utc_epoch_ns;               /* of the first fix to arrive */
+    unsigned int        mask;                       /* receivers that reported */
+    gps_fix_t           fixes[FUSION_MAX_RECEIVERS];
+} fusion_epoch_t;
+
+/*
+ * Multi-receiver fusion and voting
+ *
+ * Receivers on one platform hand in their fixes (e.g. from gpsshm_next() on
+ * each receiver's daemon, so nothing is parsed twice). Fixes within align_ns
+ * of each other form an epoch; it is fused once every live receiver has
+ * reported, or after wait_ns of newer data, or when FUSION_PENDING epochs are
+ * waiting. All timing is by fix time, so logs fuse like live streams.
+ *
+ * Each fix gets a horizontal error of uere x HDOP, scaled by its GGA quality
+ * (RTK is trusted more, dead reckoning less) and inflated below
+ * FUSION_MIN_SVS satellites, and is weighted by its inverse square. A fix is
+ * voted out when it lies more than reject_sigma from the weighted mean of the
+ * others; the worst goes first and the mean is updated from running sums, so a
+ * pass is O(receivers). A majority is always kept: with two receivers that
+ * disagree neither is rejected and chi2 says so. Everything lives in the
+ * struct, nothing is allocated.
+ * */
+typedef struct {
+    /* configuration */
+    int                 num_receivers;
+    double              uere;
+    double              reject_sigma;
+    int64_t             align_ns;
+    int64_t             wait_ns;
+    int64_t             stale_ns;
+    fusion_handler_t    handler;
+    void                *handler_arg;
+
+    fusion_epoch_t      epochs[FUSION_PENDING];
+    int                 order[FUSION_PENDING];      /* pending epoch slots, oldest first */
+    int                 pending;
+    int64_t             last_seen[FUSION_MAX_RECEIVERS];    /* newest fix time per receiver */
+    unsigned int        seen_mask;
+    int64_t             first_ns;                   /* first fix, receivers not yet seen are waited for until stale */
+    int64_t             newest_ns;
+    int64_t             fused_ns;                   /* newest epoch emitted, fixes up to it are late */
+    int                 fused_any;
+
+    unsigned long       epochs_fused;
+    unsigned long       incomplete;                 /* fused without every live receiver */
+    unsigned long       late;                       /* fixes for an epoch already fused */
+    unsigned long       empty;                      /* epochs without a valid fix */
+} fusion_t;
+
+int fusion_init(fusion_t *, int);
+void fusion_set_handler(fusion_t *, fusion_handler_t, void *);
+int fusion_add(fusion_t *, int, const gps_fix_t *);
+void fusion_flush(fusion_t *);
+int fusion_fuse(fusion_t *, const fusion_epoch_t *, gps_fix_t *, fusion_result_t *);
+
+#endif /* FUSION_H */
@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "geodesy.h"
+
+#define DEG2RAD     (M_PI / 180.0)
+#define RAD2DEG     (180.0 / M_PI)
+
+#define VINCENTY_MAX_ITERATIONS     200
+#define VINCENTY_TOLERANCE          1e-12
+
+/*
+ * SIMD helpers
+ *
+ * One set of kernels is written against the vd_* macros below and compiled for
+ * AVX (4 doubles) or SSE2 (2 doubles), whichever the compiler targets. Only
+ * sin/cos are vectorized: asin/atan2 of the results are finished by libm.
+ * */
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define GEODESY_SIMD
+#define VD_N                4
+typedef __m256d vd;
+#define vd_set1(a)          _mm256_set1_pd(a)
+#define vd_load(p)          _mm256_loadu_pd(p)
+#define vd_store(p, a)      _mm256_storeu_pd((p), (a))
+#define vd_add(a, b)        _mm256_add_pd((a), (b))
+#define vd_sub(a, b)        _mm256_sub_pd((a), (b))
+#define vd_mul(a, b)        _mm256_mul_pd((a), (b))
+#define vd_div(a, b)        _mm256_div_pd((a), (b))
+#define vd_sqrt(a)          _mm256_sqrt_pd(a)
+#define vd_and(a, b)        _mm256_and_pd((a), (b))
+#define vd_andnot(a, b)     _mm256_andnot_pd((a), (b))
+#define vd_or(a, b)         _mm256_or_pd((a), (b))
+#define vd_xor(a, b)        _mm256_xor_pd((a), (b))
+#define vd_eq(a, b)         _mm256_cmp_pd((a), (b), _CMP_EQ_OQ)
+#define vd_ge(a, b)         _mm256_cmp_pd((a), (b), _CMP_GE_OQ)
+#define vd_round(a)         _mm256_round_pd((a), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GEODESY_SIMD
+#define VD_N                2
+typedef __m128d vd;
+#define vd_set1(a)          _mm_set1_pd(a)
+#define vd_load(p)          _mm_loadu_pd(p)
+#define vd_store(p, a)      _mm_storeu_pd((p), (a))
+#define vd_add(a, b)        _mm_add_pd((a), (b))
+#define vd_sub(a, b)        _mm_sub_pd((a), (b))
+#define vd_mul(a, b)        _mm_mul_pd((a), (b))
+#define vd_div(a, b)        _mm_div_pd((a), (b))
+#define vd_sqrt(a)          _mm_sqrt_pd(a)
+#define vd_and(a, b)        _mm_and_pd((a), (b))
+#define vd_andnot(a, b)     _mm_andnot_pd((a), (b))
+#define vd_or(a, b)         _mm_or_pd((a), (b))
+#define vd_xor(a, b)        _mm_xor_pd((a), (b))
+#define vd_eq(a, b)         _mm_cmpeq_pd((a), (b))
+#define vd_ge(a, b)         _mm_cmpge_pd((a), (b))
+/* SSE2 has no round instruction; adding 1.5 * 2^52 rounds to nearest for |a| < 2^51 */
+#define vd_round(a)         _mm_sub_pd(_mm_add_pd((a), _mm_set1_pd(6755399441055744.0)), \
+                                       _mm_set1_pd(6755399441055744.0))
+#endif
+
+#ifdef GEODESY_SIMD
+
+#define vd_select(mask, a, b)   vd_or(vd_and((mask), (a)), vd_andnot((mask), (b)))
+
+/*
+ * sin and cos of x (radians) at the same time
+ *
+ * Cody-Waite reduction by pi/2 and the Cephes minimax polynomials on
+ * [-pi/4, pi/4]; accurate to a couple of ulp for the |x| <= 2 pi we use.
+ * */
+static inline void vd_sincos(vd x, vd *s, vd *c) {
+    const vd sign_bit = vd_set1(-0.0);
+    vd k, r, z, sp, cp, q, swap, neg_s, neg_c;
+
+    k = vd_round(vd_mul(x, vd_set1(2.0 / M_PI)));
+    r = vd_sub(x, vd_mul(k, vd_set1(1.57079625129699707031e+00)));
+    r = vd_sub(r, vd_mul(k, vd_set1(7.54978941586159635336e-08)));
+    r = vd_sub(r, vd_mul(k, vd_set1(5.39030285815811905290e-15)));
+    z = vd_mul(r, r);
+
+    sp = vd_set1(1.58962301576546568060e-10);
+    sp = vd_add(vd_mul(sp, z), vd_set1(-2.50507477628578072866e-08));
+    sp = vd_add(vd_mul(sp, z), vd_set1(2.75573136213857245213e-06));
+    sp = vd_add(vd_mul(sp, z), vd_set1(-1.98412698295895385996e-04));
+    sp = vd_add(vd_mul(sp, z), vd_set1(8.33333333332211858878e-03));
+    sp = vd_add(vd_mul(sp, z), vd_set1(-1.66666666666666307295e-01));
+    sp = vd_add(r, vd_mul(vd_mul(r, z), sp));
+
+    cp = vd_set1(-1.13585365213876817300e-11);
+    cp = vd_add(vd_mul(cp, z), vd_set1(2.08757008419747316778e-09));
+    cp = vd_add(vd_mul(cp, z), vd_set1(-2.75573141792967388112e-07));
+    cp = vd_add(vd_mul(cp, z), vd_set1(2.48015872888517045348e-05));
+    cp = vd_add(vd_mul(cp, z), vd_set1(-1.38888888888730564116e-03));
+    cp = vd_add(vd_mul(cp, z), vd_set1(4.16666666666665929218e-02));
+    cp = vd_add(vd_sub(vd_set1(1.0), vd_mul(z, vd_set1(0.5))), vd_mul(vd_mul(z, z), cp));
+
+    /* quadrant q = k mod 4; floor(k / 4) == round((k - 1.5) / 4) for integer k */
+    q = vd_sub(k, vd_mul(vd_set1(4.0), vd_round(vd_mul(vd_sub(k, vd_set1(1.5)), vd_set1(0.25)))));
+
+    swap = vd_or(vd_eq(q, vd_set1(1.0)), vd_eq(q, vd_set1(3.0)));
+    neg_s = vd_ge(q, vd_set1(2.0));
+    neg_c = vd_or(vd_eq(q, vd_set1(1.0)), vd_eq(q, vd_set1(2.0)));
+
+    *s = vd_xor(vd_select(swap, cp, sp), vd_and(neg_s, sign_bit));
+    *c = vd_xor(vd_select(swap, sp, cp), vd_and(neg_c, sign_bit));
+}
+
+#endif /* GEODESY_SIMD */
+
+/* geodetic (WGS-84) to Earth-centered, Earth-fixed coordinates */
+void geodesy_lla_to_ecef_1(double latitude, double longitude, double altitude, double *x, double *y, double *z) {
+    double sin_lat = sin(latitude * DEG2RAD);
+    double cos_lat = cos(latitude * DEG2RAD);
+    double n = WGS84_A / sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+
+    *x = (n + altitude) * cos_lat * cos(longitude * DEG2RAD);
+    *y = (n + altitude) * cos_lat * sin(longitude * DEG2RAD);
+    *z = (n * (1.0 - WGS84_E2) + altitude) * sin_lat;
+}
+
+void geodesy_lla_to_ecef(const double *latitude, const double *longitude, const double *altitude,
+                         double *x, double *y, double *z, int n) {
+    int i = 0;
+
+#ifdef GEODESY_SIMD
+    for (; i + VD_N <= n; i += VD_N) {
+        vd sin_lat, cos_lat, sin_lon, cos_lon, radius, h;
+
+        vd_sincos(vd_mul(vd_load(latitude + i), vd_set1(DEG2RAD)), &sin_lat, &cos_lat);
+        vd_sincos(vd_mul(vd_load(longitude + i), vd_set1(DEG2RAD)), &sin_lon, &cos_lon);
+        h = vd_load(altitude + i);
+
+        radius = vd_div(vd_set1(WGS84_A),
+                        vd_sqrt(vd_sub(vd_set1(1.0), vd_mul(vd_set1(WGS84_E2), vd_mul(sin_lat, sin_lat)))));
+
+        vd_store(x + i, vd_mul(vd_mul(vd_add(radius, h), cos_lat), cos_lon));
+        vd_store(y + i, vd_mul(vd_mul(vd_add(radius, h), cos_lat), sin_lon));
+        vd_store(z + i, vd_mul(vd_add(vd_mul(radius, vd_set1(1.0 - WGS84_E2)), h), sin_lat));
+    }
+#endif
+
+    for (; i < n; i++) {
+        geodesy_lla_to_ecef_1(latitude[i], longitude[i], altitude[i], &x[i], &y[i], &z[i]);
+    }
+}
+
+/* precomputes the rotation for ECEF to ENU around the given point */
+void geodesy_set_reference(geodesy_ref_t *ref, double latitude, double longitude, double altitude) {
+    ref->latitude = latitude;
+    ref->longitude = longitude;
+    ref->altitude = altitude;
+    ref->sin_lat = sin(latitude * DEG2RAD);
+    ref->cos_lat = cos(latitude * DEG2RAD);
+    ref->sin_lon = sin(longitude * DEG2RAD);
+    ref->cos_lon = cos(longitude * DEG2RAD);
+    geodesy_lla_to_ecef_1(latitude, longitude, altitude, &ref->x, &ref->y, &ref->z);
+}
+
+void geodesy_ecef_to_enu(const geodesy_ref_t *ref, const double *x, const double *y, const double *z,
+                         double *east, double *north, double *up, int n) {
+    int i = 0;
+
+#ifdef GEODESY_SIMD
+    const vd rx = vd_set1(ref->x), ry = vd_set1(ref->y), rz = vd_set1(ref->z);
+    const vd sin_lat = vd_set1(ref->sin_lat), cos_lat = vd_set1(ref->cos_lat);
+    const vd sin_lon = vd_set1(ref->sin_lon), cos_lon = vd_set1(ref->cos_lon);
+
+    for (; i + VD_N <= n; i += VD_N) {
+        vd dx = vd_sub(vd_load(x + i), rx);
+        vd dy = vd_sub(vd_load(y + i), ry);
+        vd dz = vd_sub(vd_load(z + i), rz);
+        vd t = vd_add(vd_mul(cos_lon, dx), vd_mul(sin_lon, dy));
+
+        vd_store(east + i, vd_sub(vd_mul(cos_lon, dy), vd_mul(sin_lon, dx)));
+        vd_store(north + i, vd_sub(vd_mul(cos_lat, dz), vd_mul(sin_lat, t)));
+        vd_store(up + i, vd_add(vd_mul(cos_lat, t), vd_mul(sin_lat, dz)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        double dx = x[i] - ref->x;
+        double dy = y[i] - ref->y;
+        double dz = z[i] - ref->z;
+        double t = ref->cos_lon * dx + ref->sin_lon * dy;
+
+        east[i] = ref->cos_lon * dy - ref->sin_lon * dx;
+        north[i] = ref->cos_lat * dz - ref->sin_lat * t;
+        up[i] = ref->cos_lat * t + ref->sin_lat * dz;
+    }
+}
+
+/* great circle distance in meters on a sphere of EARTH_MEAN_RADIUS */
+double geodesy_haversine_1(double lat1, double lon1, double lat2, double lon2) {
+    double s_lat = sin((lat2 - lat1) * DEG2RAD * 0.5);
+    double s_lon = sin((lon2 - lon1) * DEG2RAD * 0.5);
+    double a = s_lat * s_lat + cos(lat1 * DEG2RAD) * cos(lat2 * DEG2RAD) * s_lon * s_lon;
+
+    return 2.0 * EARTH_MEAN_RADIUS * asin(sqrt(a < 1.0 ? a : 1.0));
+}
+
+void geodesy_haversine(const double *lat1, const double *lon1, const double *lat2, const double *lon2,
+                       double *distance, int n) {
+    int i = 0;
+
+#ifdef GEODESY_SIMD
+    for (; i + VD_N <= n; i += VD_N) {
+        vd phi1 = vd_mul(vd_load(lat1 + i), vd_set1(DEG2RAD));
+        vd phi2 = vd_mul(vd_load(lat2 + i), vd_set1(DEG2RAD));
+        vd half_dlon = vd_mul(vd_sub(vd_load(lon2 + i), vd_load(lon1 + i)), vd_set1(DEG2RAD * 0.5));
+        vd s_lat, s_lon, c1, c2, unused;
+        int j;
+
+        vd_sincos(vd_mul(vd_sub(phi2, phi1), vd_set1(0.5)), &s_lat, &unused);
+        vd_sincos(half_dlon, &s_lon, &unused);
+        vd_sincos(phi1, &unused, &c1);
+        vd_sincos(phi2, &unused, &c2);
+
+        vd_store(distance + i, vd_add(vd_mul(s_lat, s_lat), vd_mul(vd_mul(c1, c2), vd_mul(s_lon, s_lon))));
+
+        for (j = i; j < i + VD_N; j++) {
+            double a = distance[j];
+            distance[j] = 2.0 * EARTH_MEAN_RADIUS * asin(sqrt(a < 1.0 ? a : 1.0));
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        distance[i] = geodesy_haversine_1(lat1[i], lon1[i], lat2[i], lon2[i]);
+    }
+}
+
+/* initial great circle bearing from point 1 to point 2, degrees clockwise from true north [0, 360) */
+double geodesy_bearing_1(double lat1, double lon1, double lat2, double lon2) {
+    double phi1 = lat1 * DEG2RAD;
+    double phi2 = lat2 * DEG2RAD;
+    double dlon = (lon2 - lon1) * DEG2RAD;
+    double bearing;
+
+    bearing = atan2(sin(dlon) * cos(phi2), cos(phi1) * sin(phi2) - sin(phi1) * cos(phi2) * cos(dlon)) * RAD2DEG;
+    return bearing < 0.0 ? bearing + 360.0 : bearing;
+}
+
+void geodesy_bearing(const double *lat1, const double *lon1, const double *lat2, const double *lon2,
+                     double *bearing, int n) {
+    int i = 0;
+
+#ifdef GEODESY_SIMD
+    for (; i + VD_N <= n; i += VD_N) {
+        double east[VD_N], north[VD_N];
+        vd s1, c1, s2, c2, s_dlon, c_dlon;
+        int j;
+
+        vd_sincos(vd_mul(vd_load(lat1 + i), vd_set1(DEG2RAD)), &s1, &c1);
+        vd_sincos(vd_mul(vd_load(lat2 + i), vd_set1(DEG2RAD)), &s2, &c2);
+        vd_sincos(vd_mul(vd_sub(vd_load(lon2 + i), vd_load(lon1 + i)), vd_set1(DEG2RAD)), &s_dlon, &c_dlon);
+
+        vd_store(east, vd_mul(s_dlon, c2));
+        vd_store(north, vd_sub(vd_mul(c1, s2), vd_mul(vd_mul(s1, c2), c_dlon)));
+
+        for (j = 0; j < VD_N; j++) {
+            double b = atan2(east[j], north[j]) * RAD2DEG;
+            bearing[i + j] = b < 0.0 ? b + 360.0 : b;
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        bearing[i] = geodesy_bearing_1(lat1[i], lon1[i], lat2[i], lon2[i]);
+    }
+}
+
+/*
+ * Vincenty's inverse formula: ellipsoidal distance in meters
+ *
+ * Iterative, so there is no SIMD version. Returns -1 (and NAN distance) when the
+ * iteration doesn't converge, which happens for nearly antipodal points.
+ * */
+int geodesy_vincenty_1(double lat1, double lon1, double lat2, double lon2, double *distance) {
+    double u1 = atan((1.0 - WGS84_F) * tan(lat1 * DEG2RAD));
+    double u2 = atan((1.0 - WGS84_F) * tan(lat2 * DEG2RAD));
+    double sin_u1 = sin(u1), cos_u1 = cos(u1);
+    double sin_u2 = sin(u2), cos_u2 = cos(u2);
+    double l = (lon2 - lon1) * DEG2RAD;
+    double lambda = l, lambda_prev;
+    double sin_sigma, cos_sigma, sigma, sin_alpha, cos2_alpha, cos_2sigma_m, c;
+    double u_sq, a, b, delta_sigma;
+    int i;
+
+    for (i = 0; i < VINCENTY_MAX_ITERATIONS; i++) {
+        double sin_lambda = sin(lambda), cos_lambda = cos(lambda);
+        double t1 = cos_u2 * sin_lambda;
+        double t2 = cos_u1 * sin_u2 - sin_u1 * cos_u2 * cos_lambda;
+
+        sin_sigma = sqrt(t1 * t1 + t2 * t2);
+        if (sin_sigma == 0.0) {
+            /* coincident points */
+            *distance = 0.0;
+            return 0;
+        }
+        cos_sigma = sin_u1 * sin_u2 + cos_u1 * cos_u2 * cos_lambda;
+        sigma = atan2(sin_sigma, cos_sigma);
+        sin_alpha = cos_u1 * cos_u2 * sin_lambda / sin_sigma;
+        cos2_alpha = 1.0 - sin_alpha * sin_alpha;
+        /* equatorial line: cos2_alpha == 0 */
+        cos_2sigma_m = cos2_alpha != 0.0 ? cos_sigma - 2.0 * sin_u1 * sin_u2 / cos2_alpha : 0.0;
+        c = WGS84_F / 16.0 * cos2_alpha * (4.0 + WGS84_F * (4.0 - 3.0 * cos2_alpha));
+
+        lambda_prev = lambda;
+        lambda = l + (1.0 - c) * WGS84_F * sin_alpha *
+                     (sigma + c * sin_sigma * (cos_2sigma_m + c * cos_sigma * (-1.0 + 2.0 * cos_2sigma_m * cos_2sigma_m)));
+
+        if (fabs(lambda - lambda_prev) < VINCENTY_TOLERANCE) {
+            break;
+        }
+    }
+
+    if (i == VINCENTY_MAX_ITERATIONS) {
+        *distance = NAN;
+        return -1;
+    }
+
+    u_sq = cos2_alpha * (WGS84_A * WGS84_A - WGS84_B * WGS84_B) / (WGS84_B * WGS84_B);
+    a = 1.0 + u_sq / 16384.0 * (4096.0 + u_sq * (-768.0 + u_sq * (320.0 - 175.0 * u_sq)));
+    b = u_sq / 1024.0 * (256.0 + u_sq * (-128.0 + u_sq * (74.0 - 47.0 * u_sq)));
+    delta_sigma = b * sin_sigma * (cos_2sigma_m + b / 4.0 * (cos_sigma * (-1.0 + 2.0 * cos_2sigma_m * cos_2sigma_m) -
+                  b / 6.0 * cos_2sigma_m * (-3.0 + 4.0 * sin_sigma * sin_sigma) * (-3.0 + 4.0 * cos_2sigma_m * cos_2sigma_m)));
+
+    *distance = WGS84_B * a * (sigma - delta_sigma);
+    return 0;
+}
+
+/* returns the number of pairs that did not converge */
+int geodesy_vincenty(const double *lat1, const double *lon1, const double *lat2, const double *lon2,
+                     double *distance, int n) {
+    int i, failed = 0;
+
+    for (i = 0; i < n; i++) {
+        if (geodesy_vincenty_1(lat1[i], lon1[i], lat2[i], lon2[i], &distance[i]) < 0) {
+            failed++;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,42 @@
+#ifndef GEODESY_H
+#define GEODESY_H
+
+/* WGS-84 ellipsoid */
+#define WGS84_A             6378137.0               /* semi-major axis in meters */
+#define WGS84_F             (1.0 / 298.257223563)   /* flattening */
+#define WGS84_B             6356752.314245179       /* semi-minor axis in meters */
+#define WGS84_E2            6.69437999014e-3        /* first eccentricity squared */
+#define EARTH_MEAN_RADIUS   6371008.8               /* mean radius in meters, used by haversine */
+
+/*
+ * Local East-North-Up frame around a reference point
+ * */
+typedef struct {
+    double              latitude;                   /* in degrees */
+    double              longitude;                  /* in degrees */
+    double              altitude;                   /* in meters */
+    double              x, y, z;                    /* reference point in ECEF meters */
+    double              sin_lat, cos_lat;
+    double              sin_lon, cos_lon;
+} geodesy_ref_t;
+
+/*
+ * Batch kernels. Latitudes/longitudes are in degrees and every array holds n
+ * points. They use AVX or SSE2 when the compiler targets them and a scalar
+ * loop otherwise (and for the tail).
+ * */
+void geodesy_lla_to_ecef(const double *, const double *, const double *, double *, double *, double *, int);
+void geodesy_set_reference(geodesy_ref_t *, double, double, double);
+void geodesy_ecef_to_enu(const geodesy_ref_t *, const double *, const double *, const double *,
+                         double *, double *, double *, int);
+void geodesy_haversine(const double *, const double *, const double *, const double *, double *, int);
+void geodesy_bearing(const double *, const double *, const double *, const double *, double *, int);
+int geodesy_vincenty(const double *, const double *, const double *, const double *, double *, int);
+
+/* single point versions */
+void geodesy_lla_to_ecef_1(double, double, double, double *, double *, double *);
+double geodesy_haversine_1(double, double, double, double);
+double geodesy_bearing_1(double, double, double, double);
+int geodesy_vincenty_1(double, double, double, double, double *);
+
+#endif /* GEODESY_H */
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "geodesy.h"
+#include "geofence.h"
+
+#define DEG2RAD     (M_PI / 180.0)
+#define RAD2DEG     (180.0 / M_PI)
+
+/* allocates room for capacity fences, dwell time in seconds; returns -1 if out of memory */
+int geofence_init(geofence_set_t *set, int capacity, double dwell_seconds) {
+    memset(set, 0, sizeof(geofence_set_t));
+
+    set->fences = (geofence_t *) calloc(capacity, sizeof(geofence_t));
+    set->inside = (int *) malloc(capacity * sizeof(int));
+    if (set->fences == NULL || set->inside == NULL) {
+        geofence_free(set);
+        return -1;
+    }
+    set->capacity = capacity;
+    set->dwell_ns = (int64_t) (dwell_seconds * NSEC_PER_SEC);
+    return 0;
+}
+
+void geofence_free(geofence_set_t *set) {
+    int i;
+
+    for (i = 0; i < set->num_fences; i++) {
+        free(set->fences[i].vertex_lat);
+        free(set->fences[i].vertex_lon);
+    }
+    free(set->fences);
+    free(set->inside);
+    free(set->cell_start);
+    free(set->cell_fences);
+    memset(set, 0, sizeof(geofence_set_t));
+}
+
+void geofence_set_handler(geofence_set_t *set, geofence_handler_t handler, void *arg) {
+    set->handler = handler;
+    set->handler_arg = arg;
+}
+
+/* adds a circle of radius meters, returns -1 if the set is full */
+int geofence_add_circle(geofence_set_t *set, int id, double latitude, double longitude, double radius) {
+    geofence_t *fence;
+    double dlat, dlon, cos_lat;
+
+    if (set->num_fences >= set->capacity) {
+        return -1;
+    }
+    fence = &set->fences[set->num_fences];
+    memset(fence, 0, sizeof(geofence_t));
+
+    fence->id = id;
+    fence->type = GEOFENCE_CIRCLE;
+    fence->latitude = latitude;
+    fence->longitude = longitude;
+    fence->radius = radius;
+
+    /* generous box: the haversine sphere is close enough to the ellipsoid here */
+    dlat = radius / EARTH_MEAN_RADIUS * RAD2DEG * 1.01;
+    cos_lat = cos((fabs(latitude) + dlat) * DEG2RAD);
+    dlon = cos_lat > 1e-6 ? dlat / cos_lat : 180.0;
+    fence->min_lat = latitude - dlat;
+    fence->max_lat = latitude + dlat;
+    fence->min_lon = longitude - dlon;
+    fence->max_lon = longitude + dlon;
+
+    set->num_fences++;
+    return 0;
+}
+
+/* adds a polygon, copying its vertices; returns -1 if the set is full or out of memory */
+int geofence_add_polygon(geofence_set_t *set, int id, const double *latitude, const double *longitude, int n) {
+    geofence_t *fence;
+    int i;
+
+    if (set->num_fences >= set->capacity || n < 3) {
+        return -1;
+    }
+    fence = &set->fences[set->num_fences];
+    memset(fence, 0, sizeof(geofence_t));
+
+    fence->vertex_lat = (double *) malloc(n * sizeof(double));
+    fence->vertex_lon = (double *) malloc(n * sizeof(double));
+    if (fence->vertex_lat == NULL || fence->vertex_lon == NULL) {
+        free(fence->vertex_lat);
+        free(fence->vertex_lon);
+        return -1;
+    }
+    memcpy(fence->vertex_lat, latitude, n * sizeof(double));
+    memcpy(fence->vertex_lon, longitude, n * sizeof(double));
+
+    fence->id = id;
+    fence->type = GEOFENCE_POLYGON;
+    fence->num_vertices = n;
+    fence->min_lat = fence->max_lat = latitude[0];
+    fence->min_lon = fence->max_lon = longitude[0];
+    for (i = 1; i < n; i++) {
+        fence->min_lat = fmin(fence->min_lat, latitude[i]);
+        fence->max_lat = fmax(fence->max_lat, latitude[i]);
+        fence->min_lon = fmin(fence->min_lon, longitude[i]);
+        fence->max_lon = fmax(fence->max_lon, longitude[i]);
+    }
+
+    set->num_fences++;
+    return 0;
+}
+
+/* grid row/column of a coordinate, clamped to the grid */
+static int grid_row(const geofence_set_t *set, double latitude) {
+    int row = (int) floor((latitude - set->grid_lat) / set->cell_size);
+    return row < 0 ? 0 : (row >= set->rows ? set->rows - 1 : row);
+}
+
+static int grid_col(const geofence_set_t *set, double longitude) {
+    int col = (int) floor((longitude - set->grid_lon) / set->cell_size);
+    return col < 0 ? 0 : (col >= set->cols ? set->cols - 1 : col);
+}
+
+/*
+ * Builds the grid index; call after the last fence was added
+ *
+ * cell_size is in degrees (0 for GEOFENCE_CELL_DEGREES). It is increased when
+ * the fences would need more than GEOFENCE_MAX_CELLS cells. Returns -1 if out
+ * of memory.
+ * */
+int geofence_build(geofence_set_t *set, double cell_size) {
+    double min_lat = 90.0, max_lat = -90.0, min_lon = 180.0, max_lon = -180.0;
+    int i, r, c, total = 0;
+    int *fill;
+
+    free(set->cell_start);
+    free(set->cell_fences);
+    set->cell_start = NULL;
+    set->cell_fences = NULL;
+
+    if (set->num_fences == 0) {
+        set->rows = set->cols = 0;
+        return 0;
+    }
+
+    for (i = 0; i < set->num_fences; i++) {
+        min_lat = fmin(min_lat, set->fences[i].min_lat);
+        max_lat = fmax(max_lat, set->fences[i].max_lat);
+        min_lon = fmin(min_lon, set->fences[i].min_lon);
+        max_lon = fmax(max_lon, set->fences[i].max_lon);
+    }
+
+    set->cell_size = cell_size > 0.0 ? cell_size : GEOFENCE_CELL_DEGREES;
+    while (((max_lat - min_lat) / set->cell_size + 1) * ((max_lon - min_lon) / set->cell_size + 1) > GEOFENCE_MAX_CELLS) {
+        set->cell_size *= 2.0;
+    }
+    set->grid_lat = min_lat;
+    set->grid_lon = min_lon;
+    set->rows = (int) ((max_lat - min_lat) / set->cell_size) + 1;
+    set->cols = (int) ((max_lon - min_lon) / set->cell_size) + 1;
+
+    set->cell_start = (int *) calloc(set->rows * set->cols + 1, sizeof(int));
+    fill = (int *) calloc(set->rows * set->cols, sizeof(int));
+    if (set->cell_start == NULL || fill == NULL) {
+        free(fill);
+        return -1;
+    }
+
+    /* count, prefix sum, then fill */
+    for (i = 0; i < set->num_fences; i++) {
+        geofence_t *fence = &set->fences[i];
+        for (r = grid_row(set, fence->min_lat); r <= grid_row(set, fence->max_lat); r++) {
+            for (c = grid_col(set, fence->min_lon); c <= grid_col(set, fence->max_lon); c++) {
+                set->cell_start[r * set->cols + c + 1]++;
+                total++;
+            }
+        }
+    }
+    for (i = 0; i < set->rows * set->cols; i++) {
+        set->cell_start[i + 1] += set->cell_start[i];
+    }
+
+    set->cell_fences = (int *) malloc(total * sizeof(int));
+    if (set->cell_fences == NULL) {
+        free(fill);
+        return -1;
+    }
+    for (i = 0; i < set->num_fences; i++) {
+        geofence_t *fence = &set->fences[i];
+        for (r = grid_row(set, fence->min_lat); r <= grid_row(set, fence->max_lat); r++) {
+            for (c = grid_col(set, fence->min_lon); c <= grid_col(set, fence->max_lon); c++) {
+                int cell = r * set->cols + c;
+                set->cell_fences[set->cell_start[cell] + fill[cell]++] = i;
+            }
+        }
+    }
+
+    free(fill);
+    return 0;
+}
+
+/* crossing-number point in polygon test */
+static int polygon_contains(const geofence_t *fence, double latitude, double longitude) {
+    int i, j, inside = 0;
+
+    for (i = 0, j = fence->num_vertices - 1; i < fence->num_vertices; j = i++) {
+        double lat_i = fence->vertex_lat[i], lat_j = fence->vertex_lat[j];
+        if ((lat_i > latitude) != (lat_j > latitude)) {
+            double lon_cross = fence->vertex_lon[j] + (latitude - lat_j) * (fence->vertex_lon[i] - fence->vertex_lon[j]) /
+                                                      (lat_i - lat_j);
+            if (longitude < lon_cross) {
+                inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+static int fence_contains(const geofence_t *fence, double latitude, double longitude) {
+    if (latitude < fence->min_lat || latitude > fence->max_lat ||
+        longitude < fence->min_lon || longitude > fence->max_lon) {
+        return 0;
+    }
+    if (fence->type == GEOFENCE_CIRCLE) {
+        return geodesy_haversine_1(fence->latitude, fence->longitude, latitude, longitude) <= fence->radius;
+    }
+    return polygon_contains(fence, latitude, longitude);
+}
+
+static void fence_event(geofence_set_t *set, int event, const geofence_t *fence, const gps_fix_t *fix) {
+    if (set->handler != NULL) {
+        set->handler(event, fence, fix, set->handler_arg);
+    }
+}
+
+/* tests one fence against the fix and reports any change */
+static void fence_evaluate(geofence_set_t *set, int index, const gps_fix_t *fix) {
+    geofence_t *fence = &set->fences[index];
+    int inside;
+
+    if (fence->stamp == set->stamp) {
+        return;
+    }
+    fence->stamp = set->stamp;
+
+    inside = fence_contains(fence, fix->latitude, fix->longitude);
+
+    if (inside && !fence->inside) {
+        fence->inside = 1;
+        fence->dwell_reported = 0;
+        fence->enter_ns = fix->utc_epoch_ns;
+        set->inside[set->num_inside++] = index;
+        fence_event(set, GEOFENCE_ENTER, fence, fix);
+    } else if (!inside && fence->inside) {
+        fence->inside = 0;
+        fence_event(set, GEOFENCE_EXIT, fence, fix);
+    }
+
+    if (fence->inside && !fence->dwell_reported && fix->utc_epoch_ns - fence->enter_ns >= set->dwell_ns) {
+        fence->dwell_reported = 1;
+        fence_event(set, GEOFENCE_DWELL, fence, fix);
+    }
+}
+
+/*
+ * Evaluates a fix against every fence and sends enter/exit/dwell events
+ *
+ * Returns the number of fences the fix is inside, or -1 for an invalid fix.
+ * */
+int geofence_update(geofence_set_t *set, const gps_fix_t *fix) {
+    int i, n, cell;
+
+    if (!fix->valid) {
+        return -1;
+    }
+    set->stamp++;
+
+    /* fences we are inside: they may have been left */
+    n = set->num_inside;
+    for (i = 0; i < n; i++) {
+        fence_evaluate(set, set->inside[i], fix);
+    }
+
+    if (set->rows > 0 &&
+        fix->latitude >= set->grid_lat && fix->latitude < set->grid_lat + set->rows * set->cell_size &&
+        fix->longitude >= set->grid_lon && fix->longitude < set->grid_lon + set->cols * set->cell_size) {
+        cell = grid_row(set, fix->latitude) * set->cols + grid_col(set, fix->longitude);
+        for (i = set->cell_start[cell]; i < set->cell_start[cell + 1]; i++) {
+            fence_evaluate(set, set->cell_fences[i], fix);
+        }
+    }
+
+    /* drop the fences that were left */
+    for (i = 0, n = 0; i < set->num_inside; i++) {
+        if (set->fences[set->inside[i]].inside) {
+            set->inside[n++] = set->inside[i];
+        }
+    }
+    set->num_inside = n;
+
+    return n;
+}
+
+/* for gps_add_fix_handler(geofence_fix_handler, &set) */
+void geofence_fix_handler(const gps_fix_t *fix, void *arg) {
+    geofence_update((geofence_set_t *) arg, fix);
+}
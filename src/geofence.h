@@ -0,0 +1,78 @@
+#ifndef GEOFENCE_H
+#define GEOFENCE_H
+
+#include "satgps.h"
+
+#define GEOFENCE_MAX_CELLS      (1 << 20)   /* upper bound on grid cells, the cell size grows to fit */
+#define GEOFENCE_CELL_DEGREES   0.01        /* default grid cell size, about 1 km */
+
+/* fence types */
+#define GEOFENCE_CIRCLE         0
+#define GEOFENCE_POLYGON        1
+
+/* events */
+#define GEOFENCE_ENTER          0
+#define GEOFENCE_EXIT           1
+#define GEOFENCE_DWELL          2
+
+/*
+ * Circle or polygon fence
+ *
+ * Polygons are simple and closed implicitly (last vertex connects to the first).
+ * Fences must not straddle the antimeridian.
+ * */
+typedef struct {
+    int                 id;                         /* caller's identifier */
+    int                 type;                       /* GEOFENCE_CIRCLE or GEOFENCE_POLYGON */
+    double              latitude;                   /* circle center, in degrees */
+    double              longitude;
+    double              radius;                     /* circle radius in meters */
+    double              *vertex_lat;                /* polygon vertices, in degrees */
+    double              *vertex_lon;
+    int                 num_vertices;
+    double              min_lat, max_lat;           /* bounding box */
+    double              min_lon, max_lon;
+    int                 inside;                     /* 1 while the last fix was inside */
+    int                 dwell_reported;             /* 1 once GEOFENCE_DWELL was sent for this visit */
+    int64_t             enter_ns;                   /* epoch of the fix that entered */
+    unsigned int        stamp;                      /* last evaluation that tested this fence */
+} geofence_t;
+
+typedef void (*geofence_handler_t)(int, const geofence_t *, const gps_fix_t *, void *);
+
+/*
+ * Set of fences with a uniform lat/lon grid index
+ *
+ * Each fix looks up one grid cell, then tests only the fences whose bounding
+ * box overlaps that cell plus those it is currently inside (to see exits).
+ * */
+typedef struct {
+    geofence_t          *fences;
+    int                 num_fences;
+    int                 capacity;
+    int64_t             dwell_ns;                   /* time inside before GEOFENCE_DWELL */
+    geofence_handler_t  handler;
+    void                *handler_arg;
+
+    /* grid index, cell_start/cell_fences in compressed row form */
+    double              cell_size;                  /* in degrees */
+    double              grid_lat, grid_lon;         /* south-west corner */
+    int                 rows, cols;
+    int                 *cell_start;                /* rows * cols + 1 offsets into cell_fences */
+    int                 *cell_fences;
+
+    int                 *inside;                    /* indices of fences we are inside */
+    int                 num_inside;
+    unsigned int        stamp;
+} geofence_set_t;
+
+int geofence_init(geofence_set_t *, int, double);
+void geofence_free(geofence_set_t *);
+void geofence_set_handler(geofence_set_t *, geofence_handler_t, void *);
+int geofence_add_circle(geofence_set_t *, int, double, double, double);
+int geofence_add_polygon(geofence_set_t *, int, const double *, const double *, int);
+int geofence_build(geofence_set_t *, double);
+int geofence_update(geofence_set_t *, const gps_fix_t *);
+void geofence_fix_handler(const gps_fix_t *, void *);
+
+#endif /* GEOFENCE_H */
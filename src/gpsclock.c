@@ -0,0 +1,248 @@
+#include <string.h>
+#include <time.h>
+
+#include "satgps.h"
+#include "ubx.h"
+#include "gpstime.h"
+#include "gpsclock.h"
+
+static _Atomic(gpsclock_t *) DefaultClock;
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* k-th smallest of v[0..n-1], reorders v (Hoare's selection) */
+static double select_kth(double *v, int n, int k) {
+    int lo = 0, hi = n - 1, i, j;
+    double pivot, t;
+
+    while (lo < hi) {
+        pivot = v[lo + (hi - lo) / 2];
+        i = lo;
+        j = hi;
+        while (i <= j) {
+            while (v[i] < pivot) {
+                i++;
+            }
+            while (v[j] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                t = v[i];
+                v[i] = v[j];
+                v[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) {
+            hi = j;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+    return v[k];
+}
+
+/*
+ * baud is the serial line speed, 0 if lines don't come over a UART; latency_ns
+ * is how long after the epoch the receiver starts sending, 0 if unknown
+ * */
+void gpsclock_init(gpsclock_t *clock, int baud, int64_t latency_ns) {
+    memset(clock, 0, sizeof(gpsclock_t));
+    clock->baud = baud;
+    clock->latency_ns = latency_ns;
+    atomic_store(&DefaultClock, clock);
+}
+
+static void publish(gpsclock_t *clock, const gpsclock_estimate_t *estimate) {
+    unsigned int s = atomic_load_explicit(&clock->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&clock->seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    clock->estimate = *estimate;
+    atomic_store_explicit(&clock->seq, s + 2, memory_order_release);
+}
+
+/* refits drift and offset to the window, pinned to the newest sample */
+static void fit(gpsclock_t *clock) {
+    gpsclock_estimate_t estimate;
+    int64_t ref_mono, ref_offset;
+    int i, j, a, b, n = clock->count, pairs = 0;
+    double drift = 0.0, envelope, median;
+
+    ref_mono = clock->mono[(clock->head + n - 1) % GPSCLOCK_WINDOW];
+    ref_offset = clock->offset[(clock->head + n - 1) % GPSCLOCK_WINDOW];
+
+    for (i = 0; i < n; i++) {
+        a = (clock->head + i) % GPSCLOCK_WINDOW;
+        for (j = i + 1; j < n; j++) {
+            b = (clock->head + j) % GPSCLOCK_WINDOW;
+            if (clock->mono[b] != clock->mono[a]) {
+                clock->slopes[pairs++] = (double) (clock->offset[b] - clock->offset[a]) /
+                                         (double) (clock->mono[b] - clock->mono[a]);
+            }
+        }
+    }
+    if (pairs > 0) {
+        drift = select_kth(clock->slopes, pairs, pairs / 2);
+    }
+
+    /* arrivals are only ever late: take the near-top residual, one in 16 may be a mispaired epoch */
+    for (i = 0; i < n; i++) {
+        a = (clock->head + i) % GPSCLOCK_WINDOW;
+        clock->residuals[i] = (double) (clock->offset[a] - ref_offset) - drift * (double) (clock->mono[a] - ref_mono);
+    }
+    envelope = select_kth(clock->residuals, n, n - 1 - n / 16);
+    median = select_kth(clock->residuals, n, n / 2);
+
+    estimate.mono_ns = ref_mono;
+    estimate.utc_ns = ref_mono + ref_offset + (int64_t) envelope + clock->latency_ns;
+    estimate.drift = drift;
+    estimate.spread_ns = (int64_t) (envelope - median);
+    estimate.samples = n;
+    publish(clock, &estimate);
+}
+
+/* one epoch's UTC time against its first byte's arrival, restarts the window after a jump */
+static void add_sample(gpsclock_t *clock, int64_t utc_ns, int64_t mono_ns) {
+    int64_t predicted, offset = utc_ns - mono_ns;
+    int tail;
+
+    if (clock->count >= GPSCLOCK_MIN_SAMPLES) {
+        predicted = clock->estimate.utc_ns - clock->latency_ns - clock->estimate.mono_ns +
+                    (int64_t) (clock->estimate.drift * (double) (mono_ns - clock->estimate.mono_ns));
+        if (offset - predicted > GPSCLOCK_RESET_NS || predicted - offset > GPSCLOCK_RESET_NS) {
+            clock->head = 0;
+            clock->count = 0;
+            clock->resets++;
+        }
+    }
+
+    tail = (clock->head + clock->count) % GPSCLOCK_WINDOW;
+    clock->mono[tail] = mono_ns;
+    clock->offset[tail] = offset;
+    if (clock->count < GPSCLOCK_WINDOW) {
+        clock->count++;
+    } else {
+        clock->head = (clock->head + 1) % GPSCLOCK_WINDOW;
+    }
+    clock->epochs++;
+    fit(clock);
+}
+
+/*
+ * Adds a sentence's UTC time and the CLOCK_MONOTONIC time its first byte
+ * arrived. Sentences of one epoch are collected and the earliest arrival
+ * kept; the epoch enters the fit when the next one starts.
+ * */
+void gpsclock_add(gpsclock_t *clock, int64_t utc_ns, int64_t mono_ns) {
+    if (utc_ns < GPSCLOCK_MIN_EPOCH_NS) {
+        return;
+    }
+    if (utc_ns == clock->pending_utc) {
+        if (mono_ns < clock->pending_mono) {
+            clock->pending_mono = mono_ns;
+        }
+        return;
+    }
+    if (clock->pending_utc != 0) {
+        add_sample(clock, clock->pending_utc, clock->pending_mono);
+    }
+    clock->pending_utc = utc_ns;
+    clock->pending_mono = mono_ns;
+}
+
+/*
+ * Takes the time from a line that has just been parsed: a valid RMC, GLL or
+ * GGA from the library tables, or a UBX NAV-PVT from the fix it published
+ * */
+void gpsclock_line(gpsclock_t *clock, const gps_line_t *line) {
+    gps_data_t *data = gps_get_data_ptr();
+    int64_t utc_ns, transmit_ns = 0;
+
+    switch (line->type) {
+        case GNRMC_MESSAGE:
+            if (data->RmcDataGn == NULL || !data->RmcDataGn->valid) {
+                return;
+            }
+            utc_ns = data->RmcDataGn->utc_epoch_ns;
+            break;
+        case GNGLL_MESSAGE:
+            if (data->GllDataGn == NULL || !data->GllDataGn->valid) {
+                return;
+            }
+            utc_ns = data->GllDataGn->utc_epoch_ns;
+            break;
+        case GNGGA_MESSAGE:
+            if (data->GgaDataGn == NULL || data->GgaDataGn->gps_quality == 0) {
+                return;
+            }
+            utc_ns = data->GgaDataGn->utc_epoch_ns;
+            break;
+        case UBX_MESSAGE:
+            if ((uint8_t) line->text[2] != UBX_CLASS_NAV || (uint8_t) line->text[3] != UBX_NAV_PVT ||
+                !data->fix.valid || !(data->fix.sources & UBX_MESSAGE)) {
+                return;
+            }
+            utc_ns = data->fix.utc_epoch_ns;
+            break;
+        default:
+            return;
+    }
+
+    /* the line was stamped after its last byte; NMEA lines lost their CR LF */
+    if (clock->baud > 0) {
+        transmit_ns = (int64_t) (line->length + (line->type == UBX_MESSAGE ? 0 : 2)) *
+                      GPSCLOCK_BITS_PER_CHAR * NSEC_PER_SEC / clock->baud;
+    }
+    gpsclock_add(clock, utc_ns, line->received_mono_ns - transmit_ns);
+}
+
+/* rtpipe consumer, arg is the gpsclock_t */
+void gpsclock_consumer(const gps_line_t *line, int result, void *arg) {
+    if (result == 0) {
+        gpsclock_line((gpsclock_t *) arg, line);
+    }
+}
+
+/* consistent copy of the model, from any thread */
+void gpsclock_estimate(gpsclock_t *clock, gpsclock_estimate_t *estimate) {
+    unsigned int s1, s2;
+
+    do {
+        s1 = atomic_load_explicit(&clock->seq, memory_order_acquire);
+        memcpy(estimate, &clock->estimate, sizeof(gpsclock_estimate_t));
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&clock->seq, memory_order_relaxed);
+    } while ((s1 & 1) || s1 != s2);
+}
+
+/* UTC nanoseconds since 1970-01-01 at a CLOCK_MONOTONIC time, 0 until GPSCLOCK_MIN_SAMPLES epochs were seen */
+int64_t gpsclock_to_utc(gpsclock_t *clock, int64_t mono_ns) {
+    gpsclock_estimate_t estimate;
+    int64_t elapsed;
+
+    gpsclock_estimate(clock, &estimate);
+    if (estimate.samples < GPSCLOCK_MIN_SAMPLES) {
+        return 0;
+    }
+    elapsed = mono_ns - estimate.mono_ns;
+    return estimate.utc_ns + elapsed + (int64_t) (estimate.drift * (double) elapsed);
+}
+
+/* GPS-disciplined UTC nanoseconds now, 0 if there's no clock or it isn't synchronised yet */
+int64_t gps_now(void) {
+    gpsclock_t *clock = atomic_load_explicit(&DefaultClock, memory_order_acquire);
+
+    if (clock == NULL) {
+        return 0;
+    }
+    return gpsclock_to_utc(clock, monotonic_ns());
+}
@@ -0,0 +1,76 @@
+#ifndef GPSCLOCK_H
+#define GPSCLOCK_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "satgps.h"
+#include "reader.h"
+
+#define GPSCLOCK_WINDOW             64          /* epochs the fit uses */
+#define GPSCLOCK_MIN_SAMPLES        4           /* epochs before gps_now() returns a time */
+#define GPSCLOCK_DEFAULT_BAUD       9600        /* serial.c's line speed */
+#define GPSCLOCK_BITS_PER_CHAR      10          /* 8N1: start, 8 data, stop */
+#define GPSCLOCK_RESET_NS           1000000000LL    /* a sample this far off the fit restarts the window */
+#define GPSCLOCK_MIN_EPOCH_NS       946684800000000000LL    /* 2000-01-01, earlier times have no date yet */
+
+/* the model, UTC = utc_ns + (mono - mono_ns) * (1 + drift) */
+typedef struct {
+    int64_t             mono_ns;                    /* CLOCK_MONOTONIC at the reference point */
+    int64_t             utc_ns;                     /* UTC nanoseconds since 1970-01-01 at mono_ns */
+    double              drift;                      /* rate of UTC against CLOCK_MONOTONIC, minus 1; 1e-6 is 1 ppm */
+    int64_t             spread_ns;                  /* median arrival latency above the fastest, a jitter measure */
+    int                 samples;                    /* epochs in the fit, 0 before the first */
+} gpsclock_estimate_t;
+
+/*
+ * GPS time against the host's monotonic clock, without a PPS line
+ *
+ * Each epoch's UTC time is paired with the CLOCK_MONOTONIC time the first
+ * byte of its earliest sentence arrived: the line's read time less its
+ * transmission time at the configured baud rate. Over a sliding window of
+ * epochs the drift is the Theil-Sen slope (median of the pairwise slopes),
+ * which ignores the late arrivals scheduling delays and read batching cause;
+ * the offset follows the upper envelope of the samples, since every
+ * arrival is late and never early. What is left is the receiver's own
+ * output latency, a constant to be measured once and set in latency_ns.
+ *
+ * One thread feeds samples; the model is published under a sequence counter,
+ * so gps_now() and gpsclock_to_utc() from any thread cost a vDSO
+ * clock_gettime() and a few multiplies. gps_now() reads the clock most
+ * recently passed to gpsclock_init().
+ * */
+typedef struct {
+    /* configuration */
+    int                 baud;                       /* 0 for network sources, no transmission delay */
+    int64_t             latency_ns;                 /* receiver output latency, epoch to first byte */
+
+    /* window of epochs, offset = UTC - arrival */
+    int64_t             mono[GPSCLOCK_WINDOW];
+    int64_t             offset[GPSCLOCK_WINDOW];
+    int                 head;                       /* oldest sample */
+    int                 count;
+
+    /* epoch being collected */
+    int64_t             pending_utc;
+    int64_t             pending_mono;
+
+    unsigned long       epochs;                     /* samples taken */
+    unsigned long       resets;                     /* windows restarted after a time jump */
+
+    double              slopes[GPSCLOCK_WINDOW * (GPSCLOCK_WINDOW - 1) / 2];
+    double              residuals[GPSCLOCK_WINDOW];
+
+    atomic_uint         seq;
+    gpsclock_estimate_t estimate;
+} gpsclock_t;
+
+void gpsclock_init(gpsclock_t *, int, int64_t);
+void gpsclock_add(gpsclock_t *, int64_t, int64_t);
+void gpsclock_line(gpsclock_t *, const gps_line_t *);
+void gpsclock_consumer(const gps_line_t *, int, void *);
+void gpsclock_estimate(gpsclock_t *, gpsclock_estimate_t *);
+int64_t gpsclock_to_utc(gpsclock_t *, int64_t);
+int64_t gps_now(void);
+
+#endif /* GPSCLOCK_H */
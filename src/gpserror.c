@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "satgps.h"
+#include "gpserror.h"
+
+static gps_error_slot_t ErrorRing[GPS_ERROR_RING_SIZE];
+static _Atomic uint64_t ErrorCount;
+
+/* sentence names by filter bit number */
+static const char *SentenceNames[] = {
+    "GLGSV", "GPGSV", "GNGLL", "GNRMC", "GNVTG", "GNGGA", "GNGSA", "GNTXT", "UBX"
+};
+
+static const char *ErrorStrings[] = {
+    "no error",
+    "checksum missing",
+    "checksum mismatch",
+    "too few fields",
+    "unexpected field value",
+    "data flagged invalid",
+    "sentence number out of range",
+    "unhandled sentence type",
+    "too many fix handlers",
+    "UBX checksum mismatch",
+    "UBX payload too short"
+};
+
+/*
+ * Records an error: code, sentence type, field index, byte offset, detail value
+ *
+ * Safe from any thread. It stores five integers, nothing is formatted.
+ * */
+void gps_error_push(int code, int sentence_type, int field, int offset, int value) {
+    uint64_t index = atomic_fetch_add_explicit(&ErrorCount, 1, memory_order_relaxed);
+    gps_error_slot_t *slot = &ErrorRing[index & (GPS_ERROR_RING_SIZE - 1)];
+
+    /* seqlock: odd while the slot is being written */
+    atomic_store_explicit(&slot->seq, 2 * index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->error.index = index;
+    slot->error.code = code;
+    slot->error.sentence_type = sentence_type;
+    slot->error.field = field;
+    slot->error.offset = offset;
+    slot->error.value = value;
+
+    atomic_store_explicit(&slot->seq, 2 * index + 2, memory_order_release);
+}
+
+/* number of errors recorded so far, the newest may still be being written */
+uint64_t gps_error_count() {
+    return atomic_load_explicit(&ErrorCount, memory_order_acquire);
+}
+
+/*
+ * Reads error number index
+ *
+ * Returns 1 with the error, 0 if it has been overwritten meanwhile and -1 if
+ * its writer hasn't finished yet (the number is claimed before the slot is filled).
+ * Never waits: the slot holds exactly this error only while seq is 2 * index + 2.
+ * */
+static int read_slot(uint64_t index, gps_error_t *error) {
+    gps_error_slot_t *slot = &ErrorRing[index & (GPS_ERROR_RING_SIZE - 1)];
+    uint64_t s1, s2;
+
+    s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (s1 < 2 * index + 2) {
+        return -1;
+    }
+    if (s1 != 2 * index + 2) {
+        return 0;
+    }
+    *error = slot->error;
+    atomic_thread_fence(memory_order_acquire);
+    s2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    return s1 == s2 && error->index == index;
+}
+
+/*
+ * Most recent error, returns 0 if there was none
+ *
+ * If the newest slot is still being filled (its writer may be preempted
+ * halfway, for as long as the scheduler likes) this returns the one before
+ * it. After GPS_ERROR_LATEST_TRIES rounds of writers overtaking us it gives
+ * up and returns 0 rather than spin.
+ * */
+int gps_error_latest(gps_error_t *error) {
+    uint64_t count;
+    int tries;
+
+    for (tries = 0; tries < GPS_ERROR_LATEST_TRIES; tries++) {
+        count = gps_error_count();
+        if (count == 0) {
+            return 0;
+        }
+        if (read_slot(count - 1, error) == 1) {
+            return 1;
+        }
+        if (count >= 2 && read_slot(count - 2, error) == 1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* starts a cursor at the next error to be recorded */
+void gps_error_cursor_init(gps_error_cursor_t *cursor) {
+    cursor->read_index = gps_error_count();
+    cursor->lost = 0;
+}
+
+/*
+ * Next error after the last one this cursor read
+ *
+ * Returns 1 with an error, 0 if there is nothing new. A reader that falls more
+ * than GPS_ERROR_RING_SIZE errors behind skips ahead and counts the gap in lost.
+ * */
+int gps_error_next(gps_error_cursor_t *cursor, gps_error_t *error) {
+    uint64_t count;
+
+    for (;;) {
+        count = gps_error_count();
+        if (cursor->read_index >= count) {
+            return 0;
+        }
+        if (count - cursor->read_index > GPS_ERROR_RING_SIZE) {
+            cursor->lost += count - GPS_ERROR_RING_SIZE - cursor->read_index;
+            cursor->read_index = count - GPS_ERROR_RING_SIZE;
+        }
+        switch (read_slot(cursor->read_index, error)) {
+            case 1:
+                cursor->read_index++;
+                return 1;
+            case -1:
+                /* claimed but not written yet, it will be there next time */
+                return 0;
+        }
+        cursor->lost++;
+        cursor->read_index++;
+    }
+}
+
+/* short description of an error code */
+const char *gps_error_string(int code) {
+    if (code < 0 || code >= (int) (sizeof(ErrorStrings) / sizeof(ErrorStrings[0]))) {
+        return "unknown error";
+    }
+    return ErrorStrings[code];
+}
+
+/* formats an error as text, returns its length like snprintf() */
+int gps_error_format(const gps_error_t *error, char *buffer, size_t size) {
+    const char *name = error->sentence_type ? "NMEA" : "satgps";
+    char detail[48] = "";
+    int len = 0;
+    int bit;
+
+    for (bit = 0; bit < (int) (sizeof(SentenceNames) / sizeof(SentenceNames[0])); bit++) {
+        if (error->sentence_type == (1 << bit)) {
+            name = SentenceNames[bit];
+            break;
+        }
+    }
+
+    switch (error->code) {
+        case GPS_ERR_CHECKSUM:
+            snprintf(detail, sizeof(detail), ": got %02X, calculated %02X",
+                     (error->value >> 8) & 0xff, error->value & 0xff);
+            break;
+        case GPS_ERR_UBX_CHECKSUM:
+            snprintf(detail, sizeof(detail), ": got %02X %02X, calculated %02X %02X",
+                     (error->value >> 16) & 0xff, (error->value >> 24) & 0xff,
+                     error->value & 0xff, (error->value >> 8) & 0xff);
+            break;
+        case GPS_ERR_BAD_FIELD:
+            snprintf(detail, sizeof(detail), ": '%c'", error->value ? error->value : ' ');
+            break;
+        case GPS_ERR_NO_FIELDS:
+        case GPS_ERR_SENTENCE_NUMBER:
+        case GPS_ERR_HANDLERS_FULL:
+            snprintf(detail, sizeof(detail), ": %d", error->value);
+            break;
+        case GPS_ERR_UBX_LENGTH:
+            snprintf(detail, sizeof(detail), ": NAV 0x%02X", error->value);
+            break;
+    }
+
+    if (error->field >= 0) {
+        len = snprintf(buffer, size, "%s field %d (byte %d): %s%s", name, error->field, error->offset,
+                       gps_error_string(error->code), detail);
+    } else if (error->offset >= 0) {
+        len = snprintf(buffer, size, "%s byte %d: %s%s", name, error->offset,
+                       gps_error_string(error->code), detail);
+    } else {
+        len = snprintf(buffer, size, "%s: %s%s", name, gps_error_string(error->code), detail);
+    }
+    return len;
+}
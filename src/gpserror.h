@@ -0,0 +1,70 @@
+#ifndef GPSERROR_H
+#define GPSERROR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define GPS_ERROR_RING_SIZE         64          /* most recent errors kept, power of 2 */
+#define GPS_ERROR_MAX_STRING        128         /* enough for gps_error_format() */
+#define GPS_ERROR_LATEST_TRIES      4           /* gps_error_latest() rounds before it gives up */
+
+/* error codes */
+#define GPS_ERR_NONE                0
+#define GPS_ERR_NO_CHECKSUM         1           /* no '*' in the sentence */
+#define GPS_ERR_CHECKSUM            2           /* mismatch, value = received << 8 | calculated */
+#define GPS_ERR_NO_FIELDS           3           /* fewer fields than the sentence needs, value = fields found */
+#define GPS_ERR_BAD_FIELD           4           /* unexpected value in field, value = its first character */
+#define GPS_ERR_DATA_VOID           5           /* receiver flagged the data invalid */
+#define GPS_ERR_SENTENCE_NUMBER     6           /* TXT sentence number out of range, value = the number */
+#define GPS_ERR_SENTENCE_TYPE       7           /* parser called with a type it doesn't handle */
+#define GPS_ERR_HANDLERS_FULL       8           /* value = GPS_MAX_FIX_HANDLERS */
+#define GPS_ERR_UBX_CHECKSUM        9           /* value = received CK_B CK_A << 16 | calculated CK_B CK_A */
+#define GPS_ERR_UBX_LENGTH          10          /* payload too short for its message, value = message id */
+
+/*
+ * One parse error
+ *
+ * Recorded as numbers only; gps_error_format() turns it into text when someone
+ * actually wants to read it.
+ * */
+typedef struct {
+    uint64_t            index;                      /* error number, counts from 0 */
+    int                 code;                       /* GPS_ERR_* */
+    int                 sentence_type;              /* filter bit, e.g. GNRMC_MESSAGE, 0 if unknown */
+    int                 field;                      /* NMEA field index, -1 if not tied to a field */
+    int                 offset;                     /* byte offset into the sentence, -1 if unknown */
+    int                 value;                      /* code specific detail */
+} gps_error_t;
+
+/*
+ * Ring of the last GPS_ERROR_RING_SIZE errors
+ *
+ * Any thread may write: the reader thread's UBX framing pushes while the
+ * parsing thread does. A writer claims an error number with one atomic add,
+ * then fills that slot under a sequence counter derived from the number
+ * (2 * index + 1 while writing, 2 * index + 2 once done). Readers copy a slot
+ * and count it as overwritten if the counter moved; they never wait for a
+ * writer, which may be preempted halfway by a higher priority thread. Two writers only
+ * share a slot if the ring wraps during a single push.
+ * */
+typedef struct {
+    _Atomic uint64_t    seq;
+    gps_error_t         error;
+} gps_error_slot_t;
+
+/* reader position for gps_error_next() */
+typedef struct {
+    uint64_t            read_index;
+    unsigned long       lost;                       /* errors overwritten before they were read */
+} gps_error_cursor_t;
+
+void gps_error_push(int, int, int, int, int);
+uint64_t gps_error_count(void);
+int gps_error_latest(gps_error_t *);
+void gps_error_cursor_init(gps_error_cursor_t *);
+int gps_error_next(gps_error_cursor_t *, gps_error_t *);
+int gps_error_format(const gps_error_t *, char *, size_t);
+const char *gps_error_string(int);
+
+#endif /* GPSERROR_H */
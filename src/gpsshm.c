@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "satgps.h"
+#include "gpsshm.h"
+
+/* seqlock writer: counter odd while the data is being changed */
+static unsigned int write_begin(atomic_uint *seq) {
+    unsigned int s = atomic_load_explicit(seq, memory_order_relaxed);
+
+    atomic_store_explicit(seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return s;
+}
+
+static void write_end(atomic_uint *seq, unsigned int s) {
+    atomic_store_explicit(seq, s + 2, memory_order_release);
+}
+
+/* seqlock reader: copies size bytes from src, retrying until they were stable */
+static void read_copy(const atomic_uint *seq, void *dst, const void *src, size_t size) {
+    unsigned int s1, s2;
+
+    do {
+        s1 = atomic_load_explicit((atomic_uint *) seq, memory_order_acquire);
+        memcpy(dst, src, size);
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit((atomic_uint *) seq, memory_order_relaxed);
+    } while ((s1 & 1) || s1 != s2);
+}
+
+/* a slot whose writer died halfway holds a torn fix: mark it overwritten and release it */
+static void repair_slot(gpsshm_slot_t *slot) {
+    unsigned int s = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    if (s & 1) {
+        slot->index = UINT64_MAX;
+        atomic_store_explicit(&slot->seq, s + 1, memory_order_release);
+    }
+}
+
+static void repair_seq(atomic_uint *seq) {
+    unsigned int s = atomic_load_explicit(seq, memory_order_relaxed);
+
+    if (s & 1) {
+        atomic_store_explicit(seq, s + 1, memory_order_release);
+    }
+}
+
+/*
+ * Maps the region a previous publisher left behind, returns -1 if its layout
+ * doesn't match ours
+ *
+ * Clients may still be attached, so nothing is cleared: the fix numbering
+ * carries on from write_index and they keep following the stream.
+ * */
+static int take_over(gpsshm_publisher_t *pub) {
+    gpsshm_region_t *region;
+    struct stat st;
+    int fd, i;
+
+    fd = shm_open(pub->name, O_RDWR, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size != (off_t) sizeof(gpsshm_region_t)) {
+        close(fd);
+        return -1;
+    }
+    region = (gpsshm_region_t *) mmap(NULL, sizeof(gpsshm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        return -1;
+    }
+    if (region->magic != GPSSHM_MAGIC || region->version != GPSSHM_VERSION ||
+        region->ring_size != GPSSHM_RING_SIZE) {
+        munmap(region, sizeof(gpsshm_region_t));
+        return -1;
+    }
+
+    /* the previous publisher may have been killed in the middle of a write */
+    for (i = 0; i < GPSSHM_RING_SIZE; i++) {
+        repair_slot(&region->ring[i]);
+    }
+    repair_seq(&region->sky.seq);
+    repair_seq(&region->stats_seq);
+
+    pub->region = region;
+    return 0;
+}
+
+/*
+ * Creates the shared memory region, or takes over the one a previous
+ * publisher left behind; returns -1 on error
+ *
+ * A region of another layout is unlinked and replaced, so clients still
+ * mapping it are never written with data they would misread.
+ * */
+int gpsshm_create(gpsshm_publisher_t *pub, const char *name) {
+    int fd;
+
+    strncpy(pub->name, name ? name : GPSSHM_DEFAULT_NAME, sizeof(pub->name) - 1);
+    pub->name[sizeof(pub->name) - 1] = '\0';
+
+    fd = shm_open(pub->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        if (take_over(pub) == 0) {
+            return 0;
+        }
+        shm_unlink(pub->name);
+        fd = shm_open(pub->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0) {
+        perror("shm_open");
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(gpsshm_region_t)) < 0) {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+    pub->region = (gpsshm_region_t *) mmap(NULL, sizeof(gpsshm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pub->region == MAP_FAILED) {
+        perror("mmap");
+        pub->region = NULL;
+        return -1;
+    }
+
+    /* nobody can have attached to a region this new yet */
+    memset(pub->region, 0, sizeof(gpsshm_region_t));
+    pub->region->ring_size = GPSSHM_RING_SIZE;
+    pub->region->version = GPSSHM_VERSION;
+    atomic_thread_fence(memory_order_release);
+    pub->region->magic = GPSSHM_MAGIC;
+    return 0;
+}
+
+void gpsshm_destroy(gpsshm_publisher_t *pub) {
+    if (pub->region != NULL) {
+        munmap(pub->region, sizeof(gpsshm_region_t));
+        shm_unlink(pub->name);
+        pub->region = NULL;
+    }
+}
+
+void gpsshm_publish_fix(gpsshm_publisher_t *pub, const gps_fix_t *fix) {
+    uint64_t index = atomic_load_explicit(&pub->region->write_index, memory_order_relaxed);
+    gpsshm_slot_t *slot = &pub->region->ring[index & (GPSSHM_RING_SIZE - 1)];
+    unsigned int s;
+
+    s = write_begin(&slot->seq);
+    slot->index = index;
+    slot->fix = *fix;
+    write_end(&slot->seq, s);
+
+    atomic_store_explicit(&pub->region->write_index, index + 1, memory_order_release);
+}
+
+/* copies the current GSV tables */
+void gpsshm_publish_sky(gpsshm_publisher_t *pub) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+    unsigned int s;
+
+    s = write_begin(&pub->region->sky.seq);
+    if (gps_data->GsvDataGps != NULL) {
+        pub->region->sky.gps = *gps_data->GsvDataGps;
+    }
+    if (gps_data->GsvDataGlonass != NULL) {
+        pub->region->sky.glonass = *gps_data->GsvDataGlonass;
+    }
+    write_end(&pub->region->sky.seq, s);
+}
+
+void gpsshm_publish_stats(gpsshm_publisher_t *pub, const gpsshm_stats_t *stats) {
+    unsigned int s;
+
+    s = write_begin(&pub->region->stats_seq);
+    pub->region->stats = *stats;
+    write_end(&pub->region->stats_seq, s);
+}
+
+/* for gps_add_fix_handler(gpsshm_fix_handler, &pub): the fix and the sky view with it */
+void gpsshm_fix_handler(const gps_fix_t *fix, void *arg) {
+    gpsshm_publisher_t *pub = (gpsshm_publisher_t *) arg;
+
+    gpsshm_publish_fix(pub, fix);
+    gpsshm_publish_sky(pub);
+}
+
+/* maps a publisher's region read-only, returns -1 if it doesn't exist or doesn't match */
+int gpsshm_attach(gpsshm_client_t *client, const char *name) {
+    const gpsshm_region_t *region;
+    int fd;
+
+    fd = shm_open(name ? name : GPSSHM_DEFAULT_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    region = (const gpsshm_region_t *) mmap(NULL, sizeof(gpsshm_region_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        return -1;
+    }
+    if (region->magic != GPSSHM_MAGIC || region->version != GPSSHM_VERSION ||
+        region->ring_size != GPSSHM_RING_SIZE) {
+        munmap((void *) region, sizeof(gpsshm_region_t));
+        return -1;
+    }
+
+    client->region = region;
+    client->read_index = atomic_load_explicit((_Atomic uint64_t *) &region->write_index, memory_order_acquire);
+    client->lost = 0;
+    return 0;
+}
+
+void gpsshm_detach(gpsshm_client_t *client) {
+    if (client->region != NULL) {
+        munmap((void *) client->region, sizeof(gpsshm_region_t));
+        client->region = NULL;
+    }
+}
+
+/* reads fix number index, returns 0 if it has been overwritten meanwhile */
+static int read_slot(const gpsshm_region_t *region, uint64_t index, gps_fix_t *fix) {
+    const gpsshm_slot_t *slot = &region->ring[index & (GPSSHM_RING_SIZE - 1)];
+    gpsshm_slot_t copy;
+
+    read_copy(&slot->seq, &copy, slot, sizeof(gpsshm_slot_t));
+    if (copy.index != index) {
+        return 0;
+    }
+    *fix = copy.fix;
+    return 1;
+}
+
+/* most recent fix, returns 0 if none was published yet */
+int gpsshm_latest(gpsshm_client_t *client, gps_fix_t *fix) {
+    uint64_t write_index;
+
+    do {
+        write_index = atomic_load_explicit((_Atomic uint64_t *) &client->region->write_index, memory_order_acquire);
+        if (write_index == 0) {
+            return 0;
+        }
+    } while (!read_slot(client->region, write_index - 1, fix));
+    return 1;
+}
+
+/*
+ * Next fix in the stream after the last one this client read
+ *
+ * Returns 1 with a fix, 0 if there is nothing new. A client that falls more
+ * than GPSSHM_RING_SIZE fixes behind skips ahead and counts the gap in lost.
+ * */
+int gpsshm_next(gpsshm_client_t *client, gps_fix_t *fix) {
+    uint64_t write_index;
+
+    for (;;) {
+        write_index = atomic_load_explicit((_Atomic uint64_t *) &client->region->write_index, memory_order_acquire);
+        if (client->read_index >= write_index) {
+            return 0;
+        }
+        if (write_index - client->read_index > GPSSHM_RING_SIZE) {
+            client->lost += write_index - GPSSHM_RING_SIZE - client->read_index;
+            client->read_index = write_index - GPSSHM_RING_SIZE;
+        }
+        if (read_slot(client->region, client->read_index, fix)) {
+            client->read_index++;
+            return 1;
+        }
+        /* overwritten while we looked: the publisher lapped us, go around again */
+        client->lost++;
+        client->read_index++;
+    }
+}
+
+void gpsshm_sky(gpsshm_client_t *client, gsv_data_t *gps, gsv_data_t *glonass) {
+    gpsshm_sky_t copy;
+
+    read_copy(&client->region->sky.seq, &copy, &client->region->sky, sizeof(gpsshm_sky_t));
+    if (gps != NULL) {
+        *gps = copy.gps;
+    }
+    if (glonass != NULL) {
+        *glonass = copy.glonass;
+    }
+}
+
+void gpsshm_stats(gpsshm_client_t *client, gpsshm_stats_t *stats) {
+    read_copy(&client->region->stats_seq, stats, &client->region->stats, sizeof(gpsshm_stats_t));
+}
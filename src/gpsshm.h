@@ -0,0 +1,78 @@
+#ifndef GPSSHM_H
+#define GPSSHM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "satgps.h"
+
+#define GPSSHM_DEFAULT_NAME     "/satgps"
+#define GPSSHM_MAGIC            0x53475053  /* "SGPS" */
+#define GPSSHM_VERSION          2
+#define GPSSHM_RING_SIZE        256         /* fixes kept for tailing clients, power of 2 */
+
+/*
+ * Shared memory layout
+ *
+ * One publisher writes, any number of clients map the region read-only. Every
+ * slot has its own sequence counter (odd while being written), so readers copy
+ * a slot and retry if it changed underneath them; they never make a syscall.
+ * */
+typedef struct {
+    atomic_uint         seq;
+    uint64_t            index;                      /* fix number stored in this slot */
+    gps_fix_t           fix;
+} gpsshm_slot_t;
+
+typedef struct {
+    atomic_uint         seq;
+    gsv_data_t          gps;                        /* $GPGSV satellites */
+    gsv_data_t          glonass;                    /* $GLGSV satellites */
+} gpsshm_sky_t;
+
+typedef struct {
+    unsigned long       sentences;                  /* sentences read */
+    unsigned long       errors;                     /* sentences rejected */
+    unsigned long       fixes;                      /* fixes published */
+    unsigned long       dropped;                    /* sentences dropped or replaced by the reader queue */
+} gpsshm_stats_t;
+
+typedef struct {
+    uint32_t            magic;
+    uint32_t            version;
+    uint32_t            ring_size;
+    _Atomic uint64_t    write_index;                /* fixes published so far */
+    gpsshm_slot_t       ring[GPSSHM_RING_SIZE];
+    gpsshm_sky_t        sky;
+    atomic_uint         stats_seq;
+    gpsshm_stats_t      stats;
+} gpsshm_region_t;
+
+/* publisher side */
+typedef struct {
+    gpsshm_region_t     *region;
+    char                name[64];
+} gpsshm_publisher_t;
+
+/* client side */
+typedef struct {
+    const gpsshm_region_t *region;
+    uint64_t            read_index;                 /* next fix to read with gpsshm_next() */
+    unsigned long       lost;                       /* fixes overwritten before this client read them */
+} gpsshm_client_t;
+
+int gpsshm_create(gpsshm_publisher_t *, const char *);
+void gpsshm_destroy(gpsshm_publisher_t *);
+void gpsshm_publish_fix(gpsshm_publisher_t *, const gps_fix_t *);
+void gpsshm_publish_sky(gpsshm_publisher_t *);
+void gpsshm_publish_stats(gpsshm_publisher_t *, const gpsshm_stats_t *);
+void gpsshm_fix_handler(const gps_fix_t *, void *);
+
+int gpsshm_attach(gpsshm_client_t *, const char *);
+void gpsshm_detach(gpsshm_client_t *);
+int gpsshm_latest(gpsshm_client_t *, gps_fix_t *);
+int gpsshm_next(gpsshm_client_t *, gps_fix_t *);
+void gpsshm_sky(gpsshm_client_t *, gsv_data_t *, gsv_data_t *);
+void gpsshm_stats(gpsshm_client_t *, gpsshm_stats_t *);
+
+#endif /* GPSSHM_H */
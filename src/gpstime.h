@@ -0,0 +1,59 @@
+#ifndef GPSTIME_H
+#define GPSTIME_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define NSEC_PER_SEC    1000000000LL
+#define SEC_PER_DAY     86400LL
+
+/*
+ * Calendar conversions without mktime()/timegm()
+ *
+ * Pure integer arithmetic (H. Hinnant's days_from_civil), so they touch no
+ * timezone state and fold to constants when the arguments are constant.
+ * */
+
+/* days since 1970-01-01 of a proleptic Gregorian date, month 1-12 */
+static inline int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+    int64_t era;
+    unsigned yoe, doy, doe;
+
+    year -= month <= 2;
+    era = (year >= 0 ? year : year - 399) / 400;
+    yoe = (unsigned) (year - era * 400);
+    doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (int64_t) doe - 719468;
+}
+
+/* inverse of days_from_civil() */
+static inline void civil_from_days(int64_t days, int64_t *year, unsigned *month, unsigned *day) {
+    int64_t era;
+    unsigned doe, yoe, doy, mp;
+
+    days += 719468;
+    era = (days >= 0 ? days : days - 146096) / 146097;
+    doe = (unsigned) (days - era * 146097);
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (int64_t) yoe + era * 400 + (*month <= 2);
+}
+
+/* UTC nanoseconds since the Unix epoch */
+static inline int64_t gps_epoch_ns(int64_t days, int64_t seconds_of_day, int64_t usec) {
+    return (days * SEC_PER_DAY + seconds_of_day) * NSEC_PER_SEC + usec * 1000;
+}
+
+/* timegm() replacement for a valid struct tm (tm_year since 1900, tm_mon 0-11) */
+static inline int64_t gps_timegm_ns(const struct tm *tm) {
+    return gps_epoch_ns(days_from_civil(tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday),
+                        tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec, 0);
+}
+
+#endif /* GPSTIME_H */
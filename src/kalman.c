@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "geodesy.h"
+#include "kalman.h"
+
+#define DEG2RAD     (M_PI / 180.0)
+#define RAD2DEG     (180.0 / M_PI)
+
+/* relative position error per GGA quality indicator */
+static double quality_scale(int gps_quality) {
+    switch (gps_quality) {
+        case 2: /* differential */
+            return 0.5;
+        case 4: /* RTK fixed */
+            return 0.02;
+        case 5: /* RTK float */
+            return 0.2;
+        case 6: /* dead reckoning */
+            return 5.0;
+        default:
+            return 1.0;
+    }
+}
+
+/* moves the tangent plane to latitude/longitude */
+static void kalman_set_reference(kalman_t *kf, double latitude, double longitude, double altitude) {
+    double sin_lat = sin(latitude * DEG2RAD);
+    double w = sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+
+    kf->ref_latitude = latitude;
+    kf->ref_longitude = longitude;
+    kf->meridian_radius = WGS84_A * (1.0 - WGS84_E2) / (w * w * w) + altitude;
+    kf->parallel_radius = (WGS84_A / w + altitude) * cos(latitude * DEG2RAD);
+}
+
+/* x = F x, P = F P F' + Q for the constant-velocity model */
+static void kalman_predict(kalman_t *kf, int axis, double dt) {
+    double (*P)[2] = kf->P[axis];
+    double q = kf->accel_noise;
+
+    kf->x[axis][0] += kf->x[axis][1] * dt;
+
+    P[0][0] += dt * (P[0][1] + P[1][0]) + dt * dt * P[1][1] + q * dt * dt * dt / 3.0;
+    P[0][1] += dt * P[1][1] + q * dt * dt / 2.0;
+    P[1][0] = P[0][1];
+    P[1][1] += q * dt;
+}
+
+/* scalar measurement z of state component i with variance r */
+static void kalman_correct(kalman_t *kf, int axis, int i, double z, double r) {
+    double (*P)[2] = kf->P[axis];
+    double pi0 = P[i][0], pi1 = P[i][1];
+    double s = P[i][i] + r;
+    double k0 = P[0][i] / s;
+    double k1 = P[1][i] / s;
+    double y = z - kf->x[axis][i];
+
+    kf->x[axis][0] += k0 * y;
+    kf->x[axis][1] += k1 * y;
+
+    P[0][0] -= k0 * pi0;
+    P[0][1] -= k0 * pi1;
+    P[1][0] -= k1 * pi0;
+    P[1][1] -= k1 * pi1;
+}
+
+/* fills latitude, longitude... from the filter state */
+static void kalman_output(kalman_t *kf) {
+    kf->latitude = kf->ref_latitude + kf->x[KALMAN_NORTH][0] / kf->meridian_radius * RAD2DEG;
+    kf->longitude = kf->ref_longitude + kf->x[KALMAN_EAST][0] / kf->parallel_radius * RAD2DEG;
+    if (kf->longitude > 180.0) kf->longitude -= 360.0;
+    if (kf->longitude < -180.0) kf->longitude += 360.0;
+    kf->altitude = kf->x[KALMAN_UP][0];
+
+    kf->velocity[KALMAN_EAST] = kf->x[KALMAN_EAST][1];
+    kf->velocity[KALMAN_NORTH] = kf->x[KALMAN_NORTH][1];
+    kf->velocity[KALMAN_UP] = kf->x[KALMAN_UP][1];
+    kf->speed = hypot(kf->velocity[KALMAN_EAST], kf->velocity[KALMAN_NORTH]);
+    kf->track_angle = atan2(kf->velocity[KALMAN_EAST], kf->velocity[KALMAN_NORTH]) * RAD2DEG;
+    if (kf->track_angle < 0.0) kf->track_angle += 360.0;
+}
+
+/* sets the default noise model; the filter starts on the first valid fix */
+void kalman_init(kalman_t *kf) {
+    memset(kf, 0, sizeof(kalman_t));
+    kf->uere = KALMAN_DEFAULT_UERE;
+    kf->accel_noise = KALMAN_DEFAULT_ACCEL_NOISE;
+    kf->speed_noise = KALMAN_DEFAULT_SPEED_NOISE;
+}
+
+/*
+ * Feeds one fix to the filter
+ *
+ * Position noise is UERE * DOP, scaled by the GGA quality. DOPs come from GSA
+ * when it is filtered (HDOP and VDOP), otherwise from the GGA HDOP. RMC (or
+ * NAV-PVT) speed/track is used as a velocity measurement. Returns -1 if the fix
+ * was not used.
+ * */
+int kalman_update(kalman_t *kf, const gps_fix_t *fix) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+    double hdop = fix->HDOP, vdop = 0.0;
+    double sigma_h, sigma_v, dt, track;
+    double z[3];
+    int axis;
+
+    if (!fix->valid) {
+        return -1;
+    }
+
+    if (gps_data->GsaDataGn != NULL && gps_data->GsaDataGn->HDOP > 0.0) {
+        hdop = gps_data->GsaDataGn->HDOP;
+        vdop = gps_data->GsaDataGn->VDOP;
+    }
+    if (hdop <= 0.0) {
+        hdop = 1.0;
+    }
+    if (vdop <= 0.0) {
+        vdop = 1.5 * hdop;
+    }
+    sigma_h = kf->uere * hdop * quality_scale(fix->gps_quality);
+    sigma_v = kf->uere * vdop * quality_scale(fix->gps_quality);
+
+    dt = (fix->utc_epoch_ns - kf->utc_epoch_ns) / (double) NSEC_PER_SEC;
+
+    if (!kf->initialized || dt <= 0.0 || dt > KALMAN_MAX_GAP) {
+        kalman_set_reference(kf, fix->latitude, fix->longitude, fix->altitude);
+        memset(kf->x, 0, sizeof(kf->x));
+        memset(kf->P, 0, sizeof(kf->P));
+        for (axis = 0; axis < 3; axis++) {
+            kf->P[axis][0][0] = axis == KALMAN_UP ? sigma_v * sigma_v : sigma_h * sigma_h;
+            kf->P[axis][1][1] = 100.0;  /* velocity unknown, 10 m/s */
+        }
+        kf->x[KALMAN_UP][0] = fix->altitude;
+        dt = 0.0;
+        kf->initialized = 1;
+    }
+    kf->utc_epoch_ns = fix->utc_epoch_ns;
+
+    /* keep the flat-earth approximation local */
+    if (fabs(kf->x[KALMAN_EAST][0]) > KALMAN_MAX_OFFSET || fabs(kf->x[KALMAN_NORTH][0]) > KALMAN_MAX_OFFSET) {
+        kalman_output(kf);
+        kalman_set_reference(kf, kf->latitude, kf->longitude, kf->altitude);
+        kf->x[KALMAN_EAST][0] = 0.0;
+        kf->x[KALMAN_NORTH][0] = 0.0;
+    }
+
+    z[KALMAN_EAST] = remainder(fix->longitude - kf->ref_longitude, 360.0) * DEG2RAD * kf->parallel_radius;
+    z[KALMAN_NORTH] = (fix->latitude - kf->ref_latitude) * DEG2RAD * kf->meridian_radius;
+    z[KALMAN_UP] = fix->altitude;
+
+    for (axis = 0; axis < 3; axis++) {
+        if (dt > 0.0) {
+            kalman_predict(kf, axis, dt);
+        }
+    }
+
+    kalman_correct(kf, KALMAN_EAST, 0, z[KALMAN_EAST], sigma_h * sigma_h);
+    kalman_correct(kf, KALMAN_NORTH, 0, z[KALMAN_NORTH], sigma_h * sigma_h);
+
+    /* altitude only comes with GGA or NAV-PVT */
+    if (fix->sources & (GNGGA_MESSAGE | UBX_MESSAGE)) {
+        kalman_correct(kf, KALMAN_UP, 0, z[KALMAN_UP], sigma_v * sigma_v);
+    }
+
+    /* RMC or NAV-PVT speed and track as a velocity measurement */
+    if (fix->sources & (GNRMC_MESSAGE | UBX_MESSAGE)) {
+        track = fix->track_angle * DEG2RAD;
+        kalman_correct(kf, KALMAN_EAST, 1, fix->speed * sin(track), kf->speed_noise * kf->speed_noise);
+        kalman_correct(kf, KALMAN_NORTH, 1, fix->speed * cos(track), kf->speed_noise * kf->speed_noise);
+    }
+
+    kalman_output(kf);
+    return 0;
+}
+
+/* for gps_add_fix_handler(kalman_fix_handler, &kf) */
+void kalman_fix_handler(const gps_fix_t *fix, void *arg) {
+    kalman_update((kalman_t *) arg, fix);
+}
@@ -0,0 +1,56 @@
+#ifndef KALMAN_H
+#define KALMAN_H
+
+#include "satgps.h"
+
+#define KALMAN_DEFAULT_UERE         5.0             /* user equivalent range error in meters (1 sigma) */
+#define KALMAN_DEFAULT_ACCEL_NOISE  1.0             /* white acceleration spectral density, m^2/s^3 */
+#define KALMAN_DEFAULT_SPEED_NOISE  0.2             /* RMC speed/track noise in m/s (1 sigma) */
+#define KALMAN_MAX_GAP              10.0            /* seconds without a fix before the filter restarts */
+#define KALMAN_MAX_OFFSET           10000.0         /* meters from the reference before it is moved */
+
+/* axes of the local tangent plane */
+#define KALMAN_EAST     0
+#define KALMAN_NORTH    1
+#define KALMAN_UP       2
+
+/*
+ * Constant-velocity Kalman smoother
+ *
+ * Each axis of a local East-North-Up plane carries a [position, velocity]
+ * state with its own 2x2 covariance. The measurement noise is isotropic
+ * horizontally, so the axes stay independent and every update is a handful of
+ * scalar operations on fixed-size arrays, with no allocation.
+ * */
+typedef struct {
+    /* configuration */
+    double              uere;                       /* meters, scaled by DOP for the position noise */
+    double              accel_noise;                /* m^2/s^3 */
+    double              speed_noise;                /* m/s */
+
+    /* smoothed output */
+    int                 initialized;                /* 0 until the first valid fix */
+    int64_t             utc_epoch_ns;               /* time of the last update */
+    double              latitude;                   /* in degrees */
+    double              longitude;                  /* in degrees */
+    double              altitude;                   /* in meters */
+    double              velocity[3];                /* east, north, up in m/s */
+    double              speed;                      /* horizontal speed in m/s */
+    double              track_angle;                /* in degrees */
+
+    /* filter state per axis: x = [position, velocity], P = covariance */
+    double              x[3][2];
+    double              P[3][2][2];
+
+    /* local tangent plane reference */
+    double              ref_latitude;
+    double              ref_longitude;
+    double              meridian_radius;            /* meters per radian of latitude */
+    double              parallel_radius;            /* meters per radian of longitude */
+} kalman_t;
+
+void kalman_init(kalman_t *);
+int kalman_update(kalman_t *, const gps_fix_t *);
+void kalman_fix_handler(const gps_fix_t *, void *);
+
+#endif /* KALMAN_H */
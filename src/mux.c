@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <netdb.h>
+
+#include "satgps.h"
+#include "mux.h"
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+/* counts[] index: 0 for unknown sentences, 1 + bit number otherwise */
+static int type_bucket(int type) {
+    return __builtin_ffs(type);
+}
+
+void mux_init(mux_t *mux, int flags) {
+    memset(mux, 0, sizeof(mux_t));
+    mux->flags = flags;
+}
+
+/* reads from an open fd (stdin, a pipe, a pty...), returns -1 if there is no room */
+int mux_add_fd(mux_t *mux, int fd) {
+    mux_input_t *in;
+
+    if (mux->num_inputs == MUX_MAX_INPUTS) {
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    in = &mux->inputs[mux->num_inputs++];
+    memset(in, 0, sizeof(mux_input_t));
+    in->fd = fd;
+    return 0;
+}
+
+/* opens a serial port, pty or FIFO; ttys are put in raw mode at their current speed. Returns -1 on error */
+int mux_add_device(mux_t *mux, const char *path) {
+    struct termios tty;
+    int fd;
+
+    if (mux->num_inputs == MUX_MAX_INPUTS) {
+        return -1;
+    }
+    fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        printf("Error opening %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (isatty(fd) && tcgetattr(fd, &tty) == 0) {
+        cfmakeraw(&tty);
+        tty.c_cflag |= (CLOCAL | CREAD);
+        tty.c_cc[VMIN] = 1;
+        tty.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    return mux_add_fd(mux, fd);
+}
+
+/* listens for NMEA datagrams on port, returns -1 on error */
+int mux_add_udp(mux_t *mux, int port) {
+    net_source_t *net;
+
+    if (mux->num_inputs == MUX_MAX_INPUTS) {
+        return -1;
+    }
+    net = (net_source_t *) malloc(sizeof(net_source_t));
+    if (net == NULL) {
+        return -1;
+    }
+    if (net_open_udp(net, port) < 0) {
+        free(net);
+        return -1;
+    }
+    mux_add_fd(mux, net->fd);
+    mux->inputs[mux->num_inputs - 1].net = net;
+    return 0;
+}
+
+static mux_output_t *new_output(mux_t *mux, int fd, const mux_output_config_t *config) {
+    mux_output_t *out;
+    int i;
+
+    if (mux->num_outputs == MUX_MAX_OUTPUTS) {
+        return NULL;
+    }
+    out = &mux->outputs[mux->num_outputs++];
+    memset(out, 0, sizeof(mux_output_t));
+    out->fd = fd;
+    if (config != NULL) {
+        out->config = *config;
+    } else {
+        out->config.types = MUX_ALL;
+    }
+    if (out->config.decimate < 1) {
+        out->config.decimate = 1;
+    }
+    out->keep_gsv[0] = out->keep_gsv[1] = 1;
+
+    for (i = 0; i < MUX_BATCH; i++) {
+        out->msgs[i].msg_hdr.msg_iov = &out->iov[i];
+        out->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return out;
+}
+
+/* writes to an open fd (stdout, a file, a pty...), config NULL passes everything; returns -1 if there is no room */
+int mux_add_output(mux_t *mux, int fd, const mux_output_config_t *config) {
+    return new_output(mux, fd, config) == NULL ? -1 : 0;
+}
+
+/* sends a datagram per sentence to host:port, returns -1 on error */
+int mux_add_output_udp(mux_t *mux, const char *host, int port, const mux_output_config_t *config) {
+    struct addrinfo hints, *res, *ai;
+    char service[16];
+    int fd = -1;
+
+    if (mux->num_outputs == MUX_MAX_OUTPUTS) {
+        return -1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0) {
+        printf("Error resolving %s\n", host);
+        return -1;
+    }
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        printf("Error connecting UDP socket to %s:%d: %s\n", host, port, strerror(errno));
+        return -1;
+    }
+
+    new_output(mux, fd, config)->udp = 1;
+    return 0;
+}
+
+/* writes the pending batch in as few syscalls as the fd allows */
+static void output_flush(mux_output_t *out) {
+    struct iovec *iov = out->iov;
+    int count = out->pending;
+    int sent = 0;
+    ssize_t n;
+
+    if (count == 0) {
+        return;
+    }
+
+    if (out->udp) {
+        while (sent < count) {
+            n = sendmmsg(out->fd, out->msgs + sent, count - sent, 0);
+            out->writes++;
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            sent += n;
+        }
+        out->sentences += sent;
+        out->dropped += count - sent;
+        out->pending = 0;
+        return;
+    }
+
+    while (count > 0) {
+        n = writev(out->fd, iov, count);
+        out->writes++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        /* skip what went out; a sentence written in part continues where it stopped */
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+            out->sentences++;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    out->dropped += count;
+    out->pending = 0;
+}
+
+static void flush_outputs(mux_t *mux) {
+    int i;
+
+    for (i = 0; i < mux->num_outputs; i++) {
+        output_flush(&mux->outputs[i]);
+    }
+}
+
+/*
+ * Queues one sentence of body bytes (up to the checksum) for out
+ *
+ * length also counts the original line ending. Unless the talker changes or
+ * the line didn't end in '\n', the iovec points at the input buffer.
+ * */
+static void output_queue(mux_output_t *out, char *line, size_t body, size_t length, unsigned char checksum) {
+    struct iovec *iov = &out->iov[out->pending];
+    char *copy = out->scratch[out->pending];
+    const char *talker = out->config.talker;
+
+    if (talker[0] != '\0' && line[1] != 'P' && (line[1] != talker[0] || line[2] != talker[1])) {
+        memcpy(copy, line, body);
+        copy[1] = talker[0];
+        copy[2] = talker[1];
+        /* XOR checksum: take the old talker out, put the new one in */
+        checksum ^= line[1] ^ line[2] ^ talker[0] ^ talker[1];
+        copy[body - 2] = HexDigits[checksum >> 4];
+        copy[body - 1] = HexDigits[checksum & 0xf];
+        copy[body] = '\r';
+        copy[body + 1] = '\n';
+        iov->iov_base = copy;
+        iov->iov_len = body + 2;
+        out->rewritten++;
+    } else if (line[length - 1] == '\n') {
+        iov->iov_base = line;
+        iov->iov_len = length;
+    } else {
+        memcpy(copy, line, body);
+        copy[body] = '\r';
+        copy[body + 1] = '\n';
+        iov->iov_base = copy;
+        iov->iov_len = body + 2;
+        out->rewritten++;
+    }
+
+    if (++out->pending == MUX_BATCH) {
+        output_flush(out);
+    }
+}
+
+/* checks one line and hands it to every output that wants it */
+static void mux_line(mux_t *mux, mux_input_t *in, char *line, size_t length) {
+    char text[MUX_MAX_SENTENCE];
+    size_t body = length;
+    char *star, *comma;
+    int high, low, type, bucket, keep, i;
+    int gsv = -1, cycle_start = 0;
+    unsigned char checksum;
+    mux_output_t *out;
+
+    while (body > 0 && (line[body - 1] == '\n' || line[body - 1] == '\r')) {
+        body--;
+    }
+    if (body == 0) {
+        return;
+    }
+    if (body > MUX_MAX_SENTENCE) {
+        in->overlong++;
+        return;
+    }
+
+    /* $ttsss,...*hh */
+    star = line + body - 3;
+    if (body < 9 || line[0] != '$' || *star != '*') {
+        in->invalid++;
+        return;
+    }
+    high = hexchar2int(star[1]);
+    low = hexchar2int(star[2]);
+    checksum = nmea_checksum(line + 1, body - 4);
+    if (high < 0 || low < 0 || checksum != (high << 4 | low)) {
+        in->invalid++;
+        return;
+    }
+    in->sentences++;
+
+    type = gps_sentence_type(line);
+    bucket = type_bucket(type);
+    if (type == GPGSV_MESSAGE || type == GLGSV_MESSAGE) {
+        /* GSV cycles are decimated whole, decided on message 1: $GPGSV,3,1,... */
+        gsv = type == GPGSV_MESSAGE ? 0 : 1;
+        comma = memchr(line + 7, ',', body - 7);
+        cycle_start = comma != NULL && comma[1] == '1' && comma[2] == ',';
+    }
+
+    for (i = 0; i < mux->num_outputs; i++) {
+        out = &mux->outputs[i];
+        if (!(out->config.types & (type ? type : MUX_UNKNOWN))) {
+            continue;
+        }
+        if (out->config.decimate > 1) {
+            if (gsv >= 0) {
+                if (cycle_start) {
+                    out->keep_gsv[gsv] = out->counts[bucket]++ % out->config.decimate == 0;
+                }
+                keep = out->keep_gsv[gsv];
+            } else {
+                keep = out->counts[bucket]++ % out->config.decimate == 0;
+            }
+            if (!keep) {
+                out->decimated++;
+                continue;
+            }
+        }
+        output_queue(out, line, body, length, checksum);
+    }
+
+    if ((mux->flags & MUX_PARSE) && gps_is_filtered(type)) {
+        /* what checksum_valid() would have left */
+        memcpy(text, line, body - 3);
+        text[body - 3] = '\0';
+        parse_sentence(text);
+    }
+}
+
+/* one read() from a device; returns -1 at end of file or on error */
+static int read_device(mux_t *mux, mux_input_t *in) {
+    char *start, *newline, *end;
+    ssize_t n;
+
+    n = read(in->fd, in->buffer + in->length, MUX_BUFFER_SIZE - in->length);
+    if (n <= 0) {
+        return n < 0 && (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    in->bytes += n;
+
+    start = in->buffer;
+    end = in->buffer + in->length + n;
+    while ((newline = memchr(start, '\n', end - start)) != NULL) {
+        mux_line(mux, in, start, newline + 1 - start);
+        start = newline + 1;
+    }
+
+    /* the batch points into the buffer, send it before the partial line moves */
+    flush_outputs(mux);
+    in->length = end - start;
+    if (in->length == MUX_BUFFER_SIZE) {
+        in->overlong++;
+        in->length = 0;
+    } else {
+        memmove(in->buffer, start, in->length);
+    }
+    return 0;
+}
+
+/* one recvmmsg() batch; each datagram holds whole lines */
+static int read_udp(mux_t *mux, mux_input_t *in) {
+    net_source_t *net = in->net;
+    char *data, *start, *newline, *end;
+    int n, i;
+
+    n = recvmmsg(net->fd, net->msgs, NET_BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    }
+    net->datagrams += n;
+    net->batches++;
+
+    for (i = 0; i < n; i++) {
+        data = net->datagram[i];
+        end = data + net->msgs[i].msg_len;
+        in->bytes += net->msgs[i].msg_len;
+        for (start = data; start < end; start = newline) {
+            newline = memchr(start, '\n', end - start);
+            newline = newline != NULL ? newline + 1 : end;
+            mux_line(mux, in, start, newline - start);
+        }
+    }
+    flush_outputs(mux);
+    return 0;
+}
+
+/*
+ * Waits up to timeout_ms (-1 forever) for input and forwards it
+ *
+ * Returns the number of valid sentences read, or -1 once every input has
+ * reached end of file or failed.
+ * */
+int mux_poll(mux_t *mux, int timeout_ms) {
+    struct pollfd fds[MUX_MAX_INPUTS];
+    unsigned long before = 0, after = 0;
+    mux_input_t *in;
+    int i, open = 0, result;
+
+    for (i = 0; i < mux->num_inputs; i++) {
+        fds[i].fd = mux->inputs[i].fd;
+        fds[i].events = POLLIN;
+        open += fds[i].fd >= 0;
+        before += mux->inputs[i].sentences;
+    }
+    if (open == 0) {
+        return -1;
+    }
+
+    if (poll(fds, mux->num_inputs, timeout_ms) < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (i = 0; i < mux->num_inputs; i++) {
+        in = &mux->inputs[i];
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+        result = in->net != NULL ? read_udp(mux, in) : read_device(mux, in);
+        if (result < 0) {
+            close(in->fd);
+            in->fd = -1;
+        }
+    }
+
+    for (i = 0; i < mux->num_inputs; i++) {
+        after += mux->inputs[i].sentences;
+    }
+    return (int) (after - before);
+}
+
+/* closes every input and output, including fds passed in */
+void mux_close(mux_t *mux) {
+    int i;
+
+    for (i = 0; i < mux->num_inputs; i++) {
+        if (mux->inputs[i].fd >= 0) {
+            close(mux->inputs[i].fd);
+            mux->inputs[i].fd = -1;
+        }
+        free(mux->inputs[i].net);
+        mux->inputs[i].net = NULL;
+    }
+    for (i = 0; i < mux->num_outputs; i++) {
+        output_flush(&mux->outputs[i]);
+        close(mux->outputs[i].fd);
+    }
+    mux->num_inputs = 0;
+    mux->num_outputs = 0;
+}
@@ -0,0 +1,95 @@
+#ifndef MUX_H
+#define MUX_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "satgps.h"
+#include "net.h"
+
+#define MUX_MAX_INPUTS              8
+#define MUX_MAX_OUTPUTS             8
+#define MUX_BATCH                   64          /* sentences per writev()/sendmmsg() */
+#define MUX_BUFFER_SIZE             4096        /* bytes taken from a device per read() */
+#define MUX_MAX_SENTENCE            128         /* longer lines are dropped, NMEA allows 82 */
+#define MUX_TYPES                   10          /* decimation counters: unknown, then one per filter bit */
+
+/* sentence types an output passes: filter bits from satgps.h, plus */
+#define MUX_UNKNOWN                 1<<15       /* valid sentences gps_sentence_type() doesn't know */
+#define MUX_ALL                     0xffff
+
+/* mux_init() flags */
+#define MUX_PARSE                   1           /* also parse_sentence() every valid line */
+
+/* what one output receives */
+typedef struct {
+    unsigned int        types;                      /* MUX_ALL, or filter bits | MUX_UNKNOWN */
+    int                 decimate;                   /* keep every Nth sentence (GSV: cycle) of each type, 0 or 1 keeps all */
+    char                talker[3];                  /* e.g. "GP" to rewrite GNRMC to GPRMC, "" keeps the original */
+} mux_output_config_t;
+
+typedef struct {
+    int                 fd;
+    net_source_t        *net;                       /* UDP inputs, NULL for devices */
+    char                buffer[MUX_BUFFER_SIZE];
+    size_t              length;                     /* bytes of a partial line carried over */
+
+    unsigned long       bytes;
+    unsigned long       sentences;                  /* valid sentences */
+    unsigned long       invalid;                    /* bad framing or checksum */
+    unsigned long       overlong;                   /* longer than MUX_MAX_SENTENCE */
+} mux_input_t;
+
+typedef struct {
+    int                 fd;
+    int                 udp;                        /* connected UDP socket: a datagram per sentence */
+    mux_output_config_t config;
+    unsigned long       counts[MUX_TYPES];          /* sentences (GSV: cycles) seen per type, for decimation */
+    int                 keep_gsv[2];                /* decision for the current GPGSV and GLGSV cycle */
+
+    /* pending batch; unmodified sentences point into the input buffer */
+    struct iovec        iov[MUX_BATCH];
+    struct mmsghdr      msgs[MUX_BATCH];
+    char                scratch[MUX_BATCH][MUX_MAX_SENTENCE + 2];
+    int                 pending;
+
+    unsigned long       sentences;                  /* written */
+    unsigned long       rewritten;                  /* of those, with a new talker or line ending */
+    unsigned long       decimated;
+    unsigned long       dropped;                    /* lost to write errors */
+    unsigned long       writes;                     /* syscalls */
+} mux_output_t;
+
+/*
+ * NMEA multiplexer
+ *
+ * Merges sentences from devices (serial ports, ptys, pipes) and UDP ports,
+ * checks each line once, and re-emits the valid ones to every output whose
+ * type filter and decimation let it through. Sentences that go out unchanged
+ * are written straight from the input buffer with writev()/sendmmsg(), a batch
+ * per syscall; only a talker rewrite copies the line, and then its checksum is
+ * patched rather than recomputed. With MUX_PARSE the same pass feeds the
+ * library, so a process can mux and parse without checking lines twice.
+ *
+ * The mux is about 150K, don't put it on the stack. A single thread calls
+ * mux_poll() in a loop; a blocking output stalls every input.
+ * */
+typedef struct {
+    mux_input_t         inputs[MUX_MAX_INPUTS];
+    int                 num_inputs;
+    mux_output_t        outputs[MUX_MAX_OUTPUTS];
+    int                 num_outputs;
+    int                 flags;                      /* MUX_PARSE */
+} mux_t;
+
+void mux_init(mux_t *, int);
+int mux_add_device(mux_t *, const char *);
+int mux_add_fd(mux_t *, int);
+int mux_add_udp(mux_t *, int);
+int mux_add_output(mux_t *, int, const mux_output_config_t *);
+int mux_add_output_udp(mux_t *, const char *, int, const mux_output_config_t *);
+int mux_poll(mux_t *, int);
+void mux_close(mux_t *);
+
+#endif /* MUX_H */
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+#include "net.h"
+
+/* binds a UDP socket on port for NMEA datagrams, returns -1 on error */
+int net_open_udp(net_source_t *src, int port) {
+    struct sockaddr_in addr;
+    int i;
+
+    memset(src, 0, sizeof(net_source_t));
+    src->type = NET_UDP;
+    src->port = port;
+
+    src->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (src->fd < 0) {
+        printf("Error opening UDP socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(src->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        printf("Error binding UDP port %d: %s\n", port, strerror(errno));
+        close(src->fd);
+        src->fd = -1;
+        return -1;
+    }
+
+    for (i = 0; i < NET_BATCH; i++) {
+        src->iov[i].iov_base = src->datagram[i];
+        src->iov[i].iov_len = NET_DATAGRAM_SIZE;
+        src->msgs[i].msg_hdr.msg_iov = &src->iov[i];
+        src->msgs[i].msg_hdr.msg_iovlen = 1;
+        src->msgs[i].msg_hdr.msg_name = &src->from[i];
+        src->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    return 0;
+}
+
+/* (re)connects the TCP socket, returns -1 on error */
+static int tcp_connect(net_source_t *src) {
+    struct addrinfo hints, *res, *ai;
+    char port[16];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", src->port);
+
+    if (getaddrinfo(src->host, port, &hints, &res) != 0) {
+        return -1;
+    }
+    src->fd = -1;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        src->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (src->fd < 0) {
+            continue;
+        }
+        if (connect(src->fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            if (ai->ai_family == AF_INET) {
+                memcpy(&src->sender, ai->ai_addr, sizeof(struct sockaddr_in));
+            }
+            break;
+        }
+        close(src->fd);
+        src->fd = -1;
+    }
+    freeaddrinfo(res);
+
+    src->start = src->end = 0;
+    return src->fd < 0 ? -1 : 0;
+}
+
+/* connects to an NMEA TCP server, returns -1 if the first attempt fails */
+int net_open_tcp(net_source_t *src, const char *host, int port) {
+    memset(src, 0, sizeof(net_source_t));
+    src->type = NET_TCP;
+    src->port = port;
+    strncpy(src->host, host, sizeof(src->host) - 1);
+
+    if (tcp_connect(src) < 0) {
+        printf("Error connecting to %s:%d: %s\n", host, port, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* copies a line of length len into buffer, returns its length */
+static int copy_line(net_source_t *src, char *buffer, size_t size, const char *line, size_t len) {
+    if (len >= size) {
+        len = size - 1;
+        src->truncated++;
+    }
+    memcpy(buffer, line, len);
+    buffer[len] = '\0';
+    return (int) len;
+}
+
+static int udp_readln(net_source_t *src, char *buffer, size_t size) {
+    for (;;) {
+        /* next line of the current datagram */
+        while (src->next_datagram < src->num_datagrams) {
+            char *data = src->datagram[src->next_datagram];
+            size_t length = src->msgs[src->next_datagram].msg_len;
+
+            if (src->datagram_pos < length) {
+                char *line = data + src->datagram_pos;
+                char *newline = memchr(line, '\n', length - src->datagram_pos);
+                size_t len = newline ? (size_t) (newline - line) : length - src->datagram_pos;
+
+                src->datagram_pos += len + 1;
+                src->sender = src->from[src->next_datagram];
+                if (len > 0) {
+                    return copy_line(src, buffer, size, line, len);
+                }
+                continue;
+            }
+            src->next_datagram++;
+            src->datagram_pos = 0;
+        }
+
+        /* everything handed out: wait for the next batch */
+        src->num_datagrams = recvmmsg(src->fd, src->msgs, NET_BATCH, MSG_WAITFORONE, NULL);
+        if (src->num_datagrams < 0) {
+            src->num_datagrams = 0;
+            if (errno != EINTR) {
+                return -1;
+            }
+            continue;
+        }
+        src->next_datagram = 0;
+        src->datagram_pos = 0;
+        src->datagrams += src->num_datagrams;
+        src->batches++;
+    }
+}
+
+static int tcp_readln(net_source_t *src, char *buffer, size_t size) {
+    ssize_t n;
+
+    for (;;) {
+        if (src->fd >= 0) {
+            char *line = src->buffer + src->start;
+            char *newline = memchr(line, '\n', src->end - src->start);
+
+            if (newline != NULL) {
+                size_t len = newline - line;
+                src->start += len + 1;
+                if (src->resync) {
+                    /* the tail of a line we already gave up on */
+                    src->resync = 0;
+                    continue;
+                }
+                return copy_line(src, buffer, size, line, len);
+            }
+
+            /* compact, and give up on a line that fills the whole buffer */
+            if (src->start > 0) {
+                memmove(src->buffer, src->buffer + src->start, src->end - src->start);
+                src->end -= src->start;
+                src->start = 0;
+            }
+            if (src->end == NET_BUFFER_SIZE) {
+                if (!src->resync) {
+                    src->truncated++;
+                }
+                /* the rest of it up to the next '\n' is not a sentence either */
+                src->end = 0;
+                src->resync = 1;
+            }
+
+            n = read(src->fd, src->buffer + src->end, NET_BUFFER_SIZE - src->end);
+            if (n > 0) {
+                src->end += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            /* peer closed or failed: a line it left unfinished never ends */
+            close(src->fd);
+            src->fd = -1;
+            src->start = src->end = 0;
+            src->resync = 0;
+        }
+
+        sleep(NET_RECONNECT_DELAY);
+        if (tcp_connect(src) == 0) {
+            src->reconnects++;
+        }
+    }
+}
+
+/* reads the next line (without '\n') into buffer, blocking; returns its length, -1 on error */
+int net_readln(net_source_t *src, char *buffer, size_t size) {
+    if (src->type == NET_UDP) {
+        return udp_readln(src, buffer, size);
+    }
+    return tcp_readln(src, buffer, size);
+}
+
+void net_close(net_source_t *src) {
+    if (src->fd >= 0) {
+        close(src->fd);
+        src->fd = -1;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stddef.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define NET_UDP             0
+#define NET_TCP             1
+
+#define NET_BATCH           32          /* datagrams pulled per recvmmsg() */
+#define NET_DATAGRAM_SIZE   2048        /* largest datagram we keep */
+#define NET_BUFFER_SIZE     8192        /* TCP framing buffer */
+#define NET_RECONNECT_DELAY 1           /* seconds between TCP reconnect attempts */
+
+/*
+ * NMEA over the network
+ *
+ * UDP: each datagram holds one or more complete sentences; up to NET_BATCH
+ * datagrams are received per syscall and handed out line by line.
+ * TCP: a byte stream framed on '\n', reconnected when the peer goes away.
+ * */
+typedef struct {
+    int                 type;                       /* NET_UDP or NET_TCP */
+    int                 fd;
+    char                host[64];                   /* TCP peer, for reconnects */
+    int                 port;
+
+    /* UDP batch */
+    struct mmsghdr      msgs[NET_BATCH];
+    struct iovec        iov[NET_BATCH];
+    struct sockaddr_in  from[NET_BATCH];
+    char                datagram[NET_BATCH][NET_DATAGRAM_SIZE];
+    int                 num_datagrams;              /* received in the last batch */
+    int                 next_datagram;              /* being split into lines */
+    size_t              datagram_pos;
+
+    /* TCP framing */
+    char                buffer[NET_BUFFER_SIZE];
+    size_t              start, end;                 /* unread bytes are buffer[start..end) */
+    int                 resync;                     /* dropping bytes up to the next '\n' */
+
+    struct sockaddr_in  sender;                     /* where the last line came from */
+    unsigned long       datagrams;                  /* UDP datagrams received */
+    unsigned long       batches;                    /* recvmmsg() calls that returned data */
+    unsigned long       reconnects;                 /* TCP reconnects */
+    unsigned long       truncated;                  /* lines cut to the caller's buffer, or dropped for overfilling NET_BUFFER_SIZE */
+} net_source_t;
+
+int net_open_udp(net_source_t *, int);
+int net_open_tcp(net_source_t *, const char *, int);
+int net_readln(net_source_t *, char *, size_t);
+void net_close(net_source_t *);
+
+#endif /* NET_H */
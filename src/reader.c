@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "satgps.h"
+#include "ubx.h"
+#include "reader.h"
+
+/* bucket for last_of_type[]: 0 for unknown sentences, 1 + bit number otherwise (UBX is 9) */
+static int type_bucket(int type) {
+    return __builtin_ffs(type);
+}
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* queues one line, applying the policy if full; called with the lock held */
+static void reader_put(gps_reader_t *reader, const gps_line_t *line) {
+    int bucket = type_bucket(line->type);
+    uint64_t pos;
+    int queued;
+
+    if (reader->tail - reader->head == (uint64_t) reader->capacity) {
+        switch (reader->policy) {
+            case READER_DROP_NEWEST:
+                reader->stats.dropped_newest++;
+                return;
+            case READER_KEEP_LATEST:
+                /* the newest queued sentence of this type is superseded, reuse its slot */
+                pos = reader->last_of_type[bucket];
+                if (pos > reader->head) {
+                    gps_line_copy(&reader->lines[(pos - 1) % reader->capacity], line);
+                    reader->stats.replaced++;
+                    return;
+                }
+                reader->head++;
+                reader->stats.dropped_oldest++;
+                break;
+            case READER_BLOCK:
+                reader->stats.blocked++;
+                while (reader->running && reader->tail - reader->head == (uint64_t) reader->capacity) {
+                    pthread_cond_wait(&reader->not_full, &reader->lock);
+                }
+                if (!reader->running) {
+                    return;
+                }
+                break;
+            default:
+                reader->head++;
+                reader->stats.dropped_oldest++;
+        }
+    }
+
+    gps_line_copy(&reader->lines[reader->tail % reader->capacity], line);
+    reader->tail++;
+    reader->last_of_type[bucket] = reader->tail;
+
+    queued = (int) (reader->tail - reader->head);
+    if (queued > reader->stats.high_water) {
+        reader->stats.high_water = queued;
+    }
+    pthread_cond_signal(&reader->not_empty);
+}
+
+static void *reader_thread(void *arg) {
+    gps_reader_t *reader = (gps_reader_t *) arg;
+    gps_line_t line;
+    int length;
+
+    /* only cancelled while blocked in the read, never with the lock held */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    for (;;) {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        length = gps_read_raw(line.text);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        if (length <= 0) {
+            continue;
+        }
+        line.length = length;
+        line.type = ubx_is_frame(line.text, length) ? UBX_MESSAGE : gps_sentence_type(line.text);
+        line.received_mono_ns = clock_ns(CLOCK_MONOTONIC);
+        line.received_ns = clock_ns(CLOCK_REALTIME);
+
+        pthread_mutex_lock(&reader->lock);
+        if (!reader->running) {
+            pthread_mutex_unlock(&reader->lock);
+            break;
+        }
+        reader->stats.read++;
+        reader_put(reader, &line);
+        pthread_mutex_unlock(&reader->lock);
+    }
+    return NULL;
+}
+
+/* allocates a queue of capacity sentences, returns -1 if out of memory */
+int gps_reader_init(gps_reader_t *reader, int capacity, int policy) {
+    pthread_condattr_t attr;
+
+    memset(reader, 0, sizeof(gps_reader_t));
+    reader->capacity = capacity > 0 ? capacity : READER_DEFAULT_CAPACITY;
+    reader->policy = policy;
+    reader->lines = (gps_line_t *) malloc(sizeof(gps_line_t) * reader->capacity);
+    if (reader->lines == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&reader->not_empty, &attr);
+    pthread_cond_init(&reader->not_full, &attr);
+    pthread_condattr_destroy(&attr);
+    return 0;
+}
+
+/* starts reading; the source must already be open */
+int gps_reader_start(gps_reader_t *reader) {
+    reader->running = 1;
+    if (pthread_create(&reader->thread, NULL, reader_thread, reader) != 0) {
+        reader->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* stops the thread; lines still queued can be dequeued afterwards */
+void gps_reader_stop(gps_reader_t *reader) {
+    pthread_mutex_lock(&reader->lock);
+    if (!reader->running) {
+        pthread_mutex_unlock(&reader->lock);
+        return;
+    }
+    reader->running = 0;
+    pthread_cond_broadcast(&reader->not_full);
+    pthread_cond_broadcast(&reader->not_empty);
+    pthread_mutex_unlock(&reader->lock);
+
+    pthread_cancel(reader->thread);
+    pthread_join(reader->thread, NULL);
+}
+
+void gps_reader_free(gps_reader_t *reader) {
+    gps_reader_stop(reader);
+    pthread_cond_destroy(&reader->not_empty);
+    pthread_cond_destroy(&reader->not_full);
+    pthread_mutex_destroy(&reader->lock);
+    free(reader->lines);
+    reader->lines = NULL;
+}
+
+/*
+ * Takes up to max queued sentences, oldest first
+ *
+ * Waits up to timeout_ms for the first one (0 doesn't wait, -1 waits forever).
+ * Returns the number of lines copied, 0 on timeout, -1 once the reader is
+ * stopped and the queue is empty.
+ * */
+int gps_reader_dequeue(gps_reader_t *reader, gps_line_t *lines, int max, int timeout_ms) {
+    struct timespec deadline;
+    int n = 0;
+
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&reader->lock);
+    while (reader->head == reader->tail && reader->running && timeout_ms != 0) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&reader->not_empty, &reader->lock);
+        } else if (pthread_cond_timedwait(&reader->not_empty, &reader->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    if (reader->head == reader->tail && !reader->running) {
+        pthread_mutex_unlock(&reader->lock);
+        return -1;
+    }
+
+    while (n < max && reader->head != reader->tail) {
+        gps_line_copy(&lines[n++], &reader->lines[reader->head % reader->capacity]);
+        reader->head++;
+    }
+    reader->stats.dequeued += n;
+
+    if (n > 0) {
+        pthread_cond_signal(&reader->not_full);
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return n;
+}
+
+void gps_reader_stats(gps_reader_t *reader, gps_reader_stats_t *stats) {
+    pthread_mutex_lock(&reader->lock);
+    *stats = reader->stats;
+    pthread_mutex_unlock(&reader->lock);
+}
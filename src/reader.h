@@ -0,0 +1,74 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "satgps.h"
+
+#define READER_DEFAULT_CAPACITY     256         /* sentences, about 800K */
+
+/* what the reader does when the queue is full */
+#define READER_DROP_OLDEST          0           /* discard the oldest queued sentence */
+#define READER_DROP_NEWEST          1           /* discard the sentence just read */
+#define READER_KEEP_LATEST          2           /* overwrite the newest queued sentence of the same type */
+#define READER_BLOCK                3           /* stop reading until there is room */
+
+/* one queued sentence, text last so gps_line_copy() can stop where it ends */
+typedef struct {
+    int                 length;
+    int                 type;                       /* filter bit from gps_sentence_type(), UBX_MESSAGE, 0 if unknown */
+    int64_t             received_ns;                /* CLOCK_REALTIME when the line was read */
+    int64_t             received_mono_ns;           /* CLOCK_MONOTONIC at the same moment */
+    char                text[GPS_MAX_FRAME];        /* NUL terminated sentence, or a UBX frame */
+} gps_line_t;
+
+/* copies a line and its text up to the NUL; sentences are a few percent of GPS_MAX_FRAME */
+static inline void gps_line_copy(gps_line_t *dst, const gps_line_t *src) {
+    memcpy(dst, src, offsetof(gps_line_t, text) + src->length + 1);
+}
+
+typedef struct {
+    unsigned long       read;                       /* sentences read from the source */
+    unsigned long       dequeued;                   /* handed to consumers */
+    unsigned long       dropped_oldest;             /* READER_DROP_OLDEST, or READER_KEEP_LATEST without a same-type entry */
+    unsigned long       dropped_newest;             /* READER_DROP_NEWEST */
+    unsigned long       replaced;                   /* READER_KEEP_LATEST overwrites */
+    unsigned long       blocked;                    /* times READER_BLOCK had to wait */
+    int                 high_water;                 /* most sentences queued at once */
+} gps_reader_stats_t;
+
+/*
+ * Reader thread and bounded queue
+ *
+ * The thread calls gps_read_raw() on the source opened with gps_open*() and
+ * queues every line; consumers take them out in batches with
+ * gps_reader_dequeue(), then check and parse them as usual (UBX frames go to
+ * ubx_decode()). Memory is fixed at gps_reader_init(), a full queue is
+ * handled by the policy and counted.
+ * */
+typedef struct {
+    gps_line_t          *lines;
+    int                 capacity;
+    int                 policy;                     /* READER_* */
+    uint64_t            head, tail;                 /* lines[head..tail) modulo capacity are queued */
+    uint64_t            last_of_type[10];           /* newest queued position + 1 per type bit, 0 if none */
+    gps_reader_stats_t  stats;
+    int                 running;
+
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      not_empty;
+    pthread_cond_t      not_full;
+} gps_reader_t;
+
+int gps_reader_init(gps_reader_t *, int, int);
+int gps_reader_start(gps_reader_t *);
+void gps_reader_stop(gps_reader_t *);
+void gps_reader_free(gps_reader_t *);
+int gps_reader_dequeue(gps_reader_t *, gps_line_t *, int, int);
+void gps_reader_stats(gps_reader_t *, gps_reader_stats_t *);
+
+#endif /* READER_H */
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "satgps.h"
+#include "ubx.h"
+#include "rtpipe.h"
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/*
+ * Touches the stack a thread will use, so that it doesn't page fault later
+ *
+ * One store per page through the volatile array, which the compiler has to
+ * keep (a memset of it cast to plain char * is a dead store and vanishes at
+ * -O2). Not inlined, so the pages are the ones the thread's later calls reuse.
+ * */
+static __attribute__((noinline)) void prefault_stack(void) {
+    volatile char stack[RTPIPE_STACK_PREFAULT];
+    long page = sysconf(_SC_PAGESIZE);
+    size_t i;
+
+    if (page <= 0) {
+        page = 4096;
+    }
+    for (i = 0; i < sizeof(stack); i += (size_t) page) {
+        stack[i] = 0;
+    }
+    stack[sizeof(stack) - 1] = 0;
+}
+
+void rtpipe_default_config(rtpipe_config_t *config) {
+    config->capacity = RTPIPE_DEFAULT_CAPACITY;
+    config->reader_cpu = -1;
+    config->decode_cpu = -1;
+    config->reader_priority = 0;
+    config->decode_priority = 0;
+    config->lock_memory = 0;
+}
+
+/*
+ * Allocates and touches the ring and, if configured, locks all memory
+ *
+ * Returns -1 if out of memory or mlockall() failed (errno says why).
+ * */
+int rtpipe_init(rtpipe_t *rt, const rtpipe_config_t *config) {
+    unsigned long capacity = 1;
+    void *slots;
+
+    memset(rt, 0, sizeof(rtpipe_t));
+    rt->config = *config;
+    while (capacity < (unsigned long) config->capacity) {
+        capacity <<= 1;
+    }
+    rt->config.capacity = (int) capacity;
+    rt->mask = capacity - 1;
+    rt->stats.latency_min_ns = INT64_MAX;
+
+    /* one extra slot for the reader to read into while the ring is full */
+    if (posix_memalign(&slots, RTPIPE_CACHE_LINE, sizeof(gps_line_t) * (capacity + 1)) != 0) {
+        return -1;
+    }
+    memset(slots, 0, sizeof(gps_line_t) * (capacity + 1));
+    rt->slots = (gps_line_t *) slots;
+
+    if (config->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        free(rt->slots);
+        rt->slots = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* consumers run on the decode thread in the order added; returns -1 if the table is full */
+int rtpipe_add_consumer(rtpipe_t *rt, rtpipe_consumer_t consumer, void *arg) {
+    if (rt->num_consumers == RTPIPE_MAX_CONSUMERS) {
+        return -1;
+    }
+    rt->consumers[rt->num_consumers] = consumer;
+    rt->consumer_args[rt->num_consumers] = arg;
+    rt->num_consumers++;
+    return 0;
+}
+
+static void *reader_thread(void *arg) {
+    rtpipe_t *rt = (rtpipe_t *) arg;
+    gps_line_t *spare = &rt->slots[rt->mask + 1];
+    gps_line_t *slot;
+    unsigned long tail, capacity = rt->mask + 1;
+    int length, full;
+
+    prefault_stack();
+
+    /* only cancelled while blocked in the read */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    while (atomic_load_explicit(&rt->running, memory_order_relaxed)) {
+        tail = atomic_load_explicit(&rt->tail, memory_order_relaxed);
+        full = tail - atomic_load_explicit(&rt->head, memory_order_acquire) == capacity;
+        slot = full ? spare : &rt->slots[tail & rt->mask];
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        length = gps_read_raw(slot->text);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        if (length <= 0) {
+            continue;
+        }
+        slot->received_mono_ns = clock_ns(CLOCK_MONOTONIC);
+        slot->received_ns = clock_ns(CLOCK_REALTIME);
+        slot->length = length;
+
+        if (full) {
+            /* the decoder may have caught up during the read */
+            if (tail - atomic_load_explicit(&rt->head, memory_order_acquire) == capacity) {
+                atomic_fetch_add_explicit(&rt->overruns, 1, memory_order_relaxed);
+                continue;
+            }
+            gps_line_copy(&rt->slots[tail & rt->mask], spare);
+        }
+
+        atomic_store_explicit(&rt->tail, tail + 1, memory_order_release);
+        atomic_fetch_add(&rt->wake, 1);
+        if (atomic_load(&rt->sleeping)) {
+            syscall(SYS_futex, &rt->wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+    }
+    return NULL;
+}
+
+/* spins briefly, then sleeps on the futex until a line is queued or 100 ms pass */
+static void wait_for_line(rtpipe_t *rt, unsigned long head) {
+    struct timespec timeout = {0, 100000000};
+    unsigned int wake;
+    int i;
+
+    for (i = 0; i < RTPIPE_SPIN; i++) {
+        if (atomic_load_explicit(&rt->tail, memory_order_acquire) != head) {
+            return;
+        }
+        cpu_relax();
+    }
+
+    wake = atomic_load(&rt->wake);
+    atomic_store(&rt->sleeping, 1);
+    if (atomic_load(&rt->tail) == head && atomic_load(&rt->running)) {
+        syscall(SYS_futex, &rt->wake, FUTEX_WAIT_PRIVATE, wake, &timeout, NULL, 0);
+    }
+    atomic_store(&rt->sleeping, 0);
+}
+
+static void record_stats(rtpipe_t *rt, int result, int64_t latency, int64_t decode) {
+    rtpipe_stats_t *stats = &rt->stats;
+    unsigned int s = atomic_load_explicit(&rt->stats_seq, memory_order_relaxed);
+
+    atomic_store_explicit(&rt->stats_seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    stats->lines++;
+    if (result < 0) {
+        stats->rejected++;
+    }
+    if (latency < stats->latency_min_ns) {
+        stats->latency_min_ns = latency;
+    }
+    if (latency > stats->latency_max_ns) {
+        stats->latency_max_ns = latency;
+    }
+    stats->latency_sum_ns += latency;
+    if (decode > stats->decode_max_ns) {
+        stats->decode_max_ns = decode;
+    }
+
+    atomic_store_explicit(&rt->stats_seq, s + 2, memory_order_release);
+}
+
+static void decode_line(rtpipe_t *rt, gps_line_t *line) {
+    char sentence[GPS_MAX_SENTENCE];
+    int64_t start = clock_ns(CLOCK_MONOTONIC), end;
+    int result = 0;
+    int i;
+
+    if (ubx_is_frame(line->text, line->length)) {
+        line->type = UBX_MESSAGE;
+        result = ubx_decode((uint8_t *) line->text, line->length) < 0 ? -1 : 0;
+    } else {
+        /* parse a copy, consumers see the line as read */
+        line->type = gps_sentence_type(line->text);
+        memcpy(sentence, line->text, line->length < GPS_MAX_SENTENCE ? line->length + 1 : GPS_MAX_SENTENCE);
+        sentence[GPS_MAX_SENTENCE - 1] = '\0';
+        if (!checksum_valid(sentence) || !prefix_valid(sentence) || parse_sentence(sentence) < 0) {
+            result = -1;
+        }
+    }
+
+    for (i = 0; i < rt->num_consumers; i++) {
+        rt->consumers[i](line, result, rt->consumer_args[i]);
+    }
+
+    end = clock_ns(CLOCK_MONOTONIC);
+    record_stats(rt, result, end - line->received_mono_ns, end - start);
+}
+
+static void *decode_thread(void *arg) {
+    rtpipe_t *rt = (rtpipe_t *) arg;
+    unsigned long head;
+
+    prefault_stack();
+
+    for (;;) {
+        head = atomic_load_explicit(&rt->head, memory_order_relaxed);
+        if (atomic_load_explicit(&rt->tail, memory_order_acquire) == head) {
+            if (!atomic_load(&rt->running)) {
+                break;
+            }
+            wait_for_line(rt, head);
+            continue;
+        }
+        decode_line(rt, &rt->slots[head & rt->mask]);
+        atomic_store_explicit(&rt->head, head + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+/* thread attributes for a CPU and SCHED_FIFO priority */
+static void thread_attr(pthread_attr_t *attr, int cpu, int priority) {
+    struct sched_param param;
+    cpu_set_t cpus;
+
+    pthread_attr_init(attr);
+    if (cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+    }
+    if (priority > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+        pthread_attr_setschedparam(attr, &param);
+    }
+}
+
+/*
+ * Starts both threads; the source must already be open
+ *
+ * Returns -1 with errno set if a thread couldn't be created, typically EPERM
+ * for SCHED_FIFO without CAP_SYS_NICE or an RLIMIT_RTPRIO, or EINVAL for a
+ * CPU that doesn't exist.
+ * */
+int rtpipe_start(rtpipe_t *rt) {
+    pthread_attr_t attr;
+    sigset_t all, old;
+    int error;
+
+    atomic_store(&rt->running, 1);
+
+    /* signals go to the application's threads, never interrupt these */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    thread_attr(&attr, rt->config.decode_cpu, rt->config.decode_priority);
+    error = pthread_create(&rt->decoder, &attr, decode_thread, rt);
+    pthread_attr_destroy(&attr);
+    if (error != 0) {
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        atomic_store(&rt->running, 0);
+        errno = error;
+        return -1;
+    }
+
+    thread_attr(&attr, rt->config.reader_cpu, rt->config.reader_priority);
+    error = pthread_create(&rt->reader, &attr, reader_thread, rt);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (error != 0) {
+        atomic_store(&rt->running, 0);
+        pthread_join(rt->decoder, NULL);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/* stops reading; lines already queued are still decoded before it returns */
+void rtpipe_stop(rtpipe_t *rt) {
+    if (!atomic_exchange(&rt->running, 0)) {
+        return;
+    }
+    pthread_cancel(rt->reader);
+    pthread_join(rt->reader, NULL);
+
+    atomic_fetch_add(&rt->wake, 1);
+    syscall(SYS_futex, &rt->wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    pthread_join(rt->decoder, NULL);
+}
+
+void rtpipe_free(rtpipe_t *rt) {
+    rtpipe_stop(rt);
+    if (rt->config.lock_memory) {
+        munlockall();
+    }
+    free(rt->slots);
+    rt->slots = NULL;
+}
+
+/* consistent copy of the statistics, from any thread */
+void rtpipe_stats(rtpipe_t *rt, rtpipe_stats_t *stats) {
+    unsigned int s1, s2;
+
+    do {
+        s1 = atomic_load_explicit(&rt->stats_seq, memory_order_acquire);
+        memcpy(stats, &rt->stats, sizeof(rtpipe_stats_t));
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&rt->stats_seq, memory_order_relaxed);
+    } while ((s1 & 1) || s1 != s2);
+
+    stats->overruns = atomic_load_explicit(&rt->overruns, memory_order_relaxed);
+    if (stats->lines == 0) {
+        stats->latency_min_ns = 0;
+    }
+    stats->jitter_ns = stats->latency_max_ns - stats->latency_min_ns;
+}
@@ -0,0 +1,84 @@
+#ifndef RTPIPE_H
+#define RTPIPE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "satgps.h"
+#include "reader.h"
+
+#define RTPIPE_DEFAULT_CAPACITY     64          /* slots, power of 2 */
+#define RTPIPE_MAX_CONSUMERS        8
+#define RTPIPE_SPIN                 1000        /* polls of an empty queue before the decoder sleeps */
+#define RTPIPE_STACK_PREFAULT       (64 * 1024) /* stack bytes each thread touches before it runs */
+#define RTPIPE_CACHE_LINE           64
+
+/* called on the decode thread with every line; result is 0 if it parsed, -1 if it was rejected */
+typedef void (*rtpipe_consumer_t)(const gps_line_t *, int, void *);
+
+typedef struct {
+    int                 capacity;                   /* slots, rounded up to a power of 2 */
+    int                 reader_cpu;                 /* CPU to pin the reader thread to, -1 for any */
+    int                 decode_cpu;
+    int                 reader_priority;            /* SCHED_FIFO 1-99, 0 keeps the normal scheduler */
+    int                 decode_priority;
+    int                 lock_memory;                /* mlockall() current and future pages */
+} rtpipe_config_t;
+
+typedef struct {
+    unsigned long       lines;                      /* dispatched */
+    unsigned long       rejected;                   /* failed the checksum or parser */
+    unsigned long       overruns;                   /* lines dropped because the queue was full */
+    int64_t             latency_min_ns;             /* read to dispatched */
+    int64_t             latency_max_ns;
+    int64_t             latency_sum_ns;
+    int64_t             jitter_ns;                  /* worst case, latency_max_ns - latency_min_ns */
+    int64_t             decode_max_ns;              /* parse and consumers only */
+} rtpipe_stats_t;
+
+/*
+ * Real-time reader/decoder pipeline
+ *
+ * A reader thread calls gps_read_raw() straight into the slots of a
+ * single-producer single-consumer ring; a decode thread checks and parses
+ * each line (ubx_decode() for UBX frames), which fires the fix handlers, then
+ * calls the consumers. Each thread can be pinned to a CPU and run SCHED_FIFO.
+ * All memory is allocated, touched and optionally locked in rtpipe_init() and
+ * rtpipe_start(), so nothing pages or allocates afterwards; set the filters
+ * and handlers before starting. When the ring is full the newest line is
+ * dropped and counted, the reader never waits for the decoder.
+ * */
+typedef struct {
+    rtpipe_config_t     config;
+    gps_line_t          *slots;
+    unsigned long       mask;
+
+    /* the reader owns tail, the decoder head; each on its own cache line */
+    _Alignas(RTPIPE_CACHE_LINE) atomic_ulong tail;
+    _Alignas(RTPIPE_CACHE_LINE) atomic_ulong head;
+    _Alignas(RTPIPE_CACHE_LINE) atomic_uint wake;   /* futex word, bumped when a line is queued */
+    atomic_int          sleeping;                   /* decoder is (about to be) waiting on wake */
+    atomic_int          running;
+
+    rtpipe_consumer_t   consumers[RTPIPE_MAX_CONSUMERS];
+    void                *consumer_args[RTPIPE_MAX_CONSUMERS];
+    int                 num_consumers;
+
+    atomic_uint         stats_seq;
+    rtpipe_stats_t      stats;
+    atomic_ulong        overruns;
+
+    pthread_t           reader;
+    pthread_t           decoder;
+} rtpipe_t;
+
+void rtpipe_default_config(rtpipe_config_t *);
+int rtpipe_init(rtpipe_t *, const rtpipe_config_t *);
+int rtpipe_add_consumer(rtpipe_t *, rtpipe_consumer_t, void *);
+int rtpipe_start(rtpipe_t *);
+void rtpipe_stop(rtpipe_t *);
+void rtpipe_free(rtpipe_t *);
+void rtpipe_stats(rtpipe_t *, rtpipe_stats_t *);
+
+#endif /* RTPIPE_H */
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "satgps.h"
+#include "satdb.h"
+
+void satdb_init(satdb_t *db) {
+    memset(db, 0, sizeof(satdb_t));
+}
+
+/* table entry for a PRN as numbered after get_prn_number(), NULL if out of range */
+satdb_sat_t *satdb_lookup(satdb_t *db, int constellation, int prn) {
+    int index;
+
+    switch (constellation) {
+        case SATDB_SBAS:
+            index = prn - 120;
+            break;
+        case SATDB_GPS:
+        case SATDB_GLONASS:
+            index = prn - 1;
+            break;
+        default:
+            return NULL;
+    }
+    if (index < 0 || index >= SATDB_MAX_PRN) {
+        return NULL;
+    }
+    return &db->sats[constellation][index];
+}
+
+/* appends one cycle to the history ring, keeping the ring sums current */
+static void satdb_push(satdb_sat_t *sat, const satdb_sample_t *sample) {
+    satdb_sample_t *oldest;
+
+    if (sat->count == SATDB_HISTORY) {
+        oldest = &sat->history[(sat->head - sat->count) & (SATDB_HISTORY - 1)];
+        if (oldest->snr > 0) {
+            sat->snr_sum -= oldest->snr;
+            sat->snr_tracked--;
+        }
+        sat->count--;
+    }
+
+    sat->history[sat->head & (SATDB_HISTORY - 1)] = *sample;
+    sat->head++;
+    sat->count++;
+    if (sample->snr > 0) {
+        sat->snr_sum += sample->snr;
+        sat->snr_tracked++;
+    }
+}
+
+/* one satellite of a GSV cycle */
+static void satdb_observe(satdb_t *db, satdb_sat_t *sat, int constellation, int prn, const gsv_sat_t *gsv, int64_t t) {
+    satdb_sample_t sample;
+
+    if (sat->prn == 0) {
+        sat->prn = prn;
+        sat->constellation = constellation;
+    }
+
+    /* SNR went null while still in view */
+    if (sat->in_view && sat->snr > 0 && gsv->signal_to_noise <= 0) {
+        sat->dropouts++;
+    }
+
+    sat->in_view = 1;
+    sat->elevation = gsv->elevation;
+    sat->azimuth = gsv->azimuth;
+    sat->snr = gsv->signal_to_noise;
+    sat->last_seen_ns = t;
+    sat->last_cycle = db->cycles[constellation];
+    sat->cycles++;
+
+    if (sat->snr > 0) {
+        if (sat->snr_min == 0 || sat->snr < sat->snr_min) {
+            sat->snr_min = sat->snr;
+        }
+        if (sat->snr > sat->snr_max) {
+            sat->snr_max = sat->snr;
+        }
+    }
+
+    sample.cycle = (uint16_t) db->cycles[constellation];
+    sample.snr = (uint8_t) (sat->snr > 0 ? sat->snr : 0);
+    sample.elevation = (int8_t) sat->elevation;
+    sample.used = (uint8_t) sat->used;
+    sample.reserved = 0;
+    satdb_push(sat, &sample);
+}
+
+/* marks satellites missing from the cycle that just ended as out of view */
+static void satdb_sweep(satdb_t *db, int constellation) {
+    satdb_sat_t *sat;
+    int i;
+
+    for (i = 0; i < SATDB_MAX_PRN; i++) {
+        sat = &db->sats[constellation][i];
+        if (!sat->in_view || sat->last_cycle == db->cycles[constellation]) {
+            continue;
+        }
+        if (sat->snr > 0 && sat->elevation > SATDB_DROPOUT_ELEVATION) {
+            sat->dropouts++;
+        }
+        sat->in_view = 0;
+        sat->snr = 0;
+        sat->used = 0;
+    }
+}
+
+/*
+ * Ingests a complete GSV cycle (gsv_type GPGSV_MESSAGE or GLGSV_MESSAGE) seen at time t
+ *
+ * $GPGSV carries GPS and SBAS, $GLGSV carries GLONASS.
+ * */
+void satdb_update_gsv(satdb_t *db, const gsv_data_t *gsv, int gsv_type, int64_t t) {
+    const gsv_sat_t *s;
+    satdb_sat_t *sat;
+    int constellation;
+    int i, n;
+
+    if (gsv_type == GLGSV_MESSAGE) {
+        db->cycles[SATDB_GLONASS]++;
+    } else {
+        db->cycles[SATDB_GPS]++;
+        db->cycles[SATDB_SBAS]++;
+    }
+
+    n = gsv->satellites_in_view < GPS_MAX_SATS ? gsv->satellites_in_view : GPS_MAX_SATS;
+    for (i = 0; i < n; i++) {
+        s = &gsv->gsv_sat[i];
+        if (gsv_type == GLGSV_MESSAGE) {
+            constellation = SATDB_GLONASS;
+        } else {
+            constellation = s->prn_number >= 120 ? SATDB_SBAS : SATDB_GPS;
+        }
+        sat = satdb_lookup(db, constellation, s->prn_number);
+        if (sat != NULL) {
+            satdb_observe(db, sat, constellation, s->prn_number, s, t);
+        }
+    }
+
+    if (gsv_type == GLGSV_MESSAGE) {
+        satdb_sweep(db, SATDB_GLONASS);
+    } else {
+        satdb_sweep(db, SATDB_GPS);
+        satdb_sweep(db, SATDB_SBAS);
+    }
+}
+
+/*
+ * Merges GSA used-in-fix flags
+ *
+ * GSA lists raw NMEA numbers: 1-32 GPS, 33-64 SBAS, 65-96 GLONASS. A receiver
+ * may send one GSA per constellation, so only the constellations listed here
+ * have their flags replaced; an empty list clears them all.
+ * */
+void satdb_update_gsa(satdb_t *db, const gsa_data_t *gsa) {
+    satdb_sat_t *sat;
+    int constellation[12];
+    int prn[12];
+    int listed[SATDB_CONSTELLATIONS] = {0, 0, 0};
+    int any = 0;
+    int i, c;
+
+    for (i = 0; i < 12; i++) {
+        constellation[i] = -1;
+        prn[i] = gsa->prn_number[i];
+        if (prn[i] >= 1 && prn[i] <= 32) {
+            constellation[i] = SATDB_GPS;
+        } else if (prn[i] >= 33 && prn[i] <= 64) {
+            constellation[i] = SATDB_SBAS;
+            prn[i] += 87;
+        } else if (prn[i] >= 65 && prn[i] <= 96) {
+            constellation[i] = SATDB_GLONASS;
+            prn[i] -= 64;
+        }
+        if (constellation[i] >= 0) {
+            listed[constellation[i]] = 1;
+            any = 1;
+        }
+    }
+
+    for (c = 0; c < SATDB_CONSTELLATIONS; c++) {
+        if (listed[c] || !any) {
+            for (i = 0; i < SATDB_MAX_PRN; i++) {
+                db->sats[c][i].used = 0;
+            }
+        }
+    }
+
+    for (i = 0; i < 12; i++) {
+        if (constellation[i] < 0) {
+            continue;
+        }
+        sat = satdb_lookup(db, constellation[i], prn[i]);
+        if (sat != NULL) {
+            sat->used = 1;
+        }
+    }
+}
+
+/*
+ * Feeds the database from GpsData after parse_sentence(), msg_type from gps_sentence_type()
+ *
+ * GSV is taken once its last sentence of the cycle is in, GSA right away.
+ * */
+void satdb_sentence(satdb_t *db, int msg_type) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+    gsv_data_t *gsv = NULL;
+
+    switch (msg_type) {
+        case GPGSV_MESSAGE:
+            gsv = gps_data->GsvDataGps;
+            break;
+        case GLGSV_MESSAGE:
+            gsv = gps_data->GsvDataGlonass;
+            break;
+        case GNGSA_MESSAGE:
+            if (gps_data->GsaDataGn != NULL) {
+                satdb_update_gsa(db, gps_data->GsaDataGn);
+            }
+            return;
+        default:
+            return;
+    }
+
+    if (gsv != NULL && gsv->message_number == gsv->total_messages) {
+        satdb_update_gsv(db, gsv, msg_type, gps_data->fix.utc_epoch_ns);
+    }
+}
+
+/* copies up to max samples, oldest first, returns how many */
+int satdb_history(const satdb_sat_t *sat, satdb_sample_t *samples, int max) {
+    unsigned int start = sat->head - sat->count;
+    int i, n;
+
+    n = (int) sat->count < max ? (int) sat->count : max;
+    /* the newest n */
+    start += sat->count - n;
+    for (i = 0; i < n; i++) {
+        samples[i] = sat->history[(start + i) & (SATDB_HISTORY - 1)];
+    }
+    return n;
+}
+
+/* mean SNR over the tracked samples in the history ring, 0 if none */
+double satdb_mean_snr(const satdb_sat_t *sat) {
+    if (sat->snr_tracked == 0) {
+        return 0.0;
+    }
+    return (double) sat->snr_sum / sat->snr_tracked;
+}
@@ -0,0 +1,76 @@
+#ifndef SATDB_H
+#define SATDB_H
+
+#include <stdint.h>
+
+#include "satgps.h"
+
+/* constellations */
+#define SATDB_GPS                   0           /* PRN 1-64 */
+#define SATDB_SBAS                  1           /* PRN 120-183 */
+#define SATDB_GLONASS               2           /* slot 1-64 */
+#define SATDB_CONSTELLATIONS        3
+
+#define SATDB_MAX_PRN               64          /* satellites per constellation */
+#define SATDB_HISTORY               64          /* GSV cycles kept per satellite, power of 2 */
+#define SATDB_DROPOUT_ELEVATION     10          /* degrees; losing a satellite above this is a dropout */
+
+/* one GSV cycle of one satellite, 6 bytes */
+typedef struct {
+    uint16_t            cycle;                      /* low bits of satdb_t.cycles[constellation] */
+    uint8_t             snr;                        /* dB-Hz, 0 when not tracked */
+    int8_t              elevation;                  /* degrees */
+    uint8_t             used;                       /* in the fix per GSA */
+    uint8_t             reserved;
+} satdb_sample_t;
+
+typedef struct {
+    int                 prn;                        /* 0 if never seen */
+    int                 constellation;
+
+    /* latest GSV/GSA */
+    int                 in_view;
+    int                 elevation;
+    int                 azimuth;
+    int                 snr;
+    int                 used;
+    int64_t             last_seen_ns;               /* fix time of the last cycle it was in */
+    unsigned long       last_cycle;                 /* satdb_t.cycles[constellation] of that cycle */
+
+    /* history ring, oldest at (head - count) */
+    satdb_sample_t      history[SATDB_HISTORY];
+    unsigned int        head;
+    unsigned int        count;
+    int                 snr_sum;                    /* over the samples in the ring */
+    int                 snr_tracked;                /* samples in the ring with an SNR */
+
+    /* since the satellite was first seen */
+    unsigned long       cycles;                     /* GSV cycles in view */
+    unsigned long       dropouts;                   /* lost above SATDB_DROPOUT_ELEVATION or SNR gone while in view */
+    int                 snr_min;                    /* over tracked cycles, 0 if never tracked */
+    int                 snr_max;
+} satdb_sat_t;
+
+/*
+ * Per-satellite database
+ *
+ * Satellites are indexed directly by constellation and PRN, so lookups are an
+ * array access. Each GSV cycle appends one sample per satellite in view and
+ * updates the running statistics; nothing is rescanned. Keep one satdb_t per
+ * receiver: feed it from the global GpsData with satdb_sentence() after
+ * parse_sentence(), or from other tables with satdb_update_gsv()/_gsa().
+ * */
+typedef struct {
+    satdb_sat_t         sats[SATDB_CONSTELLATIONS][SATDB_MAX_PRN];
+    unsigned long       cycles[SATDB_CONSTELLATIONS];   /* GSV cycles ingested */
+} satdb_t;
+
+void satdb_init(satdb_t *);
+void satdb_update_gsv(satdb_t *, const gsv_data_t *, int, int64_t);
+void satdb_update_gsa(satdb_t *, const gsa_data_t *);
+void satdb_sentence(satdb_t *, int);
+satdb_sat_t *satdb_lookup(satdb_t *, int, int);
+int satdb_history(const satdb_sat_t *, satdb_sample_t *, int);
+double satdb_mean_snr(const satdb_sat_t *);
+
+#endif /* SATDB_H */
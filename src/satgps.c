@@ -5,38 +5,143 @@
 #include <stdlib.h>
 
 #include "serial.h"
+#include "net.h"
 #include "satgps.h"
+#include "gpserror.h"
+#include "ubx.h"
+#include "trace.h"
 
 /* globals */
 
 /* GPS Data */
 gps_data_t GpsData;
 
+/* current sentence source and, for UDP/TCP, its state */
+static int Source = GPS_SOURCE_SERIAL;
+static net_source_t NetSource;
+
+/* serial bytes not yet split into sentences and UBX frames */
+static ubx_stream_t Stream;
+static char RxChunk[SERIAL_CHUNK];
+static int RxStart, RxEnd;
+
+/* fix being assembled from the sentences of the current epoch */
+static gps_fix_t PendingFix;
+
+/* date of the most recent RMC, carried into fixes built from time-only sentences */
+static struct tm FixDate;
+
+/* day (since 1970-01-01) and time of day of the last time-stamped sentence, for midnight rollover */
+static int64_t EpochDays;
+static long EpochSeconds = -1;
+
+/* per GSV table (GPS, GLONASS): lowest SNR of the last complete cycle, and the next sentence number due */
+static int GsvMinSnr[2] = {-1, -1};
+static int GsvNext[2];
+
+/* registered fix handlers */
+static struct {
+    gps_fix_handler_t   handler;
+    void                *arg;
+} FixHandlers[GPS_MAX_FIX_HANDLERS];
+
+static void fix_merge(int);
+static void fix_emit(void);
+static int64_t utc_epoch(struct timeval *);
+static double parse_coordinate(const char *, int);
+
 /* opens port to GPS device for reading */
 
 int gps_open() {
+    Source = GPS_SOURCE_SERIAL;
+    ubx_stream_init(&Stream);
+    RxStart = RxEnd = 0;
     return serial_open();
 }
 
-/* reads sentence from device */
+/* listens for NMEA datagrams on a UDP port */
+int gps_open_udp(int port) {
+    Source = GPS_SOURCE_UDP;
+    return net_open_udp(&NetSource, port);
+}
+
+/* reads NMEA from a TCP server, reconnecting if it goes away */
+int gps_open_tcp(const char *host, int port) {
+    Source = GPS_SOURCE_TCP;
+    return net_open_tcp(&NetSource, host, port);
+}
+
+/*
+ * Reads the next message from the open source without touching GpsData, for the reader thread
+ *
+ * buffer must hold GPS_MAX_FRAME bytes. The serial port may carry NMEA and
+ * UBX mixed; a UBX frame is returned as is (see ubx_is_frame()), a sentence
+ * NUL terminated. Network sources carry NMEA only.
+ * */
+int gps_read_raw(char *buffer) {
+    int used;
+
+    if (Source != GPS_SOURCE_SERIAL) {
+        return net_readln(&NetSource, buffer, GPS_MAX_SENTENCE);
+    }
+
+    for (;;) {
+        if (RxStart == RxEnd) {
+            RxStart = 0;
+            RxEnd = serial_read(RxChunk, sizeof(RxChunk));
+        }
+        if (ubx_stream_feed(&Stream, (uint8_t *) RxChunk + RxStart, RxEnd - RxStart, &used) != UBX_STREAM_NONE) {
+            RxStart += used;
+            memcpy(buffer, Stream.frame, Stream.length + 1);
+            return Stream.length;
+        }
+        RxStart += used;
+    }
+}
+
+/*
+ * Reads sentence from device, buffer must hold GPS_MAX_SENTENCE bytes
+ *
+ * UBX frames are decoded into GpsData right here; for those it returns 0 with
+ * an empty buffer, as there is nothing left to parse.
+ * */
 int gps_read(char *buffer) {
+    char frame[GPS_MAX_FRAME];
     int num_bytes;
 
-    num_bytes = serial_readln(buffer);
+    num_bytes = gps_read_raw(frame);
+    if (ubx_is_frame(frame, num_bytes)) {
+        ubx_decode((uint8_t *) frame, num_bytes);
+        buffer[0] = '\0';
+        return 0;
+    }
+    if (num_bytes >= 0) {
+        memcpy(buffer, frame, num_bytes + 1);
+    }
     if(num_bytes > 0) {
         /* save sentence before parsing */
-        strcpy(GpsData.sentence, buffer);
+        strncpy(GpsData.sentence, buffer, sizeof(GpsData.sentence) - 1);
     }
     return num_bytes;
 }
 
 int gps_close() {
+    if (Source != GPS_SOURCE_SERIAL) {
+        net_close(&NetSource);
+        return 0;
+    }
     return serial_close();
 }
 
-/* copies the error message into error_string */
+/* formats the most recent error into error_string, which must hold GPS_ERROR_MAX_STRING bytes */
 void gps_get_error(char *error_string) {
-    strcpy(error_string, GpsData.error_message);
+    gps_error_t error;
+
+    if (gps_error_latest(&error)) {
+        gps_error_format(&error, error_string, GPS_ERROR_MAX_STRING);
+    } else {
+        error_string[0] = '\0';
+    }
 }
 
 /* returns pointer to GpsData struct */
@@ -44,6 +149,41 @@ gps_data_t *gps_get_data_ptr(void) {
     return &GpsData;
 }
 
+/*
+ * Takes the lowest SNR of a GSV table whose cycle is complete
+ *
+ * Called on the last sentence of a GSV cycle, and by ubx.h for NAV-SAT, so
+ * gps_min_snr() never sees a table that is half rewritten.
+ * */
+void gps_gsv_cycle_end(int msg_type) {
+    gsv_data_t *table = msg_type == GPGSV_MESSAGE ? GpsData.GsvDataGps : GpsData.GsvDataGlonass;
+    int i, n, snr, min = -1;
+
+    if (table == NULL) {
+        return;
+    }
+    n = table->satellites_in_view < GPS_MAX_SATS ? table->satellites_in_view : GPS_MAX_SATS;
+    for (i = 0; i < n; i++) {
+        snr = table->gsv_sat[i].signal_to_noise;
+        if (snr > 0 && (min < 0 || snr < min)) {
+            min = snr;
+        }
+    }
+    GsvMinSnr[msg_type == GPGSV_MESSAGE ? 0 : 1] = min;
+}
+
+/* lowest non-zero SNR in dB-Hz of the last complete GSV cycles, -1 if none is tracked or GSV is filtered out */
+int gps_min_snr(void) {
+    int t, min = -1;
+
+    for (t = 0; t < 2; t++) {
+        if (GsvMinSnr[t] > 0 && (min < 0 || GsvMinSnr[t] < min)) {
+            min = GsvMinSnr[t];
+        }
+    }
+    return min;
+}
+
 /* Sets which NMEA messages we will be listening for using bit mask. */
 void gps_set_filters(int filters) {
 
@@ -54,23 +194,25 @@ void gps_set_filters(int filters) {
 
     /* malloc only wanted structs, this saves memory in low-mem situations */
 
+    /* GSV tables can be read before their first cycle, so start them empty */
     if(gps_is_filtered(GLGSV_MESSAGE)) {
-        GpsData.GsvDataGlonass = (gsv_data_t *) malloc(sizeof(gsv_data_t));
+        GpsData.GsvDataGlonass = (gsv_data_t *) calloc(1, sizeof(gsv_data_t));
     }
     if(gps_is_filtered(GPGSV_MESSAGE)) {
-        GpsData.GsvDataGps = (gsv_data_t *) malloc(sizeof(gsv_data_t));
+        GpsData.GsvDataGps = (gsv_data_t *) calloc(1, sizeof(gsv_data_t));
     }
     if(gps_is_filtered(GNGLL_MESSAGE)) {
         GpsData.GllDataGn = (gll_data_t *) malloc(sizeof(gll_data_t));
     }
+    /* so are RMC and GGA times, until the receiver sends one */
     if(gps_is_filtered(GNRMC_MESSAGE)) {
-        GpsData.RmcDataGn = (rmc_data_t *) malloc(sizeof(rmc_data_t));
+        GpsData.RmcDataGn = (rmc_data_t *) calloc(1, sizeof(rmc_data_t));
     }
     if(gps_is_filtered(GNVTG_MESSAGE)) {
         GpsData.VtgDataGn = (vtg_data_t *) malloc(sizeof(vtg_data_t));
     }
     if(gps_is_filtered(GNGGA_MESSAGE)) {
-        GpsData.GgaDataGn = (gga_data_t *) malloc(sizeof(gga_data_t));
+        GpsData.GgaDataGn = (gga_data_t *) calloc(1, sizeof(gga_data_t));
     }
     if(gps_is_filtered(GNGSA_MESSAGE)) {
         GpsData.GsaDataGn = (gsa_data_t *) malloc(sizeof(gsa_data_t));
@@ -91,6 +233,21 @@ void gps_clear_data() {
     free(GpsData.GgaDataGn);
     free(GpsData.GsaDataGn);
     free(GpsData.TxtDataGn);
+
+    GsvMinSnr[0] = GsvMinSnr[1] = -1;
+    GsvNext[0] = GsvNext[1] = 0;
+
+    /* so that a second gps_set_filters() doesn't free them again */
+    GpsData.GsvDataGlonass = NULL;
+    GpsData.GsvDataGps = NULL;
+    GpsData.GllDataGn = NULL;
+    GpsData.RmcDataGn = NULL;
+    GpsData.VtgDataGn = NULL;
+    GpsData.GgaDataGn = NULL;
+    GpsData.GsaDataGn = NULL;
+    GpsData.TxtDataGn = NULL;
+
+    PendingFix.sources = 0;
 }
 
 /* returns > 0 if message is filtered, 0 if not */
@@ -98,6 +255,143 @@ int gps_is_filtered(int msg_type) {
     return (GpsData.filters & msg_type);
 }
 
+/* returns the filter bitmask matching the sentence prefix, 0 if unknown */
+int gps_sentence_type(char *buffer) {
+
+    if (strncmp(buffer, NMEA_PREFIX_GLGSV, 6) == 0) return GLGSV_MESSAGE;
+    if (strncmp(buffer, NMEA_PREFIX_GPGSV, 6) == 0) return GPGSV_MESSAGE;
+    if (strncmp(buffer, NMEA_PREFIX_GNGLL, 6) == 0) return GNGLL_MESSAGE;
+    if (strncmp(buffer, NMEA_PREFIX_GNRMC, 6) == 0) return GNRMC_MESSAGE;
+    if (strncmp(buffer, NMEA_PREFIX_GNVTG, 6) == 0) return GNVTG_MESSAGE;
+    if (strncmp(buffer, NMEA_PREFIX_GNGGA, 6) == 0) return GNGGA_MESSAGE;
+    if (strncmp(buffer, NMEA_PREFIX_GNGSA, 6) == 0) return GNGSA_MESSAGE;
+    if (strncmp(buffer, NMEA_PREFIX_GNTXT, 6) == 0) return GNTXT_MESSAGE;
+
+    return 0;
+}
+
+/* registers a function to be called with every completed fix, returns -1 if the table is full */
+int gps_add_fix_handler(gps_fix_handler_t handler, void *arg) {
+    int i;
+
+    for (i = 0; i < GPS_MAX_FIX_HANDLERS; i++) {
+        if (FixHandlers[i].handler == NULL) {
+            FixHandlers[i].handler = handler;
+            FixHandlers[i].arg = arg;
+            return 0;
+        }
+    }
+    gps_error_push(GPS_ERR_HANDLERS_FULL, 0, -1, -1, GPS_MAX_FIX_HANDLERS);
+    return -1;
+}
+
+/* removes a handler added with gps_add_fix_handler(), returns -1 if it wasn't registered */
+int gps_remove_fix_handler(gps_fix_handler_t handler, void *arg) {
+    int i;
+
+    for (i = 0; i < GPS_MAX_FIX_HANDLERS; i++) {
+        if (FixHandlers[i].handler == handler && FixHandlers[i].arg == arg) {
+            FixHandlers[i].handler = NULL;
+            FixHandlers[i].arg = NULL;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* completes a partially assembled fix, e.g. at the end of a log */
+void gps_flush_fix() {
+    if (PendingFix.sources) {
+        fix_emit();
+    }
+}
+
+/*
+ * Publishes a fix that was not merged from NMEA, e.g. a UBX NAV-PVT
+ *
+ * A partially merged NMEA fix is completed first, and a dated fix becomes the
+ * date for later time-only sentences.
+ * */
+void gps_publish_fix(const gps_fix_t *fix) {
+    gps_flush_fix();
+
+    if (fix->utc_date.tm_mday > 0) {
+        FixDate = fix->utc_date;
+        EpochDays = fix->utc_epoch_ns / (SEC_PER_DAY * NSEC_PER_SEC);
+        EpochSeconds = fix->utc_time.tv_sec;
+    }
+
+    PendingFix = *fix;
+    fix_emit();
+}
+
+/* publishes the pending fix and hands it to every registered handler */
+static void fix_emit() {
+    int i;
+
+    GpsData.fix = PendingFix;
+    GpsData.fix_count++;
+    PendingFix.sources = 0;
+
+    for (i = 0; i < GPS_MAX_FIX_HANDLERS; i++) {
+        if (FixHandlers[i].handler != NULL) {
+            FixHandlers[i].handler(&GpsData.fix, FixHandlers[i].arg);
+        }
+    }
+}
+
+/* merges a freshly parsed RMC or GGA into the pending fix */
+static void fix_merge(int msg_type) {
+    struct timeval utc_time;
+    int64_t utc_epoch_ns;
+    unsigned int wanted;
+
+    if (msg_type == GNRMC_MESSAGE) {
+        utc_time = GpsData.RmcDataGn->utc_time;
+        utc_epoch_ns = GpsData.RmcDataGn->utc_epoch_ns;
+        FixDate = GpsData.RmcDataGn->utc_date;
+    } else {
+        utc_time = GpsData.GgaDataGn->utc_time;
+        utc_epoch_ns = GpsData.GgaDataGn->utc_epoch_ns;
+    }
+
+    /* a sentence from a newer epoch completes whatever we had */
+    if (PendingFix.sources && PendingFix.utc_epoch_ns != utc_epoch_ns) {
+        fix_emit();
+    }
+
+    if (!PendingFix.sources) {
+        memset(&PendingFix, 0, sizeof(PendingFix));
+        PendingFix.utc_time = utc_time;
+        PendingFix.utc_epoch_ns = utc_epoch_ns;
+        PendingFix.valid = 1;
+    }
+    PendingFix.utc_date = FixDate;
+
+    if (msg_type == GNRMC_MESSAGE) {
+        PendingFix.latitude = GpsData.RmcDataGn->latitude;
+        PendingFix.longitude = GpsData.RmcDataGn->longitude;
+        PendingFix.speed = GpsData.RmcDataGn->speed;
+        PendingFix.track_angle = GpsData.RmcDataGn->track_angle;
+        PendingFix.valid &= GpsData.RmcDataGn->valid;
+    } else {
+        PendingFix.latitude = GpsData.GgaDataGn->latitude;
+        PendingFix.longitude = GpsData.GgaDataGn->longitude;
+        PendingFix.altitude = GpsData.GgaDataGn->orthometric_height;
+        PendingFix.gps_quality = GpsData.GgaDataGn->gps_quality;
+        PendingFix.number_svs = GpsData.GgaDataGn->number_svs;
+        PendingFix.HDOP = GpsData.GgaDataGn->HDOP;
+        PendingFix.valid &= (GpsData.GgaDataGn->gps_quality > 0);
+    }
+    PendingFix.sources |= msg_type;
+
+    /* complete once every filtered position sentence has been merged */
+    wanted = GpsData.filters & (GNRMC_MESSAGE | GNGGA_MESSAGE);
+    if ((PendingFix.sources & wanted) == wanted) {
+        fix_emit();
+    }
+}
+
 
 /* returns 1 if we can read this prefix, 0 otherwise */
 int prefix_valid(char *buffer) {
@@ -117,13 +411,8 @@ int prefix_valid(char *buffer) {
 
 }
 
-/* Parse NMEA sentences
- *
- * Returns message number or -1 if it does not understand the sentence
- *
- * */
-
-int parse_sentence(char *buffer) {
+/* hands the sentence to the parser for its type */
+static int dispatch_sentence(char *buffer) {
 
     //printf("GpsData size is %d bytes\n",sizeof(GpsData));
 
@@ -173,6 +462,24 @@ int parse_sentence(char *buffer) {
 
 }
 
+/* Parse NMEA sentences
+ *
+ * Returns message number or -1 if it does not understand the sentence, which
+ * also leaves the error text in GpsData.error_message
+ *
+ * */
+int parse_sentence(char *buffer) {
+    int result;
+
+    TRACE_SCOPE(TRACE_DISPATCH);
+    result = dispatch_sentence(buffer);
+    if (result < 0) {
+        /* only failures are formatted, so good sentences still cost no sprintf */
+        gps_get_error(GpsData.error_message);
+    }
+    return result;
+}
+
 /*
     GSV Fields:
     0	Message ID $GPGSV
@@ -192,27 +499,30 @@ int parse_sentence(char *buffer) {
 int parse_gsv(char *buffer, int msg_type) {
 
     int num_fields = 0;
-    int processed_fields = 0;
-    int i;
+    int i, t;
     char *field[GPS_MAX_FIELDS];
 
     gsv_data_t *GsvData;
 
+    TRACE_SCOPE(TRACE_PARSE_GSV);
+
     switch (msg_type) {
         case GPGSV_MESSAGE:
             GsvData = GpsData.GsvDataGps;
+            t = 0;
             break;
         case GLGSV_MESSAGE:
             GsvData = GpsData.GsvDataGlonass;
+            t = 1;
             break;
         default:
-            sprintf(GpsData.error_message, "Bad GSV message type: %s", GpsData.sentence);
+            gps_error_push(GPS_ERR_SENTENCE_TYPE, msg_type, -1, -1, msg_type);
             return -1;
     }
 
     num_fields = parse_fields(buffer, field, GPS_MAX_FIELDS);
-    if (num_fields < 1) {
-        sprintf(GpsData.error_message, "Bad GSV parse of sentence: %s", GpsData.sentence);
+    if (num_fields + 1 < NMEA_FIELDS_GSV) {
+        gps_error_push(GPS_ERR_NO_FIELDS, msg_type, -1, -1, num_fields + 1);
         return -1;
     }
 
@@ -223,6 +533,13 @@ int parse_gsv(char *buffer, int msg_type) {
     /* num sats in view */
     GsvData->satellites_in_view = atoi(field[3]);
 
+    /* a cycle only counts if none of its sentences went missing */
+    if (GsvData->message_number == 1 || (GsvNext[t] > 1 && GsvData->message_number == GsvNext[t])) {
+        GsvNext[t] = GsvData->message_number + 1;
+    } else {
+        GsvNext[t] = 0;
+    }
+
     /* read up to four satellites per sentence */
     for (i = 0; i < 4; i++) {
 
@@ -230,9 +547,9 @@ int parse_gsv(char *buffer, int msg_type) {
         int skip = (GsvData->message_number - 1) * 4;
 
         /* make sure we don't read beyond the number of parsed fields */
-        processed_fields += 4;
-
-        if (processed_fields > num_fields) break;
+        if (7 + i * 4 > num_fields) break;
+        /* a cycle can announce more satellites than we have room for */
+        if (i + skip < 0 || i + skip >= GPS_MAX_SATS) break;
         /* make sure we adjust PRN number based on GSV type */
         GsvData->gsv_sat[i + skip].prn_number = get_prn_number(atoi(field[4 + (i * 4)]), msg_type);
         GsvData->gsv_sat[i + skip].elevation = atoi(field[5 + (i * 4)]);
@@ -241,6 +558,10 @@ int parse_gsv(char *buffer, int msg_type) {
 
     }
 
+    if (GsvNext[t] > 1 && GsvData->message_number == GsvData->total_messages) {
+        gps_gsv_cycle_end(msg_type);
+    }
+
     return 0;
 
 }
@@ -260,19 +581,13 @@ int parse_gsv(char *buffer, int msg_type) {
 int parse_gll(char *buffer) {
 
     int num_fields = 0;
-    char hours[3];
-    char minutes[3];
-    char seconds[3];
-    char degrees[4];
-
-
-    char milliseconds[16];
-    char *eptr;
     char *field[GPS_MAX_FIELDS];
 
+    TRACE_SCOPE(TRACE_PARSE_GLL);
+
     num_fields = parse_fields(buffer, field, GPS_MAX_FIELDS);
-    if (num_fields < 1) {
-        sprintf(GpsData.error_message, "Bad GLL parse of sentence: %s", GpsData.sentence);
+    if (num_fields + 1 < NMEA_FIELDS_GLL) {
+        gps_error_push(GPS_ERR_NO_FIELDS, GNGLL_MESSAGE, -1, -1, num_fields + 1);
         return -1;
     }
 
@@ -281,24 +596,17 @@ int parse_gll(char *buffer) {
         GpsData.GllDataGn->valid = 1;
     } else {
         GpsData.GllDataGn->valid = 0;
+        gps_error_push(GPS_ERR_DATA_VOID, GNGLL_MESSAGE, 6, field[6] - buffer, field[6][0]);
         return -1;
     }
 
-    strncpy(degrees, field[1], 2);
-    degrees[2] = '\0'; // null terminate
-    strcpy(minutes, field[1] + 2);
-
-    GpsData.GllDataGn->latitude = strtod(degrees, &eptr) + (strtod(minutes, &eptr) / 60.00);
+    GpsData.GllDataGn->latitude = parse_coordinate(field[1], 2);
     /* South is negative */
     if (strncmp(field[2], "S", 1) == 0) {
         GpsData.GllDataGn->latitude *= -1;
     }
 
-    strncpy(degrees, field[3], 3);
-    degrees[3] = '\0'; // null terminate
-    strcpy(minutes, field[3] + 3);
-
-    GpsData.GllDataGn->longitude = strtod(degrees, &eptr) + (strtod(minutes, &eptr) / 60.00);
+    GpsData.GllDataGn->longitude = parse_coordinate(field[3], 3);
     /* West is negative */
     if (strncmp(field[4], "W", 1) == 0) {
         GpsData.GllDataGn->longitude *= -1;
@@ -306,16 +614,9 @@ int parse_gll(char *buffer) {
 
     strcpy(GpsData.GllDataGn->utc_time_string, field[5]);
 
-    strncpy(hours, field[5], 2);
-    hours[2] = '\0'; // null terminate
-    strncpy(minutes, field[5] + 2, 2);
-    minutes[2] = '\0'; // null terminate
-    strncpy(seconds, field[5] + 4, 2);
-    seconds[2] = '\0'; // null terminate
-    strcpy(milliseconds, field[5] + 7); // already null terminated
-
-    GpsData.GllDataGn->utc_time.tv_sec = (atoi(hours) * 3600) + (atoi(minutes) * 60) + atoi(seconds);
-    GpsData.GllDataGn->utc_time.tv_usec = atoi(milliseconds) * 1000;
+    if (parse_utc_time(field[5], &GpsData.GllDataGn->utc_time) == 0) {
+        GpsData.GllDataGn->utc_epoch_ns = utc_epoch(&GpsData.GllDataGn->utc_time);
+    }
 
     return 0;
 }
@@ -339,21 +640,18 @@ int parse_gll(char *buffer) {
 int parse_rmc(char *buffer) {
     int num_fields = 0;
 
-    char day[3];
-    char month[3];
-    char year[3];
-
-    char hours[3];
-    char minutes[3];
-    char seconds[3];
-    char degrees[4];
+    struct timeval utc_time;
+    struct tm utc_date;
+    int have_time;
 
     char *eptr;
     char *field[GPS_MAX_FIELDS];
 
+    TRACE_SCOPE(TRACE_PARSE_RMC);
+
     num_fields = parse_fields(buffer, field, GPS_MAX_FIELDS);
-    if (num_fields < 1) {
-        sprintf(GpsData.error_message, "Bad RMC parse of sentence: %s", GpsData.sentence);
+    if (num_fields + 1 < NMEA_FIELDS_RMC) {
+        gps_error_push(GPS_ERR_NO_FIELDS, GNRMC_MESSAGE, -1, -1, num_fields + 1);
         return -1;
     }
 
@@ -367,28 +665,20 @@ int parse_rmc(char *buffer) {
         //return -1;
     } else {
         GpsData.RmcDataGn->valid = 0;
-        sprintf(GpsData.error_message, "RMC data unknown Valid flag: %s", GpsData.sentence);
+        gps_error_push(GPS_ERR_BAD_FIELD, GNRMC_MESSAGE, 2, field[2] - buffer, field[2][0]);
         return -1;
     }
 
     strcpy(GpsData.RmcDataGn->utc_time_string, field[1]);
 
-    strncpy(degrees, field[3], 2);
-    degrees[2] = '\0'; // null terminate
-    strcpy(minutes, field[3] + 2);
-
-    GpsData.RmcDataGn->latitude = strtod(degrees, &eptr) + (strtod(minutes, &eptr) / 60.00);
+    GpsData.RmcDataGn->latitude = parse_coordinate(field[3], 2);
 
     /* South is negative */
     if (strncmp(field[4], "S", 1) == 0) {
         GpsData.RmcDataGn->latitude *= -1;
     }
 
-    strncpy(degrees, field[5], 3);
-    degrees[3] = '\0'; // null terminate
-    strcpy(minutes, field[5] + 3);
-
-    GpsData.RmcDataGn->longitude = strtod(degrees, &eptr) + (strtod(minutes, &eptr) / 60.00);
+    GpsData.RmcDataGn->longitude = parse_coordinate(field[5], 3);
 
     /* West is negative */
     if (strncmp(field[6], "W", 1) == 0) {
@@ -400,32 +690,36 @@ int parse_rmc(char *buffer) {
 
     strcpy(GpsData.RmcDataGn->utc_date_string, field[9]);
 
-    // parse date
-    strncpy(day, field[9], 2);
-    day[2] = '\0'; // null terminate
-    strncpy(month, field[9] + 2, 2);
-    month[2] = '\0'; // null terminate
-    strncpy(year, field[9] + 4, 2);
-    year[2] = '\0'; // null terminate
-
-    GpsData.RmcDataGn->utc_date.tm_mday = atoi(day);
-    GpsData.RmcDataGn->utc_date.tm_mon = atoi(month);
-    GpsData.RmcDataGn->utc_date.tm_year = atoi(year) + 2000;
-
-    // parse time
-    strncpy(hours, field[1], 2);
-    hours[2] = '\0'; // null terminate
-    strncpy(minutes, field[1] + 2, 2);
-    minutes[2] = '\0'; // null terminate
-    strncpy(seconds, field[1] + 4, 2);
-    seconds[2] = '\0'; // null terminate
-
-    GpsData.RmcDataGn->utc_date.tm_hour = atoi(hours);
-    GpsData.RmcDataGn->utc_date.tm_min = atoi(minutes);
-    GpsData.RmcDataGn->utc_date.tm_sec = atoi(seconds);
+    /* a receiver without a fix sends empty time and date, which must not move the date */
+    have_time = parse_utc_time(field[1], &utc_time) == 0;
+    if (have_time) {
+        if (parse_utc_date(field[9], &utc_date) == 0) {
+            utc_date.tm_hour = (int) (utc_time.tv_sec / 3600);
+            utc_date.tm_min = (int) (utc_time.tv_sec / 60 % 60);
+            utc_date.tm_sec = (int) (utc_time.tv_sec % 60);
+
+            /* RMC carries the date, which time-only sentences pick up */
+            EpochDays = days_from_civil(utc_date.tm_year + 1900, utc_date.tm_mon + 1, utc_date.tm_mday);
+            EpochSeconds = utc_time.tv_sec;
+            utc_date.tm_wday = (int) ((EpochDays % 7 + 11) % 7);   /* 1970-01-01 was a Thursday */
+            utc_date.tm_yday = (int) (EpochDays - days_from_civil(utc_date.tm_year + 1900, 1, 1));
+            GpsData.RmcDataGn->utc_date = utc_date;
+            GpsData.RmcDataGn->utc_epoch_ns = gps_epoch_ns(EpochDays, utc_time.tv_sec, utc_time.tv_usec);
+        } else {
+            /* time but no date yet: dated from the last good one, like GGA */
+            GpsData.RmcDataGn->utc_epoch_ns = utc_epoch(&utc_time);
+        }
+        GpsData.RmcDataGn->utc_time = utc_time;
+    }
 
     GpsData.RmcDataGn->magnetic_variation = strtod(field[10], &eptr);
 
+    /* without a time there is no epoch to put this in, so it does not make a fix */
+    if (!have_time) {
+        return 0;
+    }
+    fix_merge(GNRMC_MESSAGE);
+
     return 0;
 
 }
@@ -448,9 +742,11 @@ int parse_vtg(char *buffer) {
     int num_fields;
     char *field[GPS_MAX_FIELDS];
     char *eptr;
+
+    TRACE_SCOPE(TRACE_PARSE_VTG);
     num_fields = parse_fields(buffer, field, GPS_MAX_FIELDS);
-    if (num_fields < 1) {
-        sprintf(GpsData.error_message, "Bad VTG parse of sentence: %s", GpsData.sentence);
+    if (num_fields + 1 < NMEA_FIELDS_VTG) {
+        gps_error_push(GPS_ERR_NO_FIELDS, GNVTG_MESSAGE, -1, -1, num_fields + 1);
         return -1;
     }
 
@@ -500,52 +796,34 @@ int parse_vtg(char *buffer) {
  */
 
 int parse_gga(char *buffer) {
-    int num_fields;
+    int num_fields, have_time;
     char *field[GPS_MAX_FIELDS];
     char *eptr;
 
-    char hours[3];
-    char minutes[3];
-    char seconds[3];
-    char degrees[4];
-    char milliseconds[16];
+    TRACE_SCOPE(TRACE_PARSE_GGA);
 
     num_fields = parse_fields(buffer, field, GPS_MAX_FIELDS);
-    if (num_fields < 1) {
-        sprintf(GpsData.error_message, "Bad GGA parse of sentence: %s", GpsData.sentence);
+    if (num_fields + 1 < NMEA_FIELDS_GGA) {
+        gps_error_push(GPS_ERR_NO_FIELDS, GNGGA_MESSAGE, -1, -1, num_fields + 1);
         return -1;
     }
 
     strcpy(GpsData.GgaDataGn->utc_time_string, field[1]);
 
     // parse time
-    strncpy(hours, field[1], 2);
-    hours[2] = '\0'; // null terminate
-    strncpy(minutes, field[1] + 2, 2);
-    minutes[2] = '\0'; // null terminate
-    strncpy(seconds, field[1] + 4, 2);
-    seconds[2] = '\0'; // null terminate
-    strcpy(milliseconds, field[1] + 7); // already null terminated
-
-    GpsData.GgaDataGn->utc_time.tv_sec = (atoi(hours) * 3600) + (atoi(minutes) * 60) + atoi(seconds);
-    GpsData.GgaDataGn->utc_time.tv_usec = atoi(milliseconds) * 1000;
-
+    have_time = parse_utc_time(field[1], &GpsData.GgaDataGn->utc_time) == 0;
+    if (have_time) {
+        GpsData.GgaDataGn->utc_epoch_ns = utc_epoch(&GpsData.GgaDataGn->utc_time);
+    }
 
-    strncpy(degrees, field[2], 2);
-    degrees[2] = '\0'; // null terminate
-    strcpy(minutes, field[2] + 2);
 
-    GpsData.GgaDataGn->latitude = strtod(degrees, &eptr) + (strtod(minutes, &eptr) / 60.00);
+    GpsData.GgaDataGn->latitude = parse_coordinate(field[2], 2);
 
     if (strncmp(field[3], "S", 1) == 0) {
         GpsData.GgaDataGn->latitude *= -1;
     }
 
-    strncpy(degrees, field[4], 3);
-    degrees[3] = '\0'; // null terminate
-    strcpy(minutes, field[4] + 3);
-
-    GpsData.GgaDataGn->longitude = strtod(degrees, &eptr) + (strtod(minutes, &eptr) / 60.00);
+    GpsData.GgaDataGn->longitude = parse_coordinate(field[4], 3);
 
     if (strncmp(field[5], "W", 1) == 0) {
         GpsData.GgaDataGn->longitude *= -1;
@@ -566,10 +844,119 @@ int parse_gga(char *buffer) {
     GpsData.GgaDataGn->age_of_differential = strtod(field[13], &eptr);
     GpsData.GgaDataGn->reference_id = atoi(field[14]);
 
+    /* like RMC, a sentence without a time does not make a fix */
+    if (!have_time) {
+        return 0;
+    }
+    fix_merge(GNGGA_MESSAGE);
+
     return 0;
 
 }
 
+/*
+ * Epoch of a time-only sentence (GGA, GLL)
+ *
+ * Uses the date of the last RMC. A time of day that went back by more than 12
+ * hours crossed midnight; one that went forward by more than 12 hours is a late
+ * sentence from before midnight.
+ */
+
+static int64_t utc_epoch(struct timeval *utc_time) {
+    if (EpochSeconds >= 0) {
+        if (utc_time->tv_sec < EpochSeconds - SEC_PER_DAY / 2) {
+            EpochDays++;
+        } else if (utc_time->tv_sec > EpochSeconds + SEC_PER_DAY / 2) {
+            return gps_epoch_ns(EpochDays - 1, utc_time->tv_sec, utc_time->tv_usec);
+        }
+    }
+    EpochSeconds = utc_time->tv_sec;
+
+    return gps_epoch_ns(EpochDays, utc_time->tv_sec, utc_time->tv_usec);
+}
+
+/*
+ * Parses a hhmmss.sss time field into seconds of the day
+ *
+ * The fraction may have any number of digits. Returns -1 if the field is too short.
+ */
+
+int parse_utc_time(char *field, struct timeval *utc_time) {
+    int i;
+    long usec = 0;
+    long scale = 100000;
+
+    for (i = 0; i < 6; i++) {
+        if (field[i] < '0' || field[i] > '9') {
+            return -1;
+        }
+    }
+
+    utc_time->tv_sec = ((field[0] - '0') * 10 + (field[1] - '0')) * 3600 +
+                       ((field[2] - '0') * 10 + (field[3] - '0')) * 60 +
+                       ((field[4] - '0') * 10 + (field[5] - '0'));
+
+    if (field[6] == '.') {
+        for (i = 7; field[i] >= '0' && field[i] <= '9' && scale > 0; i++) {
+            usec += (field[i] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    utc_time->tv_usec = usec;
+
+    return 0;
+}
+
+/*
+ * Parses a ddmm.mmmm or dddmm.mmmm coordinate field into degrees, unsigned
+ *
+ * Returns 0 for a field too short to hold the degrees, e.g. an empty one.
+ */
+
+static double parse_coordinate(const char *field, int degree_digits) {
+    char degrees[4];
+
+    if (strlen(field) < (size_t) degree_digits) {
+        return 0.0;
+    }
+    memcpy(degrees, field, degree_digits);
+    degrees[degree_digits] = '\0';
+
+    return strtod(degrees, NULL) + strtod(field + degree_digits, NULL) / 60.00;
+}
+
+/*
+ * Parses a ddmmyy date field into date, years 2000 to 2099
+ *
+ * Returns -1 unless the field is exactly six digits with the day and month in range.
+ */
+
+int parse_utc_date(char *field, struct tm *date) {
+    int i, day, month;
+
+    for (i = 0; i < 6; i++) {
+        if (field[i] < '0' || field[i] > '9') {
+            return -1;
+        }
+    }
+    if (field[6] != '\0' && field[6] != '*') {
+        return -1;
+    }
+
+    day = (field[0] - '0') * 10 + (field[1] - '0');
+    month = (field[2] - '0') * 10 + (field[3] - '0');
+    if (day < 1 || day > 31 || month < 1 || month > 12) {
+        return -1;
+    }
+
+    memset(date, 0, sizeof(struct tm));
+    date->tm_mday = day;
+    date->tm_mon = month - 1;
+    date->tm_year = (field[4] - '0') * 10 + (field[5] - '0') + 100;
+
+    return 0;
+}
+
 /*
     GSA sentence
     0	Message ID $GPGSA
@@ -587,9 +974,11 @@ int parse_gsa(char *buffer) {
     char *field[GPS_MAX_FIELDS];
     char *eptr;
 
+    TRACE_SCOPE(TRACE_PARSE_GSA);
+
     num_fields = parse_fields(buffer, field, GPS_MAX_FIELDS);
-    if (num_fields < 1) {
-        sprintf(GpsData.error_message, "Bad GLL parse of sentence: %s", GpsData.sentence);
+    if (num_fields + 1 < NMEA_FIELDS_GSA) {
+        gps_error_push(GPS_ERR_NO_FIELDS, GNGSA_MESSAGE, -1, -1, num_fields + 1);
         return -1;
     }
 
@@ -599,7 +988,7 @@ int parse_gsa(char *buffer) {
     } else if (strncmp(field[1], "A", 1) == 0) {
         GpsData.GsaDataGn->mode_1 = 1;
     } else {
-        sprintf(GpsData.error_message, "Invalid GSA Mode 1: %s", field[1]);
+        gps_error_push(GPS_ERR_BAD_FIELD, GNGSA_MESSAGE, 1, field[1] - buffer, field[1][0]);
         return -1;
     }
 
@@ -607,9 +996,9 @@ int parse_gsa(char *buffer) {
     for (i = 0; i < 12; i++) {
         GpsData.GsaDataGn->prn_number[i] = atoi(field[3 + i]);
     }
-    GpsData.GsaDataGn->PDOP = strtod(field[4], &eptr);
-    GpsData.GsaDataGn->HDOP = strtod(field[5], &eptr);
-    GpsData.GsaDataGn->VDOP = strtod(field[6], &eptr);
+    GpsData.GsaDataGn->PDOP = strtod(field[15], &eptr);
+    GpsData.GsaDataGn->HDOP = strtod(field[16], &eptr);
+    GpsData.GsaDataGn->VDOP = strtod(field[17], &eptr);
 
     return 0;
 }
@@ -630,13 +1019,15 @@ int parse_txt(char *buffer) {
     char *message;
     char temp_buffer[256];
 
+    TRACE_SCOPE(TRACE_PARSE_TXT);
+
     int sentence_number, text_id;
 
     strcpy(temp_buffer, buffer);
 
     num_fields = parse_fields(buffer, field, GPS_MAX_FIELDS);
-    if (num_fields < 1) {
-        sprintf(GpsData.error_message, "Bad TXT parse of sentence: %s", GpsData.sentence);
+    if (num_fields + 1 < NMEA_FIELDS_TXT) {
+        gps_error_push(GPS_ERR_NO_FIELDS, GNTXT_MESSAGE, -1, -1, num_fields + 1);
         return -1;
     }
 
@@ -648,10 +1039,11 @@ int parse_txt(char *buffer) {
 
     // copy sentence into correct index
     if (sentence_number > 0 && sentence_number < 100) {
-        strcpy(GpsData.TxtDataGn->message[sentence_number], message);
+        snprintf(GpsData.TxtDataGn->message[sentence_number], sizeof(GpsData.TxtDataGn->message[sentence_number]),
+                 "%s", message);
         GpsData.TxtDataGn->text_id[sentence_number] = text_id;
     } else {
-        sprintf(GpsData.error_message, "Bad TXT sentence number: %d", sentence_number);
+        gps_error_push(GPS_ERR_SENTENCE_NUMBER, GNTXT_MESSAGE, 2, field[2] - buffer, sentence_number);
         return -1;
     }
 
@@ -738,8 +1130,8 @@ void print_rmc() {
     printf("Speed in m/s: %.6f\n", GpsData.RmcDataGn->speed);
     printf("Track angle: %.6f\n", GpsData.RmcDataGn->track_angle);
     printf("UTC Date string: %s\n", GpsData.RmcDataGn->utc_date_string);
-    printf("UTC Date: %4d-%02d-%02d %02d:%02d:%02d\n", GpsData.RmcDataGn->utc_date.tm_year,
-           GpsData.RmcDataGn->utc_date.tm_mon,
+    printf("UTC Date: %4d-%02d-%02d %02d:%02d:%02d\n", GpsData.RmcDataGn->utc_date.tm_year + 1900,
+           GpsData.RmcDataGn->utc_date.tm_mon + 1,
            GpsData.RmcDataGn->utc_date.tm_mday, GpsData.RmcDataGn->utc_date.tm_hour, GpsData.RmcDataGn->utc_date.tm_min,
            GpsData.RmcDataGn->utc_date.tm_sec);
     printf("Magnetic variation: %.6f\n", GpsData.RmcDataGn->magnetic_variation);
@@ -769,7 +1161,7 @@ int get_prn_number(int prn, int gsv_type) {
             return prn;
             break;
         default:
-            sprintf(GpsData.error_message, "Unknown GSV Type: %02x", gsv_type);
+            gps_error_push(GPS_ERR_SENTENCE_TYPE, gsv_type, -1, -1, gsv_type);
             return -1;
     }
 }
@@ -832,14 +1224,16 @@ int checksum_valid(char *string) {
     int checksum;
     unsigned char calculated_checksum = 0;
 
+    TRACE_SCOPE(TRACE_CHECKSUM);
+
     // Checksum is postcede by *
     checksum_str = strchr(string, '*');
     if (checksum_str != NULL) {
         // Remove checksum from string
         *checksum_str = '\0';
-        // Calculate checksum, starting after $ (i = 1)
-        for (int i = 1; i < strlen(string); i++) {
-            calculated_checksum = calculated_checksum ^ string[i];
+        // Calculate checksum, starting after $
+        if (checksum_str - string > 1) {
+            calculated_checksum = nmea_checksum(string + 1, checksum_str - string - 1);
         }
         checksum = hex2int((char *) checksum_str + 1);
         //printf("Checksum Str [%s], Checksum %02X, Calculated Checksum %02X\r\n",(char *)checksum_str+1, checksum, calculated_checksum);
@@ -847,13 +1241,36 @@ int checksum_valid(char *string) {
             //printf("Checksum OK");
             return 1;
         }
+        gps_error_push(GPS_ERR_CHECKSUM, gps_sentence_type(string), -1, checksum_str - string,
+                       (checksum & 0xff) << 8 | calculated_checksum);
     } else {
-        sprintf(GpsData.error_message, "Error: Checksum missing or NULL NMEA message: %s", GpsData.sentence);
-        return 0;
+        gps_error_push(GPS_ERR_NO_CHECKSUM, gps_sentence_type(string), -1, -1, 0);
     }
+    gps_get_error(GpsData.error_message);
     return 0;
 }
 
+/* XOR of length bytes, the checksum of the text between '$' and '*'; eight bytes per step */
+unsigned char nmea_checksum(const char *data, size_t length) {
+    uint64_t word, sum = 0;
+    unsigned char checksum;
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        memcpy(&word, data + i, 8);
+        sum ^= word;
+    }
+    sum ^= sum >> 32;
+    sum ^= sum >> 16;
+    sum ^= sum >> 8;
+    checksum = (unsigned char) sum;
+
+    for (; i < length; i++) {
+        checksum ^= (unsigned char) data[i];
+    }
+    return checksum;
+}
+
 int hex2int(char *c) {
     int value;
 
@@ -876,6 +1293,8 @@ int hexchar2int(char c) {
 
 int parse_fields(char *string, char **fields, int max_fields) {
     int i = 0;
+
+    TRACE_SCOPE(TRACE_PARSE_FIELDS);
     fields[i++] = string;
 
     while ((i < max_fields) && NULL != (string = strchr(string, ','))) {
@@ -1,3 +1,6 @@
+#ifndef SATGPS_H
+#define SATGPS_H
+
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -9,9 +12,18 @@
 #include <stdlib.h>
 
 #include "serial.h"
+#include "gpstime.h"
 
 #define GPS_MAX_FIELDS  32      /* probably too high; NMEA-0183 has maximum string length of 82 chars. */
 #define GPS_MAX_SATS    32      /* maximum number of satellites to store. */
+#define GPS_MAX_FIX_HANDLERS    8   /* maximum number of registered fix handlers */
+#define GPS_MAX_SENTENCE        256 /* size of the buffer passed to gps_read() */
+#define GPS_MAX_FRAME           3080 /* size of the buffer passed to gps_read_raw(), fits UBX NAV-SAT with all 255 satellites and a NUL */
+
+/* where gps_read() gets sentences from */
+#define GPS_SOURCE_SERIAL   0       /* PORTNAME, see serial.h */
+#define GPS_SOURCE_UDP      1       /* NMEA datagrams */
+#define GPS_SOURCE_TCP      2       /* NMEA stream from a TCP server */
 
 #define METERS_PER_SECOND_PER_KNOT  0.5144444444        /* to convert knots to meters per second */
 #define METERS_PER_SECOND_PER_KPH   0.2777777778        /* to convert kph to meters per second */
@@ -26,6 +38,15 @@
 #define NMEA_PREFIX_GNGSA           "$GNGSA"    /* GPS DOP and active satellites */
 #define NMEA_PREFIX_GNTXT           "$GNTXT"    /* GPS DOP and active satellites */
 
+/* fields a sentence needs before it is parsed, the address field included */
+#define NMEA_FIELDS_GSV             4           /* satellites follow in groups of four */
+#define NMEA_FIELDS_GLL             7
+#define NMEA_FIELDS_RMC             12
+#define NMEA_FIELDS_VTG             9
+#define NMEA_FIELDS_GGA             15
+#define NMEA_FIELDS_GSA             18
+#define NMEA_FIELDS_TXT             5
+
 /* Sentence filter bitmasks. Use gps_set_filters() to turn on or off */
 #define GLGSV_MESSAGE       1<<0    /* $GLGSV */
 #define GPGSV_MESSAGE       1<<1    /* $GPGSV */
@@ -35,6 +56,7 @@
 #define GNGGA_MESSAGE       1<<5    /* $GNGGA */
 #define GNGSA_MESSAGE       1<<6    /* $GNGGA */
 #define GNTXT_MESSAGE       1<<7    /* $GNGGA */
+#define UBX_MESSAGE         1<<8    /* binary UBX frame, not a filter (see ubx.h) */
 
 /*
  * GSV satellite type
@@ -64,6 +86,7 @@ typedef struct {
     double              longitude;                  /* in degrees, E is positive, W negative */
     char                utc_time_string[256];       /* UTC time, as a raw string from GPS */
     struct timeval      utc_time;                   /* UTC time as timeval, with microsecond resolution */
+    int64_t             utc_epoch_ns;               /* UTC nanoseconds since 1970-01-01, see gps_fix_t */
     int                 valid;                      /* 1 = valid, 0 = invalid */
 } gll_data_t;
 
@@ -73,13 +96,14 @@ typedef struct {
 typedef struct {
     char                utc_time_string[256];       /* UTC time, as a raw string from GPS */
     struct timeval      utc_time;                   /* UTC time as timeval, with microsecond resolution */
+    int64_t             utc_epoch_ns;               /* UTC nanoseconds since 1970-01-01, see gps_fix_t */
     int                 valid;                      /* 1 = valid, 0 = invalid */
     double              latitude;                   /* in degrees, N is positive, S negative */
     double              longitude;                  /* in degrees, E is positive, W negative */
     double              speed;                      /* ground speed in m/s */
     double              track_angle;                /* in degrees */
     char                utc_date_string[256];       /* UTC date, as raw string from GPS */
-    struct tm           utc_date;                   /* UTC date as tm struct */
+    struct tm           utc_date;                   /* UTC date and time as tm struct (tm_year since 1900, tm_mon 0-11) */
     double              magnetic_variation;         /* magnetic variation in degrees */
 } rmc_data_t;
 
@@ -99,6 +123,7 @@ typedef struct {
 typedef struct {
     char                utc_time_string[256];       /* UTC time, as a raw string from GPS */
     struct timeval      utc_time;                   /* UTC time as timeval, with microsecond resolution */
+    int64_t             utc_epoch_ns;               /* UTC nanoseconds since 1970-01-01, see gps_fix_t */
     double              latitude;                   /* in degrees, N is positive, S negative */
     double              longitude;                  /* in degrees, E is positive, W negative */
     int                 gps_quality;                /* GPS quality indicator */
@@ -130,6 +155,36 @@ typedef struct {
     char                message[128][100];           /* 100 messages of 128 chars each */
 } txt_data_t;
 
+/*
+ * Unified fix, assembled from the RMC and GGA sentences of one epoch
+ *
+ * A fix is complete once every filtered RMC/GGA sentence for the epoch has been
+ * merged in, or when a sentence for a newer epoch arrives first.
+ *
+ * utc_epoch_ns takes the date from the most recent RMC and rolls over at
+ * midnight for time-only sentences (GGA, GLL). Until an RMC has been parsed,
+ * it counts from 1970-01-01 but still increases across midnight.
+ */
+
+typedef struct {
+    int64_t             utc_epoch_ns;               /* UTC nanoseconds since 1970-01-01 */
+    struct timeval      utc_time;                   /* UTC time of day, with microsecond resolution */
+    struct tm           utc_date;                   /* UTC date from the most recent RMC, tm_mday is 0 before that */
+    int                 valid;                      /* 1 = valid, 0 = invalid */
+    double              latitude;                   /* in degrees, N is positive, S negative */
+    double              longitude;                  /* in degrees, E is positive, W negative */
+    double              altitude;                   /* orthometric height in meters (GGA) */
+    double              speed;                      /* ground speed in m/s (RMC) */
+    double              track_angle;                /* in degrees (RMC) */
+    int                 gps_quality;                /* GPS quality indicator (GGA) */
+    int                 number_svs;                 /* Number of SVs in use (GGA) */
+    double              HDOP;                       /* HDOP (GGA) */
+    unsigned int        sources;                    /* bitmask of sentences merged into this fix */
+} gps_fix_t;
+
+/* called with every completed fix */
+typedef void (*gps_fix_handler_t)(const gps_fix_t *, void *);
+
 /* all combined into one struct
  *
  * This is about 16K
@@ -146,23 +201,36 @@ typedef struct {
     gga_data_t      *GgaDataGn;                      /* Combined GPS and GLONASS GGA data */
     gsa_data_t      *GsaDataGn;                      /* Combined GPS and GLONASS GSA data */
     txt_data_t      *TxtDataGn;                      /* Combined GPS and GLONASS GSA data */
-    char            error_message[256];              /* buffer for error messages */
+    char            error_message[256];              /* last rejected sentence's error, see gps_get_error() */
     char            sentence[128];                   /* holds copy of complete sentence */
     unsigned int    filters;                         /* bitmask of sentences we will be listening for */
+    gps_fix_t       fix;                             /* most recently completed fix */
+    unsigned long   fix_count;                       /* number of fixes completed so far */
 } gps_data_t;
 
 
 int gps_open(void);
+int gps_open_udp(int);
+int gps_open_tcp(const char *, int);
 int gps_close(void);
 int gps_read(char *);
+int gps_read_raw(char *);
 gps_data_t *gps_get_data_ptr(void);
+int gps_min_snr(void);
+void gps_gsv_cycle_end(int);
 void gps_get_error(char *);
 void gps_set_filters(int);
 void gps_clear_data(void);
 int gps_is_filtered(int);
+int gps_sentence_type(char *);
+int gps_add_fix_handler(gps_fix_handler_t, void *);
+int gps_remove_fix_handler(gps_fix_handler_t, void *);
+void gps_flush_fix(void);
+void gps_publish_fix(const gps_fix_t *);
 
 
 int checksum_valid(char *);
+unsigned char nmea_checksum(const char *, size_t);
 int hex2int(char *);
 int hexchar2int(char);
 int parse_fields(char *, char **, int);
@@ -176,6 +244,8 @@ int parse_vtg(char *);
 int parse_gga(char *);
 int parse_gsa(char *);
 int parse_txt(char *);
+int parse_utc_time(char *, struct timeval *);
+int parse_utc_date(char *, struct tm *);
 
 void print_gsv(int);
 void print_gll(void);
@@ -189,5 +259,4 @@ void print_binary(unsigned int);
 
 int get_prn_number(int, int);
 
-
-
+#endif /* SATGPS_H */
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <signal.h>
+
+#include "satgps.h"
+#include "mux.h"
+
+/*
+ * Merges NMEA from serial ports, ptys and UDP and re-emits the valid sentences
+ * (see mux.h). -f, -n and -T apply to the outputs given after them.
+ *
+ *     satgps_mux [-i device|-]... [-u port]... [-f types] [-n N] [-T talker]
+ *                [-o path|-]... [-d host:port]... [-s]
+ *
+ *     -i  read a serial port, pty or FIFO, - for stdin
+ *     -u  listen for NMEA datagrams
+ *     -f  comma separated sentence types to pass: GNRMC,GPGSV,... unknown, all
+ *     -n  keep every Nth sentence of each type (whole GSV cycles)
+ *     -T  rewrite the talker ID, e.g. GP
+ *     -o  write to a file, pty or serial port, - for stdout
+ *     -d  send a datagram per sentence to host:port
+ *     -s  print statistics on exit
+ * */
+
+static volatile sig_atomic_t running = 1;
+
+static mux_t Mux;
+
+static const char *TypeNames[] = {"GLGSV", "GPGSV", "GNGLL", "GNRMC", "GNVTG", "GNGGA", "GNGSA", "GNTXT"};
+
+void shutdown_mux(int signum) {
+    (void) signum;
+    running = 0;
+}
+
+/* -f argument to a types mask, 0 if a name is unknown */
+static unsigned int parse_types(char *list) {
+    unsigned int types = 0;
+    char *name;
+    int i;
+
+    for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (strcmp(name, "all") == 0) {
+            types |= MUX_ALL;
+            continue;
+        }
+        if (strcmp(name, "unknown") == 0) {
+            types |= MUX_UNKNOWN;
+            continue;
+        }
+        for (i = 0; i < 8; i++) {
+            if (strcmp(name, TypeNames[i]) == 0) {
+                types |= 1 << i;
+                break;
+            }
+        }
+        if (i == 8) {
+            fprintf(stderr, "Unknown sentence type %s\n", name);
+            return 0;
+        }
+    }
+    return types;
+}
+
+static void print_stats(void) {
+    mux_input_t *in;
+    mux_output_t *out;
+    int i;
+
+    for (i = 0; i < Mux.num_inputs; i++) {
+        in = &Mux.inputs[i];
+        fprintf(stderr, "input %d: %lu bytes, %lu sentences, %lu invalid, %lu overlong\n",
+                i, in->bytes, in->sentences, in->invalid, in->overlong);
+    }
+    for (i = 0; i < Mux.num_outputs; i++) {
+        out = &Mux.outputs[i];
+        fprintf(stderr, "output %d: %lu sentences (%lu rewritten) in %lu writes, %lu decimated, %lu dropped\n",
+                i, out->sentences, out->rewritten, out->writes, out->decimated, out->dropped);
+    }
+}
+
+int main(int argc, char **argv) {
+    mux_output_config_t config;
+    char *colon;
+    int opt, fd, result;
+    int stats = 0;
+
+    memset(&config, 0, sizeof(config));
+    config.types = MUX_ALL;
+    mux_init(&Mux, 0);
+
+    while ((opt = getopt(argc, argv, "i:u:f:n:T:o:d:s")) != -1) {
+        result = 0;
+        switch (opt) {
+            case 'i':
+                result = strcmp(optarg, "-") == 0 ? mux_add_fd(&Mux, STDIN_FILENO) : mux_add_device(&Mux, optarg);
+                break;
+            case 'u':
+                result = mux_add_udp(&Mux, atoi(optarg));
+                break;
+            case 'f':
+                config.types = parse_types(optarg);
+                result = config.types == 0 ? -1 : 0;
+                break;
+            case 'n':
+                config.decimate = atoi(optarg);
+                break;
+            case 'T':
+                if (strlen(optarg) != 2) {
+                    fprintf(stderr, "Expected a two letter talker ID, got %s\n", optarg);
+                    return 1;
+                }
+                strcpy(config.talker, optarg);
+                break;
+            case 'o':
+                if (strcmp(optarg, "-") == 0) {
+                    fd = STDOUT_FILENO;
+                } else {
+                    fd = open(optarg, O_WRONLY | O_CREAT | O_APPEND | O_NOCTTY, 0644);
+                    if (fd < 0) {
+                        perror(optarg);
+                        return 1;
+                    }
+                }
+                result = mux_add_output(&Mux, fd, &config);
+                break;
+            case 'd':
+                colon = strrchr(optarg, ':');
+                if (colon == NULL) {
+                    fprintf(stderr, "Expected host:port, got %s\n", optarg);
+                    return 1;
+                }
+                *colon = '\0';
+                result = mux_add_output_udp(&Mux, optarg, atoi(colon + 1), &config);
+                break;
+            case 's':
+                stats = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-i device|-]... [-u port]... [-f types] [-n N] [-T talker] "
+                                "[-o path|-]... [-d host:port]... [-s]\n", argv[0]);
+                return 1;
+        }
+        if (result < 0) {
+            fprintf(stderr, "Can't add -%c %s\n", opt, optarg);
+            return 1;
+        }
+    }
+
+    if (Mux.num_inputs == 0) {
+        fprintf(stderr, "No inputs, use -i or -u\n");
+        return 1;
+    }
+    if (Mux.num_outputs == 0) {
+        mux_add_output(&Mux, STDOUT_FILENO, &config);
+    }
+
+    signal(SIGINT, shutdown_mux);
+    signal(SIGTERM, shutdown_mux);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* until interrupted or every input has ended */
+    while (running && mux_poll(&Mux, 500) >= 0) {
+    }
+
+    if (stats) {
+        print_stats();
+    }
+    mux_close(&Mux);
+    return 0;
+}
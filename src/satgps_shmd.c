@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+
+#include "serial.h"
+#include "satgps.h"
+#include "gpsshm.h"
+#include "reader.h"
+#include "ubx.h"
+
+/*
+ * Reads and parses the GPS once and publishes fixes, sky views and statistics
+ * into shared memory for any number of local clients (see gpsshm.h).
+ *
+ * A reader thread keeps draining the serial port while we parse and publish;
+ * if we fall behind, its queue applies the -p policy (latest by default).
+ *
+ *     satgps_shmd [-n /shm_name] [-p oldest|newest|latest|block]
+ * */
+
+#define SHMD_BATCH      32      /* sentences taken from the reader queue at once */
+
+static volatile sig_atomic_t running = 1;
+
+void shutdown_daemon(int signum) {
+    (void) signum;
+    running = 0;
+}
+
+int main(int argc, char **argv) {
+    gps_line_t lines[SHMD_BATCH];
+    gps_reader_t reader;
+    gps_reader_stats_t reader_stats;
+    gpsshm_publisher_t pub;
+    gpsshm_stats_t stats;
+    const char *name = GPSSHM_DEFAULT_NAME;
+    int policy = READER_KEEP_LATEST;
+    int opt, i, n;
+
+    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+        switch (opt) {
+            case 'n':
+                name = optarg;
+                break;
+            case 'p':
+                if (strcmp(optarg, "oldest") == 0) {
+                    policy = READER_DROP_OLDEST;
+                } else if (strcmp(optarg, "newest") == 0) {
+                    policy = READER_DROP_NEWEST;
+                } else if (strcmp(optarg, "latest") == 0) {
+                    policy = READER_KEEP_LATEST;
+                } else if (strcmp(optarg, "block") == 0) {
+                    policy = READER_BLOCK;
+                } else {
+                    fprintf(stderr, "Unknown policy %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n /shm_name] [-p oldest|newest|latest|block]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    signal(SIGINT, shutdown_daemon);
+    signal(SIGTERM, shutdown_daemon);
+
+    if (gpsshm_create(&pub, name) < 0) {
+        return 1;
+    }
+
+    if (gps_open() < 0) {
+        gpsshm_destroy(&pub);
+        return 1;
+    }
+
+    gps_set_filters(GLGSV_MESSAGE | GPGSV_MESSAGE | GNRMC_MESSAGE | GNVTG_MESSAGE | GNGGA_MESSAGE | GNGSA_MESSAGE);
+    gps_add_fix_handler(gpsshm_fix_handler, &pub);
+
+    if (gps_reader_init(&reader, READER_DEFAULT_CAPACITY, policy) < 0 || gps_reader_start(&reader) < 0) {
+        gps_close();
+        gpsshm_destroy(&pub);
+        return 1;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    while (running) {
+        /* wakes up now and then to notice a signal */
+        n = gps_reader_dequeue(&reader, lines, SHMD_BATCH, 500);
+        if (n < 0) {
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            stats.sentences++;
+            if (lines[i].type == UBX_MESSAGE) {
+                if (ubx_decode((uint8_t *) lines[i].text, lines[i].length) < 0) {
+                    stats.errors++;
+                }
+            } else if (!checksum_valid(lines[i].text) || !prefix_valid(lines[i].text) || parse_sentence(lines[i].text) < 0) {
+                stats.errors++;
+            }
+        }
+
+        gps_reader_stats(&reader, &reader_stats);
+        stats.dropped = reader_stats.dropped_oldest + reader_stats.dropped_newest + reader_stats.replaced;
+        stats.fixes = gps_get_data_ptr()->fix_count;
+        gpsshm_publish_stats(&pub, &stats);
+    }
+
+    gps_reader_free(&reader);
+    gps_close();
+    gpsshm_destroy(&pub);
+    return 0;
+}
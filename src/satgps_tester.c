@@ -1,61 +1,300 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <signal.h>
 
 #include "serial.h"
 #include "satgps.h"
+#include "export.h"
+#include "rtpipe.h"
+#include "gpsclock.h"
+#include "archive.h"
+#include "trace.h"
 
+static export_t Export;
+static char ExportBuffer[EXPORT_DEFAULT_BUFFER];
+static int Exporting = 0;
+static FILE *Messages;
+
+static rtpipe_t Pipeline;
+static gpsclock_t Clock;
+static int Realtime = 0;
+static volatile sig_atomic_t Stopping = 0;
 
 void shutdown() {
-    printf("Ctrl-C Caught, shutting down...\n");
+    if (Realtime && !Stopping) {
+        /* main() stops the pipeline and comes back here */
+        Stopping = 1;
+        return;
+    }
+    fprintf(stderr, "Ctrl-C Caught, shutting down...\n");
+    TRACE_DUMP("satgps_trace.json");
+    if (Exporting) {
+        gps_flush_fix();
+        export_flush(&Export);
+    }
     gps_close();
     exit(0);
 }
 
+/* writes a sky view once a GSV cycle is complete, then flushes */
+static void export_sentence(int msg_type) {
+    gsv_data_t *gsv;
+
+    if (msg_type == GPGSV_MESSAGE || msg_type == GLGSV_MESSAGE) {
+        gsv = msg_type == GPGSV_MESSAGE ? gps_get_data_ptr()->GsvDataGps : gps_get_data_ptr()->GsvDataGlonass;
+        if (gsv->message_number == gsv->total_messages) {
+            export_sky(&Export, gsv, msg_type, gps_get_data_ptr()->fix.utc_epoch_ns);
+        }
+    }
+    /* a live receiver makes a few records per second, don't hold them back */
+    export_flush(&Export);
+}
+
+/* pipeline consumer, on the decode thread: the same output as the read loop */
+static void print_line(const gps_line_t *line, int result, void *arg) {
+    char error[256];
+
+    (void) arg;
+
+    if (line->type == UBX_MESSAGE) {
+        return;
+    }
+    if (result < 0) {
+        gps_get_error(error);
+        fprintf(Messages, "GPS Error: %s\n", error);
+        fprintf(Messages, "Sentence: %s\n", line->text);
+        return;
+    }
+    if (Exporting) {
+        export_sentence(line->type);
+        return;
+    }
+    print_rmc();
+    print_txt();
+}
+
+/* -r: runs the reader and parser on their own threads until Ctrl-C */
+static void run_pipeline(const rtpipe_config_t *config) {
+    rtpipe_stats_t stats;
+    gpsclock_estimate_t estimate;
+
+    gpsclock_init(&Clock, GPSCLOCK_DEFAULT_BAUD, 0);
+    if (rtpipe_init(&Pipeline, config) < 0) {
+        perror("Can't set up the pipeline (mlockall needs CAP_IPC_LOCK or a higher RLIMIT_MEMLOCK)");
+        return;
+    }
+    rtpipe_add_consumer(&Pipeline, gpsclock_consumer, &Clock);
+    rtpipe_add_consumer(&Pipeline, print_line, NULL);
+    if (rtpipe_start(&Pipeline) < 0) {
+        perror("Can't start the pipeline threads (check the CPU numbers; SCHED_FIFO needs CAP_SYS_NICE or RLIMIT_RTPRIO)");
+        rtpipe_free(&Pipeline);
+        return;
+    }
+
+    while (!Stopping) {
+        pause();
+    }
+    rtpipe_stop(&Pipeline);
+
+    rtpipe_stats(&Pipeline, &stats);
+    fprintf(stderr, "%lu lines, %lu rejected, %lu overruns\n", stats.lines, stats.rejected, stats.overruns);
+    fprintf(stderr, "latency read to dispatched: min %.1f us, mean %.1f us, max %.1f us, jitter %.1f us\n",
+            stats.latency_min_ns / 1e3, stats.lines ? stats.latency_sum_ns / 1e3 / stats.lines : 0.0,
+            stats.latency_max_ns / 1e3, stats.jitter_ns / 1e3);
+    fprintf(stderr, "longest decode %.1f us\n", stats.decode_max_ns / 1e3);
+
+    gpsclock_estimate(&Clock, &estimate);
+    if (estimate.samples >= GPSCLOCK_MIN_SAMPLES) {
+        fprintf(stderr, "GPS clock from %d epochs: drift %.3f ppm, arrival spread %.1f us, now %lld ns\n",
+                estimate.samples, estimate.drift * 1e6, estimate.spread_ns / 1e3, (long long) gps_now());
+    }
+    rtpipe_free(&Pipeline);
+}
+
+/* MB/s of a stage's busy time */
+static double stage_rate(const archive_stage_t *stage) {
+    return stage->busy_ns > 0 ? stage->bytes_out * 1e3 / stage->busy_ns : 0.0;
+}
+
+/* -f: parses a plain, gzip or zstd log and reports which stage limits the throughput */
+static int run_archive(const char *path) {
+    archive_t archive;
+    archive_stats_t stats;
+    int result;
+
+    if (archive_open(&archive, path) < 0) {
+        perror("Can't read the log (gzip needs zlib, zstd needs libzstd at build time)");
+        return 1;
+    }
+    result = archive_parse(&archive, NULL);
+    gps_flush_fix();
+    if (Exporting) {
+        export_flush(&Export);
+    }
+    if (result < 0) {
+        fprintf(stderr, "%s: %s, stopped early\n", path, strerror(archive.error));
+    }
+
+    archive_stats(&archive, &stats);
+    fprintf(stderr, "%lu sentences, %lu UBX frames, %lu errors, %lu fixes in %.3f s\n", stats.sentences,
+            stats.frames, stats.errors, gps_get_data_ptr()->fix_count, stats.elapsed_ns / 1e9);
+    fprintf(stderr, "decompress: %.1f MB in, %.1f MB out, %.1f MB/s busy, waited %.3f s\n",
+            stats.decompress.bytes_in / 1e6, stats.decompress.bytes_out / 1e6, stage_rate(&stats.decompress),
+            stats.decompress.wait_ns / 1e9);
+    fprintf(stderr, "parse: %.1f MB/s busy, waited %.3f s\n", stage_rate(&stats.parse), stats.parse.wait_ns / 1e9);
+    archive_close(&archive);
+    return result < 0 ? 1 : 0;
+}
 
 int main(int argc, char **argv) {
     //int sfd;
-    char buffer[256];
-    char sentence[256];
+    char buffer[GPS_MAX_SENTENCE];
+    char sentence[GPS_MAX_SENTENCE];
     char error[256];
+    char *colon;
+    int opt;
+    int source = GPS_SOURCE_SERIAL;
+    int port = 0;
+    char *host = NULL;
+    char *log = NULL;
+    rtpipe_config_t rt_config;
     //int nbytes;
     //int gps_message_type;
 
+    /*
+     * -u port: NMEA over UDP, -t host:port: NMEA from a TCP server, default is the serial port
+     * -o json|csv: write fixes and sky views to stdout as NDJSON or CSV instead of printing RMC data
+     * -r reader_cpu,decode_cpu,priority: read and parse on pinned SCHED_FIFO threads with memory locked,
+     *    -1 for any CPU, priority 0 for the normal scheduler
+     * -f path: parse a plain, gzip or zstd log (- for stdin) instead, then print each stage's throughput
+     * */
+    Messages = stdout;
+    rtpipe_default_config(&rt_config);
+    while ((opt = getopt(argc, argv, "u:t:o:r:f:")) != -1) {
+        switch (opt) {
+            case 'u':
+                source = GPS_SOURCE_UDP;
+                port = atoi(optarg);
+                break;
+            case 't':
+                source = GPS_SOURCE_TCP;
+                host = optarg;
+                colon = strrchr(optarg, ':');
+                if (colon == NULL) {
+                    fprintf(stderr, "Expected host:port, got %s\n", optarg);
+                    return 1;
+                }
+                *colon = '\0';
+                port = atoi(colon + 1);
+                break;
+            case 'o':
+                if (strcmp(optarg, "json") != 0 && strcmp(optarg, "csv") != 0) {
+                    fprintf(stderr, "Expected json or csv, got %s\n", optarg);
+                    return 1;
+                }
+                export_init(&Export, strcmp(optarg, "csv") == 0 ? EXPORT_CSV : EXPORT_NDJSON, STDOUT_FILENO,
+                            ExportBuffer, sizeof(ExportBuffer));
+                Exporting = 1;
+                Messages = stderr;
+                break;
+            case 'r':
+                if (sscanf(optarg, "%d,%d,%d", &rt_config.reader_cpu, &rt_config.decode_cpu,
+                           &rt_config.decode_priority) != 3) {
+                    fprintf(stderr, "Expected reader_cpu,decode_cpu,priority, got %s\n", optarg);
+                    return 1;
+                }
+                /* the reader mostly sleeps in read(), but must win against the decoder when data arrives */
+                rt_config.reader_priority = rt_config.decode_priority > 0 ? rt_config.decode_priority + 1 : 0;
+                if (rt_config.reader_priority > 99) {
+                    rt_config.reader_priority = 99;
+                }
+                rt_config.lock_memory = 1;
+                Realtime = 1;
+                break;
+            case 'f':
+                log = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-u port | -t host:port | -f log] [-o json|csv] "
+                                "[-r reader_cpu,decode_cpu,priority]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
     signal(SIGINT, shutdown);
+    TRACE_INIT(getenv("SATGPS_TRACE_PERF") ? TRACE_PERF : 0);
+
+    if (log != NULL) {
+        gps_set_filters(GNRMC_MESSAGE | GNGGA_MESSAGE | GNGSA_MESSAGE | GPGSV_MESSAGE | GLGSV_MESSAGE);
+        if (Exporting) {
+            gps_add_fix_handler(export_fix_handler, &Export);
+        }
+        return run_archive(log);
+    }
 
     /* Open GPS device for reading */
-    gps_open();
+    switch (source) {
+        case GPS_SOURCE_UDP:
+            gps_open_udp(port);
+            break;
+        case GPS_SOURCE_TCP:
+            gps_open_tcp(host, port);
+            break;
+        default:
+            gps_open();
+    }
 
     /* set filters to parse wanted sentences */
-    gps_set_filters(GNRMC_MESSAGE | GNTXT_MESSAGE);
+    if (Exporting) {
+        gps_set_filters(GNRMC_MESSAGE | GNGGA_MESSAGE | GPGSV_MESSAGE | GLGSV_MESSAGE);
+        gps_add_fix_handler(export_fix_handler, &Export);
+    } else {
+        gps_set_filters(GNRMC_MESSAGE | GNTXT_MESSAGE);
+    }
+
+    if (Realtime) {
+        run_pipeline(&rt_config);
+        Stopping = 1;
+        shutdown();
+    }
 
     /* infinite read loop */
     while (1) {
 
         /* read sentence from GPS device */
-        gps_read(buffer);
+        /* 0 means a UBX frame, already decoded */
+        if (gps_read(buffer) <= 0) {
+            continue;
+        }
         strcpy(sentence, buffer);
 
         /* make sure the data is valid before parsing */
         if (!checksum_valid(buffer)) {
-            printf("Checksum invalid for sentence: %s\n", sentence);
+            fprintf(Messages, "Checksum invalid for sentence: %s\n", sentence);
             continue;
         }
 
         if(!prefix_valid(buffer)) {
-            printf("Unknown GPS prefix for sentence: %s\n", sentence);
+            fprintf(Messages, "Unknown GPS prefix for sentence: %s\n", sentence);
             continue;
         }
 
         /* parse sentence */
         if (parse_sentence(buffer) < 0) {
             gps_get_error(error);
-            printf("GPS Error: %s\n", error);
-            printf("Sentence: %s\n", sentence);
+            fprintf(Messages, "GPS Error: %s\n", error);
+            fprintf(Messages, "Sentence: %s\n", sentence);
         };
 
+        if (Exporting) {
+            export_sentence(gps_sentence_type(sentence));
+            continue;
+        }
+
         //print_gsv(GPGSV_MESSAGE);
         //print_gsv();
         //print_gll();
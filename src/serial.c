@@ -7,9 +7,14 @@
 
 
 #include "serial.h"
+#include "trace.h"
 
 int serial_fd;
 
+/* bytes read from the tty but not yet returned as lines */
+static char rx_buffer[SERIAL_CHUNK];
+static int rx_start, rx_end;
+
 /* opens serial port and returns fd if success, -1 if error */
 int serial_open() {
 
@@ -57,27 +62,54 @@ int serial_open() {
     return 0;
 }
 
-/* reads until newline, puts line into buffer */
+/* reads until newline, puts line into buffer (at most SERIAL_MAX_LINE bytes, longer lines are cut) */
 int serial_readln(char * buffer) {
     char c;
-    char *b = buffer;
+    int len = 0;
     int rx_length = -1;
 
+    TRACE_SCOPE(TRACE_SERIAL_READ);
+
     while(1) {
-        rx_length = read(serial_fd, (void*)(&c), 1);
-
-        if (rx_length <= 0) {
-            //wait for messages
-            sleep(1);
-        } else {
-            if (c == '\n') {
-                *b++ = '\0';
-                break;
+        /* drain the tty in chunks rather than one syscall per byte */
+        if (rx_start == rx_end) {
+            rx_length = read(serial_fd, (void*)rx_buffer, sizeof(rx_buffer));
+
+            if (rx_length <= 0) {
+                //wait for messages
+                sleep(1);
+                continue;
             }
-            *b++ = c;
+            rx_start = 0;
+            rx_end = rx_length;
+        }
+
+        c = rx_buffer[rx_start++];
+        if (c == '\n') {
+            break;
+        }
+        if (len < SERIAL_MAX_LINE - 1) {
+            buffer[len++] = c;
+        }
+    }
+    buffer[len] = '\0';
+    return len;
+}
+
+/* reads whatever the tty has, at most size bytes, waiting for at least one */
+int serial_read(char *buffer, int size) {
+    int rx_length;
+
+    TRACE_SCOPE(TRACE_SERIAL_READ);
+
+    while(1) {
+        rx_length = read(serial_fd, (void*)buffer, size);
+        if (rx_length > 0) {
+            return rx_length;
         }
+        //wait for messages
+        sleep(1);
     }
-    return strlen(buffer);
 }
 
 int serial_close() {
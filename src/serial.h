@@ -12,8 +12,12 @@
 #define PORTNAME    "/dev/serial0"
 #endif
 
+#define SERIAL_MAX_LINE     256     /* longest line serial_readln() stores, with the '\0'; same as GPS_MAX_SENTENCE */
+#define SERIAL_CHUNK        512     /* bytes taken from the tty per read() */
+
 // returns -1 if error, otherwise 0
 int serial_open();
 int serial_close();
 int serial_readln(char *);
+int serial_read(char *, int);
 
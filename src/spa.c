@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "spa.h"
+
+#define DEG2RAD     (M_PI / 180.0)
+#define RAD2DEG     (180.0 / M_PI)
+#define ARCSEC      (1.0 / 3600.0)
+
+#define SIDEREAL_DEGREES_PER_DAY    360.98564736629
+#define JULIAN_DAY_UNIX_EPOCH       2440587.5
+
+/*
+ * Solar position after Meeus, Astronomical Algorithms (2nd ed.), chapters 7,
+ * 12, 22 and 25: low-accuracy solar coordinates with the main nutation terms,
+ * good to about 0.01 degrees, which is well below what the GPS position and
+ * refraction model contribute.
+ * */
+
+/* normalizes degrees to [0, 360) */
+static double limit_degrees(double degrees) {
+    degrees = fmod(degrees, 360.0);
+    return degrees < 0.0 ? degrees + 360.0 : degrees;
+}
+
+/* apparent right ascension and declination of the sun at Julian day jd (UT) */
+static void sun_apparent(spa_data_t *spa, double jd, double *ra, double *dec, double *radius) {
+    double t = (jd + spa->delta_t / 86400.0 - 2451545.0) / 36525.0;
+    double l0 = 280.46646 + t * (36000.76983 + t * 0.0003032);
+    double m = 357.52911 + t * (35999.05029 - t * 0.0001537);
+    double e = 0.016708634 - t * (0.000042037 + t * 0.0000001267);
+    double c, theta, nu, lambda;
+
+    c = (1.914602 - t * (0.004817 + t * 0.000014)) * sin(m * DEG2RAD) +
+        (0.019993 - t * 0.000101) * sin(2.0 * m * DEG2RAD) +
+        0.000289 * sin(3.0 * m * DEG2RAD);
+    theta = l0 + c;
+    nu = m + c;
+    *radius = 1.000001018 * (1.0 - e * e) / (1.0 + e * cos(nu * DEG2RAD));
+
+    /* nutation and aberration */
+    lambda = theta + spa->nutation_longitude - 20.4898 * ARCSEC / *radius;
+
+    *ra = limit_degrees(atan2(cos(spa->obliquity * DEG2RAD) * sin(lambda * DEG2RAD), cos(lambda * DEG2RAD)) * RAD2DEG);
+    *dec = asin(sin(spa->obliquity * DEG2RAD) * sin(lambda * DEG2RAD)) * RAD2DEG;
+}
+
+/* computes the per-day terms for the day starting at jd0 */
+static void spa_cache_day(spa_data_t *spa, double jd0) {
+    double jd12 = jd0 + 0.5;
+    double t = (jd12 + spa->delta_t / 86400.0 - 2451545.0) / 36525.0;
+    double omega = 125.04452 - 1934.136261 * t;
+    double l_sun = 280.4665 + 36000.7698 * t;
+    double l_moon = 218.3165 + 481267.8813 * t;
+    double nutation_obliquity, mean_obliquity, gmst0, radius;
+    int i;
+
+    spa->nutation_longitude = (-17.20 * sin(omega * DEG2RAD) - 1.32 * sin(2.0 * l_sun * DEG2RAD) -
+                               0.23 * sin(2.0 * l_moon * DEG2RAD) + 0.21 * sin(2.0 * omega * DEG2RAD)) * ARCSEC;
+    nutation_obliquity = (9.20 * cos(omega * DEG2RAD) + 0.57 * cos(2.0 * l_sun * DEG2RAD) +
+                          0.10 * cos(2.0 * l_moon * DEG2RAD) - 0.09 * cos(2.0 * omega * DEG2RAD)) * ARCSEC;
+    mean_obliquity = 23.0 + 26.0 / 60.0 + (21.448 - t * (46.8150 + t * (0.00059 - t * 0.001813))) * ARCSEC;
+    spa->obliquity = mean_obliquity + nutation_obliquity;
+
+    t = (jd0 - 2451545.0) / 36525.0;
+    gmst0 = 280.46061837 + SIDEREAL_DEGREES_PER_DAY * (jd0 - 2451545.0) + t * t * (0.000387933 - t / 38710000.0);
+    spa->gast0 = limit_degrees(gmst0 + spa->nutation_longitude * cos(spa->obliquity * DEG2RAD));
+
+    for (i = 0; i < 3; i++) {
+        sun_apparent(spa, jd0 + i * 0.5, &spa->ra[i], &spa->dec[i], &radius);
+        /* unwrap so the interpolation doesn't jump at 360 */
+        if (i > 0 && spa->ra[i] < spa->ra[i - 1] - 180.0) {
+            spa->ra[i] += 360.0;
+        }
+    }
+    spa->parallax = 8.794 * ARCSEC / radius;
+
+    spa->jd0 = jd0;
+}
+
+/* sets default refraction parameters and clears the cache */
+void spa_init(spa_data_t *spa) {
+    spa->pressure = SPA_DEFAULT_PRESSURE;
+    spa->temperature = SPA_DEFAULT_TEMPERATURE;
+    spa->delta_t = SPA_DEFAULT_DELTA_T;
+    spa->azimuth = 0.0;
+    spa->elevation = 0.0;
+    spa->zenith = 90.0;
+    spa->jd0 = 0.0;
+}
+
+/*
+ * Computes the sun's azimuth and elevation for an observer
+ *
+ * Only a change of UTC day recomputes the cached terms. Returns 0, or -1 for a
+ * time before 1970.
+ * */
+int spa_compute(spa_data_t *spa, int64_t utc_epoch_ns, double latitude, double longitude) {
+    int64_t days = utc_epoch_ns / (SEC_PER_DAY * NSEC_PER_SEC);
+    double jd0, f, ra, dec, hour_angle, elevation, azimuth, refraction;
+    double sin_lat, cos_lat, sin_dec, cos_dec, cos_ha;
+
+    if (utc_epoch_ns < 0) {
+        return -1;
+    }
+
+    jd0 = JULIAN_DAY_UNIX_EPOCH + days;
+    if (jd0 != spa->jd0) {
+        spa_cache_day(spa, jd0);
+    }
+
+    /* quadratic interpolation through the 0h, 12h and 24h values */
+    f = (utc_epoch_ns - days * SEC_PER_DAY * NSEC_PER_SEC) / (double) (SEC_PER_DAY * NSEC_PER_SEC);
+    ra = spa->ra[0] + f * (-3.0 * spa->ra[0] + 4.0 * spa->ra[1] - spa->ra[2]) +
+         f * f * (2.0 * spa->ra[0] - 4.0 * spa->ra[1] + 2.0 * spa->ra[2]);
+    dec = spa->dec[0] + f * (-3.0 * spa->dec[0] + 4.0 * spa->dec[1] - spa->dec[2]) +
+          f * f * (2.0 * spa->dec[0] - 4.0 * spa->dec[1] + 2.0 * spa->dec[2]);
+
+    hour_angle = (spa->gast0 + SIDEREAL_DEGREES_PER_DAY * f + longitude - ra) * DEG2RAD;
+
+    sin_lat = sin(latitude * DEG2RAD);
+    cos_lat = cos(latitude * DEG2RAD);
+    sin_dec = sin(dec * DEG2RAD);
+    cos_dec = cos(dec * DEG2RAD);
+    cos_ha = cos(hour_angle);
+
+    elevation = asin(sin_lat * sin_dec + cos_lat * cos_dec * cos_ha) * RAD2DEG;
+    azimuth = atan2(-cos_dec * sin(hour_angle), cos_lat * sin_dec - sin_lat * cos_dec * cos_ha) * RAD2DEG;
+
+    /* topocentric parallax */
+    elevation -= spa->parallax * cos(elevation * DEG2RAD);
+
+    /* atmospheric refraction (Bennett), only while the sun can be above the horizon */
+    if (elevation >= -0.83337) {
+        refraction = (spa->pressure / 1010.0) * (283.0 / (273.0 + spa->temperature)) *
+                     1.02 / (60.0 * tan((elevation + 10.3 / (elevation + 5.11)) * DEG2RAD));
+        elevation += refraction;
+    }
+
+    spa->azimuth = limit_degrees(azimuth);
+    spa->elevation = elevation;
+    spa->zenith = 90.0 - elevation;
+
+    return 0;
+}
+
+/* updates the solar position from a fix, returns -1 if the fix has no usable date or position */
+int spa_update(spa_data_t *spa, const gps_fix_t *fix) {
+
+    if (!fix->valid || fix->utc_date.tm_mday == 0) {
+        return -1;
+    }
+
+    return spa_compute(spa, fix->utc_epoch_ns, fix->latitude, fix->longitude);
+}
+
+/* for gps_add_fix_handler(spa_fix_handler, &spa) */
+void spa_fix_handler(const gps_fix_t *fix, void *arg) {
+    spa_update((spa_data_t *) arg, fix);
+}
+
+/*
+ * Solar positions for a historical track, e.g. gps_batch_t columns
+ *
+ * Returns the number of points computed.
+ * */
+int spa_batch(spa_data_t *spa, const int64_t *utc_epoch_ns, const double *latitude, const double *longitude,
+              int n, double *azimuth, double *elevation) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (spa_compute(spa, utc_epoch_ns[i], latitude[i], longitude[i]) < 0) {
+            break;
+        }
+        azimuth[i] = spa->azimuth;
+        elevation[i] = spa->elevation;
+    }
+    return i;
+}
@@ -0,0 +1,43 @@
+#ifndef SPA_H
+#define SPA_H
+
+#include "satgps.h"
+
+#define SPA_DEFAULT_PRESSURE        1010.0          /* mbar, for atmospheric refraction */
+#define SPA_DEFAULT_TEMPERATURE     10.0            /* degrees C, for atmospheric refraction */
+#define SPA_DEFAULT_DELTA_T         69.2            /* TT - UT in seconds */
+
+/*
+ * Solar position state
+ *
+ * The terms that change slowly (Julian day, nutation, obliquity, the sun's
+ * apparent right ascension and declination, sidereal time) are computed once
+ * per UTC day. Every fix then only interpolates those and rotates them into
+ * the observer's horizon.
+ * */
+typedef struct {
+    double              pressure;                   /* mbar */
+    double              temperature;                /* degrees C */
+    double              delta_t;                    /* TT - UT in seconds */
+
+    double              azimuth;                    /* degrees clockwise from true north */
+    double              elevation;                  /* degrees above the horizon, refraction corrected */
+    double              zenith;                     /* 90 - elevation */
+
+    /* per-day cache */
+    double              jd0;                        /* Julian day at 0h UT of the cached day, 0 = nothing cached */
+    double              nutation_longitude;         /* degrees */
+    double              obliquity;                  /* true obliquity of the ecliptic, degrees */
+    double              gast0;                      /* apparent sidereal time at 0h UT, degrees */
+    double              ra[3];                      /* apparent right ascension at 0h, 12h, 24h UT, unwrapped */
+    double              dec[3];                     /* apparent declination at 0h, 12h, 24h UT */
+    double              parallax;                   /* equatorial horizontal parallax, degrees */
+} spa_data_t;
+
+void spa_init(spa_data_t *);
+int spa_update(spa_data_t *, const gps_fix_t *);
+void spa_fix_handler(const gps_fix_t *, void *);
+int spa_compute(spa_data_t *, int64_t, double, double);
+int spa_batch(spa_data_t *, const int64_t *, const double *, const double *, int, double *, double *);
+
+#endif /* SPA_H */
@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "satgps.h"
+#include "batch.h"
+#include "tiles.h"
+
+#define TILES_MIN_ROWS_PER_THREAD   4096        /* fewer isn't worth a thread */
+
+/* per-thread share of tiles_add_batch() */
+typedef struct {
+    tiles_t             partial;
+    const gps_batch_t   *batch;
+    int                 first, last;                /* rows [first, last) */
+    int                 result;
+    pthread_t           thread;
+} tiles_worker_t;
+
+static int tiles_alloc(tiles_t *tiles, size_t capacity) {
+    tiles->cells = (tiles_cell_t *) malloc(capacity * sizeof(tiles_cell_t));
+    if (tiles->cells == NULL) {
+        return -1;
+    }
+    /* all ones is TILES_EMPTY */
+    memset(tiles->cells, 0xff, capacity * sizeof(tiles_cell_t));
+    tiles->capacity = capacity;
+    tiles->count = 0;
+    return 0;
+}
+
+/* square lat/lon cells of cell_degrees, returns -1 if out of memory or the size is unusable */
+int tiles_init_grid(tiles_t *tiles, double cell_degrees) {
+    memset(tiles, 0, sizeof(tiles_t));
+    if (!(cell_degrees > 0.0) || 360.0 / cell_degrees >= 4294967295.0) {
+        return -1;
+    }
+    tiles->tiling = TILES_GRID;
+    tiles->cell_degrees = cell_degrees;
+    return tiles_alloc(tiles, TILES_INITIAL_CAPACITY);
+}
+
+/* Web Mercator (Bing/OSM) tiles at zoom 0 to TILES_MAX_ZOOM, returns -1 if out of memory or range */
+int tiles_init_quadkey(tiles_t *tiles, int zoom) {
+    memset(tiles, 0, sizeof(tiles_t));
+    if (zoom < 0 || zoom > TILES_MAX_ZOOM) {
+        return -1;
+    }
+    tiles->tiling = TILES_QUADKEY;
+    tiles->zoom = zoom;
+    return tiles_alloc(tiles, TILES_INITIAL_CAPACITY);
+}
+
+void tiles_free(tiles_t *tiles) {
+    free(tiles->cells);
+    memset(tiles, 0, sizeof(tiles_t));
+}
+
+/* empties the table without shrinking it */
+void tiles_reset(tiles_t *tiles) {
+    memset(tiles->cells, 0xff, tiles->capacity * sizeof(tiles_cell_t));
+    tiles->count = 0;
+    tiles->fixes = 0;
+    tiles->skipped = 0;
+}
+
+/* spreads the low 32 bits of v to the even bit positions */
+static uint64_t spread_bits(uint64_t v) {
+    v &= 0xffffffffULL;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    v = (v | (v << 1)) & 0x5555555555555555ULL;
+    return v;
+}
+
+/* inverse of spread_bits() */
+static uint64_t gather_bits(uint64_t v) {
+    v &= 0x5555555555555555ULL;
+    v = (v | (v >> 1)) & 0x3333333333333333ULL;
+    v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v >> 4)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+    v = (v | (v >> 16)) & 0x00000000ffffffffULL;
+    return v;
+}
+
+static int64_t clamp_index(double index, int64_t count) {
+    if (index < 0.0) {
+        return 0;
+    }
+    if (index >= (double) count) {
+        return count - 1;
+    }
+    return (int64_t) index;
+}
+
+/* key of the tile holding a position, in degrees */
+uint64_t tiles_key(const tiles_t *tiles, double latitude, double longitude) {
+    int64_t rows, cols, n, x, y;
+    double sin_lat;
+
+    if (tiles->tiling == TILES_GRID) {
+        rows = (int64_t) ceil(180.0 / tiles->cell_degrees);
+        cols = (int64_t) ceil(360.0 / tiles->cell_degrees);
+        y = clamp_index(floor((latitude + 90.0) / tiles->cell_degrees), rows);
+        x = clamp_index(floor((longitude + 180.0) / tiles->cell_degrees), cols);
+        return (uint64_t) y << 32 | (uint64_t) x;
+    }
+
+    n = (int64_t) 1 << tiles->zoom;
+    if (latitude > TILES_MAX_LATITUDE) {
+        latitude = TILES_MAX_LATITUDE;
+    } else if (latitude < -TILES_MAX_LATITUDE) {
+        latitude = -TILES_MAX_LATITUDE;
+    }
+    sin_lat = sin(latitude * M_PI / 180.0);
+    x = clamp_index(floor((longitude + 180.0) / 360.0 * (double) n), n);
+    y = clamp_index(floor((0.5 - log((1.0 + sin_lat) / (1.0 - sin_lat)) / (4.0 * M_PI)) * (double) n), n);
+    return spread_bits((uint64_t) x) | spread_bits((uint64_t) y) << 1;
+}
+
+/* slot holding key, or the free slot where it would go */
+static size_t find_slot(const tiles_t *tiles, uint64_t key) {
+    size_t mask = tiles->capacity - 1;
+    size_t slot = (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctzll(tiles->capacity)));
+
+    while (tiles->cells[slot].key != key && tiles->cells[slot].key != TILES_EMPTY) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int grow(tiles_t *tiles) {
+    tiles_t bigger = *tiles;
+    size_t i;
+
+    if (tiles_alloc(&bigger, tiles->capacity * 2) < 0) {
+        return -1;
+    }
+    for (i = 0; i < tiles->capacity; i++) {
+        if (tiles->cells[i].key != TILES_EMPTY) {
+            bigger.cells[find_slot(&bigger, tiles->cells[i].key)] = tiles->cells[i];
+        }
+    }
+    bigger.count = tiles->count;
+    free(tiles->cells);
+    *tiles = bigger;
+    return 0;
+}
+
+/* the cell for key, created empty if new; NULL if out of memory */
+static tiles_cell_t *get_cell(tiles_t *tiles, uint64_t key) {
+    tiles_cell_t *cell;
+
+    if ((tiles->count + 1) * 10 > tiles->capacity * 7 && grow(tiles) < 0) {
+        return NULL;
+    }
+    cell = &tiles->cells[find_slot(tiles, key)];
+    if (cell->key == TILES_EMPTY) {
+        memset(cell, 0, sizeof(tiles_cell_t));
+        cell->key = key;
+        cell->min_snr = -1;
+        tiles->count++;
+    }
+    return cell;
+}
+
+/*
+ * Adds one fix; speed and hdop may be NAN and min_snr -1 when unknown.
+ * Returns -1 if out of memory, 0 otherwise (also for fixes without a position).
+ * */
+int tiles_add(tiles_t *tiles, double latitude, double longitude, double speed, double hdop, int min_snr) {
+    tiles_cell_t *cell;
+
+    if (isnan(latitude) || isnan(longitude)) {
+        tiles->skipped++;
+        return 0;
+    }
+    cell = get_cell(tiles, tiles_key(tiles, latitude, longitude));
+    if (cell == NULL) {
+        return -1;
+    }
+
+    cell->count++;
+    if (speed >= 0.0) {
+        cell->speed_sum += speed;
+        cell->speed_count++;
+    }
+    if (hdop > 0.0) {
+        cell->hdop_sum += hdop;
+        cell->hdop_count++;
+    }
+    if (min_snr >= 0 && (cell->min_snr < 0 || min_snr < cell->min_snr)) {
+        cell->min_snr = min_snr;
+    }
+    tiles->fixes++;
+    return 0;
+}
+
+/* fix handler, arg is the tiles_t; the SNR comes from the GSV tables if GSV is filtered in */
+void tiles_fix_handler(const gps_fix_t *fix, void *arg) {
+    tiles_t *tiles = (tiles_t *) arg;
+    int has_speed = fix->sources & (GNRMC_MESSAGE | UBX_MESSAGE);
+    int has_hdop = fix->sources & (GNGGA_MESSAGE | UBX_MESSAGE);
+
+    if (!fix->valid) {
+        tiles->skipped++;
+        return;
+    }
+    tiles_add(tiles, fix->latitude, fix->longitude, has_speed ? fix->speed : NAN, has_hdop ? fix->HDOP : NAN,
+              gps_min_snr());
+}
+
+/* folds every cell of src into dst, which must use the same tiling; returns -1 if it doesn't or out of memory */
+int tiles_merge(tiles_t *dst, const tiles_t *src) {
+    const tiles_cell_t *from;
+    tiles_cell_t *to;
+    size_t i;
+
+    if (dst->tiling != src->tiling || dst->cell_degrees != src->cell_degrees || dst->zoom != src->zoom) {
+        return -1;
+    }
+    for (i = 0; i < src->capacity; i++) {
+        from = &src->cells[i];
+        if (from->key == TILES_EMPTY) {
+            continue;
+        }
+        to = get_cell(dst, from->key);
+        if (to == NULL) {
+            return -1;
+        }
+        to->count += from->count;
+        to->speed_sum += from->speed_sum;
+        to->speed_count += from->speed_count;
+        to->hdop_sum += from->hdop_sum;
+        to->hdop_count += from->hdop_count;
+        if (from->min_snr >= 0 && (to->min_snr < 0 || from->min_snr < to->min_snr)) {
+            to->min_snr = from->min_snr;
+        }
+    }
+    dst->fixes += src->fixes;
+    dst->skipped += src->skipped;
+    return 0;
+}
+
+static void *batch_worker(void *arg) {
+    tiles_worker_t *worker = (tiles_worker_t *) arg;
+    const gps_batch_t *batch = worker->batch;
+    int i;
+
+    for (i = worker->first; i < worker->last; i++) {
+        if (!batch->valid[i]) {
+            worker->partial.skipped++;
+            continue;
+        }
+        if (tiles_add(&worker->partial, batch->latitude[i], batch->longitude[i], batch->speed[i], batch->HDOP[i],
+                      batch->min_snr[i]) < 0) {
+            worker->result = -1;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Adds every valid row of a batch on up to threads threads (0: one per CPU)
+ *
+ * Each thread aggregates a contiguous range of rows into its own table; the
+ * tables are merged into tiles once all are done. Returns -1 if out of memory
+ * or a thread couldn't be started; tiles may then hold part of the batch.
+ * */
+int tiles_add_batch(tiles_t *tiles, const gps_batch_t *batch, int threads) {
+    tiles_worker_t workers[TILES_MAX_THREADS];
+    tiles_worker_t *worker;
+    int i, started, result = 0;
+
+    if (threads <= 0) {
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > batch->count / TILES_MIN_ROWS_PER_THREAD) {
+        threads = batch->count / TILES_MIN_ROWS_PER_THREAD;
+    }
+    if (threads > TILES_MAX_THREADS) {
+        threads = TILES_MAX_THREADS;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    memset(workers, 0, sizeof(tiles_worker_t) * threads);
+    for (started = 0; started < threads; started++) {
+        worker = &workers[started];
+        if (tiles->tiling == TILES_GRID ? tiles_init_grid(&worker->partial, tiles->cell_degrees) < 0
+                                        : tiles_init_quadkey(&worker->partial, tiles->zoom) < 0) {
+            result = -1;
+            break;
+        }
+        worker->batch = batch;
+        worker->first = (int) ((int64_t) batch->count * started / threads);
+        worker->last = (int) ((int64_t) batch->count * (started + 1) / threads);
+        /* the last share runs on this thread */
+        if (started == threads - 1) {
+            batch_worker(worker);
+        } else if (pthread_create(&worker->thread, NULL, batch_worker, worker) != 0) {
+            tiles_free(&worker->partial);
+            result = -1;
+            break;
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        if (i < threads - 1) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        if (workers[i].result < 0) {
+            result = -1;
+        }
+    }
+    for (i = 0; i < started && result == 0; i++) {
+        /* an empty table takes over the first partial rather than copying it */
+        if (i == 0 && tiles->count == 0 && tiles->fixes == 0 && tiles->skipped == 0) {
+            tiles_free(tiles);
+            *tiles = workers[0].partial;
+            workers[0].partial.cells = NULL;
+            continue;
+        }
+        result = tiles_merge(tiles, &workers[i].partial);
+    }
+    for (i = 0; i < started; i++) {
+        free(workers[i].partial.cells);
+    }
+    return result;
+}
+
+/* the cell for key, NULL if no fix fell into it */
+const tiles_cell_t *tiles_find(const tiles_t *tiles, uint64_t key) {
+    const tiles_cell_t *cell = &tiles->cells[find_slot(tiles, key)];
+
+    return cell->key == key ? cell : NULL;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint64_t ka = ((const tiles_cell_t *) a)->key;
+    uint64_t kb = ((const tiles_cell_t *) b)->key;
+
+    return ka < kb ? -1 : ka > kb;
+}
+
+/* copies the occupied cells to out (tiles->count of them), sorted by key; returns the count */
+size_t tiles_collect(const tiles_t *tiles, tiles_cell_t *out) {
+    size_t i, n = 0;
+
+    for (i = 0; i < tiles->capacity; i++) {
+        if (tiles->cells[i].key != TILES_EMPTY) {
+            out[n++] = tiles->cells[i];
+        }
+    }
+    qsort(out, n, sizeof(tiles_cell_t), compare_keys);
+    return n;
+}
+
+/* a tile's edges in degrees */
+void tiles_bounds(const tiles_t *tiles, uint64_t key, double *south, double *west, double *north, double *east) {
+    double n, x, y;
+
+    if (tiles->tiling == TILES_GRID) {
+        *south = (double) (key >> 32) * tiles->cell_degrees - 90.0;
+        *west = (double) (key & 0xffffffffULL) * tiles->cell_degrees - 180.0;
+        *north = fmin(*south + tiles->cell_degrees, 90.0);
+        *east = fmin(*west + tiles->cell_degrees, 180.0);
+        return;
+    }
+
+    n = (double) ((int64_t) 1 << tiles->zoom);
+    x = (double) gather_bits(key);
+    y = (double) gather_bits(key >> 1);
+    *west = x / n * 360.0 - 180.0;
+    *east = (x + 1.0) / n * 360.0 - 180.0;
+    *north = atan(sinh(M_PI * (1.0 - 2.0 * y / n))) * 180.0 / M_PI;
+    *south = atan(sinh(M_PI * (1.0 - 2.0 * (y + 1.0) / n))) * 180.0 / M_PI;
+}
+
+/* quadkey string of a TILES_QUADKEY key, buffer must hold zoom + 1 bytes */
+void tiles_quadkey(uint64_t key, int zoom, char *buffer) {
+    int i;
+
+    for (i = 0; i < zoom; i++) {
+        buffer[i] = (char) ('0' + ((key >> (2 * (zoom - 1 - i))) & 3));
+    }
+    buffer[zoom] = '\0';
+}
@@ -0,0 +1,73 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "satgps.h"
+#include "batch.h"
+
+#define TILES_INITIAL_CAPACITY      1024        /* cells, power of 2 */
+#define TILES_MAX_ZOOM              30          /* quadkey digits that fit in a 64-bit key with room to spare */
+#define TILES_MAX_THREADS           64
+#define TILES_EMPTY                 UINT64_MAX  /* key of a free slot */
+#define TILES_MAX_LATITUDE          85.05112878 /* Web Mercator cut-off */
+
+/* tilings */
+#define TILES_GRID                  0           /* cell_degrees square lat/lon cells */
+#define TILES_QUADKEY               1           /* Web Mercator tiles at a zoom level */
+
+/*
+ * Aggregate of the fixes in one tile, 40 bytes
+ *
+ * Grid keys are row << 32 | column counted from 90 S, 180 W; quadkey keys are
+ * the tile's x and y bits interleaved, so each pair of bits is one quadkey
+ * digit and sorting by key keeps neighbours together.
+ * */
+typedef struct {
+    uint64_t            key;
+    double              speed_sum;                  /* m/s, over speed_count fixes that had one */
+    double              hdop_sum;                   /* over hdop_count fixes */
+    uint32_t            count;                      /* fixes */
+    uint32_t            speed_count;
+    uint32_t            hdop_count;
+    int32_t             min_snr;                    /* dB-Hz, -1 if no fix had one */
+} tiles_cell_t;
+
+/*
+ * Sparse grid of per-tile aggregates
+ *
+ * Only tiles that received a fix take space: cells live in an open
+ * addressing hash table (linear probing, doubled at 70% load). A fleet's
+ * month of fixes usually touches a few thousand to a few million tiles.
+ * tiles_add_batch() splits decoded batch columns across threads, each
+ * filling a private table with no sharing, and merges the tables at the end.
+ * */
+typedef struct {
+    int                 tiling;                     /* TILES_GRID or TILES_QUADKEY */
+    double              cell_degrees;               /* TILES_GRID */
+    int                 zoom;                       /* TILES_QUADKEY */
+
+    tiles_cell_t        *cells;
+    size_t              capacity;                   /* slots, power of 2 */
+    size_t              count;                      /* occupied slots */
+
+    unsigned long       fixes;                      /* added */
+    unsigned long       skipped;                    /* invalid or without a position */
+} tiles_t;
+
+int tiles_init_grid(tiles_t *, double);
+int tiles_init_quadkey(tiles_t *, int);
+void tiles_free(tiles_t *);
+void tiles_reset(tiles_t *);
+uint64_t tiles_key(const tiles_t *, double, double);
+int tiles_add(tiles_t *, double, double, double, double, int);
+void tiles_fix_handler(const gps_fix_t *, void *);
+int tiles_add_batch(tiles_t *, const gps_batch_t *, int);
+int tiles_merge(tiles_t *, const tiles_t *);
+const tiles_cell_t *tiles_find(const tiles_t *, uint64_t);
+size_t tiles_collect(const tiles_t *, tiles_cell_t *);
+void tiles_bounds(const tiles_t *, uint64_t, double *, double *, double *, double *);
+void tiles_quadkey(uint64_t, int, char *);
+
+#endif /* TILES_H */
@@ -0,0 +1,225 @@
+#ifdef SATGPS_TRACE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_HAVE_TSC
+#endif
+
+#include "trace.h"
+
+static const char *ProbeNames[TRACE_PROBES] = {
+    "serial_read", "checksum_valid", "parse_fields", "parse_sentence",
+    "parse_gsv", "parse_gll", "parse_rmc", "parse_vtg", "parse_gga", "parse_gsa", "parse_txt",
+    "ubx_decode"
+};
+
+/* one thread's records */
+typedef struct trace_ring {
+    trace_record_t      records[TRACE_RING_SIZE];
+    uint64_t            count;              /* records written, the ring keeps the last TRACE_RING_SIZE */
+    long                tid;
+    int                 perf_fd;            /* group leader, -1 without counters */
+    struct trace_ring   *next;
+} trace_ring_t;
+
+static __thread trace_ring_t *Ring;
+static trace_ring_t *Rings;
+static pthread_mutex_t RingsLock = PTHREAD_MUTEX_INITIALIZER;
+static int Flags;
+static double TicksPerUsec = 1000.0;        /* clock_gettime() ticks are nanoseconds */
+
+static uint64_t ticks(void) {
+#ifdef TRACE_HAVE_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* sets TRACE_* flags and, with the TSC, measures its rate; call once before the threads start */
+void trace_init(int flags) {
+#ifdef TRACE_HAVE_TSC
+    struct timespec pause = {0, 20000000};
+    uint64_t t0, t1, n0, n1;
+
+    n0 = monotonic_ns();
+    t0 = ticks();
+    nanosleep(&pause, NULL);
+    n1 = monotonic_ns();
+    t1 = ticks();
+    TicksPerUsec = (double) (t1 - t0) * 1000.0 / (double) (n1 - n0);
+#endif
+    Flags = flags;
+}
+
+static int perf_open(uint64_t config, int group) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/* the calling thread's ring, created on its first probe */
+static trace_ring_t *trace_ring(void) {
+    trace_ring_t *ring;
+
+    if (Ring != NULL) {
+        return Ring;
+    }
+    ring = (trace_ring_t *) calloc(1, sizeof(trace_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->tid = syscall(SYS_gettid);
+    ring->perf_fd = -1;
+
+    if (Flags & TRACE_PERF) {
+        /* one group, so a single read() returns all three */
+        ring->perf_fd = perf_open(PERF_COUNT_HW_INSTRUCTIONS, -1);
+        if (ring->perf_fd >= 0 &&
+            (perf_open(PERF_COUNT_HW_CACHE_MISSES, ring->perf_fd) < 0 ||
+             perf_open(PERF_COUNT_HW_BRANCH_MISSES, ring->perf_fd) < 0)) {
+            close(ring->perf_fd);
+            ring->perf_fd = -1;
+        }
+        if (ring->perf_fd < 0) {
+            fprintf(stderr, "trace: perf_event_open failed, no hardware counters for thread %ld\n", ring->tid);
+        }
+    }
+
+    pthread_mutex_lock(&RingsLock);
+    ring->next = Rings;
+    Rings = ring;
+    pthread_mutex_unlock(&RingsLock);
+
+    Ring = ring;
+    return ring;
+}
+
+static void read_counters(trace_ring_t *ring, uint64_t *counters) {
+    uint64_t values[1 + TRACE_COUNTERS];
+
+    if (ring->perf_fd < 0 || read(ring->perf_fd, values, sizeof(values)) != sizeof(values)) {
+        memset(counters, 0, sizeof(uint64_t) * TRACE_COUNTERS);
+        return;
+    }
+    memcpy(counters, values + 1, sizeof(uint64_t) * TRACE_COUNTERS);
+}
+
+trace_scope_t trace_begin(int probe) {
+    trace_ring_t *ring = trace_ring();
+    trace_scope_t scope;
+
+    scope.probe = probe;
+    if (ring != NULL) {
+        read_counters(ring, scope.counters);
+    }
+    scope.start = ticks();
+    return scope;
+}
+
+void trace_end(trace_scope_t *scope) {
+    uint64_t end = ticks();
+    trace_ring_t *ring = Ring;
+    trace_record_t *record;
+    uint64_t counters[TRACE_COUNTERS];
+    int i;
+
+    if (ring == NULL) {
+        return;
+    }
+    read_counters(ring, counters);
+
+    record = &ring->records[ring->count & (TRACE_RING_SIZE - 1)];
+    record->start = scope->start;
+    record->end = end;
+    record->probe = scope->probe;
+    for (i = 0; i < TRACE_COUNTERS; i++) {
+        record->counters[i] = counters[i] - scope->counters[i];
+    }
+    ring->count++;
+}
+
+/*
+ * Writes all recorded probes as Chrome trace JSON, returns -1 if path can't be written
+ *
+ * Threads should be done probing; a ring being written meanwhile may show a torn record.
+ * */
+int trace_dump(const char *path) {
+    trace_ring_t *ring;
+    trace_record_t *r;
+    uint64_t i, first, origin = UINT64_MAX;
+    int comma = 0;
+    FILE *fp;
+
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&RingsLock);
+
+    /* timestamps start at the oldest record */
+    for (ring = Rings; ring != NULL; ring = ring->next) {
+        first = ring->count > TRACE_RING_SIZE ? ring->count - TRACE_RING_SIZE : 0;
+        for (i = first; i < ring->count; i++) {
+            if (ring->records[i & (TRACE_RING_SIZE - 1)].start < origin) {
+                origin = ring->records[i & (TRACE_RING_SIZE - 1)].start;
+            }
+        }
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (ring = Rings; ring != NULL; ring = ring->next) {
+        first = ring->count > TRACE_RING_SIZE ? ring->count - TRACE_RING_SIZE : 0;
+        for (i = first; i < ring->count; i++) {
+            r = &ring->records[i & (TRACE_RING_SIZE - 1)];
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f",
+                    comma ? ",\n" : "", ProbeNames[r->probe], (int) getpid(), ring->tid,
+                    (double) (r->start - origin) / TicksPerUsec, (double) (r->end - r->start) / TicksPerUsec);
+            if (ring->perf_fd >= 0) {
+                fprintf(fp, ",\"args\":{\"instructions\":%llu,\"cache_misses\":%llu,\"branch_misses\":%llu}",
+                        (unsigned long long) r->counters[0], (unsigned long long) r->counters[1],
+                        (unsigned long long) r->counters[2]);
+            }
+            fprintf(fp, "}");
+            comma = 1;
+        }
+        if (ring->count > TRACE_RING_SIZE) {
+            fprintf(stderr, "trace: thread %ld lost its oldest %llu records\n", ring->tid,
+                    (unsigned long long) (ring->count - TRACE_RING_SIZE));
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    pthread_mutex_unlock(&RingsLock);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+#endif /* SATGPS_TRACE */
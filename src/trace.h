@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Hot-path tracing probes
+ *
+ * Configure with -DSATGPS_TRACE=ON to build them in. TRACE_SCOPE(probe) at the
+ * top of a function times it until it returns, by whichever return, with the
+ * TSC (clock_gettime() where there is none). TRACE_INIT(TRACE_PERF) adds
+ * instructions, cache misses and branch misses from perf_event_open(), at the
+ * cost of two read() calls per probe. Each thread records into its own ring;
+ * TRACE_DUMP(path) writes every ring as Chrome trace JSON for chrome://tracing
+ * or ui.perfetto.dev. Without the option all of this compiles to nothing.
+ * */
+
+/* probes */
+#define TRACE_SERIAL_READ       0
+#define TRACE_CHECKSUM          1
+#define TRACE_PARSE_FIELDS      2
+#define TRACE_DISPATCH          3
+#define TRACE_PARSE_GSV         4
+#define TRACE_PARSE_GLL         5
+#define TRACE_PARSE_RMC         6
+#define TRACE_PARSE_VTG         7
+#define TRACE_PARSE_GGA         8
+#define TRACE_PARSE_GSA         9
+#define TRACE_PARSE_TXT         10
+#define TRACE_UBX_DECODE        11
+#define TRACE_PROBES            12
+
+/* TRACE_INIT() flags */
+#define TRACE_PERF              1           /* hardware counters */
+
+#ifdef SATGPS_TRACE
+
+#include <stdint.h>
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE         65536       /* records per thread (48 bytes each), power of 2 */
+#endif
+#define TRACE_COUNTERS          3           /* instructions, cache misses, branch misses */
+
+typedef struct {
+    uint64_t            start;              /* ticks */
+    uint64_t            end;
+    uint64_t            counters[TRACE_COUNTERS];   /* deltas, 0 without TRACE_PERF */
+    int                 probe;
+} trace_record_t;
+
+/* an open probe, closed by the cleanup handler */
+typedef struct {
+    uint64_t            start;
+    uint64_t            counters[TRACE_COUNTERS];
+    int                 probe;
+} trace_scope_t;
+
+void trace_init(int);
+trace_scope_t trace_begin(int);
+void trace_end(trace_scope_t *);
+int trace_dump(const char *);
+
+#define TRACE_INIT(flags)   trace_init(flags)
+#define TRACE_SCOPE(probe)  trace_scope_t trace_scope_ __attribute__((cleanup(trace_end), unused)) = trace_begin(probe)
+#define TRACE_DUMP(path)    trace_dump(path)
+
+#else
+
+#define TRACE_INIT(flags)   do { } while (0)
+#define TRACE_SCOPE(probe)  do { } while (0)
+#define TRACE_DUMP(path)    do { } while (0)
+
+#endif /* SATGPS_TRACE */
+
+#endif /* TRACE_H */
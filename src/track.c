@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "geodesy.h"
+#include "track.h"
+
+#define DEG2RAD     (M_PI / 180.0)
+#define RAD2DEG     (180.0 / M_PI)
+
+/* seconds from b to a */
+static double time_diff(int64_t a, int64_t b) {
+    return (a - b) / (double) NSEC_PER_SEC;
+}
+
+void track_init(gps_track_t *track) {
+    atomic_init(&track->seq, 0);
+    track->count = 0;
+    memset(track->slot, 0, sizeof(track->slot));
+}
+
+/* appends a valid fix; call from a single thread only */
+void track_add_fix(gps_track_t *track, const gps_fix_t *fix) {
+    unsigned int seq;
+    track_slot_t *slot;
+
+    if (!fix->valid) {
+        return;
+    }
+
+    seq = atomic_load_explicit(&track->seq, memory_order_relaxed);
+    atomic_store_explicit(&track->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot = &track->slot[track->count & (TRACK_SIZE - 1)];
+    slot->utc_epoch_ns = fix->utc_epoch_ns;
+    slot->latitude = fix->latitude;
+    slot->longitude = fix->longitude;
+    /* a UBX NAV-PVT fix carries what GGA and RMC do */
+    slot->altitude = (fix->sources & (GNGGA_MESSAGE | UBX_MESSAGE)) ? fix->altitude : NAN;
+    slot->speed = (fix->sources & (GNRMC_MESSAGE | UBX_MESSAGE)) ? fix->speed : NAN;
+    slot->track_angle = (fix->sources & (GNRMC_MESSAGE | UBX_MESSAGE)) ? fix->track_angle : NAN;
+    track->count++;
+
+    atomic_store_explicit(&track->seq, seq + 2, memory_order_release);
+}
+
+/* for gps_add_fix_handler(track_fix_handler, &track) */
+void track_fix_handler(const gps_fix_t *fix, void *arg) {
+    track_add_fix((gps_track_t *) arg, fix);
+}
+
+/* consistent copy of the ring, returns the number of fixes in it */
+static unsigned int track_snapshot(gps_track_t *track, track_slot_t *slot, unsigned int *count) {
+    unsigned int seq1, seq2;
+
+    do {
+        seq1 = atomic_load_explicit(&track->seq, memory_order_acquire);
+        if (seq1 & 1) {
+            continue;
+        }
+        *count = track->count;
+        memcpy(slot, track->slot, sizeof(track->slot));
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&track->seq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+
+    return *count < TRACK_SIZE ? *count : TRACK_SIZE;
+}
+
+/* moves latitude/longitude by north/east meters */
+static void track_offset(gps_position_t *pos, double north, double east) {
+    double sin_lat = sin(pos->latitude * DEG2RAD);
+    double w = sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+
+    pos->latitude += north / (WGS84_A * (1.0 - WGS84_E2) / (w * w * w)) * RAD2DEG;
+    pos->longitude += east / (WGS84_A / w * cos(pos->latitude * DEG2RAD)) * RAD2DEG;
+    pos->longitude = remainder(pos->longitude, 360.0);
+}
+
+/*
+ * Position at time t (UTC nanoseconds since 1970-01-01)
+ *
+ * Interpolates between the two fixes around t, or dead-reckons from the newest
+ * fix with its RMC speed/track (or the velocity between the last two fixes) for
+ * up to TRACK_MAX_EXTRAPOLATION seconds. Lock-free and bounded by TRACK_SIZE.
+ * Returns TRACK_INTERPOLATED, TRACK_EXTRAPOLATED or -1 if t is not covered.
+ * */
+int gps_position_at(gps_track_t *track, int64_t t, gps_position_t *pos) {
+    track_slot_t slot[TRACK_SIZE];
+    const track_slot_t *a, *b;
+    unsigned int count, n, i;
+    double dt, f;
+
+    n = track_snapshot(track, slot, &count);
+    if (n == 0) {
+        return -1;
+    }
+
+    b = &slot[(count - 1) & (TRACK_SIZE - 1)];
+    dt = time_diff(t, b->utc_epoch_ns);
+
+    /* past the newest fix: dead-reckon */
+    if (dt >= 0.0) {
+        double speed = b->speed, track_angle = b->track_angle, climb = 0.0;
+
+        if (dt > TRACK_MAX_EXTRAPOLATION) {
+            return -1;
+        }
+
+        if (n > 1) {
+            a = &slot[(count - 2) & (TRACK_SIZE - 1)];
+            f = time_diff(b->utc_epoch_ns, a->utc_epoch_ns);
+            if (f > 0.0) {
+                if (isnan(speed)) {
+                    double north = (b->latitude - a->latitude) * DEG2RAD * WGS84_A;
+                    double east = remainder(b->longitude - a->longitude, 360.0) * DEG2RAD * WGS84_A *
+                                  cos(b->latitude * DEG2RAD);
+                    speed = hypot(north, east) / f;
+                    track_angle = atan2(east, north) * RAD2DEG;
+                }
+                if (!isnan(a->altitude) && !isnan(b->altitude)) {
+                    climb = (b->altitude - a->altitude) / f;
+                }
+            }
+        }
+        if (isnan(speed)) {
+            speed = 0.0;
+            track_angle = 0.0;
+        }
+
+        pos->latitude = b->latitude;
+        pos->longitude = b->longitude;
+        track_offset(pos, speed * cos(track_angle * DEG2RAD) * dt, speed * sin(track_angle * DEG2RAD) * dt);
+        pos->altitude = b->altitude + climb * dt;
+        pos->speed = speed;
+        pos->track_angle = track_angle;
+        pos->age = dt;
+        return TRACK_EXTRAPOLATED;
+    }
+
+    /* find the fixes around t, newest first */
+    for (i = 1; i < n; i++) {
+        a = &slot[(count - 1 - i) & (TRACK_SIZE - 1)];
+        if (time_diff(t, a->utc_epoch_ns) >= 0.0) {
+            double span = time_diff(b->utc_epoch_ns, a->utc_epoch_ns);
+
+            f = span > 0.0 ? time_diff(t, a->utc_epoch_ns) / span : 0.0;
+            pos->latitude = a->latitude + f * (b->latitude - a->latitude);
+            pos->longitude = remainder(a->longitude + f * remainder(b->longitude - a->longitude, 360.0), 360.0);
+            pos->altitude = a->altitude + f * (b->altitude - a->altitude);
+            pos->speed = isnan(b->speed) ? (isnan(a->speed) ? 0.0 : a->speed) :
+                         (isnan(a->speed) ? b->speed : a->speed + f * (b->speed - a->speed));
+            pos->track_angle = isnan(b->track_angle) ? 0.0 : b->track_angle;
+            pos->age = f < 0.5 ? f * span : (1.0 - f) * span;
+            return TRACK_INTERPOLATED;
+        }
+        b = a;
+    }
+
+    /* older than anything we kept */
+    return -1;
+}
@@ -0,0 +1,57 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <stdatomic.h>
+
+#include "satgps.h"
+
+#define TRACK_SIZE              8           /* fixes kept for interpolation, power of 2 */
+#define TRACK_MAX_EXTRAPOLATION 5.0         /* seconds past the newest fix we dead-reckon */
+
+/* gps_position_at() results */
+#define TRACK_INTERPOLATED      0
+#define TRACK_EXTRAPOLATED      1
+
+/*
+ * One fix in the track ring
+ * */
+typedef struct {
+    int64_t             utc_epoch_ns;               /* UTC nanoseconds since 1970-01-01 */
+    double              latitude;                   /* in degrees */
+    double              longitude;                  /* in degrees */
+    double              altitude;                   /* in meters, NAN without GGA or NAV-PVT */
+    double              speed;                      /* in m/s, NAN without RMC or NAV-PVT */
+    double              track_angle;                /* in degrees, NAN without RMC or NAV-PVT */
+} track_slot_t;
+
+/*
+ * Ring of recent valid fixes
+ *
+ * There is one writer (the fix handler) and any number of readers. Readers
+ * never block: they copy the ring under a sequence counter and retry if the
+ * writer was active meanwhile.
+ * */
+typedef struct {
+    atomic_uint         seq;                        /* odd while the writer is updating */
+    unsigned int        count;                      /* fixes written so far */
+    track_slot_t        slot[TRACK_SIZE];
+} gps_track_t;
+
+/*
+ * Position at an arbitrary time
+ * */
+typedef struct {
+    double              latitude;                   /* in degrees */
+    double              longitude;                  /* in degrees */
+    double              altitude;                   /* in meters, NAN if unknown */
+    double              speed;                      /* in m/s */
+    double              track_angle;                /* in degrees */
+    double              age;                        /* seconds from the nearest fix used */
+} gps_position_t;
+
+void track_init(gps_track_t *);
+void track_add_fix(gps_track_t *, const gps_fix_t *);
+void track_fix_handler(const gps_fix_t *, void *);
+int gps_position_at(gps_track_t *, int64_t, gps_position_t *);
+
+#endif /* TRACK_H */
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "gpstime.h"
+#include "geodesy.h"
+#include "batch.h"
+#include "trip.h"
+
+void trip_default_config(trip_config_t *config) {
+    config->start_speed = TRIP_START_SPEED;
+    config->stop_speed = TRIP_STOP_SPEED;
+    config->start_seconds = TRIP_START_SECONDS;
+    config->stop_seconds = TRIP_STOP_SECONDS;
+    config->dwell_seconds = TRIP_DWELL_SECONDS;
+    config->gap_seconds = TRIP_GAP_SECONDS;
+}
+
+/* config may be NULL for trip_default_config() */
+void trip_init(trip_t *trip, const trip_config_t *config) {
+    trip_config_t defaults;
+
+    if (config == NULL) {
+        trip_default_config(&defaults);
+        config = &defaults;
+    }
+    memset(trip, 0, sizeof(trip_t));
+    trip->start_speed = config->start_speed;
+    trip->stop_speed = config->stop_speed;
+    trip->start_ns = (int64_t) (config->start_seconds * NSEC_PER_SEC);
+    trip->stop_ns = (int64_t) (config->stop_seconds * NSEC_PER_SEC);
+    trip->dwell_ns = (int64_t) (config->dwell_seconds * NSEC_PER_SEC);
+    trip->gap_ns = (int64_t) (config->gap_seconds * NSEC_PER_SEC);
+    trip->state = TRIP_STOPPED;
+}
+
+void trip_set_handler(trip_t *trip, trip_handler_t handler, void *arg) {
+    trip->handler = handler;
+    trip->handler_arg = arg;
+}
+
+static void emit(trip_t *trip, int type, const trip_point_t *at, int64_t duration_ns, double distance) {
+    trip_event_t event;
+
+    if (trip->handler == NULL) {
+        return;
+    }
+    event.type = type;
+    event.utc_epoch_ns = at->utc_epoch_ns;
+    event.duration_ns = duration_ns;
+    event.latitude = at->latitude;
+    event.longitude = at->longitude;
+    event.distance = distance;
+    trip->handler(&event, trip->handler_arg);
+}
+
+/* the trip ended at a fix */
+static void end_trip(trip_t *trip, const trip_point_t *at) {
+    emit(trip, TRIP_STOP, at, at->utc_epoch_ns - trip->trip_start.utc_epoch_ns,
+         at->odometer - trip->trip_start.odometer);
+    trip->state = TRIP_STOPPED;
+    trip->dwell_reported = 0;
+    trip->trips++;
+}
+
+/*
+ * Adds one fix: time, position in degrees, speed in m/s (NAN if unknown) and
+ * whether it is valid. Fixes must come in time order; repeats are ignored.
+ * */
+void trip_add(trip_t *trip, int64_t utc_epoch_ns, double latitude, double longitude, double speed, int valid) {
+    trip_point_t point;
+    double step;
+
+    if (!valid || isnan(latitude) || isnan(longitude)) {
+        return;
+    }
+    point.utc_epoch_ns = utc_epoch_ns;
+    point.latitude = latitude;
+    point.longitude = longitude;
+    point.odometer = 0.0;
+
+    if (trip->have_last) {
+        if (utc_epoch_ns <= trip->last.utc_epoch_ns) {
+            return;
+        }
+        point.odometer = trip->last.odometer;
+
+        if (utc_epoch_ns - trip->last.utc_epoch_ns > trip->gap_ns) {
+            /* whatever happened in between is unknown: close the trip where the data stopped */
+            emit(trip, TRIP_GAP, &trip->last, utc_epoch_ns - trip->last.utc_epoch_ns, 0.0);
+            if (trip->state == TRIP_MOVING) {
+                end_trip(trip, &trip->last);
+            }
+            trip->moving = 0;
+            trip->still = 0;
+        } else {
+            step = geodesy_haversine_1(trip->last.latitude, trip->last.longitude, latitude, longitude);
+            point.odometer += step;
+            if (isnan(speed)) {
+                speed = step * NSEC_PER_SEC / (double) (utc_epoch_ns - trip->last.utc_epoch_ns);
+            }
+        }
+    }
+    trip->last = point;
+    trip->have_last = 1;
+    trip->fixes++;
+
+    if (isnan(speed)) {
+        /* first fix without a speed, nothing to go on yet */
+        return;
+    }
+
+    if (speed >= trip->start_speed) {
+        trip->still = 0;
+        if (!trip->moving) {
+            trip->moving = 1;
+            trip->moving_since = point;
+        }
+        if (trip->state == TRIP_STOPPED && utc_epoch_ns - trip->moving_since.utc_epoch_ns >= trip->start_ns) {
+            trip->state = TRIP_MOVING;
+            trip->trip_start = trip->moving_since;
+            emit(trip, TRIP_START, &trip->trip_start, 0, 0.0);
+        }
+    } else if (speed < trip->stop_speed) {
+        trip->moving = 0;
+        if (!trip->still) {
+            trip->still = 1;
+            trip->still_since = point;
+        }
+        if (trip->state == TRIP_MOVING && utc_epoch_ns - trip->still_since.utc_epoch_ns >= trip->stop_ns) {
+            end_trip(trip, &trip->still_since);
+        }
+        if (trip->state == TRIP_STOPPED && !trip->dwell_reported &&
+            utc_epoch_ns - trip->still_since.utc_epoch_ns >= trip->dwell_ns) {
+            trip->dwell_reported = 1;
+            emit(trip, TRIP_DWELL, &trip->still_since, utc_epoch_ns - trip->still_since.utc_epoch_ns, 0.0);
+        }
+    }
+    /* in between: creeping, both streaks carry on as they are */
+}
+
+/* fix handler, arg is the trip_t */
+void trip_fix_handler(const gps_fix_t *fix, void *arg) {
+    int has_speed = fix->sources & (GNRMC_MESSAGE | UBX_MESSAGE);
+    int valid = fix->valid && (!(fix->sources & (GNGGA_MESSAGE | UBX_MESSAGE)) || fix->gps_quality > 0);
+
+    trip_add((trip_t *) arg, fix->utc_epoch_ns, fix->latitude, fix->longitude, has_speed ? fix->speed : NAN, valid);
+}
+
+/* adds every row of a batch, in order */
+void trip_add_batch(trip_t *trip, const gps_batch_t *batch) {
+    int i;
+
+    for (i = 0; i < batch->count; i++) {
+        trip_add(trip, batch->utc_epoch_ns[i], batch->latitude[i], batch->longitude[i], batch->speed[i],
+                 batch->valid[i] && batch->gps_quality[i] != 0);
+    }
+}
+
+/* at the end of a log: a trip still under way ends at its last fix (or where it came to rest) */
+void trip_finish(trip_t *trip) {
+    if (trip->state == TRIP_MOVING) {
+        end_trip(trip, trip->still ? &trip->still_since : &trip->last);
+    }
+}
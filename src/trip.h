@@ -0,0 +1,109 @@
+#ifndef TRIP_H
+#define TRIP_H
+
+#include <stdint.h>
+
+#include "satgps.h"
+#include "batch.h"
+
+/* trip_default_config() */
+#define TRIP_START_SPEED            2.0         /* m/s, moving at or above */
+#define TRIP_STOP_SPEED             0.5         /* m/s, stationary below; in between keeps the current state */
+#define TRIP_START_SECONDS          10.0        /* moving this long starts a trip */
+#define TRIP_STOP_SECONDS           120.0       /* stationary this long ends it */
+#define TRIP_DWELL_SECONDS          600.0       /* stationary this long is a dwell, reported once per stop */
+#define TRIP_GAP_SECONDS            30.0        /* no valid fix this long is a gap, and ends a trip */
+
+/* events */
+#define TRIP_START                  0
+#define TRIP_STOP                   1
+#define TRIP_DWELL                  2
+#define TRIP_GAP                    3
+
+/* states */
+#define TRIP_STOPPED                0
+#define TRIP_MOVING                 1
+
+typedef struct {
+    double              start_speed;                /* m/s */
+    double              stop_speed;
+    double              start_seconds;
+    double              stop_seconds;
+    double              dwell_seconds;
+    double              gap_seconds;
+} trip_config_t;
+
+/*
+ * Event, timed when it happened rather than when it was confirmed
+ *
+ * TRIP_START: the first moving fix; TRIP_STOP: the first stationary fix, or
+ * the last fix before a gap, with the trip's duration and distance; TRIP_DWELL:
+ * the start of the stop, duration so far; TRIP_GAP: the last fix before it,
+ * duration of the gap.
+ * */
+typedef struct {
+    int                 type;                       /* TRIP_START, TRIP_STOP, TRIP_DWELL or TRIP_GAP */
+    int64_t             utc_epoch_ns;
+    int64_t             duration_ns;
+    double              latitude;                   /* in degrees */
+    double              longitude;
+    double              distance;                   /* TRIP_STOP: meters travelled, 0 otherwise */
+} trip_event_t;
+
+/* called with every event; give each receiver its own arg */
+typedef void (*trip_handler_t)(const trip_event_t *, void *);
+
+/* a fix as the segmenter remembers it */
+typedef struct {
+    int64_t             utc_epoch_ns;
+    double              latitude;
+    double              longitude;
+    double              odometer;                   /* meters travelled since trip_init() */
+} trip_point_t;
+
+/*
+ * Incremental trip segmenter, one per receiver
+ *
+ * Fixes go in one at a time, from the fix handler on a live stream or from
+ * batch columns, and are looked at once: the state is a few points (last fix,
+ * start of the current moving or stationary streak) whatever the length of
+ * the stream. Speed has hysteresis between stop_speed and start_speed, and
+ * both trips and stops must last a while before they are reported, so a
+ * traffic light or GPS wander at a standstill doesn't split a trip. Where a
+ * fix has no speed (GGA only) it is taken from the distance to the last fix.
+ * Invalid fixes and GGA quality 0 count as no fix.
+ * */
+typedef struct {
+    /* configuration, times in ns */
+    double              start_speed;
+    double              stop_speed;
+    int64_t             start_ns;
+    int64_t             stop_ns;
+    int64_t             dwell_ns;
+    int64_t             gap_ns;
+    trip_handler_t      handler;
+    void                *handler_arg;
+
+    int                 state;                      /* TRIP_STOPPED or TRIP_MOVING */
+    int                 have_last;
+    trip_point_t        last;                       /* most recent valid fix */
+    int                 moving;                     /* in a streak of fixes at or above start_speed */
+    trip_point_t        moving_since;               /* its first fix */
+    int                 still;                      /* in a streak below stop_speed */
+    trip_point_t        still_since;
+    trip_point_t        trip_start;                 /* while TRIP_MOVING */
+    int                 dwell_reported;             /* for the current stop */
+
+    unsigned long       fixes;                      /* valid fixes seen */
+    unsigned long       trips;                      /* completed */
+} trip_t;
+
+void trip_default_config(trip_config_t *);
+void trip_init(trip_t *, const trip_config_t *);
+void trip_set_handler(trip_t *, trip_handler_t, void *);
+void trip_add(trip_t *, int64_t, double, double, double, int);
+void trip_fix_handler(const gps_fix_t *, void *);
+void trip_add_batch(trip_t *, const gps_batch_t *);
+void trip_finish(trip_t *);
+
+#endif /* TRIP_H */
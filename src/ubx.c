@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "satgps.h"
+#include "gpserror.h"
+#include "gpstime.h"
+#include "ubx.h"
+#include "trace.h"
+
+#define NMEA_SBAS       87          /* NMEA numbers SBAS 120-158 as 33-71 */
+#define NMEA_GLONASS    64          /* and GLONASS 1-32 as 65-96 */
+
+/* demultiplexer states */
+#define STATE_IDLE      0
+#define STATE_NMEA      1
+#define STATE_SYNC      2
+#define STATE_UBX       3
+
+/* u-blox gnssId */
+#define GNSS_GPS        0
+#define GNSS_SBAS       1
+#define GNSS_GLONASS    6
+
+/* little-endian field readers */
+static uint16_t u2(const uint8_t *p) {
+    return (uint16_t) (p[0] | p[1] << 8);
+}
+
+static uint32_t u4(const uint8_t *p) {
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static int32_t i4(const uint8_t *p) {
+    return (int32_t) u4(p);
+}
+
+/* HDOP/VDOP/PDOP from NAV-DOP, for fixes built from NAV-PVT */
+static double UbxHDOP;
+
+void ubx_stream_init(ubx_stream_t *stream) {
+    memset(stream, 0, sizeof(ubx_stream_t));
+}
+
+/* starts a message on its first byte, returns 0 if it doesn't start one */
+static int stream_start(ubx_stream_t *stream, uint8_t c) {
+    if (c == '$') {
+        stream->state = STATE_NMEA;
+        stream->frame[0] = c;
+        stream->length = 1;
+        return 1;
+    }
+    if (c == UBX_SYNC_1) {
+        stream->state = STATE_SYNC;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Consumes bytes until a message is complete
+ *
+ * Returns UBX_STREAM_NMEA or UBX_STREAM_UBX with the message in frame/length,
+ * or UBX_STREAM_NONE once all len bytes are used up. *used says how many bytes
+ * were taken; feed the rest again after handling the message.
+ * */
+int ubx_stream_feed(ubx_stream_t *stream, const uint8_t *data, int len, int *used) {
+    uint8_t c;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        c = data[i];
+
+        switch (stream->state) {
+            case STATE_NMEA:
+                if (c == '\n') {
+                    stream->frame[stream->length] = '\0';
+                    stream->state = STATE_IDLE;
+                    stream->sentences++;
+                    *used = i + 1;
+                    return UBX_STREAM_NMEA;
+                }
+                if (c & 0x80) {
+                    /* NMEA is 7-bit: the line was cut off and binary follows */
+                    stream->state = STATE_IDLE;
+                    stream_start(stream, c);
+                    break;
+                }
+                if (stream->length < GPS_MAX_SENTENCE - 1) {
+                    stream->frame[stream->length++] = c;
+                }
+                break;
+
+            case STATE_SYNC:
+                if (c == UBX_SYNC_2) {
+                    stream->state = STATE_UBX;
+                    stream->frame[0] = UBX_SYNC_1;
+                    stream->frame[1] = UBX_SYNC_2;
+                    stream->length = 2;
+                    stream->expected = 0;
+                    stream->ck_a = 0;
+                    stream->ck_b = 0;
+                } else {
+                    stream->state = STATE_IDLE;
+                    if (!stream_start(stream, c)) {
+                        stream->skipped += 2;
+                    }
+                }
+                break;
+
+            case STATE_UBX:
+                stream->frame[stream->length++] = c;
+
+                /* checksum covers class, id, length and payload */
+                if (stream->expected == 0 || stream->length <= stream->expected - 2) {
+                    stream->ck_a += c;
+                    stream->ck_b += stream->ck_a;
+                }
+
+                if (stream->length == 6) {
+                    stream->expected = u2(stream->frame + 4) + UBX_OVERHEAD;
+                    /* gps_read_raw() copies the frame with a NUL after it */
+                    if (stream->expected > GPS_MAX_FRAME - 1) {
+                        /* too long to keep, or a false sync: hunt again from here */
+                        stream->oversize++;
+                        stream->state = STATE_IDLE;
+                    }
+                } else if (stream->expected && stream->length == stream->expected) {
+                    stream->state = STATE_IDLE;
+                    if (stream->frame[stream->length - 2] != stream->ck_a ||
+                        stream->frame[stream->length - 1] != stream->ck_b) {
+                        stream->checksum_errors++;
+                        gps_error_push(GPS_ERR_UBX_CHECKSUM, UBX_MESSAGE, -1, stream->length - 2,
+                                       (int) ((uint32_t) u2(stream->frame + stream->length - 2) << 16 |
+                                              stream->ck_b << 8 | stream->ck_a));
+                        break;
+                    }
+                    stream->frames++;
+                    *used = i + 1;
+                    return UBX_STREAM_UBX;
+                }
+                break;
+
+            default:
+                if (!stream_start(stream, c)) {
+                    stream->skipped++;
+                }
+        }
+    }
+
+    *used = len;
+    return UBX_STREAM_NONE;
+}
+
+/* 1 if buffer holds a UBX frame as returned by gps_read_raw(), rather than a sentence */
+int ubx_is_frame(const char *buffer, int length) {
+    return length >= UBX_OVERHEAD && (uint8_t) buffer[0] == UBX_SYNC_1 && (uint8_t) buffer[1] == UBX_SYNC_2;
+}
+
+/* GGA-style quality indicator from the NAV-PVT fix type and flags */
+static int pvt_quality(int fix_type, int flags) {
+    if (!(flags & 0x01)) {
+        return 0;
+    }
+    switch (flags >> 6) {
+        case 1:
+            return 5;                           /* RTK float */
+        case 2:
+            return 4;                           /* RTK fixed */
+    }
+    if (fix_type == 1) {
+        return 6;                               /* dead reckoning */
+    }
+    if (fix_type >= 2 && fix_type <= 4) {
+        return (flags & 0x02) ? 2 : 1;          /* differential or plain GNSS */
+    }
+    return 0;
+}
+
+/* NAV-PVT: one message carries the time, position, velocity and quality of RMC+GGA+VTG */
+static int decode_nav_pvt(const uint8_t *p) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+    gps_fix_t fix;
+    int64_t days, nsec, year;
+    unsigned month, day;
+    int fix_type = p[20];
+    int flags = p[21];
+    int valid = p[11];
+
+    memset(&fix, 0, sizeof(fix));
+
+    /* time: the date may not be resolved yet, the time of day usually is; nano can borrow from the previous second */
+    days = (valid & 0x01) ? days_from_civil(u2(p + 4), p[6], p[7]) : 0;
+    fix.utc_epoch_ns = gps_epoch_ns(days, p[8] * 3600 + p[9] * 60 + p[10], 0) + i4(p + 16);
+
+    days = fix.utc_epoch_ns / (SEC_PER_DAY * NSEC_PER_SEC);
+    nsec = fix.utc_epoch_ns - days * SEC_PER_DAY * NSEC_PER_SEC;
+    if (nsec < 0) {
+        nsec += SEC_PER_DAY * NSEC_PER_SEC;
+        days--;
+    }
+    fix.utc_time.tv_sec = (long) (nsec / NSEC_PER_SEC);
+    fix.utc_time.tv_usec = (long) (nsec % NSEC_PER_SEC / 1000);
+    if (valid & 0x01) {
+        civil_from_days(days, &year, &month, &day);
+        fix.utc_date.tm_year = (int) year - 1900;
+        fix.utc_date.tm_mon = (int) month - 1;
+        fix.utc_date.tm_mday = (int) day;
+        fix.utc_date.tm_hour = (int) (fix.utc_time.tv_sec / 3600);
+        fix.utc_date.tm_min = (int) (fix.utc_time.tv_sec / 60 % 60);
+        fix.utc_date.tm_sec = (int) (fix.utc_time.tv_sec % 60);
+        fix.utc_date.tm_wday = (int) ((days % 7 + 11) % 7);     /* 1970-01-01 was a Thursday */
+        fix.utc_date.tm_yday = (int) (days - days_from_civil(year, 1, 1));
+    }
+
+    fix.valid = (flags & 0x01) && (valid & 0x02) && fix_type >= 2 && fix_type <= 4;
+    fix.longitude = i4(p + 24) * 1e-7;
+    fix.latitude = i4(p + 28) * 1e-7;
+    fix.altitude = i4(p + 36) * 1e-3;
+    fix.speed = i4(p + 60) * 1e-3;
+    fix.track_angle = i4(p + 64) * 1e-5;
+    fix.gps_quality = pvt_quality(fix_type, flags);
+    fix.number_svs = p[23];
+    fix.HDOP = UbxHDOP > 0.0 ? UbxHDOP : u2(p + 76) * 0.01;
+    fix.sources = UBX_MESSAGE;
+
+    if (gps_data->GsaDataGn != NULL) {
+        gps_data->GsaDataGn->mode_2 = fix_type == 3 || fix_type == 4 ? 3 : (fix_type == 2 ? 2 : 1);
+        gps_data->GsaDataGn->PDOP = u2(p + 76) * 0.01;
+    }
+
+    gps_publish_fix(&fix);
+    return UBX_MESSAGE | (gps_data->GsaDataGn != NULL ? GNGSA_MESSAGE : 0);
+}
+
+/* NAV-DOP: the DOPs NAV-PVT leaves out */
+static int decode_nav_dop(const uint8_t *p) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+
+    UbxHDOP = u2(p + 12) * 0.01;
+    if (gps_data->GsaDataGn == NULL) {
+        return 0;
+    }
+    gps_data->GsaDataGn->PDOP = u2(p + 6) * 0.01;
+    gps_data->GsaDataGn->VDOP = u2(p + 10) * 0.01;
+    gps_data->GsaDataGn->HDOP = UbxHDOP;
+    return GNGSA_MESSAGE;
+}
+
+/* NAV-SAT: every satellite with elevation, azimuth, C/N0 and whether it is used, as a one-sentence GSV cycle */
+static int decode_nav_sat(const uint8_t *p, int length) {
+    gps_data_t *gps_data = gps_get_data_ptr();
+    gsv_data_t *gsv;
+    gsv_sat_t *sat;
+    const uint8_t *sv;
+    int num_svs = p[5];
+    int used = 0, updated = 0;
+    int i, prn;
+
+    if (length < 8 + 12 * num_svs) {
+        return -1;
+    }
+
+    if (gps_data->GsvDataGps != NULL) {
+        gps_data->GsvDataGps->satellites_in_view = 0;
+    }
+    if (gps_data->GsvDataGlonass != NULL) {
+        gps_data->GsvDataGlonass->satellites_in_view = 0;
+    }
+
+    for (i = 0; i < num_svs; i++) {
+        sv = p + 8 + 12 * i;
+        prn = sv[1];
+
+        switch (sv[0]) {
+            case GNSS_GPS:
+            case GNSS_SBAS:
+                gsv = gps_data->GsvDataGps;
+                break;
+            case GNSS_GLONASS:
+                gsv = gps_data->GsvDataGlonass;
+                break;
+            default:
+                continue;
+        }
+
+        /* GSA used list, in NMEA numbering */
+        if ((u4(sv + 8) & 0x08) && gps_data->GsaDataGn != NULL && used < 12) {
+            gps_data->GsaDataGn->prn_number[used++] = sv[0] == GNSS_GLONASS ? prn + NMEA_GLONASS :
+                                                      (sv[0] == GNSS_SBAS ? prn - NMEA_SBAS : prn);
+        }
+
+        if (gsv == NULL || gsv->satellites_in_view >= GPS_MAX_SATS) {
+            continue;
+        }
+        sat = &gsv->gsv_sat[gsv->satellites_in_view++];
+        sat->prn_number = prn;
+        sat->elevation = (int8_t) sv[3];
+        sat->azimuth = (int16_t) u2(sv + 4);
+        sat->signal_to_noise = sv[2];
+    }
+
+    if (gps_data->GsvDataGps != NULL) {
+        gps_data->GsvDataGps->total_messages = 1;
+        gps_data->GsvDataGps->message_number = 1;
+        gps_gsv_cycle_end(GPGSV_MESSAGE);
+        updated |= GPGSV_MESSAGE;
+    }
+    if (gps_data->GsvDataGlonass != NULL) {
+        gps_data->GsvDataGlonass->total_messages = 1;
+        gps_data->GsvDataGlonass->message_number = 1;
+        gps_gsv_cycle_end(GLGSV_MESSAGE);
+        updated |= GLGSV_MESSAGE;
+    }
+    if (gps_data->GsaDataGn != NULL) {
+        for (i = used; i < 12; i++) {
+            gps_data->GsaDataGn->prn_number[i] = 0;
+        }
+        updated |= GNGSA_MESSAGE;
+    }
+    return updated;
+}
+
+/*
+ * Decodes a checksummed UBX frame into GpsData
+ *
+ * NAV-PVT becomes a gps_fix_t for the fix handlers, NAV-SAT fills the GSV
+ * tables and the GSA used list, NAV-DOP the GSA DOPs. Returns the filter bits
+ * of the tables that changed (UBX_MESSAGE for a fix), 0 for messages we don't
+ * decode, -1 if the payload is too short.
+ * */
+int ubx_decode(const uint8_t *frame, int length) {
+    const uint8_t *payload = frame + 6;
+    int payload_length = length - UBX_OVERHEAD;
+    int updated;
+
+    TRACE_SCOPE(TRACE_UBX_DECODE);
+
+    if (frame[2] != UBX_CLASS_NAV) {
+        return 0;
+    }
+
+    switch (frame[3]) {
+        case UBX_NAV_PVT:
+            if (payload_length < UBX_NAV_PVT_LENGTH) {
+                break;
+            }
+            return decode_nav_pvt(payload);
+        case UBX_NAV_DOP:
+            if (payload_length < UBX_NAV_DOP_LENGTH) {
+                break;
+            }
+            return decode_nav_dop(payload);
+        case UBX_NAV_SAT:
+            if (payload_length < 8 || (updated = decode_nav_sat(payload, payload_length)) < 0) {
+                break;
+            }
+            return updated;
+        default:
+            return 0;
+    }
+
+    gps_error_push(GPS_ERR_UBX_LENGTH, UBX_MESSAGE, -1, -1, frame[3]);
+    return -1;
+}
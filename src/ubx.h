@@ -0,0 +1,53 @@
+#ifndef UBX_H
+#define UBX_H
+
+#include <stdint.h>
+
+#include "satgps.h"
+
+#define UBX_SYNC_1          0xB5
+#define UBX_SYNC_2          0x62
+#define UBX_OVERHEAD        8           /* sync, class, id, length, checksum */
+
+/* messages we decode */
+#define UBX_CLASS_NAV       0x01
+#define UBX_NAV_DOP         0x04
+#define UBX_NAV_PVT         0x07
+#define UBX_NAV_SAT         0x35
+
+#define UBX_NAV_DOP_LENGTH  18
+#define UBX_NAV_PVT_LENGTH  92
+
+/* what ubx_stream_feed() completed */
+#define UBX_STREAM_NONE     0
+#define UBX_STREAM_NMEA     1           /* frame holds a sentence without '\n', NUL terminated */
+#define UBX_STREAM_UBX      2           /* frame holds a UBX frame with a good checksum */
+
+/*
+ * NMEA/UBX demultiplexer
+ *
+ * Bytes from the receiver go in, complete NMEA sentences and UBX frames come
+ * out; which one is decided per message by its first byte ('$' or 0xB5 0x62),
+ * so a receiver can mix both on one port. The UBX checksum is accumulated as
+ * the bytes arrive. Frames longer than GPS_MAX_FRAME are skipped and counted.
+ * */
+typedef struct {
+    int                 state;
+    uint8_t             frame[GPS_MAX_FRAME];
+    int                 length;                     /* bytes in frame */
+    int                 expected;                   /* total UBX frame length once the header is in */
+    uint8_t             ck_a, ck_b;                 /* running Fletcher checksum */
+
+    unsigned long       sentences;                  /* NMEA sentences out */
+    unsigned long       frames;                     /* UBX frames out */
+    unsigned long       checksum_errors;            /* UBX frames dropped for their checksum */
+    unsigned long       oversize;                   /* UBX frames too long to keep */
+    unsigned long       skipped;                    /* bytes outside any message */
+} ubx_stream_t;
+
+void ubx_stream_init(ubx_stream_t *);
+int ubx_stream_feed(ubx_stream_t *, const uint8_t *, int, int *);
+int ubx_is_frame(const char *, int);
+int ubx_decode(const uint8_t *, int);
+
+#endif /* UBX_H */
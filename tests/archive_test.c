@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+
+#ifdef SATGPS_ZLIB
+#include <zlib.h>
+#endif
+
+#include "satgps.h"
+#include "gpserror.h"
+#include "batch.h"
+#include "archive.h"
+
+#define EPOCHS          200
+
+static int Failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        Failures++; \
+    } \
+} while (0)
+
+/* checksum-valid sentences that stop short of the fields their parser reads */
+static const char *ShortSentences[] = {
+    "$GNRMC,1",
+    "$GNRMC,,V,,,,,,,,",
+    "$GNGGA,1",
+    "$GNGSA,A",
+    "$GNGSA,A,3,04,05,,09,12,,,24,,,,,2.5",
+    "$GPGSV,1",
+    "$GLGSV,1,1",
+    "$GNGLL,1",
+    "$GNVTG,1",
+    "$GNTXT,01",
+};
+#define NUM_SHORT       ((int) (sizeof(ShortSentences) / sizeof(ShortSentences[0])))
+
+static char Log[EPOCHS * 200 + NUM_SHORT * 64];
+static size_t LogLength;
+static int Fixes;
+
+/* appends a sentence with its checksum and CRLF */
+static void add_sentence(const char *body) {
+    unsigned char sum = 0;
+    const char *p;
+
+    for (p = body + 1; *p; p++) {
+        sum ^= (unsigned char) *p;
+    }
+    LogLength += sprintf(Log + LogLength, "%s*%02X\r\n", body, sum);
+}
+
+/* EPOCHS seconds of RMC + GGA + GPGSV, with a short sentence every 20 epochs */
+static void make_log(void) {
+    char body[128];
+    int i, hh, mm, ss;
+
+    LogLength = 0;
+    for (i = 0; i < EPOCHS; i++) {
+        hh = 12 + i / 3600;
+        mm = i / 60 % 60;
+        ss = i % 60;
+        sprintf(body, "$GNRMC,%02d%02d%02d.00,A,5200.%04d,N,00400.%04d,E,10.0,45.0,150326,,,A", hh, mm, ss, i, i);
+        add_sentence(body);
+        sprintf(body, "$GNGGA,%02d%02d%02d.00,5200.%04d,N,00400.%04d,E,1,08,0.9,10.0,M,47.0,M,,", hh, mm, ss, i, i);
+        add_sentence(body);
+        add_sentence("$GPGSV,1,1,02,05,40,120,38,12,60,240,41");
+        if (i % 20 == 10 && i / 20 < NUM_SHORT) {
+            add_sentence(ShortSentences[i / 20]);
+        }
+    }
+}
+
+static void count_fix(const gps_fix_t *fix, void *arg) {
+    (void) arg;
+    if (fix->valid) {
+        Fixes++;
+    }
+}
+
+static int write_file(const char *path, const char *data, size_t length) {
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL) {
+        return -1;
+    }
+    fwrite(data, 1, length, file);
+    fclose(file);
+    return 0;
+}
+
+/*
+ * Parses a log file; every good epoch must come out as a fix and every short
+ * sentence as a too-few-fields error, without reading past its fields
+ * */
+static void check_parse(const char *path, const char *what) {
+    static archive_t archive;
+    archive_stats_t stats;
+    gps_error_cursor_t cursor;
+    gps_error_t error;
+    int result, no_fields = 0;
+
+    gps_error_cursor_init(&cursor);
+    Fixes = 0;
+
+    CHECK(archive_open(&archive, path) == 0, "%s: open: %s", what, strerror(errno));
+    result = archive_parse(&archive, NULL);
+    gps_flush_fix();
+    archive_stats(&archive, &stats);
+    archive_close(&archive);
+
+    while (gps_error_next(&cursor, &error)) {
+        no_fields += error.code == GPS_ERR_NO_FIELDS;
+    }
+    CHECK(result == 0, "%s: parse returned %d", what, result);
+    CHECK(Fixes == EPOCHS, "%s: %d fixes, expected %d", what, Fixes, EPOCHS);
+    CHECK(stats.sentences == (unsigned long) (3 * EPOCHS + NUM_SHORT), "%s: %lu sentences", what, stats.sentences);
+    CHECK(stats.errors == NUM_SHORT, "%s: %lu errors, expected %d", what, stats.errors, NUM_SHORT);
+    CHECK(no_fields == NUM_SHORT, "%s: %d too-few-fields errors, expected %d", what, no_fields, NUM_SHORT);
+}
+
+/* batch mode gives a row per fix */
+static void check_batch(const char *path) {
+    static archive_t archive;
+    gps_batch_t batch;
+    int result;
+
+    /* a batch that cannot take a line is refused rather than looping the caller forever */
+    CHECK(gps_batch_alloc(&batch, 1) == -1, "batch of 1 row allocated");
+    CHECK(gps_batch_alloc(&batch, 2 * EPOCHS) == 0, "batch alloc");
+    CHECK(archive_open(&archive, path) == 0, "batch: open: %s", strerror(errno));
+    result = archive_parse(&archive, &batch);
+    gps_batch_finish(&batch);
+    archive_close(&archive);
+
+    CHECK(result == 0, "batch: parse returned %d", result);
+    CHECK(batch.count == EPOCHS, "batch: %d rows", batch.count);
+    CHECK(batch.count > 0 && fabs(batch.latitude[0] - 52.0) < 1e-9, "batch: latitude %.9f", batch.latitude[0]);
+    CHECK(batch.count > 0 && batch.number_svs[0] == 8, "batch: %d satellites", batch.number_svs[0]);
+    gps_batch_free(&batch);
+}
+
+#ifdef SATGPS_ZLIB
+/* gzip of the log, and the same cut in half */
+static void check_gzip(const char *dir) {
+    static archive_t archive;
+    char path[256], cut[256];
+    unsigned char *packed;
+    uLongf packed_length;
+    z_stream z;
+    FILE *file;
+    long size;
+
+    snprintf(path, sizeof(path), "%s/log.gz", dir);
+    memset(&z, 0, sizeof(z));
+    packed_length = compressBound(LogLength) + 32;
+    packed = malloc(packed_length);
+    deflateInit2(&z, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    z.next_in = (Bytef *) Log;
+    z.avail_in = LogLength;
+    z.next_out = packed;
+    z.avail_out = packed_length;
+    deflate(&z, Z_FINISH);
+    size = (long) z.total_out;
+    deflateEnd(&z);
+
+    file = fopen(path, "wb");
+    fwrite(packed, 1, size, file);
+    fclose(file);
+    check_parse(path, "gzip");
+
+    snprintf(cut, sizeof(cut), "%s/cut.gz", dir);
+    write_file(cut, (const char *) packed, size / 2);
+    CHECK(archive_open(&archive, cut) == 0, "cut: open: %s", strerror(errno));
+    CHECK(archive_parse(&archive, NULL) == -1, "cut: parse didn't fail");
+    CHECK(archive.error == ENODATA, "cut: error %d, expected ENODATA", archive.error);
+    archive_close(&archive);
+
+    unlink(path);
+    unlink(cut);
+    free(packed);
+}
+#endif
+
+int main(void) {
+    char dir[] = "/tmp/satgps_archive_testXXXXXX";
+    char path[256];
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    gps_set_filters(GLGSV_MESSAGE | GPGSV_MESSAGE | GNGLL_MESSAGE | GNRMC_MESSAGE | GNVTG_MESSAGE |
+                    GNGGA_MESSAGE | GNGSA_MESSAGE | GNTXT_MESSAGE);
+    gps_add_fix_handler(count_fix, NULL);
+
+    make_log();
+    snprintf(path, sizeof(path), "%s/log.nmea", dir);
+    write_file(path, Log, LogLength);
+    check_parse(path, "plain");
+    check_batch(path);
+    unlink(path);
+
+#ifdef SATGPS_ZLIB
+    check_gzip(dir);
+#endif
+    rmdir(dir);
+
+    if (Failures) {
+        printf("%d checks failed\n", Failures);
+        return 1;
+    }
+    printf("archive: all checks passed\n");
+    return 0;
+}
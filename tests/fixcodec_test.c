@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "fixcodec.h"
+
+#define TRACK_FIXES     600
+
+static int Failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        Failures++; \
+    } \
+} while (0)
+
+/* a 1 Hz drive: ~15 m/s north-east with some wander, altitude drifting */
+static void make_track(gps_fix_t *fix, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        memset(&fix[i], 0, sizeof(gps_fix_t));
+        fix[i].utc_epoch_ns = 1773576000LL * NSEC_PER_SEC + (int64_t) i * NSEC_PER_SEC;
+        fix[i].valid = 1;
+        fix[i].latitude = 52.0 + i * 1.0e-4 + 2.0e-6 * sin(i * 0.1);
+        fix[i].longitude = 4.0 + i * 1.6e-4 + 2.0e-6 * cos(i * 0.07);
+        fix[i].altitude = 10.0 + 3.0 * sin(i * 0.01);
+    }
+}
+
+static int same_value(double a, double b, double tolerance) {
+    if (isnan(a) || isnan(b)) {
+        return isnan(a) && isnan(b);
+    }
+    /* the last term covers the rounding of huge values in the worst case test */
+    return fabs(a - b) <= tolerance + fabs(b) * 1e-15;
+}
+
+/*
+ * Encodes fixes, decodes every frame and compares; returns the total frame
+ * bytes. The frame being built must never outgrow the buffer.
+ * */
+static size_t round_trip(const fixcodec_config_t *config, const gps_fix_t *fix, int n) {
+    static fixcodec_t codec;
+    gps_fix_t decoded[256];
+    size_t total = 0;
+    int i, j, len, got, at = 0;
+
+    fixcodec_init(&codec, config);
+    for (i = 0; i <= n; i++) {
+        len = i < n ? fixcodec_encode(&codec, &fix[i]) : fixcodec_flush(&codec);
+        CHECK(codec.bytes <= FIXCODEC_MAX_FRAME, "chunk_bits %d: frame at %zu bytes", config->chunk_bits, codec.bytes);
+        if (len <= 0) {
+            continue;
+        }
+        CHECK(len <= FIXCODEC_MAX_FRAME, "chunk_bits %d: frame of %d bytes", config->chunk_bits, len);
+        total += len;
+
+        got = fixcodec_decode(config, codec.frame, codec.frame_bytes, decoded, 256);
+        CHECK(got == codec.frame[0], "chunk_bits %d: decoded %d of %d fixes", config->chunk_bits, got, codec.frame[0]);
+        for (j = 0; j < got && at < n; j++, at++) {
+            CHECK(decoded[j].valid == (fix[at].valid != 0), "fix %d: valid", at);
+            CHECK(decoded[j].utc_epoch_ns == fix[at].utc_epoch_ns / config->time_unit_ns * config->time_unit_ns,
+                  "fix %d: time %lld", at, (long long) decoded[j].utc_epoch_ns);
+            CHECK(same_value(decoded[j].latitude, fix[at].latitude, 0.5 / config->position_scale),
+                  "fix %d: latitude %.9f, was %.9f", at, decoded[j].latitude, fix[at].latitude);
+            CHECK(same_value(decoded[j].longitude, fix[at].longitude, 0.5 / config->position_scale),
+                  "fix %d: longitude %.9f, was %.9f", at, decoded[j].longitude, fix[at].longitude);
+            CHECK(same_value(decoded[j].altitude, fix[at].altitude, 0.5 / config->altitude_scale),
+                  "fix %d: altitude %.3f, was %.3f", at, decoded[j].altitude, fix[at].altitude);
+        }
+    }
+    CHECK(at == n, "chunk_bits %d: %d of %d fixes came back", config->chunk_bits, at, n);
+    return total;
+}
+
+/* a steady track at the default precision round-trips and packs small */
+static void test_track(void) {
+    static gps_fix_t fix[TRACK_FIXES];
+    fixcodec_config_t config;
+    size_t bytes;
+    double per_fix;
+
+    make_track(fix, TRACK_FIXES);
+    fixcodec_default_config(&config);
+    bytes = round_trip(&config, fix, TRACK_FIXES);
+    per_fix = (double) bytes / TRACK_FIXES;
+
+    printf("track: %d fixes in %zu bytes, %.2f bytes per fix, %.1fx smaller than gps_fix_t, %.1fx smaller than rmc_data_t\n",
+           TRACK_FIXES, bytes, per_fix, sizeof(gps_fix_t) / per_fix, sizeof(rmc_data_t) / per_fix);
+    CHECK(per_fix < 8.0, "%.2f bytes per fix", per_fix);
+}
+
+/* every chunk size round-trips */
+static void test_chunk_sizes(void) {
+    static gps_fix_t fix[TRACK_FIXES];
+    fixcodec_config_t config;
+    int chunk_bits;
+
+    make_track(fix, TRACK_FIXES);
+    fixcodec_default_config(&config);
+    for (chunk_bits = 1; chunk_bits <= 16; chunk_bits++) {
+        config.chunk_bits = chunk_bits;
+        round_trip(&config, fix, TRACK_FIXES);
+    }
+}
+
+/*
+ * Worst case records: void fixes with NaN positions alternating with extreme
+ * ones, so every delta is a full-width varint, at every chunk size.
+ * */
+static void test_worst_case(void) {
+    static gps_fix_t fix[TRACK_FIXES];
+    fixcodec_config_t config;
+    int i, chunk_bits;
+
+    for (i = 0; i < TRACK_FIXES; i++) {
+        memset(&fix[i], 0, sizeof(gps_fix_t));
+        /* time deltas swing by about 2^62, so the delta of delta does too */
+        fix[i].utc_epoch_ns = (i % 3 == 2 ? INT64_MAX / 2 : 0) + i;
+        fix[i].valid = i & 1;
+        if (i % 8 == 0) {
+            fix[i].latitude = NAN;
+            fix[i].longitude = NAN;
+            fix[i].altitude = NAN;
+        } else {
+            /* about +-2^62.4 in fixed point, so the deltas need all 64 bits */
+            fix[i].latitude = i & 1 ? 6.0e11 : -6.0e11;
+            fix[i].longitude = i & 1 ? -6.0e11 : 6.0e11;
+            fix[i].altitude = i & 1 ? 6.0e16 : -6.0e16;
+        }
+    }
+
+    fixcodec_default_config(&config);
+    config.time_unit_ns = 1;
+    for (chunk_bits = 1; chunk_bits <= 16; chunk_bits++) {
+        config.chunk_bits = chunk_bits;
+        round_trip(&config, fix, TRACK_FIXES);
+    }
+}
+
+/* a truncated frame is reported as corrupt rather than read past */
+static void test_truncated(void) {
+    static gps_fix_t fix[16];
+    static fixcodec_t codec;
+    gps_fix_t decoded[16];
+    fixcodec_config_t config;
+    int i, len;
+
+    make_track(fix, 16);
+    fixcodec_default_config(&config);
+    fixcodec_init(&codec, &config);
+    for (i = 0; i < 16; i++) {
+        fixcodec_encode(&codec, &fix[i]);
+    }
+    len = fixcodec_flush(&codec);
+    CHECK(fixcodec_decode(&config, codec.frame, len / 2, decoded, 16) == -1, "half a frame decoded");
+    CHECK(fixcodec_decode(&config, codec.frame, 0, decoded, 16) == -1, "empty frame decoded");
+}
+
+int main(void) {
+    test_track();
+    test_chunk_sizes();
+    test_worst_case();
+    test_truncated();
+
+    if (Failures) {
+        printf("%d checks failed\n", Failures);
+        return 1;
+    }
+    printf("fixcodec: all checks passed\n");
+    return 0;
+}
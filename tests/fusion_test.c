@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "fusion.h"
+
+#define T0              (1773576000LL * NSEC_PER_SEC)
+#define METERS_PER_DEG  111195.0    /* along a meridian */
+#define MAX_RESULTS     64
+
+static int Failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        Failures++; \
+    } \
+} while (0)
+
+static fusion_result_t Results[MAX_RESULTS];
+static gps_fix_t Fused[MAX_RESULTS];
+static int NumResults;
+
+static void record_result(const gps_fix_t *fix, const fusion_result_t *result, void *arg) {
+    (void) arg;
+    if (NumResults < MAX_RESULTS) {
+        Fused[NumResults] = *fix;
+        Results[NumResults] = *result;
+    }
+    NumResults++;
+}
+
+/* an RMC+GGA fix north and east of a point by some meters, HDOP 1 with 10 satellites */
+static gps_fix_t make_fix(int64_t utc_epoch_ns, double latitude, double longitude, double north, double east) {
+    gps_fix_t fix;
+
+    memset(&fix, 0, sizeof(gps_fix_t));
+    fix.utc_epoch_ns = utc_epoch_ns;
+    fix.valid = 1;
+    fix.latitude = latitude + north / METERS_PER_DEG;
+    fix.longitude = longitude + east / (METERS_PER_DEG * cos(latitude * M_PI / 180.0));
+    fix.altitude = 10.0;
+    fix.speed = 10.0;
+    fix.track_angle = 90.0;
+    fix.HDOP = 1.0;
+    fix.gps_quality = 1;
+    fix.number_svs = 10;
+    fix.sources = GNRMC_MESSAGE | GNGGA_MESSAGE;
+    return fix;
+}
+
+/* meters between a fused fix and a point, on the local plane */
+static double offset(const gps_fix_t *fix, double latitude, double longitude) {
+    double north = (fix->latitude - latitude) * METERS_PER_DEG;
+    double east = remainder(fix->longitude - longitude, 360.0) * METERS_PER_DEG * cos(latitude * M_PI / 180.0);
+
+    return hypot(north, east);
+}
+
+/* three receivers within a meter and one 100 m off: the outlier is voted out */
+static void test_outlier(void) {
+    fusion_t fusion;
+    fusion_epoch_t epoch;
+    fusion_result_t result;
+    gps_fix_t out;
+
+    fusion_init(&fusion, 4);
+    memset(&epoch, 0, sizeof(epoch));
+    epoch.utc_epoch_ns = T0;
+    epoch.mask = 0xf;
+    epoch.fixes[0] = make_fix(T0, 52.0, 4.0, 0.5, 0.0);
+    epoch.fixes[1] = make_fix(T0, 52.0, 4.0, -0.5, 0.5);
+    epoch.fixes[2] = make_fix(T0, 52.0, 4.0, 0.0, -0.5);
+    epoch.fixes[3] = make_fix(T0, 52.0, 4.0, 100.0, 0.0);
+
+    CHECK(fusion_fuse(&fusion, &epoch, &out, &result) == 0, "outlier: no fix");
+    CHECK(result.used == 3 && result.rejected == 1, "outlier: %d used, %d rejected", result.used, result.rejected);
+    CHECK(result.used_mask == 0x7 && result.rejected_mask == 0x8, "outlier: used %x, rejected %x",
+          result.used_mask, result.rejected_mask);
+    CHECK(offset(&out, 52.0, 4.0) < 0.5, "outlier: fused %.2f m from the others", offset(&out, 52.0, 4.0));
+    CHECK(result.spread < 1.0, "outlier: spread %.2f m", result.spread);
+    CHECK(result.sigma > 2.8 && result.sigma < 2.9, "outlier: sigma %.2f m, expected 5 / sqrt(3)", result.sigma);
+
+    /* two receivers that disagree: no majority to vote with, chi2 shows it */
+    epoch.mask = 0x9;
+    CHECK(fusion_fuse(&fusion, &epoch, &out, &result) == 0, "pair: no fix");
+    CHECK(result.used == 2 && result.rejected == 0, "pair: %d used, %d rejected", result.used, result.rejected);
+    CHECK(result.chi2 > 10.0, "pair: chi2 %.1f", result.chi2);
+
+    /* an invalid fix is not voted on, it isn't used at all */
+    epoch.mask = 0xf;
+    epoch.fixes[3].valid = 0;
+    CHECK(fusion_fuse(&fusion, &epoch, &out, &result) == 0, "invalid: no fix");
+    CHECK(result.used == 3 && result.rejected == 0 && result.used_mask == 0x7, "invalid: %d used, %d rejected",
+          result.used, result.rejected);
+}
+
+/* receivers either side of 180 degrees fuse onto the dateline, not onto Greenwich */
+static void test_dateline(void) {
+    fusion_t fusion;
+    fusion_epoch_t epoch;
+    fusion_result_t result;
+    gps_fix_t out;
+
+    fusion_init(&fusion, 2);
+    memset(&epoch, 0, sizeof(epoch));
+    epoch.utc_epoch_ns = T0;
+    epoch.mask = 0x3;
+    epoch.fixes[0] = make_fix(T0, -17.0, 180.0, 0.0, -3.0);
+    epoch.fixes[1] = make_fix(T0, -17.0, -180.0, 0.0, 3.0);
+
+    CHECK(fusion_fuse(&fusion, &epoch, &out, &result) == 0, "dateline: no fix");
+    CHECK(offset(&out, -17.0, 180.0) < 0.01, "dateline: fused at %.7f, %.7f", out.latitude, out.longitude);
+    CHECK(out.longitude >= -180.0 && out.longitude <= 180.0, "dateline: longitude %.7f", out.longitude);
+    CHECK(result.spread < 3.01, "dateline: spread %.2f m", result.spread);
+}
+
+/*
+ * A stream from three receivers: one misses an epoch, which is fused a
+ * second later without it, then reports late and finally goes silent
+ * */
+static void test_missing(void) {
+    fusion_t fusion;
+    gps_fix_t fix;
+    int64_t t;
+    int e, r, before;
+
+    fusion_init(&fusion, 3);
+    fusion_set_handler(&fusion, record_result, NULL);
+    NumResults = 0;
+
+    for (e = 0; e < 20; e++) {
+        t = T0 + (int64_t) e * NSEC_PER_SEC;
+        before = NumResults;
+        for (r = 0; r < 3; r++) {
+            /* receiver 2 misses epoch 3 and is gone from epoch 10 */
+            if (r == 2 && (e == 3 || e >= 10)) {
+                continue;
+            }
+            /* receivers don't report at exactly the same instant */
+            fix = make_fix(t + r * 10000000LL, 52.0, 4.0, r * 0.3, 0.0);
+            fusion_add(&fusion, r, &fix);
+        }
+        if (e == 4) {
+            /* epoch 3 is over a second behind by now, so it went without receiver 2 */
+            fix = make_fix(t - NSEC_PER_SEC, 52.0, 4.0, 0.0, 0.0);
+            fusion_add(&fusion, 2, &fix);
+        }
+        if (e < 3 || (e > 4 && e < 10) || e >= 16) {
+            /* everyone live reported, or receiver 2 is stale: fused without waiting */
+            CHECK(NumResults == before + 1, "epoch %d: %d fused on its last fix", e, NumResults - before);
+        }
+    }
+    fusion_flush(&fusion);
+
+    CHECK(NumResults == 20, "%d epochs fused", NumResults);
+    CHECK(fusion.epochs_fused == 20 && fusion.empty == 0, "%lu fused, %lu empty", fusion.epochs_fused, fusion.empty);
+    CHECK(fusion.late == 1, "%lu late", fusion.late);
+    if (NumResults < 20) {
+        return;
+    }
+    CHECK(Results[3].missing_mask == 0x4 && Results[3].used == 2, "epoch 3: missing %x, %d used",
+          Results[3].missing_mask, Results[3].used);
+    CHECK(Results[2].missing_mask == 0 && Results[2].used == 3, "epoch 2: missing %x", Results[2].missing_mask);
+    CHECK(Results[19].missing_mask == 0x4, "epoch 19: missing %x", Results[19].missing_mask);
+    CHECK(Fused[5].utc_epoch_ns == T0 + 5 * NSEC_PER_SEC, "epoch 5 at %lld", (long long) Fused[5].utc_epoch_ns);
+    /*
+     * epoch 3, then 10-13: each is fused a second after it, and receiver 2
+     * (last heard at 9 s) only goes stale after 14 s
+     * */
+    CHECK(fusion.incomplete == 5, "%lu incomplete", fusion.incomplete);
+}
+
+int main(void) {
+    test_outlier();
+    test_dateline();
+    test_missing();
+
+    if (Failures) {
+        printf("%d checks failed\n", Failures);
+        return 1;
+    }
+    printf("fusion: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "batch.h"
+#include "tiles.h"
+
+#define ROWS            100000      /* enough for tiles_add_batch() to start several threads */
+
+static int Failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        Failures++; \
+    } \
+} while (0)
+
+/* quadkey digits of the tile holding a position */
+static void quadkey_of(int zoom, double latitude, double longitude, char *buffer) {
+    tiles_t tiles;
+
+    tiles_init_quadkey(&tiles, zoom);
+    tiles_quadkey(tiles_key(&tiles, latitude, longitude), zoom, buffer);
+    tiles_free(&tiles);
+}
+
+/* quadkeys from the Bing Maps tile system description, and the tile bounds around them */
+static void test_quadkey(void) {
+    tiles_t tiles;
+    double south, west, north, east;
+    char quadkey[TILES_MAX_ZOOM + 1];
+
+    /* tile x 3, y 5 at level 3 is "213" */
+    quadkey_of(3, -50.0, -20.0, quadkey);
+    CHECK(strcmp(quadkey, "213") == 0, "quadkey %s, expected 213", quadkey);
+
+    quadkey_of(1, 10.0, 10.0, quadkey);
+    CHECK(strcmp(quadkey, "1") == 0, "quadkey %s, expected 1", quadkey);
+    quadkey_of(1, -10.0, -10.0, quadkey);
+    CHECK(strcmp(quadkey, "2") == 0, "quadkey %s, expected 2", quadkey);
+
+    /* beyond the Web Mercator cut-off the edge tile is used */
+    quadkey_of(2, 89.9, 179.9, quadkey);
+    CHECK(strcmp(quadkey, "11") == 0, "quadkey %s, expected 11", quadkey);
+
+    tiles_init_quadkey(&tiles, 3);
+    tiles_bounds(&tiles, tiles_key(&tiles, -50.0, -20.0), &south, &west, &north, &east);
+    CHECK(fabs(west + 45.0) < 1e-9 && fabs(east) < 1e-9, "west %.9f east %.9f", west, east);
+    CHECK(fabs(north + 40.979898) < 1e-6 && fabs(south + 66.513260) < 1e-6, "south %.6f north %.6f", south, north);
+    tiles_free(&tiles);
+}
+
+/* a grid cell's key and bounds, and the per-cell aggregates */
+static void test_grid(void) {
+    tiles_t tiles;
+    const tiles_cell_t *cell;
+    double south, west, north, east;
+    uint64_t key;
+
+    tiles_init_grid(&tiles, 0.5);
+    key = tiles_key(&tiles, 52.1, 4.3);
+    CHECK(key == ((uint64_t) 284 << 32 | 368), "key %016llx", (unsigned long long) key);
+    tiles_bounds(&tiles, key, &south, &west, &north, &east);
+    CHECK(south == 52.0 && north == 52.5 && west == 4.0 && east == 4.5, "bounds %g %g %g %g", south, west, north, east);
+
+    tiles_add(&tiles, 52.1, 4.3, 10.0, 1.0, 40);
+    tiles_add(&tiles, 52.2, 4.4, NAN, 3.0, 35);
+    tiles_add(&tiles, 52.3, 4.1, 20.0, NAN, -1);
+    tiles_add(&tiles, NAN, 4.1, 20.0, 1.0, 30);
+    cell = tiles_find(&tiles, key);
+    CHECK(cell != NULL && cell->count == 3, "cell count %u", cell ? cell->count : 0);
+    CHECK(cell != NULL && cell->speed_count == 2 && cell->speed_sum == 30.0, "speed %u %g",
+          cell ? cell->speed_count : 0, cell ? cell->speed_sum : 0.0);
+    CHECK(cell != NULL && cell->hdop_count == 2 && cell->hdop_sum == 4.0, "hdop %u %g",
+          cell ? cell->hdop_count : 0, cell ? cell->hdop_sum : 0.0);
+    CHECK(cell != NULL && cell->min_snr == 35, "min_snr %d", cell ? cell->min_snr : 0);
+    CHECK(tiles.count == 1 && tiles.fixes == 3 && tiles.skipped == 1, "%zu cells, %lu fixes, %lu skipped",
+          tiles.count, tiles.fixes, tiles.skipped);
+    tiles_free(&tiles);
+}
+
+/* a fleet over western Europe from a fixed LCG, some rows invalid or without speed, HDOP or SNR */
+static void make_batch(gps_batch_t *batch) {
+    uint64_t state = 12345;
+    int i;
+
+    gps_batch_alloc(batch, ROWS);
+    for (i = 0; i < ROWS; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        batch->utc_epoch_ns[i] = (int64_t) i * NSEC_PER_SEC;
+        batch->latitude[i] = 45.0 + (double) (state >> 40) / (double) (1 << 24) * 10.0;
+        batch->longitude[i] = -5.0 + (double) ((state >> 16) & 0xffffff) / (double) (1 << 24) * 15.0;
+        batch->speed[i] = (state & 7) == 0 ? NAN : (double) (state & 0xff) / 8.0;
+        batch->HDOP[i] = (state & 0x30) == 0 ? NAN : 0.5 + (double) ((state >> 8) & 0xf) / 4.0;
+        batch->min_snr[i] = (state & 0x300) == 0 ? -1 : 20 + (int) ((state >> 12) & 0x1f);
+        batch->valid[i] = (state & 0xc00) != 0;
+    }
+    batch->count = ROWS;
+}
+
+static int same_sum(double a, double b) {
+    return fabs(a - b) <= 1e-9 * fmax(1.0, fabs(b));
+}
+
+/* the threaded tables must merge into what one thread makes, and both into what tiles_add() makes */
+static void compare(const tiles_t *a, const tiles_t *b, const char *what) {
+    tiles_cell_t *ca, *cb;
+    size_t i, na, nb;
+    int mismatches = 0;
+
+    CHECK(a->fixes == b->fixes && a->skipped == b->skipped, "%s: %lu/%lu fixes, %lu/%lu skipped",
+          what, a->fixes, b->fixes, a->skipped, b->skipped);
+    CHECK(a->count == b->count, "%s: %zu cells, expected %zu", what, a->count, b->count);
+    if (a->count != b->count) {
+        return;
+    }
+
+    ca = malloc(sizeof(tiles_cell_t) * a->count);
+    cb = malloc(sizeof(tiles_cell_t) * b->count);
+    na = tiles_collect(a, ca);
+    nb = tiles_collect(b, cb);
+    for (i = 0; i < na && i < nb; i++) {
+        if (ca[i].key != cb[i].key || ca[i].count != cb[i].count || ca[i].speed_count != cb[i].speed_count ||
+            ca[i].hdop_count != cb[i].hdop_count || ca[i].min_snr != cb[i].min_snr ||
+            !same_sum(ca[i].speed_sum, cb[i].speed_sum) || !same_sum(ca[i].hdop_sum, cb[i].hdop_sum)) {
+            mismatches++;
+        }
+        if (i > 0 && ca[i - 1].key >= ca[i].key) {
+            mismatches++;
+        }
+    }
+    CHECK(mismatches == 0, "%s: %d cells differ", what, mismatches);
+    free(ca);
+    free(cb);
+}
+
+static void test_batch(int tiling) {
+    static gps_batch_t batch;
+    tiles_t serial, single, threaded;
+    const char *name = tiling == TILES_GRID ? "grid" : "quadkey";
+    char what[64];
+    int i;
+
+    make_batch(&batch);
+    if (tiling == TILES_GRID) {
+        tiles_init_grid(&serial, 0.1);
+        tiles_init_grid(&single, 0.1);
+        tiles_init_grid(&threaded, 0.1);
+    } else {
+        tiles_init_quadkey(&serial, 12);
+        tiles_init_quadkey(&single, 12);
+        tiles_init_quadkey(&threaded, 12);
+    }
+
+    for (i = 0; i < batch.count; i++) {
+        if (!batch.valid[i]) {
+            serial.skipped++;
+            continue;
+        }
+        tiles_add(&serial, batch.latitude[i], batch.longitude[i], batch.speed[i], batch.HDOP[i], batch.min_snr[i]);
+    }
+    CHECK(tiles_add_batch(&single, &batch, 1) == 0, "%s: one thread failed", name);
+    CHECK(tiles_add_batch(&threaded, &batch, 7) == 0, "%s: seven threads failed", name);
+
+    snprintf(what, sizeof(what), "%s, one thread", name);
+    compare(&single, &serial, what);
+    snprintf(what, sizeof(what), "%s, seven threads", name);
+    compare(&threaded, &single, what);
+
+    /* a second batch into a non-empty table merges rather than replacing it */
+    CHECK(tiles_add_batch(&threaded, &batch, 7) == 0, "%s: second batch failed", name);
+    CHECK(threaded.fixes == 2 * single.fixes, "%s: %lu fixes after two batches", name, threaded.fixes);
+
+    tiles_free(&serial);
+    tiles_free(&single);
+    tiles_free(&threaded);
+    gps_batch_free(&batch);
+}
+
+int main(void) {
+    test_quadkey();
+    test_grid();
+    test_batch(TILES_GRID);
+    test_batch(TILES_QUADKEY);
+
+    if (Failures) {
+        printf("%d checks failed\n", Failures);
+        return 1;
+    }
+    printf("tiles: all checks passed\n");
+    return 0;
+}
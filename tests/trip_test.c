@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "satgps.h"
+#include "batch.h"
+#include "trip.h"
+
+#define T0              (1773576000LL * NSEC_PER_SEC)
+#define METERS_PER_DEG  111195.0    /* along a meridian */
+#define MAX_EVENTS      32
+
+static int Failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        Failures++; \
+    } \
+} while (0)
+
+static const char *EventNames[] = {"START", "STOP", "DWELL", "GAP"};
+
+static trip_event_t Events[MAX_EVENTS];
+static int NumEvents;
+
+static void record_event(const trip_event_t *event, void *arg) {
+    (void) arg;
+    if (NumEvents < MAX_EVENTS) {
+        Events[NumEvents] = *event;
+    }
+    NumEvents++;
+}
+
+/* seconds [from, to) at one speed heading north; speed NAN for GGA-only fixes moving at 10 m/s */
+typedef struct {
+    int                 from, to;
+    double              speed;
+    int                 valid;
+} segment_t;
+
+/*
+ * A day at 1 Hz: parked, a drive with a 30 s traffic light, parked long
+ * enough to dwell, a 60 s outage while parked, a drive cut by a 100 s
+ * outage, and a GGA-only drive still under way when the log ends
+ * */
+static const segment_t Day[] = {
+    {0, 60, 0.0, 1},
+    {60, 200, 10.0, 1},
+    {200, 230, 0.0, 1},
+    {230, 360, 10.0, 1},
+    {360, 700, 0.0, 1},
+    {700, 720, 0.0, 0},         /* invalid fixes, must not count */
+    {720, 1080, 0.0, 1},
+    {1140, 1300, 10.0, 1},
+    {1400, 1420, NAN, 1},
+};
+#define NUM_SEGMENTS    ((int) (sizeof(Day) / sizeof(Day[0])))
+
+/* what Day must produce: type, at second, duration in seconds, distance in meters */
+static const struct {
+    int                 type;
+    int                 at;
+    int                 duration;
+    double              distance;
+} Expected[] = {
+    {TRIP_START, 60, 0, 0.0},
+    {TRIP_STOP, 360, 300, 2690.0},      /* 269 moving seconds, the light doesn't split it */
+    {TRIP_DWELL, 360, 600, 0.0},
+    {TRIP_GAP, 1079, 61, 0.0},          /* parked, so no stop */
+    {TRIP_START, 1140, 0, 0.0},
+    {TRIP_GAP, 1299, 101, 0.0},
+    {TRIP_STOP, 1299, 159, 1590.0},     /* ends at the last fix before the outage */
+    {TRIP_START, 1401, 0, 0.0},         /* the first fix after a gap has no speed to derive */
+    {TRIP_STOP, 1419, 18, 180.0},       /* closed by trip_finish() */
+};
+#define NUM_EXPECTED    ((int) (sizeof(Expected) / sizeof(Expected[0])))
+
+/* Day as fixes into trip_add() (then trip_finish()), or as batch columns if batch isn't NULL */
+static void run_day(trip_t *trip, gps_batch_t *batch) {
+    double north = 0.0, speed;
+    int i, s;
+
+    for (i = 0; i < NUM_SEGMENTS; i++) {
+        for (s = Day[i].from; s < Day[i].to; s++) {
+            speed = Day[i].speed;
+            if (Day[i].valid && (isnan(speed) || speed > 0.0)) {
+                north += isnan(speed) ? 10.0 : speed;
+            }
+            if (batch != NULL) {
+                batch->utc_epoch_ns[batch->count] = T0 + (int64_t) s * NSEC_PER_SEC;
+                batch->latitude[batch->count] = Day[i].valid ? 52.0 + north / METERS_PER_DEG : 10.0;
+                batch->longitude[batch->count] = 4.0;
+                batch->speed[batch->count] = speed;
+                batch->gps_quality[batch->count] = Day[i].valid ? 1 : 0;
+                batch->valid[batch->count] = Day[i].valid;
+                batch->count++;
+            } else {
+                trip_add(trip, T0 + (int64_t) s * NSEC_PER_SEC, Day[i].valid ? 52.0 + north / METERS_PER_DEG : 10.0,
+                         4.0, speed, Day[i].valid);
+            }
+        }
+    }
+    if (trip != NULL) {
+        trip_finish(trip);
+    }
+}
+
+static void check_events(const trip_t *trip, const char *what) {
+    int i;
+
+    CHECK(NumEvents == NUM_EXPECTED, "%s: %d events, expected %d", what, NumEvents, NUM_EXPECTED);
+    for (i = 0; i < NUM_EXPECTED && i < NumEvents; i++) {
+        CHECK(Events[i].type == Expected[i].type, "%s: event %d is %s, expected %s", what, i,
+              EventNames[Events[i].type], EventNames[Expected[i].type]);
+        CHECK(Events[i].utc_epoch_ns == T0 + (int64_t) Expected[i].at * NSEC_PER_SEC, "%s: event %d at %.0f s, expected %d",
+              what, i, (double) (Events[i].utc_epoch_ns - T0) / NSEC_PER_SEC, Expected[i].at);
+        CHECK(Events[i].duration_ns == (int64_t) Expected[i].duration * NSEC_PER_SEC, "%s: event %d lasted %.0f s, expected %d",
+              what, i, (double) Events[i].duration_ns / NSEC_PER_SEC, Expected[i].duration);
+        CHECK(fabs(Events[i].distance - Expected[i].distance) < 1.0, "%s: event %d distance %.1f m, expected %.0f",
+              what, i, Events[i].distance, Expected[i].distance);
+        CHECK(fabs(Events[i].longitude - 4.0) < 1e-12, "%s: event %d at a fix outside the day", what, i);
+    }
+    CHECK(trip->trips == 3, "%s: %lu trips", what, trip->trips);
+}
+
+/* the day fed fix by fix */
+static void test_fixes(void) {
+    trip_t trip;
+
+    trip_init(&trip, NULL);
+    trip_set_handler(&trip, record_event, NULL);
+    NumEvents = 0;
+    run_day(&trip, NULL);
+    check_events(&trip, "fixes");
+}
+
+/* the same day as batch columns */
+static void test_batch(void) {
+    static gps_batch_t batch;
+    trip_t trip;
+
+    gps_batch_alloc(&batch, 2000);
+    trip_init(&trip, NULL);
+    trip_set_handler(&trip, record_event, NULL);
+    NumEvents = 0;
+    run_day(NULL, &batch);
+    trip_add_batch(&trip, &batch);
+    trip_finish(&trip);
+    check_events(&trip, "batch");
+    gps_batch_free(&batch);
+}
+
+/* speed between the thresholds keeps whatever state it finds */
+static void test_hysteresis(void) {
+    trip_t trip;
+    int s;
+
+    trip_init(&trip, NULL);
+    trip_set_handler(&trip, record_event, NULL);
+    NumEvents = 0;
+    for (s = 0; s < 300; s++) {
+        trip_add(&trip, T0 + (int64_t) s * NSEC_PER_SEC, 52.0, 4.0, 1.0, 1);
+    }
+    CHECK(NumEvents == 0 && trip.state == TRIP_STOPPED, "creeping from rest: %d events", NumEvents);
+    for (s = 300; s < 320; s++) {
+        trip_add(&trip, T0 + (int64_t) s * NSEC_PER_SEC, 52.0, 4.0, 5.0, 1);
+    }
+    for (s = 320; s < 800; s++) {
+        trip_add(&trip, T0 + (int64_t) s * NSEC_PER_SEC, 52.0, 4.0, 1.0, 1);
+    }
+    CHECK(NumEvents == 1 && trip.state == TRIP_MOVING, "creeping in a trip: %d events", NumEvents);
+}
+
+int main(void) {
+    test_fixes();
+    test_batch();
+    test_hysteresis();
+
+    if (Failures) {
+        printf("%d checks failed\n", Failures);
+        return 1;
+    }
+    printf("trip: all checks passed\n");
+    return 0;
+}